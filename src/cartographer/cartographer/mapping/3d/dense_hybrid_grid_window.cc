@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
+
+#include <algorithm>
+
+namespace cartographer {
+namespace mapping {
+
+DenseHybridGridWindow::DenseHybridGridWindow(const HybridGrid* hybrid_grid,
+                                             const int half_size)
+    : hybrid_grid_(hybrid_grid),
+      half_size_(half_size),
+      size_(2 * half_size),
+      center_(Eigen::Array3i::Zero()),
+      origin_(Eigen::Array3i::Constant(-half_size)),
+      values_(static_cast<size_t>(size_) * size_ * size_, 0) {
+  CHECK_NOTNULL(hybrid_grid_);
+  CHECK_GT(half_size_, 0);
+  Recenter(center_);
+}
+
+void DenseHybridGridWindow::Recenter(const Eigen::Array3i& center) {
+  center_ = center;
+  origin_ = center - half_size_;
+  std::fill(values_.begin(), values_.end(), 0);
+  // Iterating the HybridGrid only visits allocated cells, which is much
+  // cheaper than looking up every cell of the window.
+  for (auto it = HybridGrid::Iterator(*hybrid_grid_); !it.Done(); it.Next()) {
+    const Eigen::Array3i index = it.GetCellIndex();
+    if (Contains(index)) {
+      values_[ToFlatIndex(index - origin_)] = it.GetValue();
+    }
+  }
+}
+
+bool DenseHybridGridWindow::RecenterIfNeeded(const Eigen::Array3i& index) {
+  if (((index - center_).abs() <= half_size_ / 2).all()) {
+    return false;
+  }
+  Recenter(index);
+  return true;
+}
+
+void DenseHybridGridWindow::Update(
+    const std::vector<Eigen::Array3i>& updated_cells) {
+  for (const Eigen::Array3i& index : updated_cells) {
+    if (Contains(index)) {
+      values_[ToFlatIndex(index - origin_)] = hybrid_grid_->value(index);
+    }
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
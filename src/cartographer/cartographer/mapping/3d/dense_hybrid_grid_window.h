@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_DENSE_HYBRID_GRID_WINDOW_H_
+#define CARTOGRAPHER_MAPPING_3D_DENSE_HYBRID_GRID_WINDOW_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/3d/hybrid_grid.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+// A dense copy of the cells of a HybridGrid inside a cube around a center
+// cell. Lookups inside the cube read from a single contiguous array instead of
+// walking the tree of the HybridGrid; lookups outside of it fall back to the
+// HybridGrid. The copy is not updated automatically: after the HybridGrid
+// changed, Update() or Recenter() has to be called.
+class DenseHybridGridWindow {
+ public:
+  // Creates a window of (2 * 'half_size')^3 cells of 'hybrid_grid' which must
+  // outlive this object. The window is centered at cell (0, 0, 0).
+  DenseHybridGridWindow(const HybridGrid* hybrid_grid, int half_size);
+
+  DenseHybridGridWindow(const DenseHybridGridWindow&) = delete;
+  DenseHybridGridWindow& operator=(const DenseHybridGridWindow&) = delete;
+
+  // Moves the window to be centered at 'center' and copies all its cells from
+  // the HybridGrid.
+  void Recenter(const Eigen::Array3i& center);
+
+  // Recenters the window at 'index' if 'index' is more than half of the half
+  // size away from the current center along any axis. Returns true if the
+  // window was recentered.
+  bool RecenterIfNeeded(const Eigen::Array3i& index);
+
+  // Copies the current values of 'updated_cells' from the HybridGrid. Cells
+  // outside of the window are ignored.
+  void Update(const std::vector<Eigen::Array3i>& updated_cells);
+
+  const HybridGrid& hybrid_grid() const { return *hybrid_grid_; }
+  float resolution() const { return hybrid_grid_->resolution(); }
+  const Eigen::Array3i& center() const { return center_; }
+
+  Eigen::Array3i GetCellIndex(const Eigen::Vector3f& point) const {
+    return hybrid_grid_->GetCellIndex(point);
+  }
+
+  void GetCellIndices(const transform::Rigid3f& transform,
+                      const std::vector<Eigen::Vector3f>& points,
+                      std::vector<Eigen::Array3i>* const cell_indices) const {
+    hybrid_grid_->GetCellIndices(transform, points, cell_indices);
+  }
+
+  Eigen::Vector3f GetCenterOfCell(const Eigen::Array3i& index) const {
+    return hybrid_grid_->GetCenterOfCell(index);
+  }
+
+  // Returns true if the cell at 'index' is inside the window.
+  bool Contains(const Eigen::Array3i& index) const {
+    const Eigen::Array3i offset = index - origin_;
+    return static_cast<unsigned int>(offset.x()) < unsigned_size() &&
+           static_cast<unsigned int>(offset.y()) < unsigned_size() &&
+           static_cast<unsigned int>(offset.z()) < unsigned_size();
+  }
+
+  uint16 value(const Eigen::Array3i& index) const {
+    if (!Contains(index)) {
+      return hybrid_grid_->value(index);
+    }
+    return values_[ToFlatIndex(index - origin_)];
+  }
+
+  // Returns the probability of the cell with 'index'.
+  float GetProbability(const Eigen::Array3i& index) const {
+    return ValueToProbability(value(index));
+  }
+
+  // Fills 'probabilities' with the probabilities of the 2x2x2 cube of cells
+  // with lowest cell 'index' in the order of CubeOffset().
+  void GetCubeProbabilities(const Eigen::Array3i& index,
+                            float* const probabilities) const {
+    const Eigen::Array3i offset = index - origin_;
+    if (static_cast<unsigned int>(offset.x()) >= unsigned_size() - 1 ||
+        static_cast<unsigned int>(offset.y()) >= unsigned_size() - 1 ||
+        static_cast<unsigned int>(offset.z()) >= unsigned_size() - 1) {
+      hybrid_grid_->GetCubeProbabilities(index, probabilities);
+      return;
+    }
+    const int y_stride = size_;
+    const int z_stride = size_ * size_;
+    const uint16* const cell = &values_[ToFlatIndex(offset)];
+    probabilities[0] = ValueToProbability(cell[0]);
+    probabilities[1] = ValueToProbability(cell[1]);
+    probabilities[2] = ValueToProbability(cell[y_stride]);
+    probabilities[3] = ValueToProbability(cell[y_stride + 1]);
+    probabilities[4] = ValueToProbability(cell[z_stride]);
+    probabilities[5] = ValueToProbability(cell[z_stride + 1]);
+    probabilities[6] = ValueToProbability(cell[z_stride + y_stride]);
+    probabilities[7] = ValueToProbability(cell[z_stride + y_stride + 1]);
+  }
+
+ private:
+  unsigned int unsigned_size() const { return static_cast<unsigned int>(size_); }
+
+  // 'offset' is relative to 'origin_', x changes fastest.
+  int ToFlatIndex(const Eigen::Array3i& offset) const {
+    return offset.x() + size_ * (offset.y() + size_ * offset.z());
+  }
+
+  const HybridGrid* const hybrid_grid_;
+  const int half_size_;
+  const int size_;
+  Eigen::Array3i center_;
+  // Lowest cell index inside the window.
+  Eigen::Array3i origin_;
+  std::vector<uint16> values_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_DENSE_HYBRID_GRID_WINDOW_H_
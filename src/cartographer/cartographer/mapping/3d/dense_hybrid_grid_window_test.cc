@@ -0,0 +1,111 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+class DenseHybridGridWindowTest : public ::testing::Test {
+ protected:
+  DenseHybridGridWindowTest() : hybrid_grid_(0.5f) {
+    std::mt19937 prng(42);
+    std::uniform_int_distribution<int> index_distribution(-20, 20);
+    std::uniform_real_distribution<float> probability_distribution(
+        kMinProbability, kMaxProbability);
+    for (int i = 0; i < 5000; ++i) {
+      hybrid_grid_.SetProbability(
+          Eigen::Array3i(index_distribution(prng), index_distribution(prng),
+                         index_distribution(prng)),
+          probability_distribution(prng));
+    }
+  }
+
+  // Expects all lookups in 'dense_window' to match the HybridGrid, both for
+  // cells inside and outside of the window.
+  void ExpectConsistentWithHybridGrid(
+      const DenseHybridGridWindow& dense_window) const {
+    for (int z = -22; z <= 22; ++z) {
+      for (int y = -22; y <= 22; ++y) {
+        for (int x = -22; x <= 22; ++x) {
+          const Eigen::Array3i index(x, y, z);
+          EXPECT_EQ(hybrid_grid_.value(index), dense_window.value(index));
+          std::array<float, 8> expected;
+          std::array<float, 8> actual;
+          hybrid_grid_.GetCubeProbabilities(index, expected.data());
+          dense_window.GetCubeProbabilities(index, actual.data());
+          EXPECT_EQ(expected, actual) << index;
+        }
+      }
+    }
+  }
+
+  HybridGrid hybrid_grid_;
+};
+
+TEST_F(DenseHybridGridWindowTest, Contains) {
+  DenseHybridGridWindow dense_window(&hybrid_grid_, 4);
+  EXPECT_TRUE(dense_window.Contains(Eigen::Array3i(-4, -4, -4)));
+  EXPECT_TRUE(dense_window.Contains(Eigen::Array3i(3, 3, 3)));
+  EXPECT_FALSE(dense_window.Contains(Eigen::Array3i(4, 0, 0)));
+  EXPECT_FALSE(dense_window.Contains(Eigen::Array3i(0, -5, 0)));
+  dense_window.Recenter(Eigen::Array3i(10, 0, 0));
+  EXPECT_TRUE(dense_window.Contains(Eigen::Array3i(13, 0, 0)));
+  EXPECT_FALSE(dense_window.Contains(Eigen::Array3i(3, 0, 0)));
+}
+
+TEST_F(DenseHybridGridWindowTest, LookupsMatchHybridGrid) {
+  DenseHybridGridWindow dense_window(&hybrid_grid_, 8);
+  ExpectConsistentWithHybridGrid(dense_window);
+  dense_window.Recenter(Eigen::Array3i(15, -5, 3));
+  ExpectConsistentWithHybridGrid(dense_window);
+}
+
+TEST_F(DenseHybridGridWindowTest, RecenterIfNeeded) {
+  DenseHybridGridWindow dense_window(&hybrid_grid_, 8);
+  EXPECT_FALSE(dense_window.RecenterIfNeeded(Eigen::Array3i(4, -4, 0)));
+  EXPECT_TRUE((dense_window.center() == Eigen::Array3i::Zero()).all());
+  EXPECT_TRUE(dense_window.RecenterIfNeeded(Eigen::Array3i(0, 0, 5)));
+  EXPECT_TRUE((dense_window.center() == Eigen::Array3i(0, 0, 5)).all());
+  ExpectConsistentWithHybridGrid(dense_window);
+}
+
+TEST_F(DenseHybridGridWindowTest, Update) {
+  DenseHybridGridWindow dense_window(&hybrid_grid_, 8);
+  std::vector<Eigen::Array3i> updated_cells;
+  for (const Eigen::Array3i& index :
+       {Eigen::Array3i(1, 2, 3), Eigen::Array3i(-8, 7, 0),
+        Eigen::Array3i(30, 0, 0)}) {
+    hybrid_grid_.SetProbability(index, 0.77f);
+    updated_cells.push_back(index);
+  }
+  // The window still holds the old values until it is updated.
+  EXPECT_NE(hybrid_grid_.value(Eigen::Array3i(1, 2, 3)),
+            dense_window.value(Eigen::Array3i(1, 2, 3)));
+  dense_window.Update(updated_cells);
+  ExpectConsistentWithHybridGrid(dense_window);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
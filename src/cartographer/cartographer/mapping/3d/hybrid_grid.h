@@ -17,9 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -51,6 +53,14 @@ inline Eigen::Array3i To3DIndex(const int index, const int bits) {
                         (index >> bits) >> bits);
 }
 
+// Returns the offset of the 'i'-th cell of a 2x2x2 cube from its lowest cell,
+// x changing fastest, then y, then z.
+inline Eigen::Array3i CubeOffset(const int i) {
+  DCHECK_GE(i, 0);
+  DCHECK_LT(i, 8);
+  return Eigen::Array3i(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+}
+
 // A function to compare value to the default value. (Allows specializations).
 template <typename TValueType>
 bool IsDefaultValue(const TValueType& v) {
@@ -83,6 +93,9 @@ class FlatGrid {
   // Returns the number of voxels per dimension.
   static int grid_size() { return 1 << kBits; }
 
+  // Returns the approximate number of bytes used by this grid.
+  size_t MemoryUsage() const { return sizeof(*this); }
+
   // Returns the value stored at 'index', each dimension of 'index' being
   // between 0 and grid_size() - 1.
   ValueType value(const Eigen::Array3i& index) const {
@@ -94,6 +107,25 @@ class FlatGrid {
     return &cells_[ToFlatIndex(index, kBits)];
   }
 
+  // Fills 'values' with the 8 values of the 2x2x2 cube with lowest cell
+  // 'index' in the order of CubeOffset(). Each dimension of 'index' must be
+  // between 0 and grid_size() - 2.
+  void GetCubeValues(const Eigen::Array3i& index,
+                     ValueType* const values) const {
+    DCHECK((index < grid_size() - 1).all()) << index;
+    constexpr int kYStride = 1 << kBits;
+    constexpr int kZStride = 1 << (2 * kBits);
+    const ValueType* const cell = &cells_[ToFlatIndex(index, kBits)];
+    values[0] = cell[0];
+    values[1] = cell[1];
+    values[2] = cell[kYStride];
+    values[3] = cell[kYStride + 1];
+    values[4] = cell[kZStride];
+    values[5] = cell[kZStride + 1];
+    values[6] = cell[kZStride + kYStride];
+    values[7] = cell[kZStride + kYStride + 1];
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -140,14 +172,27 @@ class FlatGrid {
 // A grid consisting of '2^kBits' x '2^kBits' x '2^kBits' grids of type
 // 'WrappedGrid'. Wrapped grids are constructed on first access via
 // 'mutable_value()'.
-template <typename WrappedGrid, int kBits>
+template <typename TWrappedGrid, int kBits>
 class NestedGrid {
  public:
+  using WrappedGrid = TWrappedGrid;
   using ValueType = typename WrappedGrid::ValueType;
 
   // Returns the number of voxels per dimension.
   static int grid_size() { return WrappedGrid::grid_size() << kBits; }
 
+  // Returns the approximate number of bytes used by this grid and the wrapped
+  // grids constructed so far.
+  size_t MemoryUsage() const {
+    size_t memory_usage = sizeof(*this);
+    for (const std::unique_ptr<WrappedGrid>& meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        memory_usage += meta_cell->MemoryUsage();
+      }
+    }
+    return memory_usage;
+  }
+
   // Returns the value stored at 'index', each dimension of 'index' being
   // between 0 and grid_size() - 1.
   ValueType value(const Eigen::Array3i& index) const {
@@ -176,6 +221,36 @@ class NestedGrid {
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Returns the wrapped grid containing 'index', each dimension of 'index'
+  // being between 0 and grid_size() - 1, or nullptr if it was not constructed.
+  const WrappedGrid* GetWrappedGrid(const Eigen::Array3i& index) const {
+    return meta_cells_[ToFlatIndex(GetMetaIndex(index), kBits)].get();
+  }
+
+  // Fills 'values' with the 8 values of the 2x2x2 cube with lowest cell
+  // 'index' in the order of CubeOffset(). Each dimension of 'index' must be
+  // between 0 and grid_size() - 2. A single wrapped grid is looked up if it
+  // contains the whole cube.
+  void GetCubeValues(const Eigen::Array3i& index,
+                     ValueType* const values) const {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    const Eigen::Array3i inner_index =
+        index - meta_index * WrappedGrid::grid_size();
+    if ((inner_index < WrappedGrid::grid_size() - 1).all()) {
+      const WrappedGrid* const meta_cell =
+          meta_cells_[ToFlatIndex(meta_index, kBits)].get();
+      if (meta_cell == nullptr) {
+        std::fill(values, values + 8, ValueType());
+        return;
+      }
+      meta_cell->GetCubeValues(inner_index, values);
+      return;
+    }
+    for (int i = 0; i != 8; ++i) {
+      values[i] = value(index + CubeOffset(i));
+    }
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -259,6 +334,20 @@ class DynamicGrid {
   // Returns the current number of voxels per dimension.
   int grid_size() const { return WrappedGrid::grid_size() << bits_; }
 
+  // Returns the approximate number of bytes used by this grid and the wrapped
+  // grids constructed so far.
+  size_t MemoryUsage() const {
+    size_t memory_usage =
+        sizeof(*this) +
+        meta_cells_.capacity() * sizeof(std::unique_ptr<WrappedGrid>);
+    for (const std::unique_ptr<WrappedGrid>& meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        memory_usage += meta_cell->MemoryUsage();
+      }
+    }
+    return memory_usage;
+  }
+
   // Returns the value stored at 'index'.
   ValueType value(const Eigen::Array3i& index) const {
     //加上边长的一半，将index变为从0开始？hybrid的index是以0为中心，存在负数的；
@@ -301,6 +390,74 @@ class DynamicGrid {
     return meta_cell->mutable_value(inner_index);
   }
 
+  // Fills 'values' with the 8 values of the 2x2x2 cube with lowest cell
+  // 'index' in the order of CubeOffset(). If the cube lies inside a single
+  // wrapped grid, the grid hierarchy is only traversed once instead of once
+  // per cell.
+  void GetCubeValues(const Eigen::Array3i& index,
+                     ValueType* const values) const {
+    const Eigen::Array3i shifted_index = index + (grid_size() >> 1);
+    // The cast to unsigned is for performance to check with 3 comparisons
+    // shifted_index.[xyz] >= 0 and shifted_index.[xyz] < grid_size - 1.
+    if ((shifted_index.cast<unsigned int>() < grid_size() - 1).all()) {
+      const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
+      const Eigen::Array3i inner_index =
+          shifted_index - meta_index * WrappedGrid::grid_size();
+      if ((inner_index < WrappedGrid::grid_size() - 1).all()) {
+        const WrappedGrid* const meta_cell =
+            meta_cells_[ToFlatIndex(meta_index, bits_)].get();
+        if (meta_cell == nullptr) {
+          std::fill(values, values + 8, ValueType());
+          return;
+        }
+        meta_cell->GetCubeValues(inner_index, values);
+        return;
+      }
+    }
+    for (int i = 0; i != 8; ++i) {
+      values[i] = value(index + CubeOffset(i));
+    }
+  }
+
+  // Fills 'values' with the values stored at 'indices'. The innermost grid
+  // found for an index is kept for the following indices, so that the grid
+  // hierarchy is only traversed once for consecutive indices which lie close
+  // together, as is common for the points of a range scan.
+  void GetValues(const std::vector<Eigen::Array3i>& indices,
+                 ValueType* const values) const {
+    using InnermostGrid = typename WrappedGrid::WrappedGrid;
+    const InnermostGrid* innermost_grid = nullptr;
+    // Shifted indices inside of the grid are non-negative, so this does not
+    // match any of them.
+    Eigen::Array3i innermost_grid_index(-1, -1, -1);
+    for (size_t i = 0; i != indices.size(); ++i) {
+      const Eigen::Array3i shifted_index = indices[i] + (grid_size() >> 1);
+      if ((shifted_index.cast<unsigned int>() >= grid_size()).any()) {
+        values[i] = ValueType();
+        continue;
+      }
+      const Eigen::Array3i current_innermost_grid_index =
+          shifted_index / InnermostGrid::grid_size();
+      if ((current_innermost_grid_index != innermost_grid_index).any()) {
+        innermost_grid_index = current_innermost_grid_index;
+        const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
+        const WrappedGrid* const meta_cell =
+            meta_cells_[ToFlatIndex(meta_index, bits_)].get();
+        innermost_grid =
+            meta_cell == nullptr
+                ? nullptr
+                : meta_cell->GetWrappedGrid(shifted_index -
+                                            meta_index *
+                                                WrappedGrid::grid_size());
+      }
+      values[i] = innermost_grid == nullptr
+                      ? ValueType()
+                      : innermost_grid->value(
+                            shifted_index - innermost_grid_index *
+                                                InnermostGrid::grid_size());
+    }
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -434,6 +591,31 @@ class HybridGridBase : public GridBase<ValueType> {
                           common::RoundToInt(index.z()));
   }
 
+  // Fills 'cell_indices' with the indices of the cells containing 'points',
+  // like GetCellIndex(). All points are converted at once as a 3xN matrix,
+  // which Eigen vectorizes.
+  void GetCellIndices(const std::vector<Eigen::Vector3f>& points,
+                      std::vector<Eigen::Array3i>* const cell_indices) const {
+    cell_indices->resize(points.size());
+    if (points.empty()) return;
+    CellIndicesMatrix(cell_indices) =
+        (PointsMatrix(points).array() / resolution_).round().cast<int>();
+  }
+
+  // Same as above, but for 'points' transformed by 'transform'.
+  void GetCellIndices(const transform::Rigid3f& transform,
+                      const std::vector<Eigen::Vector3f>& points,
+                      std::vector<Eigen::Array3i>* const cell_indices) const {
+    cell_indices->resize(points.size());
+    if (points.empty()) return;
+    const Eigen::Matrix3Xf transformed_points =
+        (transform.rotation().toRotationMatrix() * PointsMatrix(points))
+            .colwise() +
+        transform.translation();
+    CellIndicesMatrix(cell_indices) =
+        (transformed_points.array() / resolution_).round().cast<int>();
+  }
+
   // Returns one of the octants, (0, 0, 0), (1, 0, 0), ..., (1, 1, 1).
   static Eigen::Array3i GetOctant(const int i) {
     DCHECK_GE(i, 0);
@@ -457,10 +639,209 @@ class HybridGridBase : public GridBase<ValueType> {
   }
 
  private:
+  // Views a vector of 3D points or indices, which are stored contiguously, as
+  // a 3xN matrix.
+  static Eigen::Map<const Eigen::Matrix3Xf> PointsMatrix(
+      const std::vector<Eigen::Vector3f>& points) {
+    return Eigen::Map<const Eigen::Matrix3Xf>(points.front().data(), 3,
+                                              points.size());
+  }
+  static Eigen::Map<Eigen::Matrix3Xi> CellIndicesMatrix(
+      std::vector<Eigen::Array3i>* const cell_indices) {
+    return Eigen::Map<Eigen::Matrix3Xi>(cell_indices->front().data(), 3,
+                                        cell_indices->size());
+  }
+
   // Edge length of each voxel.
   const float resolution_;
 };
 
+// A read-only copy of the known cells of a 'GridBase<uint16>' holding
+// probability values without update markers. Values are quantized to 8 bits.
+// Only blocks of 8x8x8 cells with known cells are stored, each as a bitmap of
+// its known cells and their values, instead of 512 16-bit values.
+class CompactGrid {
+ public:
+  explicit CompactGrid(const GridBase<uint16>& grid)
+      : grid_size_(grid.grid_size()) {
+    // The grid iterator visits all cells of a block of 8x8x8 cells in z-major
+    // order before moving on to the next block.
+    for (typename GridBase<uint16>::Iterator it(grid); !it.Done(); it.Next()) {
+      const Eigen::Array3i cell_index = it.GetCellIndex();
+      DCHECK_LT(it.GetValue(), kUpdateMarker);
+      const Eigen::Array3i block_index = GetBlockIndex(cell_index);
+      int32* const block_position = block_table_.mutable_value(block_index);
+      if (*block_position == 0) {
+        blocks_.emplace_back();
+        blocks_.back().block_index = block_index;
+        blocks_.back().first_value = values_.size();
+        *block_position = blocks_.size();
+      }
+      Block& block = blocks_[*block_position - 1];
+      const int flat_index = ToFlatIndex(GetIndexInBlock(cell_index), kBits);
+      DCHECK_EQ(values_.size(), block.first_value + Rank(block, flat_index));
+      block.occupancy[flat_index >> 6] |= uint64{1} << (flat_index & 63);
+      values_.push_back(QuantizeValue(it.GetValue()));
+    }
+    for (Block& block : blocks_) {
+      int rank = 0;
+      for (int word = 0; word != kNumWords; ++word) {
+        block.rank[word] = rank;
+        rank += __builtin_popcountll(block.occupancy[word]);
+      }
+    }
+    values_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+  }
+
+  CompactGrid(const CompactGrid&) = delete;
+  CompactGrid& operator=(const CompactGrid&) = delete;
+
+  // Returns the size of the grid this was copied from.
+  int grid_size() const { return grid_size_; }
+
+  // Returns the value stored at 'index', 0 if the cell is unknown.
+  uint16 value(const Eigen::Array3i& index) const {
+    const int32 block_position = block_table_.value(GetBlockIndex(index));
+    if (block_position == 0) {
+      return 0;
+    }
+    const Block& block = blocks_[block_position - 1];
+    const int flat_index = ToFlatIndex(GetIndexInBlock(index), kBits);
+    const uint64 word = block.occupancy[flat_index >> 6];
+    const uint64 bit = uint64{1} << (flat_index & 63);
+    if ((word & bit) == 0) {
+      return 0;
+    }
+    return DequantizeValue(
+        values_[block.first_value + block.rank[flat_index >> 6] +
+                __builtin_popcountll(word & (bit - 1))]);
+  }
+
+  // An iterator for iterating over all known cells.
+  class Iterator {
+   public:
+    Iterator() : compact_grid_(nullptr), value_index_(0) {}
+
+    explicit Iterator(const CompactGrid& compact_grid)
+        : compact_grid_(&compact_grid), value_index_(0) {
+      if (!Done()) {
+        flat_index_ = -1;
+        AdvanceToKnownCell();
+      }
+    }
+
+    void Next() {
+      DCHECK(!Done());
+      ++value_index_;
+      if (!Done()) {
+        AdvanceToKnownCell();
+      }
+    }
+
+    bool Done() const {
+      return compact_grid_ == nullptr ||
+             value_index_ == compact_grid_->values_.size();
+    }
+
+    void AdvanceToEnd() {
+      if (compact_grid_ != nullptr) {
+        value_index_ = compact_grid_->values_.size();
+      }
+    }
+
+    Eigen::Array3i GetCellIndex() const {
+      DCHECK(!Done());
+      return compact_grid_->blocks_[block_position_].block_index * kBlockSize +
+             To3DIndex(flat_index_, kBits);
+    }
+
+    uint16 GetValue() const {
+      DCHECK(!Done());
+      return DequantizeValue(compact_grid_->values_[value_index_]);
+    }
+
+    bool operator!=(const Iterator& it) const {
+      return it.value_index_ != value_index_;
+    }
+
+   private:
+    // Moves 'block_position_' and 'flat_index_' to the cell of the value at
+    // 'value_index_', which follows the current cell.
+    void AdvanceToKnownCell() {
+      const auto& blocks = compact_grid_->blocks_;
+      if (block_position_ + 1 < blocks.size() &&
+          blocks[block_position_ + 1].first_value == value_index_) {
+        ++block_position_;
+        flat_index_ = -1;
+      }
+      const Block& block = blocks[block_position_];
+      do {
+        ++flat_index_;
+      } while (!(block.occupancy[flat_index_ >> 6] &
+                 (uint64{1} << (flat_index_ & 63))));
+    }
+
+    const CompactGrid* compact_grid_;
+    size_t value_index_;
+    size_t block_position_ = 0;
+    int flat_index_ = 0;
+  };
+
+ private:
+  static constexpr int kBits = 3;
+  static constexpr int kBlockSize = 1 << kBits;
+  static constexpr int kNumWords = (1 << (3 * kBits)) / 64;
+
+  struct Block {
+    Eigen::Array3i block_index;
+    // Bit 'i' is set if the cell with flat index 'i' is known.
+    std::array<uint64, kNumWords> occupancy{};
+    // Number of known cells in the words before each word of 'occupancy'.
+    std::array<uint16, kNumWords> rank{};
+    // Index into 'values_' of the value of the first known cell.
+    uint32 first_value = 0;
+  };
+
+  // Maps the 15-bit values 1 to 32767 onto 1 to 255, 0 stays unknown.
+  static uint8 QuantizeValue(const uint16 value) {
+    if (value == 0) return 0;
+    return 1 + ((value - 1) * 254 + 16383) / 32766;
+  }
+  static uint16 DequantizeValue(const uint8 value) {
+    if (value == 0) return 0;
+    return 1 + ((value - 1) * 32766 + 127) / 254;
+  }
+
+  static Eigen::Array3i GetBlockIndex(const Eigen::Array3i& index) {
+    // Arithmetic shifts round towards negative infinity.
+    return Eigen::Array3i(index.x() >> kBits, index.y() >> kBits,
+                          index.z() >> kBits);
+  }
+  static Eigen::Array3i GetIndexInBlock(const Eigen::Array3i& index) {
+    return Eigen::Array3i(index.x() & (kBlockSize - 1),
+                          index.y() & (kBlockSize - 1),
+                          index.z() & (kBlockSize - 1));
+  }
+
+  // Returns the number of known cells before 'flat_index' in 'block' while
+  // 'rank' is not yet filled in.
+  static int Rank(const Block& block, const int flat_index) {
+    int rank = 0;
+    for (int word = 0; word != (flat_index >> 6); ++word) {
+      rank += __builtin_popcountll(block.occupancy[word]);
+    }
+    return rank + __builtin_popcountll(block.occupancy[flat_index >> 6] &
+                                       ((uint64{1} << (flat_index & 63)) - 1));
+  }
+
+  const int grid_size_;
+  // One plus the position in 'blocks_' of each stored block, by block index.
+  GridBase<int32> block_table_;
+  std::vector<Block> blocks_;
+  std::vector<uint8> values_;
+};
+
 // A grid containing probability values stored using 15 bits, and an update
 // marker per voxel.
 // Points are expected to be close to the origin. Points far from the origin
@@ -469,6 +850,65 @@ class HybridGridBase : public GridBase<ValueType> {
 // The hard limit of cell indexes is +/- 8192 around the origin.
 class HybridGrid : public HybridGridBase<uint16> {
  public:
+  // An iterator for iterating over all known cells, which works for both the
+  // updatable and the compact representation.
+  class Iterator {
+   public:
+    explicit Iterator(const HybridGrid& hybrid_grid)
+        : is_compact_(hybrid_grid.is_compact()),
+          grid_iterator_(hybrid_grid),
+          compact_grid_iterator_(
+              is_compact_ ? CompactGrid::Iterator(*hybrid_grid.compact_grid_)
+                          : CompactGrid::Iterator()) {}
+
+    void Next() {
+      if (is_compact_) {
+        compact_grid_iterator_.Next();
+      } else {
+        grid_iterator_.Next();
+      }
+    }
+
+    bool Done() const {
+      return is_compact_ ? compact_grid_iterator_.Done()
+                         : grid_iterator_.Done();
+    }
+
+    Eigen::Array3i GetCellIndex() const {
+      return is_compact_ ? compact_grid_iterator_.GetCellIndex()
+                         : grid_iterator_.GetCellIndex();
+    }
+
+    ValueType GetValue() const {
+      return is_compact_ ? compact_grid_iterator_.GetValue()
+                         : grid_iterator_.GetValue();
+    }
+
+    void AdvanceToEnd() {
+      grid_iterator_.AdvanceToEnd();
+      compact_grid_iterator_.AdvanceToEnd();
+    }
+
+    const std::pair<Eigen::Array3i, ValueType> operator*() const {
+      return std::pair<Eigen::Array3i, ValueType>(GetCellIndex(), GetValue());
+    }
+
+    Iterator& operator++() {
+      Next();
+      return *this;
+    }
+
+    bool operator!=(const Iterator& it) const {
+      return is_compact_ ? compact_grid_iterator_ != it.compact_grid_iterator_
+                         : grid_iterator_ != it.grid_iterator_;
+    }
+
+   private:
+    bool is_compact_;
+    HybridGridBase<uint16>::Iterator grid_iterator_;
+    CompactGrid::Iterator compact_grid_iterator_;
+  };
+
   explicit HybridGrid(const float resolution)
       : HybridGridBase<uint16>(resolution) {}
 
@@ -487,9 +927,47 @@ class HybridGrid : public HybridGridBase<uint16> {
 
   // Sets the probability of the cell at 'index' to the given 'probability'.
   void SetProbability(const Eigen::Array3i& index, const float probability) {
+    CHECK(!is_compact()) << "A compact grid cannot be changed.";
     *mutable_value(index) = ProbabilityToValue(probability);
   }
 
+  // Replaces the storage by a read-only 'CompactGrid' with 8-bit values to
+  // save memory once no more updates follow, e.g. for finished submaps.
+  void Compact() {
+    CHECK(update_indices_.empty())
+        << "Compacting a grid during an update is not supported.";
+    if (is_compact()) return;
+    compact_grid_ = common::make_unique<CompactGrid>(*this);
+    static_cast<GridBase<uint16>&>(*this) = GridBase<uint16>();
+  }
+
+  bool is_compact() const { return compact_grid_ != nullptr; }
+
+  // Returns the grid size in cells, which is kept when compacting.
+  int grid_size() const {
+    return is_compact() ? compact_grid_->grid_size()
+                        : HybridGridBase<uint16>::grid_size();
+  }
+
+  // Returns the value stored at 'index'.
+  ValueType value(const Eigen::Array3i& index) const {
+    return is_compact() ? compact_grid_->value(index)
+                        : HybridGridBase<uint16>::value(index);
+  }
+
+  // Fills 'values' with the 8 values of the 2x2x2 cube with lowest cell
+  // 'index' in the order of CubeOffset().
+  void GetCubeValues(const Eigen::Array3i& index,
+                     ValueType* const values) const {
+    if (!is_compact()) {
+      HybridGridBase<uint16>::GetCubeValues(index, values);
+      return;
+    }
+    for (int i = 0; i != 8; ++i) {
+      values[i] = compact_grid_->value(index + CubeOffset(i));
+    }
+  }
+
   // Finishes the update sequence.
   void FinishUpdate() {
     while (!update_indices_.empty()) {
@@ -509,6 +987,7 @@ class HybridGrid : public HybridGridBase<uint16> {
   bool ApplyLookupTable(const Eigen::Array3i& index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), kUpdateMarker);
+    DCHECK(!is_compact());
     uint16* const cell = mutable_value(index);
     if (*cell >= kUpdateMarker) {
       return false;
@@ -519,11 +998,44 @@ class HybridGrid : public HybridGridBase<uint16> {
     return true;
   }
 
+  // Fills 'values' with the values stored at 'indices'.
+  void GetValues(const std::vector<Eigen::Array3i>& indices,
+                 ValueType* const values) const {
+    if (!is_compact()) {
+      HybridGridBase<uint16>::GetValues(indices, values);
+      return;
+    }
+    for (size_t i = 0; i != indices.size(); ++i) {
+      values[i] = compact_grid_->value(indices[i]);
+    }
+  }
+
   // Returns the probability of the cell with 'index'.
   float GetProbability(const Eigen::Array3i& index) const {
     return ValueToProbability(value(index));
   }
 
+  // Fills 'probabilities' with the probabilities of the cells at 'indices'.
+  void GetProbabilities(const std::vector<Eigen::Array3i>& indices,
+                        std::vector<float>* const probabilities) const {
+    std::vector<ValueType> values(indices.size());
+    GetValues(indices, values.data());
+    probabilities->resize(indices.size());
+    std::transform(values.begin(), values.end(), probabilities->begin(),
+                   ValueToProbability);
+  }
+
+  // Fills 'probabilities' with the probabilities of the 2x2x2 cube of cells
+  // with lowest cell 'index' in the order of CubeOffset().
+  void GetCubeProbabilities(const Eigen::Array3i& index,
+                            float* const probabilities) const {
+    std::array<ValueType, 8> values;
+    GetCubeValues(index, values.data());
+    for (int i = 0; i != 8; ++i) {
+      probabilities[i] = ValueToProbability(values[i]);
+    }
+  }
+
   // Returns true if the probability at the specified 'index' is known.
   bool IsKnown(const Eigen::Array3i& index) const { return value(index) != 0; }
 
@@ -541,9 +1053,20 @@ class HybridGrid : public HybridGridBase<uint16> {
     return result;
   }
 
+  // Iterator functions for range-based for loops.
+  Iterator begin() const { return Iterator(*this); }
+
+  Iterator end() const {
+    Iterator it(*this);
+    it.AdvanceToEnd();
+    return it;
+  }
+
  private:
   // Markers at changed cells.
   std::vector<ValueType*> update_indices_;
+  // Set once the grid is compacted, the base grid is empty from then on.
+  std::unique_ptr<CompactGrid> compact_grid_;
 };
 
 }  // namespace mapping
@@ -16,9 +16,11 @@
 
 #include "cartographer/mapping/3d/hybrid_grid.h"
 
+#include <array>
 #include <map>
 #include <random>
 #include <tuple>
+#include <vector>
 
 #include "gmock/gmock.h"
 
@@ -120,6 +122,18 @@ TEST(HybridGridTest, GetCenterOfCell) {
   EXPECT_THAT(hybrid_grid.GetCellIndex(center), AllCwiseEqual(index));
 }
 
+TEST(HybridGridTest, MemoryUsage) {
+  HybridGrid hybrid_grid(1.f);
+  const size_t empty_memory_usage = hybrid_grid.MemoryUsage();
+  hybrid_grid.SetProbability(Eigen::Array3i(1, 2, 3), 0.6f);
+  const size_t memory_usage = hybrid_grid.MemoryUsage();
+  // A flat grid of 8 x 8 x 8 values has been constructed.
+  EXPECT_GE(memory_usage, empty_memory_usage + 512 * sizeof(uint16));
+  // It also holds the neighboring cell.
+  hybrid_grid.SetProbability(Eigen::Array3i(2, 2, 3), 0.6f);
+  EXPECT_EQ(memory_usage, hybrid_grid.MemoryUsage());
+}
+
 class RandomHybridGridTest : public ::testing::Test {
  public:
   RandomHybridGridTest() : hybrid_grid_(2.f), values_() {
@@ -201,6 +215,120 @@ TEST_F(RandomHybridGridTest, ToProto) {
   EXPECT_EQ(proto_map, hybrid_grid_map);
 }
 
+TEST_F(RandomHybridGridTest, GetCubeProbabilities) {
+  std::vector<Eigen::Array3i> indices;
+  // Cubes containing a known cell at each of their 8 corners.
+  int i = 0;
+  for (const auto& pair : values_) {
+    indices.push_back(Eigen::Array3i(std::get<0>(pair.first),
+                                     std::get<1>(pair.first),
+                                     std::get<2>(pair.first)) -
+                      CubeOffset(i++ % 8));
+  }
+  // Random cubes, including cubes crossing the boundaries of the nested grids
+  // and cubes partially or fully outside of the grid.
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> xyz_distribution(-4100, 4100);
+  for (int j = 0; j < 10000; ++j) {
+    indices.push_back(Eigen::Array3i(xyz_distribution(rng),
+                                     xyz_distribution(rng),
+                                     xyz_distribution(rng)));
+  }
+  for (const Eigen::Array3i& index : indices) {
+    std::array<float, 8> probabilities;
+    hybrid_grid_.GetCubeProbabilities(index, probabilities.data());
+    for (int j = 0; j != 8; ++j) {
+      EXPECT_EQ(hybrid_grid_.GetProbability(index + CubeOffset(j)),
+                probabilities[j]);
+    }
+  }
+}
+
+TEST_F(RandomHybridGridTest, Compact) {
+  HybridGrid compact_grid(hybrid_grid_.ToProto());
+  compact_grid.Compact();
+  ASSERT_TRUE(compact_grid.is_compact());
+  EXPECT_EQ(hybrid_grid_.grid_size(), compact_grid.grid_size());
+
+  // Values are quantized to 8 bits.
+  constexpr float kMaxError = (kMaxProbability - kMinProbability) / 254.f;
+  auto it = HybridGrid::Iterator(hybrid_grid_);
+  for (const auto& cell : compact_grid) {
+    ASSERT_FALSE(it.Done());
+    EXPECT_THAT(cell.first, AllCwiseEqual(it.GetCellIndex()));
+    EXPECT_NEAR(ValueToProbability(it.GetValue()),
+                ValueToProbability(cell.second), kMaxError);
+    it.Next();
+  }
+  EXPECT_TRUE(it.Done());
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> offset_distribution(-2, 2);
+  for (const auto& pair : values_) {
+    const Eigen::Array3i cell_index(std::get<0>(pair.first),
+                                    std::get<1>(pair.first),
+                                    std::get<2>(pair.first));
+    EXPECT_NEAR(pair.second, compact_grid.GetProbability(cell_index),
+                kMaxError);
+    // Mostly unknown neighbors in the same or adjacent blocks.
+    const Eigen::Array3i index =
+        cell_index + Eigen::Array3i(offset_distribution(rng),
+                                    offset_distribution(rng),
+                                    offset_distribution(rng));
+    EXPECT_EQ(hybrid_grid_.IsKnown(index), compact_grid.IsKnown(index));
+    std::array<float, 8> probabilities;
+    compact_grid.GetCubeProbabilities(index, probabilities.data());
+    for (int j = 0; j != 8; ++j) {
+      EXPECT_NEAR(hybrid_grid_.GetProbability(index + CubeOffset(j)),
+                  probabilities[j], kMaxError);
+    }
+  }
+  EXPECT_EQ(hybrid_grid_.ToProto().x_indices_size(),
+            compact_grid.ToProto().x_indices_size());
+}
+
+TEST_F(RandomHybridGridTest, BatchLookups) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> xyz_distribution(-6100.f, 6100.f);
+  std::vector<Eigen::Vector3f> points;
+  for (const auto& pair : values_) {
+    points.push_back(hybrid_grid_.GetCenterOfCell(Eigen::Array3i(
+        std::get<0>(pair.first), std::get<1>(pair.first),
+        std::get<2>(pair.first))));
+    points.push_back(Eigen::Vector3f(
+        xyz_distribution(rng), xyz_distribution(rng), xyz_distribution(rng)));
+  }
+  const transform::Rigid3f transform(
+      Eigen::Vector3f(0.3f, -1.2f, 0.5f),
+      Eigen::Quaternionf(Eigen::AngleAxisf(0.1f, Eigen::Vector3f::UnitZ())));
+  std::vector<Eigen::Array3i> cell_indices;
+  hybrid_grid_.GetCellIndices(points, &cell_indices);
+  std::vector<Eigen::Array3i> transformed_cell_indices;
+  hybrid_grid_.GetCellIndices(transform, points, &transformed_cell_indices);
+  ASSERT_EQ(points.size(), cell_indices.size());
+  ASSERT_EQ(points.size(), transformed_cell_indices.size());
+  for (size_t i = 0; i != points.size(); ++i) {
+    EXPECT_THAT(cell_indices[i],
+                AllCwiseEqual(hybrid_grid_.GetCellIndex(points[i])));
+    const Eigen::Vector3f transformed_point =
+        transform.rotation().toRotationMatrix() * points[i] +
+        transform.translation();
+    EXPECT_THAT(transformed_cell_indices[i],
+                AllCwiseEqual(hybrid_grid_.GetCellIndex(transformed_point)));
+  }
+
+  HybridGrid compact_grid(hybrid_grid_.ToProto());
+  compact_grid.Compact();
+  for (const HybridGrid* grid : {&hybrid_grid_, &compact_grid}) {
+    std::vector<float> probabilities;
+    grid->GetProbabilities(cell_indices, &probabilities);
+    ASSERT_EQ(cell_indices.size(), probabilities.size());
+    for (size_t i = 0; i != cell_indices.size(); ++i) {
+      EXPECT_EQ(grid->GetProbability(cell_indices[i]), probabilities[i]);
+    }
+  }
+}
+
 struct EigenComparator {
   bool operator()(const Eigen::Vector3i& lhs,
                   const Eigen::Vector3i& rhs) const {
@@ -26,13 +26,12 @@ namespace {
 
 void InsertMissesIntoGrid(const std::vector<uint16>& miss_table,
                           const Eigen::Vector3f& origin,
-                          const sensor::PointCloud& returns,
+                          const std::vector<Eigen::Array3i>& hit_cells,
                           HybridGrid* hybrid_grid,
-                          const int num_free_space_voxels) {
+                          const int num_free_space_voxels,
+                          std::vector<Eigen::Array3i>* updated_cells) {
   const Eigen::Array3i origin_cell = hybrid_grid->GetCellIndex(origin);
-  for (const Eigen::Vector3f& hit : returns) {
-    const Eigen::Array3i hit_cell = hybrid_grid->GetCellIndex(hit);
-
+  for (const Eigen::Array3i& hit_cell : hit_cells) {
     const Eigen::Array3i delta = hit_cell - origin_cell;
     const int num_samples = delta.cwiseAbs().maxCoeff();
     CHECK_LT(num_samples, 1 << 15);
@@ -46,7 +45,10 @@ void InsertMissesIntoGrid(const std::vector<uint16>& miss_table,
          position < num_samples; ++position) {
       const Eigen::Array3i miss_cell =
           origin_cell + delta * position / num_samples;
-      hybrid_grid->ApplyLookupTable(miss_cell, miss_table);
+      if (hybrid_grid->ApplyLookupTable(miss_cell, miss_table) &&
+          updated_cells != nullptr) {
+        updated_cells->push_back(miss_cell);
+      }
     }
   }
 }
@@ -77,17 +79,27 @@ RangeDataInserter3D::RangeDataInserter3D(
 
 void RangeDataInserter3D::Insert(const sensor::RangeData& range_data,
                                  HybridGrid* hybrid_grid) const {
+  Insert(range_data, hybrid_grid, nullptr /* updated_cells */);
+}
+
+void RangeDataInserter3D::Insert(
+    const sensor::RangeData& range_data, HybridGrid* hybrid_grid,
+    std::vector<Eigen::Array3i>* const updated_cells) const {
   CHECK_NOTNULL(hybrid_grid);
 
-  for (const Eigen::Vector3f& hit : range_data.returns) {
-    const Eigen::Array3i hit_cell = hybrid_grid->GetCellIndex(hit);
-    hybrid_grid->ApplyLookupTable(hit_cell, hit_table_);
+  std::vector<Eigen::Array3i> hit_cells;
+  hybrid_grid->GetCellIndices(range_data.returns, &hit_cells);
+  for (const Eigen::Array3i& hit_cell : hit_cells) {
+    if (hybrid_grid->ApplyLookupTable(hit_cell, hit_table_) &&
+        updated_cells != nullptr) {
+      updated_cells->push_back(hit_cell);
+    }
   }
 
   // By not starting a new update after hits are inserted, we give hits priority
   // (i.e. no hits will be ignored because of a miss in the same cell).
-  InsertMissesIntoGrid(miss_table_, range_data.origin, range_data.returns,
-                       hybrid_grid, options_.num_free_space_voxels());
+  InsertMissesIntoGrid(miss_table_, range_data.origin, hit_cells, hybrid_grid,
+                       options_.num_free_space_voxels(), updated_cells);
   hybrid_grid->FinishUpdate();
 }
 
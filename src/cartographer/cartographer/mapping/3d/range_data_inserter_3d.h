@@ -17,6 +17,9 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_RANGE_DATA_INSERTER_3D_H_
 #define CARTOGRAPHER_MAPPING_3D_RANGE_DATA_INSERTER_3D_H_
 
+#include <vector>
+
+#include "Eigen/Core"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/proto/3d/range_data_inserter_options_3d.pb.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -40,6 +43,11 @@ class RangeDataInserter3D {
   void Insert(const sensor::RangeData& range_data,
               HybridGrid* hybrid_grid) const;
 
+  // Same as above, but additionally appends the indices of all cells of
+  // 'hybrid_grid' which were changed to 'updated_cells' if it is not nullptr.
+  void Insert(const sensor::RangeData& range_data, HybridGrid* hybrid_grid,
+              std::vector<Eigen::Array3i>* updated_cells) const;
+
  private:
   const proto::RangeDataInserterOptions3D options_;
   const std::vector<uint16> hit_table_;
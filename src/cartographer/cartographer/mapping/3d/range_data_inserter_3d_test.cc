@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/3d/range_data_inserter_3d.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -39,14 +40,18 @@ class RangeDataInserter3DTest : public ::testing::Test {
     range_data_inserter_.reset(new RangeDataInserter3D(options_));
   }
 
-  void InsertPointCloud() {
+  void InsertPointCloud() { InsertPointCloud(nullptr /* updated_cells */); }
+
+  void InsertPointCloud(std::vector<Eigen::Array3i>* updated_cells) {
     const Eigen::Vector3f origin = Eigen::Vector3f(0.f, 0.f, -4.f);
     sensor::PointCloud returns = {
         {-3.f, -1.f, 4.f}, {-2.f, 0.f, 4.f}, {-1.f, 1.f, 4.f}, {0.f, 2.f, 4.f}};
     range_data_inserter_->Insert(sensor::RangeData{origin, returns, {}},
-                                 &hybrid_grid_);
+                                 &hybrid_grid_, updated_cells);
   }
 
+  const HybridGrid& hybrid_grid() const { return hybrid_grid_; }
+
   float GetProbability(float x, float y, float z) const {
     return hybrid_grid_.GetProbability(
         hybrid_grid_.GetCellIndex(Eigen::Vector3f(x, y, z)));
@@ -102,6 +107,20 @@ TEST_F(RangeDataInserter3DTest, ProbabilityProgression) {
   EXPECT_NEAR(kMinProbability, GetProbability(0.f, 0.f, -3.f), 1e-3);
 }
 
+TEST_F(RangeDataInserter3DTest, ReportsUpdatedCells) {
+  std::vector<Eigen::Array3i> updated_cells;
+  InsertPointCloud(&updated_cells);
+  int num_known_cells = 0;
+  for (const auto it : hybrid_grid()) {
+    ++num_known_cells;
+    EXPECT_EQ(1, std::count_if(updated_cells.begin(), updated_cells.end(),
+                               [&it](const Eigen::Array3i& index) {
+                                 return (index == it.first).all();
+                               }));
+  }
+  EXPECT_EQ(num_known_cells, updated_cells.size());
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
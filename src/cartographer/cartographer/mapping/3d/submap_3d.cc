@@ -50,6 +50,17 @@ sensor::RangeData FilterRangeDataByMaxRange(const sensor::RangeData& range_data,
   return result;
 }
 
+// Brings 'dense_window' up to date after 'updated_cells' were changed by
+// inserting range data with 'origin'. The window follows the origin.
+void UpdateDenseWindow(const Eigen::Vector3f& origin,
+                       const std::vector<Eigen::Array3i>& updated_cells,
+                       DenseHybridGridWindow* const dense_window) {
+  // A recentered window already contains all updated cells.
+  if (!dense_window->RecenterIfNeeded(dense_window->GetCellIndex(origin))) {
+    dense_window->Update(updated_cells);
+  }
+}
+
 std::vector<PixelData> AccumulatePixelData(
     const int width, const int height, const Eigen::Array2i& min_index,
     const Eigen::Array2i& max_index,
@@ -192,7 +203,21 @@ proto::SubmapsOptions3D CreateSubmapsOptions3D(
   *options.mutable_range_data_inserter_options() =
       CreateRangeDataInserterOptions3D(
           parameter_dictionary->GetDictionary("range_data_inserter").get());
+  options.set_use_dense_active_window(
+      parameter_dictionary->GetBool("use_dense_active_window"));
+  options.set_high_resolution_active_window_size(
+      parameter_dictionary->GetDouble("high_resolution_active_window_size"));
+  options.set_low_resolution_active_window_size(
+      parameter_dictionary->GetDouble("low_resolution_active_window_size"));
+  options.set_compact_finished_submaps(
+      parameter_dictionary->GetBool("compact_finished_submaps"));
   CHECK_GT(options.num_range_data(), 0);
+  if (options.use_dense_active_window()) {
+    CHECK_GT(options.high_resolution_active_window_size(),
+             2. * options.high_resolution());
+    CHECK_GT(options.low_resolution_active_window_size(),
+             2. * options.low_resolution());
+  }
   return options;
 }
 
@@ -247,6 +272,15 @@ void Submap3D::UpdateFromProto(const proto::Submap& proto) {
                   submap_3d.low_resolution_hybrid_grid())
             : nullptr;
   }
+  // The dense windows would refer to the replaced grids.
+  high_resolution_dense_window_.reset();
+  low_resolution_dense_window_.reset();
+}
+
+void Submap3D::CompactGrids() {
+  CHECK(finished());
+  high_resolution_hybrid_grid_->Compact();
+  low_resolution_hybrid_grid_->Compact();
 }
 
 
@@ -269,18 +303,48 @@ void Submap3D::InsertRangeData(const sensor::RangeData& range_data,
   // local_pose是第一帧到local frame的转换矩阵
   const sensor::RangeData transformed_range_data = sensor::TransformRangeData(
       range_data, local_pose().inverse().cast<float>());
+  const bool update_dense_windows = high_resolution_dense_window_ != nullptr;
+  std::vector<Eigen::Array3i> high_resolution_updated_cells;
+  std::vector<Eigen::Array3i> low_resolution_updated_cells;
   range_data_inserter.Insert(
       FilterRangeDataByMaxRange(transformed_range_data,
                                 high_resolution_max_range),
-      high_resolution_hybrid_grid_.get());
-  range_data_inserter.Insert(transformed_range_data,
-                             low_resolution_hybrid_grid_.get());
+      high_resolution_hybrid_grid_.get(),
+      update_dense_windows ? &high_resolution_updated_cells : nullptr);
+  range_data_inserter.Insert(
+      transformed_range_data, low_resolution_hybrid_grid_.get(),
+      update_dense_windows ? &low_resolution_updated_cells : nullptr);
+  if (update_dense_windows) {
+    UpdateDenseWindow(transformed_range_data.origin,
+                      high_resolution_updated_cells,
+                      high_resolution_dense_window_.get());
+    UpdateDenseWindow(transformed_range_data.origin,
+                      low_resolution_updated_cells,
+                      low_resolution_dense_window_.get());
+  }
   set_num_range_data(num_range_data() + 1);
 }
 
+void Submap3D::EnableDenseActiveWindows(
+    const double high_resolution_window_size,
+    const double low_resolution_window_size) {
+  CHECK(!finished());
+  high_resolution_dense_window_ = common::make_unique<DenseHybridGridWindow>(
+      high_resolution_hybrid_grid_.get(),
+      common::RoundToInt(0.5 * high_resolution_window_size /
+                         high_resolution_hybrid_grid_->resolution()));
+  low_resolution_dense_window_ = common::make_unique<DenseHybridGridWindow>(
+      low_resolution_hybrid_grid_.get(),
+      common::RoundToInt(0.5 * low_resolution_window_size /
+                         low_resolution_hybrid_grid_->resolution()));
+}
+
 void Submap3D::Finish() {
   CHECK(!finished());
   set_finished(true);
+  // Finished submaps are no longer used for local scan matching.
+  high_resolution_dense_window_.reset();
+  low_resolution_dense_window_.reset();
 }
 
 ActiveSubmaps3D::ActiveSubmaps3D(const proto::SubmapsOptions3D& options)
@@ -316,12 +380,20 @@ void ActiveSubmaps3D::InsertRangeData(
 void ActiveSubmaps3D::AddSubmap(const transform::Rigid3d& local_submap_pose) {
   if (submaps_.size() > 1) {
     submaps_.front()->Finish();
+    if (options_.compact_finished_submaps()) {
+      submaps_.front()->CompactGrids();
+    }
     ++matching_submap_index_;
     submaps_.erase(submaps_.begin());
   }
   submaps_.emplace_back(new Submap3D(options_.high_resolution(),
                                      options_.low_resolution(),
                                      local_submap_pose));
+  if (options_.use_dense_active_window()) {
+    submaps_.back()->EnableDenseActiveWindows(
+        options_.high_resolution_active_window_size(),
+        options_.low_resolution_active_window_size());
+  }
   LOG(INFO) << "Added submap " << matching_submap_index_ + submaps_.size();
 }
 
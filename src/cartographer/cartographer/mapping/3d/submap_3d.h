@@ -23,6 +23,7 @@
 
 #include "Eigen/Geometry"
 #include "cartographer/common/port.h"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/3d/range_data_inserter_3d.h"
 #include "cartographer/mapping/id.h"
@@ -72,15 +73,37 @@ class Submap3D : public Submap {
     return *low_resolution_hybrid_grid_;
   }
 
+  // Dense copies of parts of the grids around the origin of the latest
+  // inserted range data, or nullptr if they are not enabled. They are dropped
+  // once the submap is finished.
+  const DenseHybridGridWindow* high_resolution_dense_window() const {
+    return high_resolution_dense_window_.get();
+  }
+  const DenseHybridGridWindow* low_resolution_dense_window() const {
+    return low_resolution_dense_window_.get();
+  }
+
+  // Starts keeping dense copies of cubes with edge lengths
+  // 'high_resolution_window_size' and 'low_resolution_window_size' in meters
+  // of the grids which are updated by InsertRangeData().
+  void EnableDenseActiveWindows(double high_resolution_window_size,
+                                double low_resolution_window_size);
+
   // Insert 'range_data' into this submap using 'range_data_inserter'. The
   // submap must not be finished yet.
   void InsertRangeData(const sensor::RangeData& range_data,
                        const RangeDataInserter3D& range_data_inserter,
                        int high_resolution_max_range);
   void Finish();
+
+  // Converts both grids of the finished submap into their compact read-only
+  // representation, see HybridGrid::Compact().
+  void CompactGrids();
  private:
   std::unique_ptr<HybridGrid> high_resolution_hybrid_grid_;
   std::unique_ptr<HybridGrid> low_resolution_hybrid_grid_;
+  std::unique_ptr<DenseHybridGridWindow> high_resolution_dense_window_;
+  std::unique_ptr<DenseHybridGridWindow> low_resolution_dense_window_;
 };
 
 // Except during initialization when only a single submap exists, there are
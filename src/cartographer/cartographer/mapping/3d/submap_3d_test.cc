@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/3d/submap_3d.h"
 
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/transform/transform.h"
 #include "gmock/gmock.h"
 
@@ -43,6 +44,45 @@ TEST(SubmapsTest, ToFromProto) {
   EXPECT_NEAR(expected.low_resolution_hybrid_grid().resolution(), 0.25, 1e-6);
 }
 
+TEST(SubmapsTest, DenseWindowsFollowInsertedRangeData) {
+  auto parameter_dictionary = common::MakeDictionary(
+      "return { "
+      "hit_probability = 0.7, "
+      "miss_probability = 0.4, "
+      "num_free_space_voxels = 5, "
+      "}");
+  const RangeDataInserter3D range_data_inserter(
+      CreateRangeDataInserterOptions3D(parameter_dictionary.get()));
+  Submap3D submap(0.5, 1.,
+                  transform::Rigid3d::Translation(Eigen::Vector3d(1., 0., 0.)));
+  submap.EnableDenseActiveWindows(8. /* high_resolution_window_size */,
+                                  16. /* low_resolution_window_size */);
+  for (int i = 0; i != 20; ++i) {
+    const Eigen::Vector3f origin(0.4f * i, 0.f, 0.f);
+    sensor::PointCloud returns;
+    for (int j = -5; j <= 5; ++j) {
+      returns.push_back(origin + Eigen::Vector3f(3.f, 0.3f * j, 1.f));
+      returns.push_back(origin + Eigen::Vector3f(0.2f * j, -2.f, -1.f));
+    }
+    submap.InsertRangeData(sensor::RangeData{origin, returns, {}},
+                           range_data_inserter, 100 /* max_range */);
+    for (const DenseHybridGridWindow* dense_window :
+         {submap.high_resolution_dense_window(),
+          submap.low_resolution_dense_window()}) {
+      ASSERT_NE(nullptr, dense_window);
+      const HybridGrid& hybrid_grid = dense_window->hybrid_grid();
+      for (const auto it : hybrid_grid) {
+        EXPECT_EQ(it.second, dense_window->value(it.first));
+      }
+    }
+  }
+  // The window followed the origin which moved 7.6 meters.
+  EXPECT_GT(submap.high_resolution_dense_window()->center().x(), 0);
+  submap.Finish();
+  EXPECT_EQ(nullptr, submap.high_resolution_dense_window());
+  EXPECT_EQ(nullptr, submap.low_resolution_dense_window());
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
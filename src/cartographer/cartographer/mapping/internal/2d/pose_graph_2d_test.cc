@@ -103,6 +103,7 @@ class PoseGraph2DTest : public ::testing::Test {
                 linear_xy_search_window = 4.,
                 linear_z_search_window = 4.,
                 angular_search_window = 0.1,
+                num_threads = 1,
               },
               ceres_scan_matcher_3d = {
                 occupied_space_weight_0 = 20.,
@@ -134,6 +135,8 @@ class PoseGraph2DTest : public ::testing::Test {
                 max_num_iterations = 200,
                 num_threads = 1,
               },
+              linear_solver_type = "SPARSE_NORMAL_CHOLESKY",
+              preconditioner_type = "JACOBI",
             },
             max_num_final_iterations = 200,
             global_sampling_ratio = 0.01,
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/deskew_pose_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "Eigen/Geometry"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+
+namespace {
+
+// Number of points transformed into a buffer on the stack at once. Since the
+// buffer cannot alias the pose samples, the compiler is free to vectorize the
+// gathers from the samples.
+constexpr size_t kBlockSize = 64;
+
+}  // namespace
+
+DeskewPoseTable::DeskewPoseTable(const std::vector<TimedPose>& timed_poses,
+                                 const double resolution)
+    : timed_poses_(timed_poses) {
+  CHECK(!timed_poses_.empty());
+  CHECK_GT(resolution, 0.);
+  start_time_ = timed_poses_.front().time;
+  const double duration = timed_poses_.back().time - start_time_;
+  CHECK_GE(duration, 0.);
+  const int num_intervals =
+      std::max(1, static_cast<int>(std::ceil(duration / resolution)));
+  num_samples_ = num_intervals + 1;
+  const double sample_interval = duration / num_intervals;
+  inverse_resolution_ =
+      duration > 0. ? static_cast<float>(1. / sample_interval) : 0.f;
+  samples_.resize(kNumComponents * num_samples_);
+  for (int i = 0; i != num_samples_; ++i) {
+    const transform::Rigid3f pose =
+        LookupPose(start_time_ + i * sample_interval).cast<float>();
+    const Eigen::Matrix3f rotation = pose.rotation().toRotationMatrix();
+    for (int row = 0; row != 3; ++row) {
+      for (int col = 0; col != 3; ++col) {
+        samples_[(3 * row + col) * num_samples_ + i] = rotation(row, col);
+      }
+      samples_[(9 + row) * num_samples_ + i] = pose.translation()[row];
+    }
+  }
+}
+
+transform::Rigid3d DeskewPoseTable::LookupPose(const double time) const {
+  if (time <= timed_poses_.front().time) {
+    return timed_poses_.front().pose;
+  }
+  if (time >= timed_poses_.back().time) {
+    return timed_poses_.back().pose;
+  }
+  const auto after = std::upper_bound(
+      timed_poses_.begin(), timed_poses_.end(), time,
+      [](const double t, const TimedPose& timed_pose) {
+        return t < timed_pose.time;
+      });
+  const auto before = std::prev(after);
+  const double factor =
+      (time - before->time) / (after->time - before->time);
+  const Eigen::Vector3d translation =
+      before->pose.translation() +
+      factor * (after->pose.translation() - before->pose.translation());
+  const Eigen::Quaterniond rotation =
+      before->pose.rotation().slerp(factor, after->pose.rotation());
+  return transform::Rigid3d(translation, rotation);
+}
+
+void DeskewPoseTable::TransformPoints(const float* const times,
+                                      const float* const xs,
+                                      const float* const ys,
+                                      const float* const zs,
+                                      const size_t num_points,
+                                      float* const out_xs,
+                                      float* const out_ys,
+                                      float* const out_zs) const {
+  const float start_time = static_cast<float>(start_time_);
+  const float inverse_resolution = inverse_resolution_;
+  const float max_position = static_cast<float>(num_samples_ - 1);
+  const int max_index = num_samples_ - 2;
+  const int num_samples = num_samples_;
+  const float* const samples = samples_.data();
+  float block_xs[kBlockSize];
+  float block_ys[kBlockSize];
+  float block_zs[kBlockSize];
+  for (size_t begin = 0; begin < num_points; begin += kBlockSize) {
+    const size_t block_size = std::min(kBlockSize, num_points - begin);
+    const float* const block_times = times + begin;
+    const float* const in_xs = xs + begin;
+    const float* const in_ys = ys + begin;
+    const float* const in_zs = zs + begin;
+    // Neighbouring samples are close enough that blending their rotation
+    // matrices linearly is accurate. This keeps the loop free of branches and
+    // transcendental functions.
+    for (size_t i = 0; i < block_size; ++i) {
+      float position = (block_times[i] - start_time) * inverse_resolution;
+      position = position < 0.f ? 0.f : position;
+      position = position > max_position ? max_position : position;
+      int index = static_cast<int>(position);
+      index = index > max_index ? max_index : index;
+      const float factor = position - static_cast<float>(index);
+      float m[kNumComponents];
+      for (int j = 0; j != kNumComponents; ++j) {
+        const float* const component = samples + j * num_samples;
+        m[j] = component[index] +
+               factor * (component[index + 1] - component[index]);
+      }
+      const float x = in_xs[i];
+      const float y = in_ys[i];
+      const float z = in_zs[i];
+      block_xs[i] = m[0] * x + m[1] * y + m[2] * z + m[9];
+      block_ys[i] = m[3] * x + m[4] * y + m[5] * z + m[10];
+      block_zs[i] = m[6] * x + m[7] * y + m[8] * z + m[11];
+    }
+    std::copy(block_xs, block_xs + block_size, out_xs + begin);
+    std::copy(block_ys, block_ys + block_size, out_ys + begin);
+    std::copy(block_zs, block_zs + block_size, out_zs + begin);
+  }
+}
+
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_DESKEW_POSE_TABLE_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_3D_DESKEW_POSE_TABLE_H_
+
+#include <vector>
+
+#include "cartographer/transform/rigid_transform.h"
+
+namespace cartographer {
+namespace mapping {
+
+// Poses of the tracking frame over the duration of a scan, sampled at a fixed
+// resolution so that the points of the scan can be deskewed with a cheap
+// linear blend of neighbouring samples instead of a slerp per point.
+class DeskewPoseTable {
+ public:
+  struct TimedPose {
+    // Relative to the time of the scan, i.e. usually not positive.
+    double time;
+    transform::Rigid3d pose;
+  };
+
+  // 'timed_poses' must not be empty and sorted by time, e.g. the states
+  // predicted from the IMU data. They are interpolated with slerp to build
+  // samples every 'resolution' seconds between the first and the last pose.
+  // Outside this interval, the first or last pose is used.
+  DeskewPoseTable(const std::vector<TimedPose>& timed_poses,
+                  double resolution);
+
+  // Returns the pose at 'time' interpolated between the 'timed_poses'.
+  transform::Rigid3d LookupPose(double time) const;
+
+  // Transforms 'num_points' points given as separate arrays of coordinates
+  // and relative times by the pose at the time of each point. The output
+  // arrays may alias the input arrays.
+  void TransformPoints(const float* times, const float* xs, const float* ys,
+                       const float* zs, size_t num_points, float* out_xs,
+                       float* out_ys, float* out_zs) const;
+
+  int num_samples() const { return num_samples_; }
+
+ private:
+  // Number of floats per sample: the rotation matrix in row-major order
+  // followed by the translation.
+  static constexpr int kNumComponents = 12;
+
+  const std::vector<TimedPose> timed_poses_;
+  double start_time_;
+  float inverse_resolution_;
+  int num_samples_;
+  // Samples stored per component, i.e. 'kNumComponents' arrays of
+  // 'num_samples_' floats each.
+  std::vector<float> samples_;
+};
+
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_3D_DESKEW_POSE_TABLE_H_
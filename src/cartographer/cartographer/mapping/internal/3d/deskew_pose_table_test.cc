@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/deskew_pose_table.h"
+
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+// Poses of a frame moving along a curve while rotating quickly around all
+// axes, sampled at 'rate' Hz over the 0.1 s before the scan time.
+std::vector<DeskewPoseTable::TimedPose> GenerateTimedPoses(const double rate) {
+  std::vector<DeskewPoseTable::TimedPose> timed_poses;
+  for (double time = -0.1; time <= 1e-9; time += 1. / rate) {
+    timed_poses.push_back(
+        {time, transform::Rigid3d(
+                   Eigen::Vector3d(2. * time, std::sin(10. * time), 0.5),
+                   Eigen::AngleAxisd(3. * time + 10. * time * time,
+                                     Eigen::Vector3d(1., -2., 3.).normalized()))});
+  }
+  return timed_poses;
+}
+
+TEST(DeskewPoseTableTest, LookupPoseInterpolatesAndClamps) {
+  const std::vector<DeskewPoseTable::TimedPose> timed_poses = {
+      {-0.1, transform::Rigid3d::Identity()},
+      {0., transform::Rigid3d(Eigen::Vector3d(1., 0., 0.),
+                              Eigen::Quaterniond(Eigen::AngleAxisd(
+                                  0.2, Eigen::Vector3d::UnitZ())))}};
+  const DeskewPoseTable table(timed_poses, 1e-3);
+  EXPECT_EQ(101, table.num_samples());
+  EXPECT_THAT(table.LookupPose(-0.05),
+              transform::IsNearly(
+                  transform::Rigid3d(Eigen::Vector3d(0.5, 0., 0.),
+                                     Eigen::Quaterniond(Eigen::AngleAxisd(
+                                         0.1, Eigen::Vector3d::UnitZ()))),
+                  1e-9));
+  EXPECT_THAT(table.LookupPose(-1.),
+              transform::IsNearly(timed_poses.front().pose, 1e-9));
+  EXPECT_THAT(table.LookupPose(1.),
+              transform::IsNearly(timed_poses.back().pose, 1e-9));
+}
+
+TEST(DeskewPoseTableTest, SinglePose) {
+  const transform::Rigid3d pose(
+      Eigen::Vector3d(1., 2., 3.),
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.5, Eigen::Vector3d::UnitX())));
+  const DeskewPoseTable table({{0., pose}}, 1e-3);
+  const std::vector<float> times = {-0.1f, -0.05f, 0.f};
+  const std::vector<float> xs = {1.f, 0.f, -2.f};
+  const std::vector<float> ys = {0.f, 1.f, 3.f};
+  const std::vector<float> zs = {0.f, 0.f, 5.f};
+  std::vector<float> out_xs(3), out_ys(3), out_zs(3);
+  table.TransformPoints(times.data(), xs.data(), ys.data(), zs.data(), 3,
+                        out_xs.data(), out_ys.data(), out_zs.data());
+  for (int i = 0; i != 3; ++i) {
+    const Eigen::Vector3d expected =
+        pose * Eigen::Vector3d(xs[i], ys[i], zs[i]);
+    EXPECT_NEAR(expected.x(), out_xs[i], 1e-5);
+    EXPECT_NEAR(expected.y(), out_ys[i], 1e-5);
+    EXPECT_NEAR(expected.z(), out_zs[i], 1e-5);
+  }
+}
+
+TEST(DeskewPoseTableTest, TransformPointsMatchesInterpolatedPoses) {
+  const DeskewPoseTable table(GenerateTimedPoses(400.), 1e-3);
+  std::vector<float> times, xs, ys, zs;
+  for (int i = 0; i != 1000; ++i) {
+    // Includes times outside of the poses to check the clamping.
+    times.push_back(-0.11f + 0.12f * i / 999.f);
+    xs.push_back(30.f * std::cos(0.1f * i));
+    ys.push_back(30.f * std::sin(0.1f * i));
+    zs.push_back(0.01f * i - 5.f);
+  }
+  std::vector<float> out_xs = xs;
+  std::vector<float> out_ys = ys;
+  std::vector<float> out_zs = zs;
+  // Transforms in place.
+  table.TransformPoints(times.data(), out_xs.data(), out_ys.data(),
+                        out_zs.data(), times.size(), out_xs.data(),
+                        out_ys.data(), out_zs.data());
+  for (size_t i = 0; i != times.size(); ++i) {
+    const Eigen::Vector3d expected =
+        table.LookupPose(times[i]) * Eigen::Vector3d(xs[i], ys[i], zs[i]);
+    // At 30 m range, this is a small fraction of typical voxel sizes.
+    EXPECT_NEAR(expected.x(), out_xs[i], 1e-3);
+    EXPECT_NEAR(expected.y(), out_ys[i], 1e-3);
+    EXPECT_NEAR(expected.z(), out_zs[i], 1e-3);
+  }
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
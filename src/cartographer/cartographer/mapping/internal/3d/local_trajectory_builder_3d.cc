@@ -31,6 +31,34 @@
 
 namespace cartographer {
 namespace mapping {
+
+namespace {
+
+// Time between the poses sampled for deskewing.
+constexpr double kDeskewPoseTableResolution = 1e-3;
+
+// Integrates 'imu_data' into 'integrator', taking the time step from
+// 'last_imu_time' which is then updated.
+void IntegrateMeasurement(
+    const sensor::ImuData& imu_data, double* const last_imu_time,
+    gtsam::PreintegratedImuMeasurements* const integrator) {
+  double imu_time = common::ToSecondsStamp(imu_data.time);
+  double dt = (*last_imu_time < 0) 
+      ? (1.0 / 500.0) : (imu_time - *last_imu_time);
+  *last_imu_time = imu_time;
+
+  // integrate this single imu message
+  integrator->integrateMeasurement(
+    gtsam::Vector3(imu_data.linear_acceleration.x(), 
+                  imu_data.linear_acceleration.y(),
+                  imu_data.linear_acceleration.z()),
+    gtsam::Vector3(imu_data.angular_velocity.x(),
+                  imu_data.angular_velocity.y(),
+                  imu_data.angular_velocity.z()), dt);
+}
+
+}  // namespace
+
 using namespace std;
 using namespace chrono;
 static auto* kLocalSlamLatencyMetric = metrics::Gauge::Null();
@@ -55,8 +83,14 @@ LocalTrajectoryBuilder3D::LocalTrajectoryBuilder3D(
               options_.ceres_scan_matcher_options())),
       accumulated_range_data_{Eigen::Vector3f::Zero(), {}, {}},
       range_data_synchronizer_(expected_range_sensor_ids) {
+  if (options_.use_loam_scan_matching()) {
+    loam_feature_extractor_ =
+        common::make_unique<scan_matching::LoamFeatureExtractor>(
+            options_.loam_scan_matcher_options().feature_extractor_options());
+    loam_scan_matcher_ = common::make_unique<scan_matching::LoamScanMatcher>(
+        options_.loam_scan_matcher_options());
+  }
   scan_period_ = options_.scan_period();
-  eable_mannually_discrew_ = options_.eable_mannually_discrew();
   frames_for_static_initialization_ = options_.frames_for_static_initialization();
   frames_for_dynamic_initialization_ = options_.frames_for_dynamic_initialization();
   g_est_win_size_ = options_.frames_for_online_gravity_estimate();
@@ -162,41 +196,76 @@ pcl::PointCloud<pcl::PointXYZI>::Ptr LocalTrajectoryBuilder3D::
 
 
 void LocalTrajectoryBuilder3D::AddImuData(const sensor::ImuData& imu_data) {
-  if(!imu_initialized_){
-    if(options_.enable_ndt_initialization() && init_integrator_){
-      double imu_time = common::ToSecondsStamp(imu_data.time);
-      double dt = (last_imu_time_ini_ < 0) 
-          ? (1.0 / 500.0) : (imu_time - last_imu_time_ini_);
-      last_imu_time_ini_ = imu_time;
-      init_integrator_->push_back(
-        dt, imu_data.linear_acceleration, imu_data.angular_velocity);
-    }else{
-      init_imu_buffer_opt_.push_back(imu_data);
+  ImuPropagatedStateCallback imu_propagated_state_callback;
+  TrajectoryBuilderInterface::ImuPropagatedState state;
+  {
+    common::MutexLocker locker(&imu_mutex_);
+    if(!imu_initialized_){
+      if(options_.enable_ndt_initialization() && init_integrator_){
+        double imu_time = common::ToSecondsStamp(imu_data.time);
+        double dt = (last_imu_time_ini_ < 0) 
+            ? (1.0 / 500.0) : (imu_time - last_imu_time_ini_);
+        last_imu_time_ini_ = imu_time;
+        init_integrator_->push_back(
+          dt, imu_data.linear_acceleration, imu_data.angular_velocity);
+      }else{
+        init_imu_buffer_opt_.push_back(imu_data);
+      }
+      return;
+    }
+    // IMU data may be added concurrently with range data. Data before the
+    // last optimized state arrived too late and is dropped.
+    if(imu_data.time < prev_state_time_){
+      return;
+    }
+    imu_que_opt_.push_back(imu_data);
+    IntegrateImuData(imu_data);
+    if (!imu_propagated_state_callback_) {
+      return;
     }
+    const gtsam::NavState& current_state = predicted_states_.back().second;
+    state.time = imu_data.time;
+    state.local_pose = PoseFromGtsamNavState(current_state);
+    state.velocity = current_state.velocity();
+    state.angular_velocity =
+        imu_data.angular_velocity - prev_bias_.gyroscope();
+    state.accelerometer_bias = prev_bias_.accelerometer();
+    state.gyroscope_bias = prev_bias_.gyroscope();
+    imu_propagated_state_callback = imu_propagated_state_callback_;
   }
+  imu_propagated_state_callback(state);
+}
 
-  //由于外层调用时需要加锁，因此IMU的添加与点云的添加其实是交替进行的
-  if(imu_initialized_ && imu_integrator_opt_){
-    // imu_que_opt_.push_back(imu_data);
-
-    double imu_time = common::ToSecondsStamp(imu_data.time);
-    double dt = (last_imu_time_opt_ < 0) 
-        ? (1.0 / 500.0) : (imu_time - last_imu_time_opt_);
-    last_imu_time_opt_ = imu_time;
-
-    // integrate this single imu message
-    imu_integrator_opt_->integrateMeasurement(
-      gtsam::Vector3(imu_data.linear_acceleration.x(), 
-                    imu_data.linear_acceleration.y(),
-                    imu_data.linear_acceleration.z()),
-      gtsam::Vector3(imu_data.angular_velocity.x(),
-                    imu_data.angular_velocity.y(),
-                    imu_data.angular_velocity.z()), dt);
-    
-    gtsam::NavState current_state = 
-      imu_integrator_opt_->predict(prev_state_, prev_bias_);
-    // 存储递推值用于纠正点云／用于scan matching的初始值
-    predicted_states_.push_back({imu_data.time, current_state});
+void LocalTrajectoryBuilder3D::SetImuPropagatedStateCallback(
+    const ImuPropagatedStateCallback& imu_propagated_state_callback) {
+  common::MutexLocker locker(&imu_mutex_);
+  imu_propagated_state_callback_ = imu_propagated_state_callback;
+}
+
+void LocalTrajectoryBuilder3D::IntegrateImuData(
+    const sensor::ImuData& imu_data) {
+  IntegrateMeasurement(imu_data, &last_imu_time_imu_,
+                       imu_integrator_imu_.get());
+  gtsam::NavState current_state = 
+    imu_integrator_imu_->predict(prev_state_, prev_bias_);
+  // 存储递推值用于纠正点云／用于scan matching的初始值
+  predicted_states_.push_back({imu_data.time, current_state});
+}
+
+void LocalTrajectoryBuilder3D::PreintegrateImuData(const common::Time& time) {
+  while (!imu_que_opt_.empty() && imu_que_opt_.front().time < time) {
+    IntegrateMeasurement(imu_que_opt_.front(), &last_imu_time_opt_,
+                         imu_integrator_opt_);
+    imu_que_opt_.pop_front();
+  }
+}
+
+void LocalTrajectoryBuilder3D::RepropagateImuData() {
+  imu_integrator_imu_->resetIntegrationAndSetBias(prev_bias_);
+  last_imu_time_imu_ = last_imu_time_opt_;
+  predicted_states_.clear();
+  for (const sensor::ImuData& imu_data : imu_que_opt_) {
+    IntegrateImuData(imu_data);
   }
 }
 
@@ -335,6 +404,9 @@ void LocalTrajectoryBuilder3D::InitializeIMU(){
     << Ba_[0], Ba_[1], Ba_[2], Bg_[0], Bg_[1], Bg_[2]).finished());
   imu_integrator_opt_ = 
     new gtsam::PreintegratedImuMeasurements(preint_param_, prior_imu_bias);
+  imu_integrator_imu_ =
+      common::make_unique<gtsam::PreintegratedImuMeasurements>(
+          preint_param_, prior_imu_bias);
   
   Eigen::Quaterniond q(R_);
   gtsam::Pose3 pose_start = gtsam::Pose3(
@@ -349,6 +421,7 @@ void LocalTrajectoryBuilder3D::InitializeIMU(){
   LOG(INFO)<<"Bg: "<<Bg_[0]<<","<<Bg_[1]<<","<<Bg_[2];
   
   prev_state_ = gtsam::NavState(pose_start, v_start);
+  prev_state_time_ = time_point_cloud_;
   prev_bias_ = prior_imu_bias;
   prev_state_odom_ = prev_state_;
   prev_bias_odom_ = prev_bias_;
@@ -360,9 +433,9 @@ std::unique_ptr<LocalTrajectoryBuilder3D::MatchingResult>
 LocalTrajectoryBuilder3D::AddRangeData(
     const std::string& sensor_id,
     const sensor::TimedPointCloudData& unsynchronized_data) {
-  sensor::TimedPointCloudOriginData synchronized_data 
+  const sensor::TimedPointCloudOriginData& synchronized_data
     = range_data_synchronizer_.AddRangeData(
-      sensor_id, unsynchronized_data, eable_mannually_discrew_);
+      sensor_id, unsynchronized_data);
   if (synchronized_data.ranges.empty()) {
     // LOG(INFO) << "Range data collator filling buffer.";
     return nullptr;
@@ -370,6 +443,7 @@ LocalTrajectoryBuilder3D::AddRangeData(
   const common::Time& time = synchronized_data.time;
   time_point_cloud_ = time;
   if(!imu_initialized_){
+    common::MutexLocker locker(&imu_mutex_);
     if(options_.enable_ndt_initialization()){
       InitilizeByNDT(time, synchronized_data);
     }else{
@@ -394,68 +468,89 @@ LocalTrajectoryBuilder3D::AddRangeData(
       sensor::VoxelFilter(0.5f * options_.voxel_filter_size())
           .Filter(synchronized_data.ranges);
   
-  std::vector<transform::Rigid3f> hits_poses;
-  transform::Rigid3d tmp_pose;
-  hits_poses.reserve(hits.size());
-  bool warned = false;
-
-  //即使是插入子地图的第一帧，也是经过初始化步骤的，同样可以进行相对运动的矫正
-  first_scan_to_insert_ = false; 
-  if(first_scan_to_insert_){
-    hits_poses = std::vector<transform::Rigid3f>(
-      hits.size(), PoseFromGtsamNavState(prev_state_).cast<float>());
-    first_scan_to_insert_ = false;
-  }else{
-    size_t idx0, idx1;
-    idx0 = idx1 = 0;
-    transform::Rigid3d cur_state_pre, rel_trans;
-    // FindIdxFromOdomQuene(time, idx0, idx1);
-    
-    // if(idx0 != idx1){
-    //   InterpolatePose(time, predicted_states_.at(idx0).first, 
-    //     predicted_states_.at(idx1).first, predicted_states_.at(idx0).second, 
-    //     predicted_states_.at(idx1).second, cur_state_pre);
-    // }else{
-    //   if(idx0 == 0 ){
-    //     LOG(WARNING)<<"Maybe IMU quene is empty?";
-    //     return nullptr;
-    //   }
-    //   cur_state_pre = PoseFromGtsamNavState(predicted_states_.at(idx0).second);
-    // }
-    
+  // Poses of the tracking frame relative to 'time' used for deskewing.
+  std::vector<DeskewPoseTable::TimedPose> timed_poses;
+  {
+    common::MutexLocker locker(&imu_mutex_);
     if(predicted_states_.empty()) return nullptr;
-    cur_state_pre = PoseFromGtsamNavState(predicted_states_.back().second);
-    rel_trans =  PoseFromGtsamNavState(prev_state_).inverse() * cur_state_pre;
-    
+
     if(std::abs(hits.front().point_time[3]) < 1e-3){//没有单点的时间戳
-      hits_poses = std::vector<transform::Rigid3f>(
-        hits.size(), cur_state_pre.cast<float>());
+      timed_poses.push_back(
+          {0., PoseFromGtsamNavState(predicted_states_.back().second)});
       LOG(WARNING)<<"Not discrewing!";
     }else{
-      const double sample_period = scan_period_;
+      // 使用IMU递推的状态而不是匀速假设对每个点进行矫正
+      timed_poses.push_back({common::ToSeconds(prev_state_time_ - time),
+                             PoseFromGtsamNavState(prev_state_)});
+      float first_point_time = 0.f;
       for (const auto& hit : hits) {
-        common::Time time_point = time + common::FromSeconds(hit.point_time[3]);
-        //注意，hit.point_time[3]是小于０的值
-        //当前帧的最后一个点为０，帧的时间戳为最后一个点的采集时间
-        double s = (sample_period + hit.point_time[3]) / sample_period;
-        InterpolatePose(s, rel_trans, tmp_pose);
-        hits_poses.push_back(
-          (PoseFromGtsamNavState(prev_state_) * tmp_pose).cast<float>());
+        first_point_time = std::min(first_point_time, hit.point_time[3]);
+      }
+      for (const auto& predicted_state : predicted_states_) {
+        const double relative_time =
+            common::ToSeconds(predicted_state.first - time);
+        if (relative_time <= timed_poses.back().time) {
+          continue;
+        }
+        // Only the last pose before the first point of the scan is kept.
+        if (relative_time <= first_point_time) {
+          timed_poses.clear();
+        }
+        timed_poses.push_back(
+            {relative_time, PoseFromGtsamNavState(predicted_state.second)});
       }
     }
+    TrimStatesCache(time);
   }
-  TrimStatesCache(time);
+  const DeskewPoseTable deskew_pose_table(timed_poses,
+                                          kDeskewPoseTableResolution);
 
   if (num_accumulated_ == 0) {
     // 'accumulated_range_data_.origin' is not used.
     accumulated_range_data_ = sensor::RangeData{{}, {}, {}};
+    accumulated_loam_features_.edge_points.Clear();
+    accumulated_loam_features_.planar_points.Clear();
+  }
+
+  if (loam_feature_extractor_ != nullptr) {
+    loam_feature_extractor_->Extract(synchronized_data, &loam_features_);
+    DiscrewLoamFeaturePoints(loam_features_.edge_points, deskew_pose_table,
+                             &accumulated_loam_features_.edge_points);
+    DiscrewLoamFeaturePoints(loam_features_.planar_points, deskew_pose_table,
+                             &accumulated_loam_features_.planar_points);
   }
           
-  for (size_t i = 0; i < hits.size(); ++i) {
-    const Eigen::Vector3f hit_in_local =
-        hits_poses[i] * hits[i].point_time.head<3>();
-    const Eigen::Vector3f origin_in_local =
-        hits_poses[i] * synchronized_data.origins.at(hits[i].origin_index);
+  // Deskews the hits and the origins they were measured from in one batch.
+  const size_t num_hits = hits.size();
+  std::vector<float> times(num_hits);
+  std::vector<float> hit_xs(num_hits), hit_ys(num_hits), hit_zs(num_hits);
+  std::vector<float> origin_xs(num_hits), origin_ys(num_hits),
+      origin_zs(num_hits);
+  for (size_t i = 0; i < num_hits; ++i) {
+    const Eigen::Vector4f& point_time = hits[i].point_time;
+    const Eigen::Vector3f& origin =
+        synchronized_data.origins.at(hits[i].origin_index);
+    times[i] = point_time[3];
+    hit_xs[i] = point_time[0];
+    hit_ys[i] = point_time[1];
+    hit_zs[i] = point_time[2];
+    origin_xs[i] = origin[0];
+    origin_ys[i] = origin[1];
+    origin_zs[i] = origin[2];
+  }
+  deskew_pose_table.TransformPoints(times.data(), hit_xs.data(),
+                                    hit_ys.data(), hit_zs.data(), num_hits,
+                                    hit_xs.data(), hit_ys.data(),
+                                    hit_zs.data());
+  deskew_pose_table.TransformPoints(times.data(), origin_xs.data(),
+                                    origin_ys.data(), origin_zs.data(),
+                                    num_hits, origin_xs.data(),
+                                    origin_ys.data(), origin_zs.data());
+
+  for (size_t i = 0; i < num_hits; ++i) {
+    const Eigen::Vector3f hit_in_local(hit_xs[i], hit_ys[i], hit_zs[i]);
+    const Eigen::Vector3f origin_in_local(origin_xs[i], origin_ys[i],
+                                          origin_zs[i]);
     const Eigen::Vector3f delta = hit_in_local - origin_in_local;
     const float range = delta.norm();
     if (range >= options_.min_range()) {
@@ -474,7 +569,8 @@ LocalTrajectoryBuilder3D::AddRangeData(
 
   if (num_accumulated_ >= options_.num_accumulated_range_data()) {
     num_accumulated_ = 0;
-    transform::Rigid3f current_pose = hits_poses.back();
+    const transform::Rigid3f current_pose =
+        deskew_pose_table.LookupPose(hits.back().point_time[3]).cast<float>();
     
     const sensor::RangeData filtered_range_data = {
         current_pose.translation(),
@@ -484,16 +580,38 @@ LocalTrajectoryBuilder3D::AddRangeData(
             .Filter(accumulated_range_data_.misses)};
     return AddAccumulatedRangeData(
       time, current_pose.cast<double>(), 
-      sensor::TransformRangeData(filtered_range_data, current_pose.inverse()));
+      sensor::TransformRangeData(filtered_range_data, current_pose.inverse()),
+      scan_matching::TransformLoamFeatures(accumulated_loam_features_,
+                                           current_pose.inverse()));
   }
   return nullptr;
 }
 
+void LocalTrajectoryBuilder3D::DiscrewLoamFeaturePoints(
+    const scan_matching::LoamFeaturePoints& points,
+    const DeskewPoseTable& deskew_pose_table,
+    scan_matching::LoamFeaturePoints* const points_in_local) {
+  const size_t offset = points_in_local->size();
+  const size_t num_points = points.size();
+  points_in_local->x.resize(offset + num_points);
+  points_in_local->y.resize(offset + num_points);
+  points_in_local->z.resize(offset + num_points);
+  points_in_local->time.insert(points_in_local->time.end(),
+                               points.time.begin(), points.time.end());
+  // Same deskewing as for the hits, 'time' is relative to the last point of
+  // the scan.
+  deskew_pose_table.TransformPoints(
+      points.time.data(), points.x.data(), points.y.data(), points.z.data(),
+      num_points, points_in_local->x.data() + offset,
+      points_in_local->y.data() + offset, points_in_local->z.data() + offset);
+}
+
 std::unique_ptr<LocalTrajectoryBuilder3D::MatchingResult>
 LocalTrajectoryBuilder3D::AddAccumulatedRangeData(
     const common::Time time,
     const transform::Rigid3d& pose_prediction,
-    const sensor::RangeData& filtered_range_data_in_tracking) {
+    const sensor::RangeData& filtered_range_data_in_tracking,
+    const scan_matching::LoamFeatures& loam_features_in_tracking) {
   if (filtered_range_data_in_tracking.returns.empty()) {
     LOG(WARNING) << "Dropped empty range data.";
     return nullptr;
@@ -511,18 +629,6 @@ LocalTrajectoryBuilder3D::AddAccumulatedRangeData(
     LOG(WARNING) << "Dropped empty high resolution point cloud data.";
     return nullptr;
   }
-  if (options_.use_online_correlative_scan_matching()) {
-    // We take a copy since we use 'initial_ceres_pose' as an output argument.
-    const transform::Rigid3d initial_pose = initial_ceres_pose;
-    double score = real_time_correlative_scan_matcher_->Match(
-        initial_pose, high_resolution_point_cloud_in_tracking,
-        matching_submap->high_resolution_hybrid_grid(), &initial_ceres_pose);
-    kRealTimeCorrelativeScanMatcherScoreMetric->Observe(score);
-  }
-
-  transform::Rigid3d pose_observation_in_submap;
-  ceres::Solver::Summary summary;
-
   sensor::AdaptiveVoxelFilter low_resolution_adaptive_voxel_filter(
       options_.low_resolution_adaptive_voxel_filter_options());
   const sensor::PointCloud low_resolution_point_cloud_in_tracking =
@@ -532,29 +638,72 @@ LocalTrajectoryBuilder3D::AddAccumulatedRangeData(
     LOG(WARNING) << "Dropped empty low resolution point cloud data.";
     return nullptr;
   }
-  ceres_scan_matcher_->Match(
-      (matching_submap->local_pose().inverse() * pose_prediction).translation(),
-      initial_ceres_pose,
-      {{&high_resolution_point_cloud_in_tracking,
-        &matching_submap->high_resolution_hybrid_grid()},
-       {&low_resolution_point_cloud_in_tracking,
-        &matching_submap->low_resolution_hybrid_grid()}},
-      &pose_observation_in_submap, &summary);
-  kCeresScanMatcherCostMetric->Observe(summary.final_cost);
-  double residual_distance = (pose_observation_in_submap.translation() -
-                              initial_ceres_pose.translation())
-                                 .norm();
-  kScanMatcherResidualDistanceMetric->Observe(residual_distance);
-  double residual_angle = pose_observation_in_submap.rotation().angularDistance(
-      initial_ceres_pose.rotation());
+
+  transform::Rigid3d pose_estimate;
+  ceres::Solver::Summary summary;
+  if (options_.use_loam_scan_matching()) {
+    // The LOAM feature map is kept in the local frame.
+    loam_scan_matcher_->Match(pose_prediction.translation(), pose_prediction,
+                              loam_features_in_tracking, &pose_estimate,
+                              &summary);
+    kCeresScanMatcherCostMetric->Observe(summary.final_cost);
+    kScanMatcherResidualDistanceMetric->Observe(
+        (pose_estimate.translation() - pose_prediction.translation()).norm());
+    kScanMatcherResidualAngleMetric->Observe(
+        pose_estimate.rotation().angularDistance(pose_prediction.rotation()));
+  } else {
+    if (options_.use_online_correlative_scan_matching()) {
+      // We take a copy since we use 'initial_ceres_pose' as an output
+      // argument.
+      const transform::Rigid3d initial_pose = initial_ceres_pose;
+      const DenseHybridGridWindow* const dense_window =
+          matching_submap->high_resolution_dense_window();
+      double score =
+          dense_window != nullptr
+              ? real_time_correlative_scan_matcher_->Match(
+                    initial_pose, high_resolution_point_cloud_in_tracking,
+                    *dense_window, &initial_ceres_pose)
+              : real_time_correlative_scan_matcher_->Match(
+                    initial_pose, high_resolution_point_cloud_in_tracking,
+                    matching_submap->high_resolution_hybrid_grid(),
+                    &initial_ceres_pose);
+      kRealTimeCorrelativeScanMatcherScoreMetric->Observe(score);
+    }
+
+    transform::Rigid3d pose_observation_in_submap;
+    ceres_scan_matcher_->Match(
+        (matching_submap->local_pose().inverse() * pose_prediction)
+            .translation(),
+        initial_ceres_pose,
+        {{&high_resolution_point_cloud_in_tracking,
+          &matching_submap->high_resolution_hybrid_grid(),
+          matching_submap->high_resolution_dense_window()},
+         {&low_resolution_point_cloud_in_tracking,
+          &matching_submap->low_resolution_hybrid_grid(),
+          matching_submap->low_resolution_dense_window()}},
+        &pose_observation_in_submap, &summary);
+    kCeresScanMatcherCostMetric->Observe(summary.final_cost);
+    double residual_distance = (pose_observation_in_submap.translation() -
+                                initial_ceres_pose.translation())
+                                   .norm();
+    kScanMatcherResidualDistanceMetric->Observe(residual_distance);
+    double residual_angle =
+        pose_observation_in_submap.rotation().angularDistance(
+            initial_ceres_pose.rotation());
   
-  kScanMatcherResidualAngleMetric->Observe(residual_angle);
-  transform::Rigid3d pose_estimate =
-      matching_submap->local_pose() * pose_observation_in_submap;
+    kScanMatcherResidualAngleMetric->Observe(residual_angle);
+    pose_estimate = matching_submap->local_pose() * pose_observation_in_submap;
+  }
 
-  WindowOptimize(pose_estimate, false);
+  {
+    common::MutexLocker locker(&imu_mutex_);
+    WindowOptimize(pose_estimate, false);
+  }
  
   auto opt_pose = PoseFromGtsamNavState(prev_state_);
+  if (loam_scan_matcher_ != nullptr) {
+    loam_scan_matcher_->InsertFeatures(loam_features_in_tracking, opt_pose);
+  }
   
   const Eigen::Quaterniond gravity_alignment = opt_pose.rotation();
   sensor::RangeData filtered_range_data_in_local = sensor::TransformRangeData(
@@ -676,7 +825,14 @@ void LocalTrajectoryBuilder3D::ResetGTSAM(){
     gtsam::ISAM2Params optParameters;
     optParameters.relinearizeThreshold = 0.1;
     optParameters.relinearizeSkip = 1;
-    optimizer_ = gtsam::ISAM2(optParameters);
+    if (options_.use_fixed_lag_smoother()) {
+      // Marginalized factors leave empty slots which should be reused.
+      optParameters.findUnusedFactorSlots = true;
+      smoother_ = common::make_unique<gtsam::IncrementalFixedLagSmoother>(
+          options_.fixed_lag_smoother_lag(), optParameters);
+    } else {
+      optimizer_ = gtsam::ISAM2(optParameters);
+    }
 
     gtsam::NonlinearFactorGraph new_graph_factors_;
     graph_factors_ = new_graph_factors_;
@@ -685,6 +841,34 @@ void LocalTrajectoryBuilder3D::ResetGTSAM(){
     graph_values_ = new_graph_values_;
 }
 
+void LocalTrajectoryBuilder3D::UpdateOptimizer(const double timestamp) {
+  if (smoother_ != nullptr) {
+    gtsam::FixedLagSmoother::KeyTimestampMap timestamps;
+    for (const gtsam::Key key : graph_values_.keys()) {
+      timestamps[key] = timestamp;
+    }
+    smoother_->update(graph_factors_, graph_values_, timestamps);
+  } else {
+    optimizer_.update(graph_factors_, graph_values_);
+  }
+  graph_factors_.resize(0);
+  graph_values_.clear();
+}
+
+gtsam::Values LocalTrajectoryBuilder3D::CalculateEstimate() const {
+  if (smoother_ != nullptr) {
+    return smoother_->calculateEstimate();
+  }
+  return optimizer_.calculateEstimate();
+}
+
+bool LocalTrajectoryBuilder3D::IsKeyInOptimizer(const gtsam::Key key) const {
+  if (smoother_ != nullptr) {
+    return smoother_->timeStamps().count(key) != 0;
+  }
+  return true;
+}
+
 void LocalTrajectoryBuilder3D::ResetParams(){
   done_first_opt_ = false;
   gtsam_initialized_ = false;
@@ -735,19 +919,22 @@ void LocalTrajectoryBuilder3D::WindowOptimize(
     graph_values_.insert(V(0), prev_vel_);
     graph_values_.insert(B(0), prev_bias_);
     // optimize once
-    optimizer_.update(graph_factors_, graph_values_);
-    graph_factors_.resize(0);
-    graph_values_.clear();
+    UpdateOptimizer(currentCorrectionTime);
 
     imu_integrator_opt_->resetIntegrationAndSetBias(prev_bias_);
+    RepropagateImuData();
     
     key_ = 1;
     gtsam_initialized_ = true;
     return;
   }
 
-  // reset graph for speed
-  if (key_ == options_.submaps_options().num_range_data()) {
+  PreintegrateImuData(time_point_cloud_);
+
+  // reset graph for speed, the fixed-lag smoother instead bounds the graph by
+  // marginalizing old states.
+  if (smoother_ == nullptr &&
+      key_ == options_.submaps_options().num_range_data()) {
       // get updated noise before reset
       gtsam::noiseModel::Gaussian::shared_ptr updatedPoseNoise = 
         gtsam::noiseModel::Gaussian::Covariance(
@@ -789,14 +976,12 @@ void LocalTrajectoryBuilder3D::WindowOptimize(
       graph_values_.insert(V(0), prev_vel_);
       graph_values_.insert(B(0), prev_bias_);
       // optimize once
-      optimizer_.update(graph_factors_, graph_values_);
-      graph_factors_.resize(0);
-      graph_values_.clear();
+      UpdateOptimizer(currentCorrectionTime);
 
       key_ = 1;
   }
 
-  // integrate imu data and optimize（Done in AddImuData）
+  // integrate imu data and optimize（Done in PreintegrateImuData）
   // add imu factor to graph
   const gtsam::PreintegratedImuMeasurements& preint_imu = dynamic_cast<
     const gtsam::PreintegratedImuMeasurements&>(*imu_integrator_opt_);
@@ -819,7 +1004,8 @@ void LocalTrajectoryBuilder3D::WindowOptimize(
   
   // gravity factor for the last pose
   if(options_.enable_gravity_factor()){
-    if(EstimateGravity() && (key_ - g_est_win_size_) >= 0){      
+    if(EstimateGravity() && (key_ - g_est_win_size_) >= 0 &&
+       IsKeyInOptimizer(X(key_ - g_est_win_size_))){
       auto ng_G = g_vec_est_G_.normalized();
       gtsam::Unit3 g_z(ng_G[0], ng_G[1], ng_G[2]);
       gtsam::Unit3 g_ref_B(0., 0., -1.);
@@ -838,19 +1024,22 @@ void LocalTrajectoryBuilder3D::WindowOptimize(
   graph_values_.insert(B(key_), prev_bias_);
   
   // optimize
-  optimizer_.update(graph_factors_, graph_values_);
-  optimizer_.update();
-  graph_factors_.resize(0);
-  graph_values_.clear();
+  UpdateOptimizer(currentCorrectionTime);
+  if (smoother_ != nullptr) {
+    smoother_->update();
+  } else {
+    optimizer_.update();
+  }
   // Overwrite the beginning of the preintegration for the next step.
-  gtsam::Values result = optimizer_.calculateEstimate();
+  gtsam::Values result = CalculateEstimate();
   prev_pose_  = result.at<gtsam::Pose3>(X(key_));
   prev_vel_   = result.at<gtsam::Vector3>(V(key_));
   prev_state_ = gtsam::NavState(prev_pose_, prev_vel_);
+  prev_state_time_ = time_point_cloud_;
   prev_bias_  = result.at<gtsam::imuBias::ConstantBias>(B(key_));
   // Reset the optimization preintegration object.
   imu_integrator_opt_->resetIntegrationAndSetBias(prev_bias_);
-  TrimOldImuData(time_point_cloud_);
+  RepropagateImuData();
   
   // check optimization
   if (FailureDetection(prev_vel_, prev_bias_)){
@@ -18,16 +18,22 @@
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_LOCAL_TRAJECTORY_BUILDER_3D_H_
 
 #include <chrono>
+#include <functional>
 #include <memory>
 
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/3d/submap_3d.h"
+#include "cartographer/mapping/internal/3d/deskew_pose_table.h"
 #include "cartographer/mapping/internal/3d/scan_matching/ceres_scan_matcher_3d.h"
+#include "cartographer/mapping/internal/3d/scan_matching/loam_feature.h"
+#include "cartographer/mapping/internal/3d/scan_matching/loam_scan_matcher.h"
 #include "cartographer/mapping/internal/3d/scan_matching/real_time_correlative_scan_matcher_3d.h"
 #include "cartographer/mapping/internal/motion_filter.h"
 #include "cartographer/mapping/internal/range_data_collator.h"
 #include "cartographer/mapping/pose_extrapolator.h"
 #include "cartographer/mapping/proto/3d/local_trajectory_builder_options_3d.pb.h"
+#include "cartographer/mapping/trajectory_builder_interface.h"
 #include "cartographer/metrics/family_factory.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/internal/voxel_filter.h"
@@ -91,6 +97,8 @@ class LocalTrajectoryBuilder3D {
     // 'nullptr' if dropped by the motion filter.
     std::unique_ptr<const InsertionResult> insertion_result;
   };
+  using ImuPropagatedStateCallback = std::function<void(
+      const TrajectoryBuilderInterface::ImuPropagatedState&)>;
 
   explicit LocalTrajectoryBuilder3D(
       const mapping::proto::LocalTrajectoryBuilderOptions3D& options,
@@ -100,7 +108,9 @@ class LocalTrajectoryBuilder3D {
   LocalTrajectoryBuilder3D(const LocalTrajectoryBuilder3D&) = delete;
   LocalTrajectoryBuilder3D& operator=(const LocalTrajectoryBuilder3D&) = delete;
 
-  void AddImuData(const sensor::ImuData& imu_data);
+  // May be called from a different thread than AddRangeData(), but not from
+  // more than one thread at a time.
+  void AddImuData(const sensor::ImuData& imu_data) EXCLUDES(imu_mutex_);
   // Returns 'MatchingResult' when range data accumulation completed,
   // otherwise 'nullptr'.  `TimedPointCloudData::time` is when the last point in
   // `range_data` was acquired, `TimedPointCloudData::ranges` contains the
@@ -109,17 +119,32 @@ class LocalTrajectoryBuilder3D {
       const std::string& sensor_id,
       const sensor::TimedPointCloudData& range_data);
   void AddOdometryData(const sensor::OdometryData& odometry_data);
+  // Registers a callback which is called from AddImuData() with the predicted
+  // state for every integrated IMU measurement. It is called without holding
+  // 'imu_mutex_'.
+  void SetImuPropagatedStateCallback(
+      const ImuPropagatedStateCallback& imu_propagated_state_callback)
+      EXCLUDES(imu_mutex_);
 
   static void RegisterMetrics(metrics::FamilyFactory* family_factory);
 
 private:
   /*****************************************************************/
-  void WindowOptimize(const transform::Rigid3d& matched_pose, bool is_drift);
-  void InitializeIMU();
-  void InitializeStatic();
+  void WindowOptimize(const transform::Rigid3d& matched_pose, bool is_drift)
+      REQUIRES(imu_mutex_);
+  void InitializeIMU() REQUIRES(imu_mutex_);
+  void InitializeStatic() REQUIRES(imu_mutex_);
   void ResetGTSAM();
+  // Adds 'graph_factors_' and 'graph_values_' stamped with 'timestamp' to the
+  // optimizer and clears them.
+  void UpdateOptimizer(double timestamp);
+  gtsam::Values CalculateEstimate() const;
+  // Returns true if 'key' is still optimized, i.e. it was not marginalized by
+  // the fixed-lag smoother.
+  bool IsKeyInOptimizer(gtsam::Key key) const;
   void FindIdxFromOdomQuene(
-    const common::Time& time, size_t& former, size_t& later);
+    const common::Time& time, size_t& former, size_t& later)
+    REQUIRES(imu_mutex_);
   transform::Rigid3d PoseFromGtsamNavState(const gtsam::NavState& pose_in);
   void InterpolatePose(const common::Time& t, 
     const common::Time& t1, const common::Time& t2, 
@@ -128,8 +153,16 @@ private:
   void InterpolatePose(const double timestamp_ratio, 
     const transform::Rigid3d& relative_transform,
     transform::Rigid3d& pose_t);
-  void TrimStatesCache(const common::Time& time);
-  void TrimOldImuData(const common::Time& time);
+  // Propagates 'prev_state_' by 'imu_data' and appends the result to
+  // 'predicted_states_'.
+  void IntegrateImuData(const sensor::ImuData& imu_data) REQUIRES(imu_mutex_);
+  // Moves the queued IMU data before 'time' into 'imu_integrator_opt_'.
+  void PreintegrateImuData(const common::Time& time) REQUIRES(imu_mutex_);
+  // Rebuilds 'predicted_states_' from the optimized 'prev_state_' and the IMU
+  // data still queued after it.
+  void RepropagateImuData() REQUIRES(imu_mutex_);
+  void TrimStatesCache(const common::Time& time) REQUIRES(imu_mutex_);
+  void TrimOldImuData(const common::Time& time) REQUIRES(imu_mutex_);
   bool FailureDetection(const gtsam::Vector3& velCur,
     const gtsam::imuBias::ConstantBias& biasCur);
   void ResetParams();
@@ -145,7 +178,7 @@ private:
     Eigen::Matrix3f& R, Eigen::Vector3f& t);
   void InitilizeByNDT(const common::Time& time, 
     const sensor::TimedPointCloudOriginData& synchronized_data
-    /* pcl::PointCloud<pcl::PointXYZI>::Ptr cur_scan */);
+    /* pcl::PointCloud<pcl::PointXYZI>::Ptr cur_scan */) REQUIRES(imu_mutex_);
   bool AlignWithWorld();
   void InitCircularBuffers();
   bool EstimateGravity();
@@ -157,10 +190,18 @@ private:
     const cartographer::sensor::TimedPointCloudOriginData& cloud,
     const transform::Rigid3d& rel_trans);
 
+  // Transforms 'points' into the local frame with the pose at the time of
+  // each point and appends them to 'points_in_local'.
+  void DiscrewLoamFeaturePoints(
+      const scan_matching::LoamFeaturePoints& points,
+      const DeskewPoseTable& deskew_pose_table,
+      scan_matching::LoamFeaturePoints* points_in_local);
+
   std::unique_ptr<MatchingResult> AddAccumulatedRangeData(
       common::Time time,
       const transform::Rigid3d& pose_prediction,
-      const sensor::RangeData& filtered_range_data_in_tracking);
+      const sensor::RangeData& filtered_range_data_in_tracking,
+      const scan_matching::LoamFeatures& loam_features_in_tracking);
 
   std::unique_ptr<InsertionResult> InsertIntoSubmap(
       common::Time time, const sensor::RangeData& filtered_range_data_in_local,
@@ -177,11 +218,15 @@ private:
   std::unique_ptr<scan_matching::RealTimeCorrelativeScanMatcher3D>
       real_time_correlative_scan_matcher_;
   std::unique_ptr<scan_matching::CeresScanMatcher3D> ceres_scan_matcher_;
+  std::unique_ptr<scan_matching::LoamFeatureExtractor> loam_feature_extractor_;
+  std::unique_ptr<scan_matching::LoamScanMatcher> loam_scan_matcher_;
 
   std::unique_ptr<mapping::PoseExtrapolator> extrapolator_;
 
   int num_accumulated_ = 0;
   sensor::RangeData accumulated_range_data_;
+  scan_matching::LoamFeatures loam_features_;
+  scan_matching::LoamFeatures accumulated_loam_features_;
   std::chrono::steady_clock::time_point accumulation_started_;
 
   // RangeDataCollator range_data_collator_;
@@ -189,20 +234,26 @@ private:
 
 /**************************************************************/
   double scan_period_;
-  bool eable_mannually_discrew_;
   int frames_for_static_initialization_ = 7;
   int accumulated_frame_num = 0;
   common::Time time_point_cloud_;
+  // Guards the IMU state shared between AddImuData() and AddRangeData(). The
+  // optimized state ('prev_state_', 'prev_bias_', ...) is only written from
+  // AddRangeData() and thus only needs the lock when written there or when
+  // read from AddImuData().
+  common::Mutex imu_mutex_;
   double last_imu_time_opt_ = -1.;
+  double last_imu_time_imu_ GUARDED_BY(imu_mutex_) = -1.;
   double last_imu_time_ini_ = -1.;
   int key_ = 1;
   double delta_t_ = 0;
   bool gtsam_initialized_ = false;
   bool done_first_opt_ = false;
   bool imu_initialized_ = false;
-  bool first_scan_to_insert_ = true;
 
   gtsam::ISAM2 optimizer_;
+  // Only used if 'use_fixed_lag_smoother' is enabled, instead of 'optimizer_'.
+  std::unique_ptr<gtsam::IncrementalFixedLagSmoother> smoother_;
   gtsam::NonlinearFactorGraph graph_factors_;
   gtsam::Values graph_values_;
 
@@ -216,13 +267,22 @@ private:
 
   boost::shared_ptr<gtsam::PreintegrationParams> preint_param_ = nullptr;
   gtsam::PreintegratedImuMeasurements *imu_integrator_opt_ = nullptr;
+  // Integrates the IMU data after 'prev_state_' for 'predicted_states_'.
+  std::unique_ptr<gtsam::PreintegratedImuMeasurements> imu_integrator_imu_
+      GUARDED_BY(imu_mutex_);
   
-  std::deque<sensor::ImuData> imu_que_opt_;
-  std::deque<std::pair<common::Time, gtsam::NavState>> predicted_states_;
+  // IMU data not yet preintegrated into 'imu_integrator_opt_'.
+  std::deque<sensor::ImuData> imu_que_opt_ GUARDED_BY(imu_mutex_);
+  std::deque<std::pair<common::Time, gtsam::NavState>> predicted_states_
+      GUARDED_BY(imu_mutex_);
+  ImuPropagatedStateCallback imu_propagated_state_callback_
+      GUARDED_BY(imu_mutex_);
 
   gtsam::Pose3 prev_pose_;
   gtsam::Vector3 prev_vel_;
   gtsam::NavState prev_state_;
+  // Time of 'prev_state_', i.e. of the last optimized scan.
+  common::Time prev_state_time_;
   gtsam::imuBias::ConstantBias prev_bias_;
 
   gtsam::NavState prev_state_odom_;
@@ -241,7 +301,7 @@ private:
   Eigen::Vector3f linear_velocity_;
   Eigen::Vector3f angular_velocity_;
   
-  std::deque<sensor::ImuData> init_imu_buffer_opt_;
+  std::deque<sensor::ImuData> init_imu_buffer_opt_ GUARDED_BY(imu_mutex_);
   sensor::ImuData last_imu_;
 
   pcl::PointCloud<pcl::PointXYZI>::Ptr filtered_cloud_pre_;
@@ -107,6 +107,10 @@ class LocalTrajectoryBuilderTest : public ::testing::Test {
               miss_probability = 0.4,
               num_free_space_voxels = 0,
             },
+            use_dense_active_window = true,
+            high_resolution_active_window_size = 10.,
+            low_resolution_active_window_size = 30.,
+            compact_finished_submaps = true,
           },
         }
         )text");
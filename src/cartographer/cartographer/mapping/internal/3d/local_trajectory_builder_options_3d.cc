@@ -18,6 +18,7 @@
 
 #include "cartographer/mapping/3d/submap_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/ceres_scan_matcher_3d.h"
+#include "cartographer/mapping/internal/3d/scan_matching/loam_scan_matcher.h"
 #include "cartographer/mapping/proto/imu_options.pb.h"
 #include "cartographer/mapping/internal/motion_filter.h"
 #include "cartographer/mapping/internal/scan_matching/real_time_correlative_scan_matcher.h"
@@ -67,6 +68,17 @@ proto::LocalTrajectoryBuilderOptions3D CreateLocalTrajectoryBuilderOptions3D(
   options.set_scan_period(parameter_dictionary->GetDouble("scan_period"));
   options.set_eable_mannually_discrew(
     parameter_dictionary->GetBool("eable_mannually_discrew"));
+  options.set_num_scan_lines(
+      parameter_dictionary->GetNonNegativeInt("num_scan_lines"));
+  options.set_min_vertical_angle(
+      parameter_dictionary->GetDouble("min_vertical_angle"));
+  options.set_max_vertical_angle(
+      parameter_dictionary->GetDouble("max_vertical_angle"));
+  if (options.eable_mannually_discrew()) {
+    CHECK_GT(options.scan_period(), 0.f);
+    CHECK_GT(options.num_scan_lines(), 0);
+    CHECK_LT(options.min_vertical_angle(), options.max_vertical_angle());
+  }
   options.set_enable_ndt_initialization(
       parameter_dictionary->GetBool("enable_ndt_initialization"));
   options.set_frames_for_static_initialization(
@@ -77,6 +89,13 @@ proto::LocalTrajectoryBuilderOptions3D CreateLocalTrajectoryBuilderOptions3D(
       parameter_dictionary->GetInt("frames_for_online_gravity_estimate"));
   options.set_enable_gravity_factor(
       parameter_dictionary->GetBool("enable_gravity_factor"));
+  options.set_use_fixed_lag_smoother(
+      parameter_dictionary->GetBool("use_fixed_lag_smoother"));
+  options.set_fixed_lag_smoother_lag(
+      parameter_dictionary->GetDouble("fixed_lag_smoother_lag"));
+  if (options.use_fixed_lag_smoother()) {
+    CHECK_GT(options.fixed_lag_smoother_lag(), 0.);
+  }
   options.set_num_accumulated_range_data(
       parameter_dictionary->GetInt("num_accumulated_range_data"));
   options.set_voxel_filter_size(
@@ -101,6 +120,11 @@ proto::LocalTrajectoryBuilderOptions3D CreateLocalTrajectoryBuilderOptions3D(
   *options.mutable_ceres_scan_matcher_options() =
       mapping::scan_matching::CreateCeresScanMatcherOptions3D(
           parameter_dictionary->GetDictionary("ceres_scan_matcher").get());
+  options.set_use_loam_scan_matching(
+      parameter_dictionary->GetBool("use_loam_scan_matching"));
+  *options.mutable_loam_scan_matcher_options() =
+      mapping::scan_matching::CreateLoamScanMatcherOptions(
+          parameter_dictionary->GetDictionary("loam_scan_matcher").get());
   *options.mutable_motion_filter_options() = CreateMotionFilterOptions(
       parameter_dictionary->GetDictionary("motion_filter").get());
   *options.mutable_imu_options() = CreateIMUOptions(
@@ -54,7 +54,11 @@ PoseGraph3D::PoseGraph3D(
     common::ThreadPool* thread_pool)
     : options_(options),
       optimization_problem_(std::move(optimization_problem)),
-      constraint_builder_(options_.constraint_builder_options(), thread_pool) {
+      constraint_builder_(options_.constraint_builder_options(), thread_pool,
+                          [this](const SubmapId& submap_id) EXCLUDES(mutex_) {
+                            common::MutexLocker locker(&mutex_);
+                            return GetSubmapNodesUnderLock(submap_id);
+                          }) {
   optimization_task_ = common::make_unique<common::Task>();  
 }
 
@@ -362,6 +366,7 @@ void PoseGraph3D::ComputeConstraintsForNode(
                    {constraint_transform, options_.matcher_translation_weight(),
                     options_.matcher_rotation_weight()},
                    Constraint::INTRA_SUBMAP});
+    constraint_keys_.emplace(submap_id, node_id);
   }
 
   /* const transform::Rigid3d global_node_pose 
@@ -407,7 +412,7 @@ void PoseGraph3D::DispatchOptimization() {
     work_queue_ = common::make_unique<std::deque<std::function<void()>>>();
       auto optimization_task = common::make_unique<common::Task>();
       optimization_task->SetWorkItem([=]() EXCLUDES(mutex_) { 
-        HandleWorkQueue(constraint_builder_.GetConstraints());
+        HandleWorkQueue(constraint_builder_.TakeNewConstraints());
     });
     auto optimization_task_handle =
       constraint_builder_.GetThreadPool()->Schedule(
@@ -448,16 +453,8 @@ void PoseGraph3D::HandleWorkQueue(
   {
     common::MutexLocker locker(&mutex_);
     for(const auto& constraint: result){
-      bool has_added = false;
-      for(int i = 0; i < constraints_.size(); ++i){
-        const auto& constraint_i = constraints_[i];
-        if(constraint_i.submap_id ==  constraint.submap_id
-          && constraint_i.node_id ==  constraint.node_id){
-          has_added = true;
-          break;
-        }
-      }
-      if(!has_added){
+      if(constraint_keys_.emplace(constraint.submap_id, constraint.node_id)
+             .second){
         constraints_.push_back(constraint);
       }
     }
@@ -654,6 +651,7 @@ void PoseGraph3D::AddSerializedConstraints(
           break;
       }
       constraints_.push_back(constraint);
+      constraint_keys_.emplace(constraint.submap_id, constraint.node_id);
     }
     LOG(INFO) << "Loaded " << constraints.size() << " constraints.";
   });
@@ -680,7 +678,7 @@ void PoseGraph3D::RunFinalOptimization() {
         options_.optimization_problem_options()
             .ceres_solver_options()
             .max_num_iterations()); 
-    HandleWorkQueue(constraint_builder_.GetConstraints());
+    HandleWorkQueue(constraint_builder_.TakeNewConstraints());
   });
   auto optimization_task_handle =
     constraint_builder_.GetThreadPool()->Schedule(
@@ -1042,6 +1040,10 @@ void PoseGraph3D::TrimmingHandle::MarkSubmapAsTrimmed(
     }
     parent_->constraints_ = std::move(constraints);
   }
+  parent_->constraint_keys_.clear();
+  for (const Constraint& constraint : parent_->constraints_) {
+    parent_->constraint_keys_.emplace(constraint.submap_id, constraint.node_id);
+  }
 
   // Mark the submap with 'submap_id' as trimmed and remove its data.
   CHECK(parent_->submap_data_.at(submap_id).state == SubmapState::kFinished);
@@ -1075,25 +1077,31 @@ void PoseGraph3D::SetGlobalSlamOptimizationCallback(
 void PoseGraph3D::ComputeConstraintsForSubmap(
     const SubmapId& submap_id){
   // LOG(WARNING)<<"submap_id.submap_index: " << submap_id.submap_index;
-  const transform::Rigid3d global_submap_pose =
-      optimization_problem_->submap_data().at(submap_id).global_pose;
   const transform::Rigid3d local_submap_pose =
       submap_data_.at(submap_id).submap->local_pose();
-  const transform::Rigid3d global_submap_pose_inverse =
-      global_submap_pose.inverse();
-  std::vector<std::pair<NodeId, TrajectoryNode> > submap_nodes;
-  for (const NodeId& submap_node_id : submap_data_.at(submap_id).node_ids) {  
-    submap_nodes.push_back({submap_node_id,
-        TrajectoryNode{trajectory_nodes_.at(submap_node_id).constant_data,
-                       /* global_submap_pose_inverse *
-                       trajectory_nodes_.at(submap_node_id).global_pose */
-              local_submap_pose.inverse() 
-              * trajectory_nodes_.at(submap_node_id).constant_data->local_pose}
-    });
-  }
   constraint_builder_.DispatchScanMatcherConstruction(
-    submap_id, local_submap_pose, submap_nodes, 
+    submap_id, local_submap_pose, GetSubmapNodesUnderLock(submap_id),
     submap_data_.at(submap_id).submap.get());
 }
+
+std::vector<std::pair<NodeId, TrajectoryNode>>
+PoseGraph3D::GetSubmapNodesUnderLock(const SubmapId& submap_id) const {
+  std::vector<std::pair<NodeId, TrajectoryNode>> submap_nodes;
+  if (!submap_data_.Contains(submap_id)) {
+    return submap_nodes;
+  }
+  const transform::Rigid3d local_submap_pose_inverse =
+      submap_data_.at(submap_id).submap->local_pose().inverse();
+  for (const NodeId& submap_node_id : submap_data_.at(submap_id).node_ids) {
+    if (!trajectory_nodes_.Contains(submap_node_id)) continue;
+    const auto& constant_data =
+        trajectory_nodes_.at(submap_node_id).constant_data;
+    submap_nodes.push_back(
+        {submap_node_id,
+         TrajectoryNode{constant_data,
+                        local_submap_pose_inverse * constant_data->local_pose}});
+  }
+  return submap_nodes;
+}
 }  // namespace mapping
 }  // namespace cartographer
@@ -24,6 +24,8 @@
 #include <memory>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
@@ -206,6 +208,11 @@ class PoseGraph3D : public PoseGraph {
   // Find constraints for a newly finished submap.
   void ComputeConstraintsForSubmap(const SubmapId& submap_id) REQUIRES(mutex_);
 
+  // Returns the nodes of 'submap_id' with their poses relative to the submap,
+  // or none if the submap has been trimmed.
+  std::vector<std::pair<NodeId, TrajectoryNode>> GetSubmapNodesUnderLock(
+      const SubmapId& submap_id) const REQUIRES(mutex_);
+
   // Computes constraints for a node and submap pair.
   void ComputeConstraint(const NodeId& node_id, const SubmapId& submap_id, 
     const SubmapId& node_submap_id)
@@ -291,6 +298,20 @@ class PoseGraph3D : public PoseGraph {
   constraints::ConstraintBuilder3D constraint_builder_ GUARDED_BY(mutex_);
   std::vector<Constraint> constraints_ GUARDED_BY(mutex_);
 
+  struct ConstraintKeyHash {
+    size_t operator()(const std::pair<SubmapId, NodeId>& key) const {
+      return (static_cast<size_t>(key.first.trajectory_id) * 73856093) ^
+             (static_cast<size_t>(key.first.submap_index) * 19349669) ^
+             (static_cast<size_t>(key.second.trajectory_id) * 83492791) ^
+             (static_cast<size_t>(key.second.node_index) * 2654435761u);
+    }
+  };
+
+  // The (submap, node) pairs of 'constraints_', to skip loop closures which
+  // were already added without searching 'constraints_'.
+  std::unordered_set<std::pair<SubmapId, NodeId>, ConstraintKeyHash>
+      constraint_keys_ GUARDED_BY(mutex_);
+
   // Submaps get assigned an ID and state as soon as they are seen, even
   // before they take part in the background computations.
   MapById<SubmapId, InternalSubmapData> submap_data_ GUARDED_BY(mutex_);
@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/internal/3d/range_data_synchronizer.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "cartographer/common/make_unique.h"
@@ -25,171 +26,154 @@
 
 namespace cartographer {
 namespace mapping {
+namespace {
 
-sensor::TimedPointCloudOriginData RangeDataSynchronizer::AddRangeData(
+bool EarlierPoint(const Eigen::Vector4f& lhs, const Eigen::Vector4f& rhs) {
+  return lhs[3] < rhs[3];
+}
+
+}  // namespace
+
+const sensor::TimedPointCloudOriginData&
+RangeDataSynchronizer::AddRangeData(
     const std::string& sensor_id,
-    const sensor::TimedPointCloudData& timed_point_cloud_data,
-    bool descrew) {
+    const sensor::TimedPointCloudData& timed_point_cloud_data) {
   CHECK_NE(expected_sensor_ids_.count(sensor_id), 0);
-  // TODO(wz): not efficient, to improve
-  sensor::TimedPointCloudOriginData result = {};
-  sensor::TimedPointCloudData point_cloud = timed_point_cloud_data;
-  if(descrew){
-    StampRangeData(point_cloud, 0.1, 64);
+  synchronized_data_.origins.clear();
+  synchronized_data_.ranges.clear();
+  if (sensor_id != prior_sensor_id) {
+    secondary_clouds_[sensor_id].push_back(timed_point_cloud_data);
+    return synchronized_data_;
   }
-  if(sensor_id == prior_sensor_id){
-    if(secondary_cloud_.empty()){
-      ToTimedPointCloudOriginData(point_cloud, result);
-      return result;
-    }else{
-      current_end_ = common::ToSecondsStamp(point_cloud.time);
-      current_start_ = current_end_ + point_cloud.ranges.front()[3];
-      // pop old clouds
-      while(1){
-        if(secondary_cloud_.empty()){
-          ToTimedPointCloudOriginData(point_cloud, result);
-          return result;
-        }
-        if(common::ToSecondsStamp(
-          secondary_cloud_.front().time) < current_start_){
-          secondary_cloud_.pop_front();
-        }else{
-          break;
-        }
-      }
-      auto secondary_lidar_time = common::ToSecondsStamp(
-        secondary_cloud_.front().time);
-      // secondary lidar too fast...should check it
-      if(secondary_lidar_time + secondary_cloud_.front().ranges.front()[3] 
-          > current_end_){
-        LOG(WARNING) << "The secondary lidar may be too fast, check it...";
-        ToTimedPointCloudOriginData(point_cloud, result);
-        return result;
-      }
-      // find overlap and merge data.
-      auto ranges = secondary_cloud_.front().ranges;
-      int i_start = -1;
-      int i_end = -1;
-      for(int i = 0; i < ranges.size(); ++i){
-        if(secondary_lidar_time + ranges[i][3] >= current_start_  
-            && secondary_lidar_time + ranges[i][3] <= current_end_
-          && i_start == -1){
-          i_start = i;
-        }
-        if(i_start != -1 && secondary_lidar_time + ranges[i][3] > current_end_){
-          i_end = i - 1;
-          break;
-        }
-      }
-      CHECK(i_start != -1)<<"Something wrong, check it...";
-      if(i_end == -1) i_end = ranges.size() - 1;
-      
-      result.ranges.resize(point_cloud.ranges.size() + i_end - i_start + 1);
 
-      sensor::TimedPointCloudOriginData::RangeMeasurement range;      
-      result.time = point_cloud.time;
-      result.origins.push_back(point_cloud.origin);
-      range.origin_index = 0;
-      for(size_t i = 0; i < point_cloud.ranges.size(); ++i){
-        range.point_time = timed_point_cloud_data.ranges[i];
-        result.ranges[i] = range;
-      }
-      range.origin_index = 1;
-      result.origins.push_back(secondary_cloud_.front().origin);
-      double relative_t = 0.;
-      for(size_t i = i_start; i <= i_end; ++i){
-        range.point_time = secondary_cloud_.front().ranges[i];
-        relative_t = secondary_cloud_.front().ranges[i][3];
-        range.point_time[3] = relative_t + secondary_lidar_time - current_end_;
-        result.ranges[point_cloud.ranges.size() + i - i_start] = range;
-      }
-      std::sort(result.ranges.begin(), result.ranges.end(),
-            [](const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
-               const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
-              return a.point_time[3] < b.point_time[3];
-            });
-      return result;
-    }
-  }else{
-    secondary_cloud_.push_back(point_cloud);
+  const sensor::TimedPointCloudData& point_cloud = timed_point_cloud_data;
+  if (point_cloud.ranges.empty()) {
+    return synchronized_data_;
   }
-  return result;
-}
+  current_end_ = common::ToSecondsStamp(point_cloud.time);
+  // Some drivers do not publish points in time order.
+  current_start_ =
+      current_end_ + (*std::min_element(point_cloud.ranges.begin(),
+                                        point_cloud.ranges.end(),
+                                        EarlierPoint))[3];
 
-void RangeDataSynchronizer::StampRangeData(
-    sensor::TimedPointCloudData& cloud,
-    const double scanPeriod,   
-    const int N_SCANS){
-  int cloudSize = cloud.ranges.size();
-  if(cloudSize < 2) return;
-  // very very naive implementation.
-  const double duration =  scanPeriod / (cloudSize - 1);
-  for (int i = 0; i < cloudSize; i++){
-    cloud.ranges[i][3] = -scanPeriod + i * duration;
+  synchronized_data_.time = point_cloud.time;
+  synchronized_data_.origins.push_back(point_cloud.origin);
+  merge_sources_.clear();
+  merge_sources_.push_back(MergeSource{
+      point_cloud.ranges.data(),
+      point_cloud.ranges.data() + point_cloud.ranges.size(), 0.f, 0});
+  for (auto& entry : secondary_clouds_) {
+    AddSecondaryMergeSource(entry.first, &entry.second);
   }
-  cloud.ranges.back()[3] = 0.;
-  /* float startOri = -atan2(
-    cloud.ranges[0][1], 
-    cloud.ranges[0][0]);
-  float endOri = -atan2(
-    cloud.ranges[cloudSize-1][1], 
-    cloud.ranges[cloudSize-1][0]) + 2 * M_PI;
+  MergeSources();
+  return synchronized_data_;
+}
 
-  if (endOri - startOri > 3 * M_PI){
-    endOri -= 2 * M_PI;
-  }else if (endOri - startOri < M_PI){
-    endOri += 2 * M_PI;
+void RangeDataSynchronizer::AddSecondaryMergeSource(
+    const std::string& sensor_id,
+    std::deque<sensor::TimedPointCloudData>* const secondary_clouds) {
+  // pop old clouds
+  while (!secondary_clouds->empty() &&
+         common::ToSecondsStamp(secondary_clouds->front().time) <
+             current_start_) {
+    secondary_clouds->pop_front();
   }
-  
-  bool halfPassed = false;
-  int count = cloudSize;
-  const float angle_ratio = 180. / M_PI;
-  
-  float x,y,z;
-  for (int i = 0; i < cloudSize; i++){
-    x = cloud.ranges[i][0];
-    y = cloud.ranges[i][1];
-    z = cloud.ranges[i][2];
-
-    float angle = atan(z / sqrt(x * x + y * y)) * angle_ratio;
-   
-    float ori = -atan2(y, x);
-    if (!halfPassed){ 
-      if (ori < startOri - M_PI / 2){
-        ori += 2 * M_PI;
-      } else if (ori > startOri + M_PI * 3 / 2) {
-        ori -= 2 * M_PI;
-      }
-      if (ori - startOri > M_PI){
-        halfPassed = true;
-      }
-    }else{
-      ori += 2 * M_PI;
-      if (ori < endOri - M_PI * 3 / 2){
-        ori += 2 * M_PI;
-      }else if (ori > endOri + M_PI / 2){
-        ori -= 2 * M_PI;
+  if (secondary_clouds->empty() || secondary_clouds->front().ranges.empty()) {
+    return;
+  }
+  const sensor::TimedPointCloudData& secondary_cloud =
+      secondary_clouds->front();
+  const double secondary_lidar_time =
+      common::ToSecondsStamp(secondary_cloud.time);
+  const sensor::TimedPointCloud& ranges = secondary_cloud.ranges;
+  const bool sorted =
+      std::is_sorted(ranges.begin(), ranges.end(), EarlierPoint);
+  const float earliest_time =
+      sorted ? ranges.front()[3]
+             : (*std::min_element(ranges.begin(), ranges.end(),
+                                  EarlierPoint))[3];
+  // secondary lidar too fast...should check it
+  if (secondary_lidar_time + earliest_time > current_end_) {
+    LOG(WARNING) << "The secondary lidar " << sensor_id
+                 << " may be too fast, check it...";
+    return;
+  }
+  // find overlap
+  const float relative_start =
+      static_cast<float>(current_start_ - secondary_lidar_time);
+  const float relative_end =
+      static_cast<float>(current_end_ - secondary_lidar_time);
+  const Eigen::Vector4f* begin;
+  const Eigen::Vector4f* end;
+  if (sorted) {
+    const auto begin_it = std::lower_bound(
+        ranges.begin(), ranges.end(), relative_start,
+        [](const Eigen::Vector4f& point, const float time) {
+          return point[3] < time;
+        });
+    const auto end_it = std::upper_bound(
+        begin_it, ranges.end(), relative_end,
+        [](const float time, const Eigen::Vector4f& point) {
+          return time < point[3];
+        });
+    begin = ranges.data() + (begin_it - ranges.begin());
+    end = ranges.data() + (end_it - ranges.begin());
+  } else {
+    // The overlap is not contiguous, so it is copied out of the cloud.
+    sensor::TimedPointCloud& overlap = unsorted_overlaps_[sensor_id];
+    overlap.clear();
+    for (const Eigen::Vector4f& point : ranges) {
+      if (point[3] >= relative_start && point[3] <= relative_end) {
+        overlap.push_back(point);
       }
     }
-    //the last point's point_time[3] is 0.
-    float ratio = (ori - startOri) / (endOri - startOri);
-    cloud.ranges[i][3] = -scanPeriod + scanPeriod * ratio;
-  } */
+    begin = overlap.data();
+    end = overlap.data() + overlap.size();
+  }
+  if (begin == end) {
+    return;
+  }
+  merge_sources_.push_back(MergeSource{
+      begin, end, static_cast<float>(secondary_lidar_time - current_end_),
+      synchronized_data_.origins.size()});
+  synchronized_data_.origins.push_back(secondary_cloud.origin);
 }
 
-void RangeDataSynchronizer::ToTimedPointCloudOriginData(
-    const sensor::TimedPointCloudData& timed_point_cloud_data,
-    sensor::TimedPointCloudOriginData& result){
-  result.time = timed_point_cloud_data.time;
-  result.ranges.resize(timed_point_cloud_data.ranges.size());
-  result.origins = {};
-  result.origins.push_back(timed_point_cloud_data.origin);
-
-  sensor::TimedPointCloudOriginData::RangeMeasurement range;
-  for(size_t i = 0; i < timed_point_cloud_data.ranges.size(); ++i){
-    range.point_time = timed_point_cloud_data.ranges[i];
-    range.origin_index = 0;
-    result.ranges[i] = range;
+void RangeDataSynchronizer::MergeSources() {
+  size_t num_points = 0;
+  bool sources_sorted = true;
+  for (const MergeSource& source : merge_sources_) {
+    num_points += source.end - source.begin;
+    sources_sorted = sources_sorted &&
+                     std::is_sorted(source.begin, source.end, EarlierPoint);
+  }
+  synchronized_data_.ranges.resize(num_points);
+  // There are only a few sources, so a linear scan for the earliest point is
+  // cheaper than maintaining a heap.
+  for (auto& range : synchronized_data_.ranges) {
+    MergeSource* earliest = nullptr;
+    for (MergeSource& source : merge_sources_) {
+      if (source.begin != source.end &&
+          (earliest == nullptr ||
+           (*source.begin)[3] + source.time_offset <
+               (*earliest->begin)[3] + earliest->time_offset)) {
+        earliest = &source;
+      }
+    }
+    range.point_time = *earliest->begin;
+    range.point_time[3] += earliest->time_offset;
+    range.origin_index = earliest->origin_index;
+    ++earliest->begin;
+  }
+  if (!sources_sorted) {
+    // Some drivers do not publish points in time order.
+    std::stable_sort(
+        synchronized_data_.ranges.begin(), synchronized_data_.ranges.end(),
+        [](const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
+           const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
+          return a.point_time[3] < b.point_time[3];
+        });
   }
 }
 
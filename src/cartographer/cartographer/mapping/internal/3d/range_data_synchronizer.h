@@ -17,17 +17,23 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_RANGE_DATA_SYNCHRONIZER_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_RANGE_DATA_SYNCHRONIZER_H_
 
-#include <memory>
 #include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "cartographer/common/make_unique.h"
 #include "cartographer/sensor/timed_point_cloud_data.h"
 
 namespace cartographer {
 namespace mapping {
 //根据主雷达的时间戳Merge各个雷达的数据，返回一个按照采样时间戳升序排列的完整点云
-//若输入的雷达是Velodyne的，则按照固定的扫描时间进行纠正
 class RangeDataSynchronizer {
  public:
+  // The first of 'expected_range_sensor_ids' is the primary sensor, all others
+  // are secondary sensors whose points are merged into the primary scans.
   explicit RangeDataSynchronizer(
       const std::vector<std::string>& expected_range_sensor_ids)
       : expected_sensor_ids_(expected_range_sensor_ids.begin(),
@@ -35,29 +41,48 @@ class RangeDataSynchronizer {
     prior_sensor_id = expected_range_sensor_ids.front();
   }
 
-  sensor::TimedPointCloudOriginData AddRangeData(
+  // Returns the merged point cloud sorted by time when 'sensor_id' is the
+  // primary sensor, and an empty point cloud otherwise. The returned reference
+  // is valid until the next call, its buffers are reused across calls.
+  const sensor::TimedPointCloudOriginData& AddRangeData(
       const std::string& sensor_id,
-      const sensor::TimedPointCloudData& timed_point_cloud_data,
-      bool descrew);
+      const sensor::TimedPointCloudData& timed_point_cloud_data);
 
  private:
-  void StampRangeData(
-    sensor::TimedPointCloudData& cloud,
-    const double scanPeriod,   
-    const int N_SCANS);
-  void ToTimedPointCloudOriginData(
-    const sensor::TimedPointCloudData& timed_point_cloud_data,
-    sensor::TimedPointCloudOriginData& result);
+  // A time sorted run of points to merge, with the offset that makes their
+  // times relative to the primary scan.
+  struct MergeSource {
+    const Eigen::Vector4f* begin;
+    const Eigen::Vector4f* end;
+    float time_offset;
+    size_t origin_index;
+  };
+
+  // Pops the clouds of 'secondary_clouds' which ended before the current
+  // primary scan started and adds the points of the oldest remaining one that
+  // fall into the primary scan to 'merge_sources_'. Points of a cloud which is
+  // not sorted by time are copied to 'unsorted_overlaps_' first.
+  void AddSecondaryMergeSource(
+      const std::string& sensor_id,
+      std::deque<sensor::TimedPointCloudData>* secondary_clouds);
+  // Merges 'merge_sources_' into 'synchronized_data_.ranges'.
+  void MergeSources();
   const std::set<std::string> expected_sensor_ids_;
 
   //主雷达只保持最新的一帧,辅雷达可以保留多帧,但一般最多两帧
   sensor::TimedPointCloudData prior_cloud_;
-  std::deque<sensor::TimedPointCloudData> secondary_cloud_={};
-  
+  std::map<std::string, std::deque<sensor::TimedPointCloudData>>
+      secondary_clouds_;
+
   double current_start_ = -1.0;
   double current_end_ = -1.0;
-  
+
   std::string prior_sensor_id = "";
+
+  std::vector<MergeSource> merge_sources_;
+  // Per secondary sensor, reused across calls.
+  std::map<std::string, sensor::TimedPointCloud> unsorted_overlaps_;
+  sensor::TimedPointCloudOriginData synchronized_data_;
 };
 
 }  // namespace mapping
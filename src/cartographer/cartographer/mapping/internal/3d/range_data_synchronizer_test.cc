@@ -0,0 +1,120 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/range_data_synchronizer.h"
+
+#include <algorithm>
+
+#include "cartographer/common/time.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace {
+
+const int kNumSamples = 11;
+
+// Creates a scan of 0.1 s ending at 'end_seconds' with points every 10 ms.
+sensor::TimedPointCloudData CreateFakeRangeData(const double end_seconds,
+                                                const float x) {
+  sensor::TimedPointCloudData result{
+      common::FromUniversal(static_cast<int64>(end_seconds * 1e7)),
+      Eigen::Vector3f(x, 0.f, 0.f), sensor::TimedPointCloud(kNumSamples)};
+  for (int i = 0; i < kNumSamples; ++i) {
+    result.ranges[i] = Eigen::Vector4f(x, 0.f, 0.f, -0.1f + 0.01f * i);
+  }
+  return result;
+}
+
+TEST(RangeDataSynchronizerTest, SinglePrimarySensor) {
+  RangeDataSynchronizer synchronizer({"primary"});
+  const sensor::TimedPointCloudOriginData& result =
+      synchronizer.AddRangeData("primary", CreateFakeRangeData(10., 1.f));
+  EXPECT_EQ(1, result.origins.size());
+  ASSERT_EQ(kNumSamples, result.ranges.size());
+  EXPECT_FLOAT_EQ(-0.1f, result.ranges.front().point_time[3]);
+  EXPECT_NEAR(0.f, result.ranges.back().point_time[3], 1e-5f);
+}
+
+TEST(RangeDataSynchronizerTest, MergesSecondarySensorsByTime) {
+  RangeDataSynchronizer synchronizer(
+      {"primary", "secondary_0", "secondary_1"});
+  EXPECT_TRUE(
+      synchronizer.AddRangeData("secondary_0", CreateFakeRangeData(9.955, 2.f))
+          .ranges.empty());
+  EXPECT_TRUE(
+      synchronizer.AddRangeData("secondary_1", CreateFakeRangeData(10., 3.f))
+          .ranges.empty());
+  const sensor::TimedPointCloudOriginData& result =
+      synchronizer.AddRangeData("primary", CreateFakeRangeData(10., 1.f));
+  ASSERT_EQ(3, result.origins.size());
+  // 'secondary_0' only overlaps with the last 6 points of the primary scan.
+  ASSERT_EQ(2 * kNumSamples + 6, result.ranges.size());
+  EXPECT_TRUE(std::is_sorted(
+      result.ranges.begin(), result.ranges.end(),
+      [](const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
+         const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
+        return a.point_time[3] < b.point_time[3];
+      }));
+  int num_points_per_origin[3] = {0, 0, 0};
+  for (const auto& range : result.ranges) {
+    ASSERT_LT(range.origin_index, 3);
+    // Points carry the x coordinate of their sensor's origin.
+    EXPECT_EQ(result.origins[range.origin_index].x(), range.point_time.x());
+    ++num_points_per_origin[range.origin_index];
+  }
+  EXPECT_EQ(kNumSamples, num_points_per_origin[0]);
+  EXPECT_EQ(6, num_points_per_origin[1]);
+  EXPECT_EQ(kNumSamples, num_points_per_origin[2]);
+  EXPECT_NEAR(-0.1f, result.ranges.front().point_time[3], 1e-5f);
+  EXPECT_NEAR(0.f, result.ranges.back().point_time[3], 1e-5f);
+}
+
+TEST(RangeDataSynchronizerTest, MergesUnsortedSensorsByTime) {
+  RangeDataSynchronizer synchronizer({"primary", "secondary"});
+  sensor::TimedPointCloudData secondary_data = CreateFakeRangeData(9.955, 2.f);
+  std::reverse(secondary_data.ranges.begin(), secondary_data.ranges.end());
+  EXPECT_TRUE(
+      synchronizer.AddRangeData("secondary", secondary_data).ranges.empty());
+  sensor::TimedPointCloudData primary_data = CreateFakeRangeData(10., 1.f);
+  std::reverse(primary_data.ranges.begin(), primary_data.ranges.end());
+  const sensor::TimedPointCloudOriginData& result =
+      synchronizer.AddRangeData("primary", primary_data);
+  ASSERT_EQ(2, result.origins.size());
+  // The primary scan still starts at its earliest point, so 'secondary' only
+  // overlaps with its last 6 points.
+  ASSERT_EQ(kNumSamples + 6, result.ranges.size());
+  EXPECT_TRUE(std::is_sorted(
+      result.ranges.begin(), result.ranges.end(),
+      [](const sensor::TimedPointCloudOriginData::RangeMeasurement& a,
+         const sensor::TimedPointCloudOriginData::RangeMeasurement& b) {
+        return a.point_time[3] < b.point_time[3];
+      }));
+  int num_points_per_origin[2] = {0, 0};
+  for (const auto& range : result.ranges) {
+    ASSERT_LT(range.origin_index, 2);
+    EXPECT_EQ(result.origins[range.origin_index].x(), range.point_time.x());
+    ++num_points_per_origin[range.origin_index];
+  }
+  EXPECT_EQ(kNumSamples, num_points_per_origin[0]);
+  EXPECT_EQ(6, num_points_per_origin[1]);
+  EXPECT_NEAR(-0.1f, result.ranges.front().point_time[3], 1e-5f);
+  EXPECT_NEAR(0.f, result.ranges.back().point_time[3], 1e-5f);
+}
+
+}  // namespace
+}  // namespace mapping
+}  // namespace cartographer
@@ -91,13 +91,15 @@ void CeresScanMatcher3D::Match(
   for (size_t i = 0; i != point_clouds_and_hybrid_grids.size(); ++i) {
     CHECK_GT(options_.occupied_space_weight(i), 0.);
     const sensor::PointCloud& point_cloud =
-        *point_clouds_and_hybrid_grids[i].first;
-    const HybridGrid& hybrid_grid = *point_clouds_and_hybrid_grids[i].second;
+        *point_clouds_and_hybrid_grids[i].point_cloud;
+    const HybridGrid& hybrid_grid =
+        *point_clouds_and_hybrid_grids[i].hybrid_grid;
     problem.AddResidualBlock(
-        OccupiedSpaceCostFunction3D::CreateAutoDiffCostFunction(
+        OccupiedSpaceCostFunction3D::CreateAnalyticCostFunction(
             options_.occupied_space_weight(i) /
                 std::sqrt(static_cast<double>(point_cloud.size())),
-            point_cloud, hybrid_grid),
+            point_cloud, hybrid_grid,
+            point_clouds_and_hybrid_grids[i].dense_window),
         nullptr /* loss function */, ceres_pose.translation(),
         ceres_pose.rotation());
   }
@@ -17,11 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_CERES_SCAN_MATCHER_3D_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_CERES_SCAN_MATCHER_3D_H_
 
-#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/proto/scan_matching/ceres_scan_matcher_options_3d.pb.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -34,8 +34,13 @@ namespace scan_matching {
 proto::CeresScanMatcherOptions3D CreateCeresScanMatcherOptions3D(
     common::LuaParameterDictionary* parameter_dictionary);
 
-using PointCloudAndHybridGridPointers =
-    std::pair<const sensor::PointCloud*, const HybridGrid*>;
+struct PointCloudAndHybridGridPointers {
+  const sensor::PointCloud* point_cloud;
+  const HybridGrid* hybrid_grid;
+  // Optional dense window of 'hybrid_grid' used for faster lookups, may be
+  // nullptr.
+  const DenseHybridGridWindow* dense_window;
+};
 
 // This scan matcher uses Ceres to align scans with an existing map.
 class CeresScanMatcher3D {
@@ -67,9 +67,10 @@ class CeresScanMatcher3DTest : public ::testing::Test {
     transform::Rigid3d pose;
 
     ceres::Solver::Summary summary;
-    ceres_scan_matcher_->Match(initial_pose.translation(), initial_pose,
-                               {{&point_cloud_, &hybrid_grid_}}, &pose,
-                               &summary);
+    ceres_scan_matcher_->Match(
+        initial_pose.translation(), initial_pose,
+        {{&point_cloud_, &hybrid_grid_, nullptr /* dense_window */}}, &pose,
+        &summary);
     EXPECT_NEAR(0., summary.final_cost, 1e-2) << summary.FullReport();
     EXPECT_THAT(pose, transform::IsNearly(expected_pose_, 3e-2));
   }
@@ -24,6 +24,8 @@
 #include "Eigen/Geometry"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/task.h"
 #include "cartographer/mapping/internal/3d/scan_matching/low_resolution_matcher.h"
 #include "cartographer/mapping/proto/scan_matching//fast_correlative_scan_matcher_options_3d.pb.h"
 #include "cartographer/transform/transform.h"
@@ -51,6 +53,8 @@ CreateFastCorrelativeScanMatcherOptions3D(
       parameter_dictionary->GetDouble("linear_z_search_window"));
   options.set_angular_search_window(
       parameter_dictionary->GetDouble("angular_search_window"));
+  options.set_num_threads(parameter_dictionary->GetInt("num_threads"));
+  CHECK_GE(options.num_threads(), 1);
   return options;
 }
 
@@ -76,6 +80,15 @@ PrecomputationGridStack3D::PrecomputationGridStack3D(
   }
 }
 
+size_t PrecomputationGridStack3D::MemoryUsage() const {
+  size_t memory_usage = sizeof(*this);
+  for (const PrecomputationGrid3D& precomputation_grid :
+       precomputation_grids_) {
+    memory_usage += precomputation_grid.MemoryUsage();
+  }
+  return memory_usage;
+}
+
 struct DiscreteScan3D {
   transform::Rigid3f pose;
   // Contains a vector of discretized scans for each 'depth'.
@@ -125,6 +138,14 @@ std::vector<std::pair<Eigen::VectorXf, float>> HistogramsAtAnglesFromNodes(
   return histograms_at_angles;
 }
 
+// Raises 'value' to 'new_value' if that is larger.
+void UpdateMax(const float new_value, std::atomic<float>* const value) {
+  float current_value = value->load();
+  while (new_value > current_value &&
+         !value->compare_exchange_weak(current_value, new_value)) {
+  }
+}
+
 }  // namespace
 
 FastCorrelativeScanMatcher3D::FastCorrelativeScanMatcher3D(
@@ -142,6 +163,10 @@ FastCorrelativeScanMatcher3D::FastCorrelativeScanMatcher3D(
 
 FastCorrelativeScanMatcher3D::~FastCorrelativeScanMatcher3D() {}
 
+size_t FastCorrelativeScanMatcher3D::MemoryUsage() const {
+  return sizeof(*this) + precomputation_grid_stack_->MemoryUsage();
+}
+
 std::unique_ptr<FastCorrelativeScanMatcher3D::Result>
 FastCorrelativeScanMatcher3D::Match(
     const transform::Rigid3d& global_node_pose,
@@ -158,7 +183,8 @@ FastCorrelativeScanMatcher3D::Match(
       global_submap_pose.cast<float>(),
       constant_data.high_resolution_point_cloud,
       constant_data.rotational_scan_matcher_histogram,
-      constant_data.gravity_alignment, min_score);
+      constant_data.gravity_alignment, min_score, 1 /* num_tasks */,
+      nullptr /* thread_pool */);
 }
 
 //wz
@@ -167,39 +193,70 @@ FastCorrelativeScanMatcher3D::MatchWith3DofInitial(
         const transform::Rigid3d& pose_in_submap_guess,
         const TrajectoryNode::Data& constant_data,
         float min_score) const{
-  const auto low_resolution_matcher = scan_matching::CreateLowResolutionMatcher(
-      low_resolution_hybrid_grid_, &constant_data.low_resolution_point_cloud);
-  const SearchParameters search_parameters{
-      common::RoundToInt(options_.linear_xy_search_window() / resolution_),
-      common::RoundToInt(options_.linear_z_search_window() / resolution_),
-      options_.angular_search_window(), &low_resolution_matcher};
-  
-  std::vector<DiscreteScan3D> discrete_scans = {};
-  discrete_scans.push_back(DiscretizeScan(
-    search_parameters, constant_data.high_resolution_point_cloud, 
-    pose_in_submap_guess.cast<float>(), options_.min_rotational_score()+0.01));
-
-  const std::vector<Candidate3D> lowest_resolution_candidates =
-      ComputeLowestResolutionCandidates(search_parameters, discrete_scans);
+  return std::move(MatchBatchWith3DofInitial(
+      {pose_in_submap_guess}, {&constant_data}, min_score).front());
+}
 
-  const Candidate3D best_candidate = BranchAndBound(
-      search_parameters, discrete_scans, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
-  if (best_candidate.score > min_score) {
-    return common::make_unique<Result>(Result{
-        best_candidate.score,
-        GetPoseFromCandidate(discrete_scans, best_candidate).cast<double>(),
-        discrete_scans[best_candidate.scan_index].rotational_score,
-        best_candidate.low_resolution_score});
+std::vector<std::unique_ptr<FastCorrelativeScanMatcher3D::Result>>
+FastCorrelativeScanMatcher3D::MatchBatchWith3DofInitial(
+    const std::vector<transform::Rigid3d>& poses_in_submap_guess,
+    const std::vector<const TrajectoryNode::Data*>& constant_data,
+    const float min_score) const {
+  CHECK_EQ(poses_in_submap_guess.size(), constant_data.size());
+  const int linear_xy_window_size =
+      common::RoundToInt(options_.linear_xy_search_window() / resolution_);
+  const int linear_z_window_size =
+      common::RoundToInt(options_.linear_z_search_window() / resolution_);
+  // Every node is searched with a single discrete scan over the same window,
+  // so the candidate offsets only depend on the options.
+  const std::vector<Candidate3D> lowest_resolution_offsets =
+      GenerateLowestResolutionCandidates(
+          SearchParameters{linear_xy_window_size, linear_z_window_size,
+                           options_.angular_search_window(),
+                           nullptr /* low_resolution_matcher */},
+          1 /* num_discrete_scans */);
+
+  std::vector<std::unique_ptr<Result>> results;
+  results.reserve(constant_data.size());
+  for (size_t i = 0; i != constant_data.size(); ++i) {
+    const auto low_resolution_matcher =
+        scan_matching::CreateLowResolutionMatcher(
+            low_resolution_hybrid_grid_,
+            &constant_data[i]->low_resolution_point_cloud);
+    const SearchParameters search_parameters{
+        linear_xy_window_size, linear_z_window_size,
+        options_.angular_search_window(), &low_resolution_matcher};
+    const std::vector<DiscreteScan3D> discrete_scans = {DiscretizeScan(
+        search_parameters, constant_data[i]->high_resolution_point_cloud,
+        poses_in_submap_guess[i].cast<float>(),
+        options_.min_rotational_score() + 0.01)};
+
+    std::vector<Candidate3D> lowest_resolution_candidates =
+        lowest_resolution_offsets;
+    ScoreCandidates(precomputation_grid_stack_->max_depth(), discrete_scans,
+                    &lowest_resolution_candidates);
+    const Candidate3D best_candidate = ParallelBranchAndBound(
+        search_parameters, discrete_scans, lowest_resolution_candidates,
+        min_score, 1 /* num_tasks */, nullptr /* thread_pool */);
+    if (best_candidate.score > min_score) {
+      results.push_back(common::make_unique<Result>(Result{
+          best_candidate.score,
+          GetPoseFromCandidate(discrete_scans, best_candidate).cast<double>(),
+          discrete_scans[best_candidate.scan_index].rotational_score,
+          best_candidate.low_resolution_score}));
+    } else {
+      results.push_back(nullptr);
+    }
   }
-  return nullptr;
+  return results;
 }
 
 std::unique_ptr<FastCorrelativeScanMatcher3D::Result>
 FastCorrelativeScanMatcher3D::MatchFullSubmap(
     const Eigen::Quaterniond& global_node_rotation,
     const Eigen::Quaterniond& global_submap_rotation,
-    const TrajectoryNode::Data& constant_data, const float min_score) const {
+    const TrajectoryNode::Data& constant_data, const float min_score,
+    common::ThreadPoolInterface* const thread_pool) const {
   float max_point_distance = 0.f;
   for (const Eigen::Vector3f& point :
        constant_data.high_resolution_point_cloud) {
@@ -218,7 +275,8 @@ FastCorrelativeScanMatcher3D::MatchFullSubmap(
       transform::Rigid3f::Rotation(global_submap_rotation.cast<float>()),
       constant_data.high_resolution_point_cloud,
       constant_data.rotational_scan_matcher_histogram,
-      constant_data.gravity_alignment, min_score);
+      constant_data.gravity_alignment, min_score, options_.num_threads(),
+      thread_pool);
 }
 
 std::unique_ptr<FastCorrelativeScanMatcher3D::Result>
@@ -228,7 +286,8 @@ FastCorrelativeScanMatcher3D::MatchWithSearchParameters(
     const transform::Rigid3f& global_submap_pose,
     const sensor::PointCloud& point_cloud,
     const Eigen::VectorXf& rotational_scan_matcher_histogram,
-    const Eigen::Quaterniond& gravity_alignment, const float min_score) const {
+    const Eigen::Quaterniond& gravity_alignment, const float min_score,
+    const int num_tasks, common::ThreadPoolInterface* const thread_pool) const {
   const std::vector<DiscreteScan3D> discrete_scans = GenerateDiscreteScans(
       search_parameters, point_cloud, rotational_scan_matcher_histogram,
       gravity_alignment, global_node_pose, global_submap_pose);
@@ -236,9 +295,9 @@ FastCorrelativeScanMatcher3D::MatchWithSearchParameters(
   const std::vector<Candidate3D> lowest_resolution_candidates =
       ComputeLowestResolutionCandidates(search_parameters, discrete_scans);
 
-  const Candidate3D best_candidate = BranchAndBound(
+  const Candidate3D best_candidate = ParallelBranchAndBound(
       search_parameters, discrete_scans, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
+      min_score, num_tasks, thread_pool);
   if (best_candidate.score > min_score) {
     return common::make_unique<Result>(Result{
         best_candidate.score,
@@ -257,10 +316,8 @@ DiscreteScan3D FastCorrelativeScanMatcher3D::DiscretizeScan(
   const PrecomputationGrid3D& original_grid =
       precomputation_grid_stack_->Get(0);
   std::vector<Eigen::Array3i> full_resolution_cell_indices;
-  for (const Eigen::Vector3f& point :
-       sensor::TransformPointCloud(point_cloud, pose)) {
-    full_resolution_cell_indices.push_back(original_grid.GetCellIndex(point));
-  }
+  original_grid.GetCellIndices(pose, point_cloud,
+                               &full_resolution_cell_indices);
   const int full_resolution_depth = std::min(options_.full_resolution_depth(),
                                              options_.branch_and_bound_depth());
   CHECK_GE(full_resolution_depth, 1);
@@ -386,6 +443,8 @@ void FastCorrelativeScanMatcher3D::ScoreCandidates(
     std::vector<Candidate3D>* const candidates) const {
   const int reduction_exponent =
       std::max(0, depth - options_.full_resolution_depth() + 1);
+  const PrecomputationGrid3D& precomputation_grid =
+      precomputation_grid_stack_->Get(depth);
   for (Candidate3D& candidate : *candidates) {
     int sum = 0;
     const DiscreteScan3D& discrete_scan = discrete_scans[candidate.scan_index];
@@ -393,14 +452,13 @@ void FastCorrelativeScanMatcher3D::ScoreCandidates(
                                 candidate.offset[1] >> reduction_exponent,
                                 candidate.offset[2] >> reduction_exponent);
     CHECK_LT(depth, discrete_scan.cell_indices_per_depth.size());
-    for (const Eigen::Array3i& cell_index :
-         discrete_scan.cell_indices_per_depth[depth]) {
-      const Eigen::Array3i proposed_cell_index = cell_index + offset;
-      sum += precomputation_grid_stack_->Get(depth).value(proposed_cell_index);
+    const std::vector<Eigen::Array3i>& cell_indices =
+        discrete_scan.cell_indices_per_depth[depth];
+    for (const Eigen::Array3i& cell_index : cell_indices) {
+      sum += precomputation_grid.value(cell_index + offset);
     }
     candidate.score = PrecomputationGrid3D::ToProbability(
-        sum /
-        static_cast<float>(discrete_scan.cell_indices_per_depth[depth].size()));
+        sum / static_cast<float>(cell_indices.size()));
   }
   std::sort(candidates->begin(), candidates->end(),
             std::greater<Candidate3D>());
@@ -426,14 +484,77 @@ transform::Rigid3f FastCorrelativeScanMatcher3D::GetPoseFromCandidate(
          discrete_scans[candidate.scan_index].pose;
 }
 
+Candidate3D FastCorrelativeScanMatcher3D::ParallelBranchAndBound(
+    const FastCorrelativeScanMatcher3D::SearchParameters& search_parameters,
+    const std::vector<DiscreteScan3D>& discrete_scans,
+    const std::vector<Candidate3D>& candidates, const float min_score,
+    int num_tasks, common::ThreadPoolInterface* const thread_pool) const {
+  if (thread_pool == nullptr) {
+    num_tasks = 1;
+  }
+  num_tasks =
+      std::max(1, std::min(num_tasks, static_cast<int>(candidates.size())));
+  std::atomic<float> best_score(min_score);
+  std::atomic<size_t> next_candidate_index(0);
+  std::vector<Candidate3D> best_candidates(num_tasks,
+                                           Candidate3D::Unsuccessful());
+  // The candidates are sorted by decreasing score, each task takes the next
+  // one which has not been searched yet.
+  const auto search = [&](const int task_index) {
+    for (size_t i = next_candidate_index++; i < candidates.size();
+         i = next_candidate_index++) {
+      if (candidates[i].score <= best_score.load()) {
+        break;
+      }
+      best_candidates[task_index] = std::max(
+          best_candidates[task_index],
+          BranchAndBound(search_parameters, discrete_scans, {candidates[i]},
+                         precomputation_grid_stack_->max_depth(), min_score,
+                         &best_score));
+    }
+  };
+
+  // Outlives this call in the pool tasks. These only use the state on this
+  // stack while they are counted as running.
+  struct PoolTasksState {
+    common::Mutex mutex;
+    bool finished GUARDED_BY(mutex) = false;
+    int num_running GUARDED_BY(mutex) = 0;
+  };
+  const auto pool_tasks_state = std::make_shared<PoolTasksState>();
+  for (int task_index = 1; task_index < num_tasks; ++task_index) {
+    auto task = common::make_unique<common::Task>();
+    task->SetWorkItem([pool_tasks_state, &search, task_index]() {
+      {
+        common::MutexLocker locker(&pool_tasks_state->mutex);
+        if (pool_tasks_state->finished) return;
+        ++pool_tasks_state->num_running;
+      }
+      search(task_index);
+      common::MutexLocker locker(&pool_tasks_state->mutex);
+      --pool_tasks_state->num_running;
+    });
+    thread_pool->Schedule(std::move(task));
+  }
+  search(0);
+  {
+    common::MutexLocker locker(&pool_tasks_state->mutex);
+    pool_tasks_state->finished = true;
+    locker.Await([&pool_tasks_state]() {
+      return pool_tasks_state->num_running == 0;
+    });
+  }
+  return *std::max_element(best_candidates.begin(), best_candidates.end());
+}
+
 Candidate3D FastCorrelativeScanMatcher3D::BranchAndBound(
     const FastCorrelativeScanMatcher3D::SearchParameters& search_parameters,
     const std::vector<DiscreteScan3D>& discrete_scans,
     const std::vector<Candidate3D>& candidates, const int candidate_depth,
-    float min_score) const {
+    float min_score, std::atomic<float>* const best_score) const {
   if (candidate_depth == 0) {
     for (const Candidate3D& candidate : candidates) {
-      if (candidate.score <= min_score) {
+      if (candidate.score <= std::max(min_score, best_score->load())) {
         // Return if the candidate is bad because the following candidate will
         // not have better score.
         return Candidate3D::Unsuccessful();
@@ -445,6 +566,7 @@ Candidate3D FastCorrelativeScanMatcher3D::BranchAndBound(
         // We found the best candidate that passes the matching function.
         Candidate3D best_candidate = candidate;
         best_candidate.low_resolution_score = low_resolution_score;
+        UpdateMax(best_candidate.score, best_score);
         return best_candidate;
       }
     }
@@ -456,7 +578,9 @@ Candidate3D FastCorrelativeScanMatcher3D::BranchAndBound(
   Candidate3D best_high_resolution_candidate = Candidate3D::Unsuccessful();
   best_high_resolution_candidate.score = min_score;
   for (const Candidate3D& candidate : candidates) {
-    if (candidate.score <= min_score) {
+    // Other threads may have found a better candidate in the meantime.
+    if (candidate.score <=
+        std::max(best_high_resolution_candidate.score, best_score->load())) {
       break;
     }
     std::vector<Candidate3D> higher_resolution_candidates;
@@ -486,7 +610,7 @@ Candidate3D FastCorrelativeScanMatcher3D::BranchAndBound(
         best_high_resolution_candidate,
         BranchAndBound(search_parameters, discrete_scans,
                        higher_resolution_candidates, candidate_depth - 1,
-                       best_high_resolution_candidate.score));
+                       best_high_resolution_candidate.score, best_score));
   }
   return best_high_resolution_candidate;
 }
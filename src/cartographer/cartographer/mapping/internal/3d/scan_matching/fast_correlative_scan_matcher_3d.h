@@ -20,11 +20,13 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_3D_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_3D_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/internal/2d/scan_matching/fast_correlative_scan_matcher_2d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/precomputation_grid_3d.h"
@@ -53,6 +55,9 @@ class PrecomputationGridStack3D {
 
   int max_depth() const { return precomputation_grids_.size() - 1; }
 
+  // Returns the approximate number of bytes used by the grids.
+  size_t MemoryUsage() const;
+
  private:
   std::vector<PrecomputationGrid3D> precomputation_grids_;
 };
@@ -83,6 +88,10 @@ class FastCorrelativeScanMatcher3D {
   FastCorrelativeScanMatcher3D& operator=(const FastCorrelativeScanMatcher3D&) =
       delete;
 
+  // Returns the approximate number of bytes used by this scan matcher, which
+  // is dominated by its precomputation grids.
+  size_t MemoryUsage() const;
+
   // Aligns the node with the given 'constant_data' within the 'hybrid_grid'
   // given 'global_node_pose' and 'global_submap_pose'. 'Result' is only
   // returned if a score above 'min_score' (excluding equality) is possible.
@@ -99,14 +108,26 @@ class FastCorrelativeScanMatcher3D {
         const TrajectoryNode::Data& constant_data,
         float min_score) const;
 
+  // Like 'MatchWith3DofInitial' for each of the nodes in 'constant_data' and
+  // the corresponding 'poses_in_submap_guess'. The lowest resolution search
+  // window is generated once for the whole batch. The result has an entry per
+  // node which is 'nullptr' if no score above 'min_score' is possible.
+  std::vector<std::unique_ptr<Result>> MatchBatchWith3DofInitial(
+      const std::vector<transform::Rigid3d>& poses_in_submap_guess,
+      const std::vector<const TrajectoryNode::Data*>& constant_data,
+      float min_score) const;
+
   // Aligns the node with the given 'constant_data' within the 'hybrid_grid'
   // given rotations which are expected to be approximately gravity aligned.
   // 'Result' is only returned if a score above 'min_score' (excluding equality)
-  // is possible.
+  // is possible. Only this search is split into 'options_.num_threads()'
+  // tasks, all but one of which run on 'thread_pool'. Without a
+  // 'thread_pool', it runs in the calling thread only.
   std::unique_ptr<Result> MatchFullSubmap(
       const Eigen::Quaterniond& global_node_rotation,
       const Eigen::Quaterniond& global_submap_rotation,
-      const TrajectoryNode::Data& constant_data, float min_score) const;
+      const TrajectoryNode::Data& constant_data, float min_score,
+      common::ThreadPoolInterface* thread_pool) const;
 
  private:
   struct SearchParameters {
@@ -122,7 +143,8 @@ class FastCorrelativeScanMatcher3D {
       const transform::Rigid3f& global_submap_pose,
       const sensor::PointCloud& point_cloud,
       const Eigen::VectorXf& rotational_scan_matcher_histogram,
-      const Eigen::Quaterniond& gravity_alignment, float min_score) const;
+      const Eigen::Quaterniond& gravity_alignment, float min_score,
+      int num_tasks, common::ThreadPoolInterface* thread_pool) const;
   DiscreteScan3D DiscretizeScan(const SearchParameters& search_parameters,
                                 const sensor::PointCloud& point_cloud,
                                 const transform::Rigid3f& pose,
@@ -142,10 +164,21 @@ class FastCorrelativeScanMatcher3D {
   std::vector<Candidate3D> ComputeLowestResolutionCandidates(
       const SearchParameters& search_parameters,
       const std::vector<DiscreteScan3D>& discrete_scans) const;
+  // Searches the lowest resolution 'candidates' in 'num_tasks' tasks which
+  // share the best score found so far for pruning. One task runs in the
+  // calling thread and the others on 'thread_pool', if given. Tasks which only
+  // start after the calling thread ran out of candidates are skipped, so this
+  // can be called from a task of a busy 'thread_pool'.
+  Candidate3D ParallelBranchAndBound(
+      const SearchParameters& search_parameters,
+      const std::vector<DiscreteScan3D>& discrete_scans,
+      const std::vector<Candidate3D>& candidates, float min_score,
+      int num_tasks, common::ThreadPoolInterface* thread_pool) const;
   Candidate3D BranchAndBound(const SearchParameters& search_parameters,
                              const std::vector<DiscreteScan3D>& discrete_scans,
                              const std::vector<Candidate3D>& candidates,
-                             int candidate_depth, float min_score) const;
+                             int candidate_depth, float min_score,
+                             std::atomic<float>* best_score) const;
   transform::Rigid3f GetPoseFromCandidate(
       const std::vector<DiscreteScan3D>& discrete_scans,
       const Candidate3D& candidate) const;
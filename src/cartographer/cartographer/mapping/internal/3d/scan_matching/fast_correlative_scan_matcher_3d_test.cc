@@ -23,6 +23,9 @@
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/task.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/3d/range_data_inserter_3d.h"
 #include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
@@ -61,7 +64,7 @@ class FastCorrelativeScanMatcher3DTest : public ::testing::Test {
 
   static proto::FastCorrelativeScanMatcherOptions3D
   CreateFastCorrelativeScanMatcher3DTestOptions3D(
-      const int branch_and_bound_depth) {
+      const int branch_and_bound_depth, const int num_threads = 1) {
     auto parameter_dictionary = common::MakeDictionary(
         "return {"
         "branch_and_bound_depth = " +
@@ -77,6 +80,9 @@ class FastCorrelativeScanMatcher3DTest : public ::testing::Test {
         "linear_xy_search_window = 0.8, "
         "linear_z_search_window = 0.8, "
         "angular_search_window = 0.3, "
+        "num_threads = " +
+        std::to_string(num_threads) +
+        ", "
         "}");
     return CreateFastCorrelativeScanMatcherOptions3D(
         parameter_dictionary.get());
@@ -163,6 +169,39 @@ TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPoseForMatch) {
   }
 }
 
+TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPosesForBatchMatch) {
+  const auto expected_pose = GetRandomPose();
+  std::unique_ptr<FastCorrelativeScanMatcher3D> fast_correlative_scan_matcher(
+      GetFastCorrelativeScanMatcher(options_, expected_pose));
+
+  const TrajectoryNode::Data constant_data = CreateConstantData(point_cloud_);
+  const TrajectoryNode::Data far_away_constant_data =
+      CreateConstantData({Eigen::Vector3f(42.f, 42.f, 42.f)});
+  const transform::Rigid3d rotation_guess = transform::Rigid3d::Rotation(
+      expected_pose.rotation().cast<double>());
+  const std::vector<
+      std::unique_ptr<FastCorrelativeScanMatcher3D::Result>>
+      results = fast_correlative_scan_matcher->MatchBatchWith3DofInitial(
+          {rotation_guess,
+           transform::Rigid3d::Translation(Eigen::Vector3d(0.1, -0.1, 0.)) *
+               rotation_guess,
+           rotation_guess},
+          {&constant_data, &constant_data, &far_away_constant_data},
+          kMinScore);
+  ASSERT_EQ(3, results.size());
+  for (int i = 0; i != 2; ++i) {
+    ASSERT_THAT(results[i], testing::NotNull());
+    EXPECT_LT(kMinScore, results[i]->score);
+    EXPECT_THAT(expected_pose, transform::IsNearly(
+                                   results[i]->pose_estimate.cast<float>(),
+                                   0.05f))
+        << "Actual: "
+        << transform::ToProto(results[i]->pose_estimate).DebugString()
+        << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+  }
+  EXPECT_THAT(results[2], testing::IsNull());
+}
+
 TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPoseForMatchFullSubmap) {
   const auto expected_pose = GetRandomPose();
 
@@ -172,7 +211,8 @@ TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPoseForMatchFullSubmap) {
   const std::unique_ptr<FastCorrelativeScanMatcher3D::Result> result =
       fast_correlative_scan_matcher->MatchFullSubmap(
           Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
-          CreateConstantData(point_cloud_), kMinScore);
+          CreateConstantData(point_cloud_), kMinScore,
+          nullptr /* thread_pool */);
   EXPECT_THAT(result, testing::NotNull());
   EXPECT_LT(kMinScore, result->score);
   EXPECT_LT(0.09f, result->rotational_score);
@@ -185,11 +225,72 @@ TEST_F(FastCorrelativeScanMatcher3DTest, CorrectPoseForMatchFullSubmap) {
   const std::unique_ptr<FastCorrelativeScanMatcher3D::Result>
       low_resolution_result = fast_correlative_scan_matcher->MatchFullSubmap(
           Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
-          CreateConstantData({Eigen::Vector3f(42.f, 42.f, 42.f)}), kMinScore);
+          CreateConstantData({Eigen::Vector3f(42.f, 42.f, 42.f)}), kMinScore,
+          nullptr /* thread_pool */);
   EXPECT_THAT(low_resolution_result, testing::IsNull())
       << low_resolution_result->low_resolution_score;
 }
 
+TEST_F(FastCorrelativeScanMatcher3DTest, MultiThreadedMatchFullSubmap) {
+  const auto expected_pose = GetRandomPose();
+  const proto::FastCorrelativeScanMatcherOptions3D options =
+      CreateFastCorrelativeScanMatcher3DTestOptions3D(6, 4 /* num_threads */);
+
+  std::unique_ptr<FastCorrelativeScanMatcher3D> fast_correlative_scan_matcher(
+      GetFastCorrelativeScanMatcher(options_, expected_pose));
+  const std::unique_ptr<FastCorrelativeScanMatcher3D::Result> expected_result =
+      fast_correlative_scan_matcher->MatchFullSubmap(
+          Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
+          CreateConstantData(point_cloud_), kMinScore,
+          nullptr /* thread_pool */);
+  ASSERT_THAT(expected_result, testing::NotNull());
+
+  common::ThreadPool thread_pool(3);
+  fast_correlative_scan_matcher =
+      GetFastCorrelativeScanMatcher(options, expected_pose);
+  const std::unique_ptr<FastCorrelativeScanMatcher3D::Result> result =
+      fast_correlative_scan_matcher->MatchFullSubmap(
+          Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
+          CreateConstantData(point_cloud_), kMinScore, &thread_pool);
+  ASSERT_THAT(result, testing::NotNull());
+  EXPECT_EQ(expected_result->score, result->score);
+  EXPECT_THAT(expected_pose,
+              transform::IsNearly(result->pose_estimate.cast<float>(), 0.05f))
+      << "Actual: " << transform::ToProto(result->pose_estimate).DebugString()
+      << "\nExpected: " << transform::ToProto(expected_pose).DebugString();
+}
+
+TEST_F(FastCorrelativeScanMatcher3DTest, MatchFullSubmapFromBusyThreadPool) {
+  const auto expected_pose = GetRandomPose();
+  const proto::FastCorrelativeScanMatcherOptions3D options =
+      CreateFastCorrelativeScanMatcher3DTestOptions3D(6, 4 /* num_threads */);
+  const std::unique_ptr<FastCorrelativeScanMatcher3D>
+      fast_correlative_scan_matcher(
+          GetFastCorrelativeScanMatcher(options, expected_pose));
+
+  // Every thread of the pool runs a match, so none is left for the tasks the
+  // matches schedule.
+  constexpr int kNumThreads = 2;
+  common::ThreadPool thread_pool(kNumThreads);
+  common::Mutex mutex;
+  int num_results = 0;
+  for (int i = 0; i != kNumThreads; ++i) {
+    auto task = common::make_unique<common::Task>();
+    task->SetWorkItem([&]() {
+      const std::unique_ptr<FastCorrelativeScanMatcher3D::Result> result =
+          fast_correlative_scan_matcher->MatchFullSubmap(
+              Eigen::Quaterniond::Identity(), Eigen::Quaterniond::Identity(),
+              CreateConstantData(point_cloud_), kMinScore, &thread_pool);
+      EXPECT_THAT(result, testing::NotNull());
+      common::MutexLocker locker(&mutex);
+      ++num_results;
+    });
+    thread_pool.Schedule(std::move(task));
+  }
+  common::MutexLocker locker(&mutex);
+  locker.Await([&num_results]() { return num_results == kNumThreads; });
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
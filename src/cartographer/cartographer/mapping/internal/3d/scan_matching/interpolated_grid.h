@@ -17,8 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 
+#include <array>
 #include <cmath>
 
+#include "Eigen/Core"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 
 namespace cartographer {
@@ -29,13 +32,26 @@ namespace scan_matching {
 // interpolation which interpolates the values and has vanishing derivative at
 // these points.
 //
-// This class is templated to work with the autodiff that Ceres provides.
-// For this reason, it is also important that the interpolation scheme be
-// continuously differentiable.
+// GetProbability() is templated to work with the autodiff that Ceres
+// provides, GetProbabilityAndGradient() computes the same value with its
+// analytic gradient. For this reason, it is also important that the
+// interpolation scheme be continuously differentiable. The 8 cells around a
+// point are read from the dense window if one is given and contains them,
+// otherwise from the HybridGrid.
 class InterpolatedGrid {
  public:
   explicit InterpolatedGrid(const HybridGrid& hybrid_grid)
-      : hybrid_grid_(hybrid_grid) {}
+      : InterpolatedGrid(hybrid_grid, nullptr /* dense_window */) {}
+
+  // Same as above, but reads cells inside 'dense_window', which must be a
+  // window of 'hybrid_grid', from its dense copy. 'dense_window' may be
+  // nullptr.
+  InterpolatedGrid(const HybridGrid& hybrid_grid,
+                   const DenseHybridGridWindow* const dense_window)
+      : hybrid_grid_(hybrid_grid), dense_window_(dense_window) {
+    CHECK(dense_window_ == nullptr ||
+          &dense_window_->hybrid_grid() == &hybrid_grid_);
+  }
 
   InterpolatedGrid(const InterpolatedGrid&) = delete;
   InterpolatedGrid& operator=(const InterpolatedGrid&) = delete;
@@ -52,23 +68,17 @@ class InterpolatedGrid {
     double x1, y1, z1, x2, y2, z2;
     ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
 
-    const Eigen::Array3i index1 =
-        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1));
-    const double q111 = hybrid_grid_.GetProbability(index1);
-    const double q112 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 0, 1));
-    const double q121 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 0));
-    const double q122 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 1));
-    const double q211 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 0));
-    const double q212 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 1));
-    const double q221 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 0));
-    const double q222 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 1));
+    std::array<float, 8> q;
+    GetCubeProbabilities(
+        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1)), q.data());
+    const double q111 = q[0];
+    const double q112 = q[4];
+    const double q121 = q[2];
+    const double q122 = q[6];
+    const double q211 = q[1];
+    const double q212 = q[5];
+    const double q221 = q[3];
+    const double q222 = q[7];
 
     const T normalized_x = (x - x1) / (x2 - x1);
     const T normalized_y = (y - y1) / (y2 - y1);
@@ -102,7 +112,72 @@ class InterpolatedGrid {
            q1;
   }
 
+  // Returns the same interpolated probability at (x, y, z) as
+  // GetProbability() and fills 'gradient' with its derivative with respect to
+  // (x, y, z). This is used by cost functions with analytic Jacobians.
+  double GetProbabilityAndGradient(const double x, const double y,
+                                   const double z,
+                                   Eigen::Vector3d* const gradient) const {
+    double x1, y1, z1, x2, y2, z2;
+    ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
+
+    std::array<float, 8> q;
+    GetCubeProbabilities(
+        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1)), q.data());
+
+    const double inverse_resolution = 1. / hybrid_grid_.resolution();
+    const double normalized_x = (x - x1) * inverse_resolution;
+    const double normalized_y = (y - y1) * inverse_resolution;
+    const double normalized_z = (z - z1) * inverse_resolution;
+
+    // Every interpolation step is A + (B - A) * h(t) with h(t) = 3t^2 - 2t^3,
+    // and h'(t) = 6t(1 - t). Derivatives are chained through all 7 steps.
+    const double hx = normalized_x * normalized_x * (3. - 2. * normalized_x);
+    const double hy = normalized_y * normalized_y * (3. - 2. * normalized_y);
+    const double hz = normalized_z * normalized_z * (3. - 2. * normalized_z);
+    const double dhx =
+        6. * normalized_x * (1. - normalized_x) * inverse_resolution;
+    const double dhy =
+        6. * normalized_y * (1. - normalized_y) * inverse_resolution;
+    const double dhz =
+        6. * normalized_z * (1. - normalized_z) * inverse_resolution;
+
+    // Interpolation in z. Indices of 'q' follow CubeOffset(), i.e. x changes
+    // fastest.
+    const double q11 = q[0] + (q[4] - q[0]) * hz;
+    const double q12 = q[2] + (q[6] - q[2]) * hz;
+    const double q21 = q[1] + (q[5] - q[1]) * hz;
+    const double q22 = q[3] + (q[7] - q[3]) * hz;
+    const double dq11_dz = (q[4] - q[0]) * dhz;
+    const double dq12_dz = (q[6] - q[2]) * dhz;
+    const double dq21_dz = (q[5] - q[1]) * dhz;
+    const double dq22_dz = (q[7] - q[3]) * dhz;
+
+    // Interpolation in y.
+    const double q1 = q11 + (q12 - q11) * hy;
+    const double q2 = q21 + (q22 - q21) * hy;
+    const double dq1_dy = (q12 - q11) * dhy;
+    const double dq2_dy = (q22 - q21) * dhy;
+    const double dq1_dz = dq11_dz + (dq12_dz - dq11_dz) * hy;
+    const double dq2_dz = dq21_dz + (dq22_dz - dq21_dz) * hy;
+
+    // Interpolation in x.
+    gradient->x() = (q2 - q1) * dhx;
+    gradient->y() = dq1_dy + (dq2_dy - dq1_dy) * hx;
+    gradient->z() = dq1_dz + (dq2_dz - dq1_dz) * hx;
+    return q1 + (q2 - q1) * hx;
+  }
+
  private:
+  void GetCubeProbabilities(const Eigen::Array3i& index,
+                            float* const probabilities) const {
+    if (dense_window_ != nullptr) {
+      dense_window_->GetCubeProbabilities(index, probabilities);
+    } else {
+      hybrid_grid_.GetCubeProbabilities(index, probabilities);
+    }
+  }
+
   template <typename T>
   void ComputeInterpolationDataPoints(const T& x, const T& y, const T& z,
                                       double* x1, double* y1, double* z1,
@@ -146,6 +221,7 @@ class InterpolatedGrid {
   }
 
   const HybridGrid& hybrid_grid_;
+  const DenseHybridGridWindow* const dense_window_;
 };
 
 }  // namespace scan_matching
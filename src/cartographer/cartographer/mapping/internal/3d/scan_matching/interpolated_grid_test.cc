@@ -83,6 +83,34 @@ TEST_F(InterpolatedGridTest, MonotonicBehaviorBetweenGridPointsInX) {
   }
 }
 
+TEST_F(InterpolatedGridTest, GradientMatchesFiniteDifferences) {
+  constexpr double kDelta = 1e-6;
+  const double kSampleStep = hybrid_grid_.resolution() / 7.;
+  for (double z = -0.5; z < 2.5; z += 3. * kSampleStep) {
+    for (double y = 1.5; y < 4.5; y += 3. * kSampleStep) {
+      for (double x = -7.5; x < -2.5; x += kSampleStep) {
+        Eigen::Vector3d gradient;
+        const double probability =
+            interpolated_grid_.GetProbabilityAndGradient(x, y, z, &gradient);
+        EXPECT_NEAR(interpolated_grid_.GetProbability(x, y, z), probability,
+                    1e-6);
+        EXPECT_NEAR((interpolated_grid_.GetProbability(x + kDelta, y, z) -
+                     interpolated_grid_.GetProbability(x - kDelta, y, z)) /
+                        (2. * kDelta),
+                    gradient.x(), 1e-3);
+        EXPECT_NEAR((interpolated_grid_.GetProbability(x, y + kDelta, z) -
+                     interpolated_grid_.GetProbability(x, y - kDelta, z)) /
+                        (2. * kDelta),
+                    gradient.y(), 1e-3);
+        EXPECT_NEAR((interpolated_grid_.GetProbability(x, y, z + kDelta) -
+                     interpolated_grid_.GetProbability(x, y, z - kDelta)) /
+                        (2. * kDelta),
+                    gradient.z(), 1e-3);
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_COST_FUNCTIONS_3D_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_COST_FUNCTIONS_3D_H_
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/mapping/internal/3d/scan_matching/rotated_point_jacobian_3d.h"
+#include "ceres/ceres.h"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+
+// Computes the distance of an edge 'point' transformed by 'translation' and
+// 'rotation' to the line through 'line_point' along the unit vector
+// 'line_direction'. The residual is direction x (transformed point - line
+// point), whose norm is the distance. Jacobians are computed analytically.
+class PointToLineCostFunction3D
+    : public ceres::SizedCostFunction<3 /* residuals */,
+                                      3 /* translation variables */,
+                                      4 /* rotation variables */> {
+ public:
+  PointToLineCostFunction3D(const double scaling_factor,
+                            const Eigen::Vector3d& point,
+                            const Eigen::Vector3d& line_point,
+                            const Eigen::Vector3d& line_direction)
+      : point_(point), line_point_(line_point) {
+    direction_cross_ << 0., -line_direction.z(), line_direction.y(),
+        line_direction.z(), 0., -line_direction.x(), -line_direction.y(),
+        line_direction.x(), 0.;
+    direction_cross_ *= scaling_factor;
+  }
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override {
+    const double* const translation = parameters[0];
+    const double* const rotation = parameters[1];
+    const Eigen::Quaterniond quaternion(rotation[0], rotation[1], rotation[2],
+                                        rotation[3]);
+    const Eigen::Vector3d transformed =
+        quaternion * point_ + Eigen::Map<const Eigen::Vector3d>(translation);
+    Eigen::Map<Eigen::Vector3d> residual(residuals);
+    residual = direction_cross_ * (transformed - line_point_);
+    if (jacobians != nullptr) {
+      if (jacobians[0] != nullptr) {
+        Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>
+            translation_jacobian(jacobians[0]);
+        translation_jacobian = direction_cross_;
+      }
+      if (jacobians[1] != nullptr) {
+        Eigen::Map<Eigen::Matrix<double, 3, 4, Eigen::RowMajor>>
+            rotation_jacobian(jacobians[1]);
+        rotation_jacobian =
+            direction_cross_ * RotatedPointJacobian(rotation, point_);
+      }
+    }
+    return true;
+  }
+
+ private:
+  const Eigen::Vector3d point_;
+  const Eigen::Vector3d line_point_;
+  // Cross product matrix of the line direction times the scaling factor.
+  Eigen::Matrix3d direction_cross_;
+};
+
+// Computes the signed distance of a planar 'point' transformed by
+// 'translation' and 'rotation' to the plane with unit 'normal' through
+// 'plane_point'. Jacobians are computed analytically.
+class PointToPlaneCostFunction3D
+    : public ceres::SizedCostFunction<1 /* residuals */,
+                                      3 /* translation variables */,
+                                      4 /* rotation variables */> {
+ public:
+  PointToPlaneCostFunction3D(const double scaling_factor,
+                             const Eigen::Vector3d& point,
+                             const Eigen::Vector3d& plane_point,
+                             const Eigen::Vector3d& normal)
+      : point_(point),
+        scaled_normal_(scaling_factor * normal),
+        scaled_offset_(-scaling_factor * normal.dot(plane_point)) {}
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override {
+    const double* const translation = parameters[0];
+    const double* const rotation = parameters[1];
+    const Eigen::Quaterniond quaternion(rotation[0], rotation[1], rotation[2],
+                                        rotation[3]);
+    const Eigen::Vector3d transformed =
+        quaternion * point_ + Eigen::Map<const Eigen::Vector3d>(translation);
+    residuals[0] = scaled_normal_.dot(transformed) + scaled_offset_;
+    if (jacobians != nullptr) {
+      if (jacobians[0] != nullptr) {
+        Eigen::Map<Eigen::Matrix<double, 1, 3>> translation_jacobian(
+            jacobians[0]);
+        translation_jacobian = scaled_normal_.transpose();
+      }
+      if (jacobians[1] != nullptr) {
+        Eigen::Map<Eigen::Matrix<double, 1, 4>> rotation_jacobian(
+            jacobians[1]);
+        rotation_jacobian =
+            scaled_normal_.transpose() * RotatedPointJacobian(rotation, point_);
+      }
+    }
+    return true;
+  }
+
+ private:
+  const Eigen::Vector3d point_;
+  const Eigen::Vector3d scaled_normal_;
+  const double scaled_offset_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_COST_FUNCTIONS_3D_H_
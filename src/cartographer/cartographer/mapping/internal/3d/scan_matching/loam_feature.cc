@@ -0,0 +1,311 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/scan_matching/loam_feature.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+
+namespace {
+
+// Range jump in meters between neighbouring points of a scan line above which
+// the farther side is considered to be occluded.
+constexpr float kOcclusionDistance = 0.3f;
+
+// Points whose range differs from both neighbours by more than this fraction
+// of their own range lie on surfaces nearly parallel to the laser beam.
+constexpr float kParallelBeamRatio = 0.02f;
+
+void TransformLoamFeaturePoints(const LoamFeaturePoints& points,
+                                const transform::Rigid3f& transform,
+                                LoamFeaturePoints* const result) {
+  result->Reserve(points.size());
+  for (size_t i = 0; i != points.size(); ++i) {
+    const Eigen::Vector3f point = transform * points.point(i);
+    result->Add(
+        Eigen::Vector4f(point.x(), point.y(), point.z(), points.time[i]));
+  }
+}
+
+}  // namespace
+
+proto::LoamFeatureExtractorOptions CreateLoamFeatureExtractorOptions(
+    common::LuaParameterDictionary* const parameter_dictionary) {
+  proto::LoamFeatureExtractorOptions options;
+  options.set_num_scan_lines(parameter_dictionary->GetInt("num_scan_lines"));
+  options.set_min_vertical_angle(
+      parameter_dictionary->GetDouble("min_vertical_angle"));
+  options.set_max_vertical_angle(
+      parameter_dictionary->GetDouble("max_vertical_angle"));
+  options.set_min_range(parameter_dictionary->GetDouble("min_range"));
+  options.set_num_sectors(parameter_dictionary->GetInt("num_sectors"));
+  options.set_max_edge_points_per_sector(
+      parameter_dictionary->GetNonNegativeInt("max_edge_points_per_sector"));
+  options.set_max_planar_points_per_sector(
+      parameter_dictionary->GetNonNegativeInt("max_planar_points_per_sector"));
+  options.set_edge_threshold(parameter_dictionary->GetDouble("edge_threshold"));
+  options.set_planar_threshold(
+      parameter_dictionary->GetDouble("planar_threshold"));
+  CHECK_GT(options.num_scan_lines(), 0);
+  CHECK_LT(options.min_vertical_angle(), options.max_vertical_angle());
+  CHECK_GT(options.num_sectors(), 0);
+  CHECK_LT(options.planar_threshold(), options.edge_threshold());
+  return options;
+}
+
+void LoamFeaturePoints::Clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  time.clear();
+}
+
+void LoamFeaturePoints::Reserve(const size_t size) {
+  x.reserve(size);
+  y.reserve(size);
+  z.reserve(size);
+  time.reserve(size);
+}
+
+void LoamFeaturePoints::Add(const Eigen::Vector4f& point_time) {
+  x.push_back(point_time[0]);
+  y.push_back(point_time[1]);
+  z.push_back(point_time[2]);
+  time.push_back(point_time[3]);
+}
+
+LoamFeatures TransformLoamFeatures(const LoamFeatures& features,
+                                   const transform::Rigid3f& transform) {
+  LoamFeatures result;
+  TransformLoamFeaturePoints(features.edge_points, transform,
+                             &result.edge_points);
+  TransformLoamFeaturePoints(features.planar_points, transform,
+                             &result.planar_points);
+  return result;
+}
+
+LoamFeatureExtractor::LoamFeatureExtractor(
+    const proto::LoamFeatureExtractorOptions& options)
+    : options_(options) {}
+
+int LoamFeatureExtractor::ScanLine(const Eigen::Vector3f& point) const {
+  const float elevation =
+      std::atan2(point.z(), std::sqrt(point.x() * point.x() +
+                                      point.y() * point.y()));
+  const float ratio =
+      (elevation - options_.min_vertical_angle()) /
+      (options_.max_vertical_angle() - options_.min_vertical_angle());
+  const int line =
+      common::RoundToInt(ratio * (options_.num_scan_lines() - 1));
+  if (line < 0 || line >= options_.num_scan_lines()) {
+    return -1;
+  }
+  return line;
+}
+
+void LoamFeatureExtractor::Extract(
+    const sensor::TimedPointCloudOriginData& range_data,
+    LoamFeatures* const features) {
+  features->edge_points.Clear();
+  features->planar_points.Clear();
+  SortByScanLine(range_data);
+  ComputeCurvature();
+  MarkUnreliablePoints();
+  const int num_lines = static_cast<int>(line_begin_.size()) - 1;
+  features->edge_points.Reserve(num_lines * options_.num_sectors() *
+                                options_.max_edge_points_per_sector());
+  features->planar_points.Reserve(num_lines * options_.num_sectors() *
+                                  options_.max_planar_points_per_sector());
+  for (int line = 0; line != num_lines; ++line) {
+    SelectFeatures(line_begin_[line], line_begin_[line + 1], features);
+  }
+}
+
+// Stable counting sort of the points by scan line. Lines of different origins
+// are kept apart, and the acquisition order is preserved within each line.
+void LoamFeatureExtractor::SortByScanLine(
+    const sensor::TimedPointCloudOriginData& range_data) {
+  const int num_scan_lines = options_.num_scan_lines();
+  const int num_lines = num_scan_lines * range_data.origins.size();
+  const float min_range_squared =
+      options_.min_range() * options_.min_range();
+  line_of_range_.resize(range_data.ranges.size());
+  line_begin_.assign(num_lines + 1, 0);
+  for (size_t i = 0; i != range_data.ranges.size(); ++i) {
+    const auto& range = range_data.ranges[i];
+    const Eigen::Vector3f point = range.point_time.head<3>() -
+                                  range_data.origins.at(range.origin_index);
+    int line = -1;
+    if (point.squaredNorm() >= min_range_squared) {
+      line = ScanLine(point);
+    }
+    if (line != -1) {
+      line += range.origin_index * num_scan_lines;
+      ++line_begin_[line + 1];
+    }
+    line_of_range_[i] = line;
+  }
+  std::partial_sum(line_begin_.begin(), line_begin_.end(),
+                   line_begin_.begin());
+
+  const int num_points = line_begin_.back();
+  points_.resize(num_points);
+  ranges_.resize(num_points);
+  // 'sorted_indices_' temporarily holds the insertion cursor of each line.
+  sorted_indices_.assign(line_begin_.begin(), line_begin_.end() - 1);
+  for (size_t i = 0; i != range_data.ranges.size(); ++i) {
+    const int line = line_of_range_[i];
+    if (line == -1) {
+      continue;
+    }
+    const auto& range = range_data.ranges[i];
+    const int index = sorted_indices_[line]++;
+    points_[index] = range.point_time;
+    ranges_[index] = (range.point_time.head<3>() -
+                      range_data.origins[range.origin_index])
+                         .norm();
+  }
+}
+
+void LoamFeatureExtractor::ComputeCurvature() {
+  curvature_.assign(ranges_.size(), 0.f);
+  const int num_lines = static_cast<int>(line_begin_.size()) - 1;
+  for (int line = 0; line != num_lines; ++line) {
+    const int begin = line_begin_[line] + kNeighbourhoodSize;
+    const int end = line_begin_[line + 1] - kNeighbourhoodSize;
+    for (int i = begin; i < end; ++i) {
+      float difference = -2.f * kNeighbourhoodSize * ranges_[i];
+      for (int j = 1; j <= kNeighbourhoodSize; ++j) {
+        difference += ranges_[i - j] + ranges_[i + j];
+      }
+      curvature_[i] = difference * difference;
+    }
+  }
+}
+
+void LoamFeatureExtractor::MarkUnreliablePoints() {
+  picked_.assign(ranges_.size(), 0);
+  const int num_lines = static_cast<int>(line_begin_.size()) - 1;
+  for (int line = 0; line != num_lines; ++line) {
+    const int begin = line_begin_[line];
+    const int end = line_begin_[line + 1];
+    // Points without a full neighbourhood have no valid curvature.
+    for (int i = begin; i < std::min(begin + kNeighbourhoodSize, end); ++i) {
+      picked_[i] = 1;
+    }
+    for (int i = std::max(begin, end - kNeighbourhoodSize); i < end; ++i) {
+      picked_[i] = 1;
+    }
+    for (int i = begin; i + 1 < end; ++i) {
+      const float difference = ranges_[i] - ranges_[i + 1];
+      if (difference > kOcclusionDistance) {
+        for (int j = std::max(begin, i - kNeighbourhoodSize); j <= i; ++j) {
+          picked_[j] = 1;
+        }
+      } else if (difference < -kOcclusionDistance) {
+        for (int j = i + 1; j <= std::min(end - 1, i + kNeighbourhoodSize + 1);
+             ++j) {
+          picked_[j] = 1;
+        }
+      }
+    }
+    for (int i = begin + 1; i + 1 < end; ++i) {
+      const float max_difference = kParallelBeamRatio * ranges_[i];
+      if (std::abs(ranges_[i - 1] - ranges_[i]) > max_difference &&
+          std::abs(ranges_[i + 1] - ranges_[i]) > max_difference) {
+        picked_[i] = 1;
+      }
+    }
+  }
+}
+
+void LoamFeatureExtractor::MarkNeighboursPicked(const int index,
+                                                const int begin,
+                                                const int end) {
+  for (int j = std::max(begin, index - kNeighbourhoodSize);
+       j <= std::min(end - 1, index + kNeighbourhoodSize); ++j) {
+    picked_[j] = 1;
+  }
+}
+
+void LoamFeatureExtractor::SelectFeatures(const int begin, const int end,
+                                          LoamFeatures* const features) {
+  const int first = begin + kNeighbourhoodSize;
+  const int last = end - kNeighbourhoodSize;
+  if (last <= first) {
+    return;
+  }
+  const int num_sectors = options_.num_sectors();
+  for (int sector = 0; sector != num_sectors; ++sector) {
+    const int sector_begin = first + (last - first) * sector / num_sectors;
+    const int sector_end = first + (last - first) * (sector + 1) / num_sectors;
+    if (sector_begin >= sector_end) {
+      continue;
+    }
+    sorted_indices_.resize(sector_end - sector_begin);
+    std::iota(sorted_indices_.begin(), sorted_indices_.end(), sector_begin);
+    std::sort(sorted_indices_.begin(), sorted_indices_.end(),
+              [this](const int a, const int b) {
+                return curvature_[a] < curvature_[b];
+              });
+
+    int num_edge_points = 0;
+    for (auto it = sorted_indices_.rbegin();
+         it != sorted_indices_.rend() &&
+         num_edge_points < options_.max_edge_points_per_sector();
+         ++it) {
+      const int index = *it;
+      if (curvature_[index] <= options_.edge_threshold()) {
+        break;
+      }
+      if (picked_[index]) {
+        continue;
+      }
+      features->edge_points.Add(points_[index]);
+      MarkNeighboursPicked(index, begin, end);
+      ++num_edge_points;
+    }
+
+    int num_planar_points = 0;
+    for (auto it = sorted_indices_.begin();
+         it != sorted_indices_.end() &&
+         num_planar_points < options_.max_planar_points_per_sector();
+         ++it) {
+      const int index = *it;
+      if (curvature_[index] >= options_.planar_threshold()) {
+        break;
+      }
+      if (picked_[index]) {
+        continue;
+      }
+      features->planar_points.Add(points_[index]);
+      MarkNeighboursPicked(index, begin, end);
+      ++num_planar_points;
+    }
+  }
+}
+
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
@@ -1,36 +1,101 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_FEATURE_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_FEATURE_H_
 
+#include <cstdint>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
-#include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/proto/scan_matching/loam_scan_matcher_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
+#include "cartographer/sensor/timed_point_cloud_data.h"
 #include "cartographer/transform/rigid_transform.h"
 
 namespace cartographer {
 namespace mapping {
 namespace scan_matching {
+
+proto::LoamFeatureExtractorOptions CreateLoamFeatureExtractorOptions(
+    common::LuaParameterDictionary* parameter_dictionary);
+
+// Feature points stored as structure of arrays so that the matcher can run
+// over contiguous coordinates. 'time' has the same meaning as the fourth entry
+// of a 'sensor::TimedPointCloud', i.e. it is relative to the last point.
+struct LoamFeaturePoints {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> time;
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+  Eigen::Vector3f point(const size_t i) const {
+    return Eigen::Vector3f(x[i], y[i], z[i]);
+  }
+
+  void Clear();
+  void Reserve(size_t size);
+  void Add(const Eigen::Vector4f& point_time);
+};
+
+struct LoamFeatures {
+  LoamFeaturePoints edge_points;
+  LoamFeaturePoints planar_points;
+};
+
+// Returns 'features' transformed by 'transform', keeping the relative times.
+LoamFeatures TransformLoamFeatures(const LoamFeatures& features,
+                                   const transform::Rigid3f& transform);
+
 /***************************************
  * 实现LOAM的特征提取
+ * Extracts sharp edge and flat planar points per scan line. The scan line of
+ * every point is recovered from its elevation angle, points of each line are
+ * kept in acquisition order, which for a spinning LiDAR is azimuth order.
 **************************************/
 class LoamFeatureExtractor {
  public:
-//   explicit LoamFeatureExtractor(const proto::LoamScanMatcherOptions& options);
-  LoamFeatureExtractor();
+  explicit LoamFeatureExtractor(
+      const proto::LoamFeatureExtractorOptions& options);
+
   LoamFeatureExtractor(const LoamFeatureExtractor&) = delete;
   LoamFeatureExtractor& operator=(const LoamFeatureExtractor&) = delete;
-  
-  
+
+  // Extracts features from 'range_data' into 'features'. Buffers of
+  // 'features' and the internal scratch buffers are reused across calls, so
+  // this is not thread-safe.
+  void Extract(const sensor::TimedPointCloudOriginData& range_data,
+               LoamFeatures* features);
+
+  // Returns the scan line of 'point' given relative to the sensor origin, or
+  // -1 if it is outside the vertical field of view.
+  int ScanLine(const Eigen::Vector3f& point) const;
 
  private:
+  // Number of neighbours on each side used to compute the curvature.
+  static constexpr int kNeighbourhoodSize = 5;
+
+  void SortByScanLine(const sensor::TimedPointCloudOriginData& range_data);
+  void ComputeCurvature();
+  void MarkUnreliablePoints();
+  void SelectFeatures(int begin, int end, LoamFeatures* features);
+  void MarkNeighboursPicked(int index, int begin, int end);
+
+  const proto::LoamFeatureExtractorOptions options_;
+
+  // Scratch buffers, indexed by the position in scan line order.
+  std::vector<int> line_of_range_;
+  std::vector<int> line_begin_;
+  std::vector<Eigen::Vector4f> points_;
+  std::vector<float> ranges_;
+  std::vector<float> curvature_;
+  std::vector<uint8_t> picked_;
+  std::vector<int> sorted_indices_;
 };
 
 }  // namespace scan_matching
 }  // namespace mapping
 }  // namespace cartographer
 
-#endif
\ No newline at end of file
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_FEATURE_H_
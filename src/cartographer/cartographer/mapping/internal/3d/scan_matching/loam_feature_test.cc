@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/scan_matching/loam_feature.h"
+
+#include <cmath>
+#include <memory>
+
+#include "Eigen/Core"
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/sensor/timed_point_cloud_data.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+namespace {
+
+constexpr int kNumScanLines = 16;
+constexpr int kNumColumns = 360;
+constexpr float kHalfRoomSize = 10.f;
+
+class LoamFeatureExtractorTest : public ::testing::Test {
+ protected:
+  LoamFeatureExtractorTest() {
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          num_scan_lines = 16,
+          min_vertical_angle = math.rad(-15.),
+          max_vertical_angle = math.rad(15.),
+          min_range = 1.,
+          num_sectors = 4,
+          max_edge_points_per_sector = 2,
+          max_planar_points_per_sector = 4,
+          edge_threshold = 1.,
+          planar_threshold = 0.1,
+        })text");
+    feature_extractor_ = common::make_unique<LoamFeatureExtractor>(
+        CreateLoamFeatureExtractorOptions(parameter_dictionary.get()));
+    GenerateRoomScan();
+  }
+
+  // Simulates one revolution of a 16 line LiDAR in the center of a square
+  // room, firing all lines of a column at once.
+  void GenerateRoomScan() {
+    range_data_.time = common::FromUniversal(0);
+    range_data_.origins = {Eigen::Vector3f::Zero()};
+    for (int column = 0; column != kNumColumns; ++column) {
+      const float azimuth = 2.f * M_PI * column / kNumColumns;
+      const Eigen::Vector2f direction(std::cos(azimuth), std::sin(azimuth));
+      const float horizontal_range =
+          kHalfRoomSize / direction.cwiseAbs().maxCoeff();
+      const float time = 0.1f * (column + 1 - kNumColumns) / kNumColumns;
+      for (int line = 0; line != kNumScanLines; ++line) {
+        const float elevation =
+            (-15.f + 30.f * line / (kNumScanLines - 1)) * M_PI / 180.f;
+        range_data_.ranges.push_back(
+            {Eigen::Vector4f(horizontal_range * direction.x(),
+                             horizontal_range * direction.y(),
+                             horizontal_range * std::tan(elevation), time),
+             0});
+      }
+    }
+  }
+
+  std::unique_ptr<LoamFeatureExtractor> feature_extractor_;
+  sensor::TimedPointCloudOriginData range_data_;
+};
+
+TEST_F(LoamFeatureExtractorTest, ScanLineFromElevation) {
+  EXPECT_EQ(0, feature_extractor_->ScanLine(
+                   Eigen::Vector3f(10.f, 0.f, 10.f * std::tan(-0.2618f))));
+  EXPECT_EQ(15, feature_extractor_->ScanLine(
+                    Eigen::Vector3f(0.f, 10.f, 10.f * std::tan(0.2618f))));
+  EXPECT_EQ(8, feature_extractor_->ScanLine(
+                   Eigen::Vector3f(5.f, 5.f, 7.071f * std::tan(0.0175f))));
+  EXPECT_EQ(-1, feature_extractor_->ScanLine(Eigen::Vector3f(1.f, 0.f, 1.f)));
+}
+
+TEST_F(LoamFeatureExtractorTest, EdgesAtCornersPlanesOnWalls) {
+  LoamFeatures features;
+  feature_extractor_->Extract(range_data_, &features);
+  ASSERT_FALSE(features.edge_points.empty());
+  ASSERT_FALSE(features.planar_points.empty());
+  EXPECT_LE(features.edge_points.size(), kNumScanLines * 4 * 2);
+  EXPECT_LE(features.planar_points.size(), kNumScanLines * 4 * 4);
+  for (size_t i = 0; i != features.edge_points.size(); ++i) {
+    const Eigen::Vector3f point = features.edge_points.point(i);
+    EXPECT_NEAR(kHalfRoomSize, std::abs(point.x()), 0.5f);
+    EXPECT_NEAR(kHalfRoomSize, std::abs(point.y()), 0.5f);
+  }
+  for (size_t i = 0; i != features.planar_points.size(); ++i) {
+    const Eigen::Vector3f point = features.planar_points.point(i);
+    EXPECT_NEAR(kHalfRoomSize,
+                std::max(std::abs(point.x()), std::abs(point.y())), 1e-3f);
+    EXPECT_GT(std::abs(std::abs(point.x()) - std::abs(point.y())), 1.f);
+    EXPECT_LE(features.planar_points.time[i], 0.f);
+  }
+}
+
+TEST_F(LoamFeatureExtractorTest, ReusesBuffers) {
+  LoamFeatures features;
+  feature_extractor_->Extract(range_data_, &features);
+  const size_t num_edge_points = features.edge_points.size();
+  const size_t num_planar_points = features.planar_points.size();
+  feature_extractor_->Extract(range_data_, &features);
+  EXPECT_EQ(num_edge_points, features.edge_points.size());
+  EXPECT_EQ(num_planar_points, features.planar_points.size());
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
@@ -1,14 +1,17 @@
-
 #include "cartographer/mapping/internal/3d/scan_matching/loam_scan_matcher.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "Eigen/Eigenvalues"
 #include "cartographer/common/ceres_solver_options.h"
 #include "cartographer/common/make_unique.h"
-#include "cartographer/mapping/internal/3d/rotation_parameterization.h"
-#include "cartographer/mapping/internal/3d/scan_matching/occupied_space_cost_function_3d.h"
+#include "cartographer/common/math.h"
+#include "cartographer/mapping/internal/3d/scan_matching/loam_cost_functions_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/rotation_delta_cost_functor_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/translation_delta_cost_functor_3d.h"
 #include "cartographer/mapping/internal/optimization/ceres_pose.h"
@@ -21,48 +24,293 @@ namespace cartographer {
 namespace mapping {
 namespace scan_matching {
 
+namespace {
+
+// Number of map points used to fit a line or a plane.
+constexpr int kNumNeighbours = 5;
+constexpr int kMaxNumNeighbours = 16;
+
+// A neighbourhood is linear if its largest eigenvalue is this many times
+// larger than the second largest.
+constexpr float kMinLinearity = 3.f;
+
+// A neighbourhood is planar if all its points are at most this many meters
+// away from the fitted plane.
+constexpr float kMaxPlaneDistance = 0.2f;
+
+// Computes mean and eigen decomposition of the covariance of 'points'.
+void FitNeighbourhood(
+    const std::vector<Eigen::Vector3f>& points, Eigen::Vector3f* mean,
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f>* eigen_solver) {
+  *mean = Eigen::Vector3f::Zero();
+  for (const Eigen::Vector3f& point : points) {
+    *mean += point;
+  }
+  *mean /= static_cast<float>(points.size());
+  Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+  for (const Eigen::Vector3f& point : points) {
+    const Eigen::Vector3f delta = point - *mean;
+    covariance += delta * delta.transpose();
+  }
+  eigen_solver->computeDirect(covariance / static_cast<float>(points.size()));
+}
+
+}  // namespace
+
 proto::LoamScanMatcherOptions CreateLoamScanMatcherOptions(
     common::LuaParameterDictionary* const parameter_dictionary) {
   proto::LoamScanMatcherOptions options;
-//   for (int i = 0;; ++i) {
-//     const std::string lua_identifier =
-//         "occupied_space_weight_" + std::to_string(i);
-//     if (!parameter_dictionary->HasKey(lua_identifier)) {
-//       break;
-//     }
-//     options.add_occupied_space_weight(
-//         parameter_dictionary->GetDouble(lua_identifier));
-//   }
-//   options.set_translation_weight(
-//       parameter_dictionary->GetDouble("translation_weight"));
-//   options.set_rotation_weight(
-//       parameter_dictionary->GetDouble("rotation_weight"));
-//   options.set_only_optimize_yaw(
-//       parameter_dictionary->GetBool("only_optimize_yaw"));
   *options.mutable_ceres_solver_options() =
       common::CreateCeresSolverOptionsProto(
           parameter_dictionary->GetDictionary("ceres_solver_options").get());
+  *options.mutable_feature_extractor_options() =
+      CreateLoamFeatureExtractorOptions(
+          parameter_dictionary->GetDictionary("feature_extractor").get());
+  options.set_edge_weight(parameter_dictionary->GetDouble("edge_weight"));
+  options.set_planar_weight(parameter_dictionary->GetDouble("planar_weight"));
+  options.set_translation_weight(
+      parameter_dictionary->GetDouble("translation_weight"));
+  options.set_rotation_weight(
+      parameter_dictionary->GetDouble("rotation_weight"));
+  options.set_num_correspondence_iterations(
+      parameter_dictionary->GetNonNegativeInt("num_correspondence_iterations"));
+  options.set_max_correspondence_distance(
+      parameter_dictionary->GetDouble("max_correspondence_distance"));
+  options.set_map_voxel_size(parameter_dictionary->GetDouble("map_voxel_size"));
+  options.set_max_points_per_voxel(
+      parameter_dictionary->GetNonNegativeInt("max_points_per_voxel"));
+  options.set_map_radius(parameter_dictionary->GetDouble("map_radius"));
+  CHECK_GE(options.edge_weight(), 0.);
+  CHECK_GE(options.planar_weight(), 0.);
+  CHECK_GT(options.max_correspondence_distance(), 0.);
+  CHECK_GT(options.map_voxel_size(), 0.);
+  CHECK_GT(options.max_points_per_voxel(), 0);
   return options;
 }
 
+LoamFeatureMap::LoamFeatureMap(const float voxel_size,
+                               const int max_points_per_voxel)
+    : voxel_size_(voxel_size), max_points_per_voxel_(max_points_per_voxel) {}
+
+Eigen::Array3i LoamFeatureMap::GetVoxelIndex(
+    const Eigen::Vector3f& point) const {
+  return (point.array() / voxel_size_).floor().cast<int>();
+}
+
+void LoamFeatureMap::Insert(const LoamFeaturePoints& points,
+                            const transform::Rigid3f& pose) {
+  const float min_squared_distance = common::Pow2(0.1f * voxel_size_);
+  for (size_t i = 0; i != points.size(); ++i) {
+    const Eigen::Vector3f point = pose * points.point(i);
+    Voxel& voxel = voxels_[GetVoxelIndex(point)];
+    if (std::any_of(voxel.points.begin(), voxel.points.end(),
+                    [&point, min_squared_distance](const Eigen::Vector3f& p) {
+                      return (p - point).squaredNorm() < min_squared_distance;
+                    })) {
+      continue;
+    }
+    if (static_cast<int>(voxel.points.size()) < max_points_per_voxel_) {
+      voxel.points.push_back(point);
+    } else {
+      voxel.points[voxel.next_to_replace] = point;
+      voxel.next_to_replace =
+          (voxel.next_to_replace + 1) % max_points_per_voxel_;
+    }
+  }
+}
+
+void LoamFeatureMap::RemoveVoxelsFarFrom(const Eigen::Vector3f& center,
+                                         const float radius) {
+  const float squared_radius = radius * radius;
+  for (auto it = voxels_.begin(); it != voxels_.end();) {
+    const Eigen::Vector3f voxel_center =
+        (it->first.cast<float>() + 0.5f).matrix() * voxel_size_;
+    if ((voxel_center - center).squaredNorm() > squared_radius) {
+      it = voxels_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void LoamFeatureMap::FindNearestNeighbours(
+    const Eigen::Vector3f& point, const float max_distance,
+    const int num_neighbours, std::vector<Eigen::Vector3f>* neighbours) const {
+  CHECK_LE(num_neighbours, kMaxNumNeighbours);
+  neighbours->resize(num_neighbours);
+  std::array<float, kMaxNumNeighbours> squared_distances;
+  const float max_squared_distance = max_distance * max_distance;
+  const Eigen::Vector3f offset = Eigen::Vector3f::Constant(max_distance);
+  const Eigen::Array3i min_index = GetVoxelIndex(point - offset);
+  const Eigen::Array3i max_index = GetVoxelIndex(point + offset);
+  int num_found = 0;
+  Eigen::Array3i index;
+  for (index.x() = min_index.x(); index.x() <= max_index.x(); ++index.x()) {
+    for (index.y() = min_index.y(); index.y() <= max_index.y(); ++index.y()) {
+      for (index.z() = min_index.z(); index.z() <= max_index.z();
+           ++index.z()) {
+        const auto it = voxels_.find(index);
+        if (it == voxels_.end()) {
+          continue;
+        }
+        for (const Eigen::Vector3f& candidate : it->second.points) {
+          const float squared_distance = (candidate - point).squaredNorm();
+          if (squared_distance > max_squared_distance ||
+              (num_found == num_neighbours &&
+               squared_distance >= squared_distances[num_found - 1])) {
+            continue;
+          }
+          // Insertion sort into the nearest neighbours found so far.
+          int i = num_found < num_neighbours ? num_found++ : num_found - 1;
+          while (i > 0 && squared_distances[i - 1] > squared_distance) {
+            squared_distances[i] = squared_distances[i - 1];
+            (*neighbours)[i] = (*neighbours)[i - 1];
+            --i;
+          }
+          squared_distances[i] = squared_distance;
+          (*neighbours)[i] = candidate;
+        }
+      }
+    }
+  }
+  neighbours->resize(num_found);
+}
+
 LoamScanMatcher::LoamScanMatcher(
     const proto::LoamScanMatcherOptions& options)
     : options_(options),
       ceres_solver_options_(
-          common::CreateCeresSolverOptions(options.ceres_solver_options())) {
+          common::CreateCeresSolverOptions(options.ceres_solver_options())),
+      edge_map_(options.map_voxel_size(), options.max_points_per_voxel()),
+      planar_map_(options.map_voxel_size(), options.max_points_per_voxel()) {
   ceres_solver_options_.linear_solver_type = ceres::DENSE_QR;
 }
 
 void LoamScanMatcher::Match(
     const Eigen::Vector3d& target_translation,
     const transform::Rigid3d& initial_pose_estimate,
-    const std::vector<PointCloudAndHybridGridPointers>&
-        point_clouds_and_hybrid_grids,
+    const LoamFeatures& features,
     transform::Rigid3d* const pose_estimate,
     ceres::Solver::Summary* const summary) {
-  
+  *pose_estimate = initial_pose_estimate;
+  if (edge_map_.empty() && planar_map_.empty()) {
+    return;
+  }
+  for (int i = 0; i != options_.num_correspondence_iterations(); ++i) {
+    ceres::Problem problem;
+    optimization::CeresPose ceres_pose(
+        *pose_estimate, nullptr /* translation_parameterization */,
+        common::make_unique<ceres::QuaternionParameterization>(), &problem);
+    AddEdgeResiduals(features.edge_points, *pose_estimate,
+                     ceres_pose.translation(), ceres_pose.rotation(), &problem);
+    AddPlanarResiduals(features.planar_points, *pose_estimate,
+                       ceres_pose.translation(), ceres_pose.rotation(),
+                       &problem);
+    if (problem.NumResidualBlocks() == 0) {
+      LOG(WARNING) << "No LOAM feature correspondences found.";
+      return;
+    }
+    if (options_.translation_weight() > 0.) {
+      problem.AddResidualBlock(
+          TranslationDeltaCostFunctor3D::CreateAutoDiffCostFunction(
+              options_.translation_weight(), target_translation),
+          nullptr /* loss function */, ceres_pose.translation());
+    }
+    if (options_.rotation_weight() > 0.) {
+      problem.AddResidualBlock(
+          RotationDeltaCostFunctor3D::CreateAutoDiffCostFunction(
+              options_.rotation_weight(), initial_pose_estimate.rotation()),
+          nullptr /* loss function */, ceres_pose.rotation());
+    }
+    ceres::Solve(ceres_solver_options_, &problem, summary);
+    *pose_estimate = ceres_pose.ToRigid();
+  }
 }
 
+void LoamScanMatcher::InsertFeatures(const LoamFeatures& features,
+                                     const transform::Rigid3d& pose) {
+  const transform::Rigid3f pose_in_local = pose.cast<float>();
+  edge_map_.Insert(features.edge_points, pose_in_local);
+  planar_map_.Insert(features.planar_points, pose_in_local);
+  edge_map_.RemoveVoxelsFarFrom(pose_in_local.translation(),
+                                options_.map_radius());
+  planar_map_.RemoveVoxelsFarFrom(pose_in_local.translation(),
+                                  options_.map_radius());
 }
+
+void LoamScanMatcher::AddEdgeResiduals(const LoamFeaturePoints& edge_points,
+                                       const transform::Rigid3d& pose,
+                                       double* const translation,
+                                       double* const rotation,
+                                       ceres::Problem* const problem) {
+  if (edge_points.empty() || options_.edge_weight() <= 0.) {
+    return;
+  }
+  const transform::Rigid3f pose_in_local = pose.cast<float>();
+  const double scaling_factor =
+      options_.edge_weight() /
+      std::sqrt(static_cast<double>(edge_points.size()));
+  Eigen::Vector3f mean;
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigen_solver;
+  for (size_t i = 0; i != edge_points.size(); ++i) {
+    const Eigen::Vector3f point = edge_points.point(i);
+    edge_map_.FindNearestNeighbours(pose_in_local * point,
+                                    options_.max_correspondence_distance(),
+                                    kNumNeighbours, &neighbours_);
+    if (static_cast<int>(neighbours_.size()) < kNumNeighbours) {
+      continue;
+    }
+    FitNeighbourhood(neighbours_, &mean, &eigen_solver);
+    const Eigen::Vector3f& eigenvalues = eigen_solver.eigenvalues();
+    if (eigenvalues[2] < kMinLinearity * eigenvalues[1]) {
+      continue;
+    }
+    problem->AddResidualBlock(
+        new PointToLineCostFunction3D(
+            scaling_factor, point.cast<double>(), mean.cast<double>(),
+            eigen_solver.eigenvectors().col(2).cast<double>()),
+        nullptr /* loss function */, translation, rotation);
+  }
 }
-}
\ No newline at end of file
+
+void LoamScanMatcher::AddPlanarResiduals(
+    const LoamFeaturePoints& planar_points, const transform::Rigid3d& pose,
+    double* const translation, double* const rotation,
+    ceres::Problem* const problem) {
+  if (planar_points.empty() || options_.planar_weight() <= 0.) {
+    return;
+  }
+  const transform::Rigid3f pose_in_local = pose.cast<float>();
+  const double scaling_factor =
+      options_.planar_weight() /
+      std::sqrt(static_cast<double>(planar_points.size()));
+  Eigen::Vector3f mean;
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigen_solver;
+  for (size_t i = 0; i != planar_points.size(); ++i) {
+    const Eigen::Vector3f point = planar_points.point(i);
+    planar_map_.FindNearestNeighbours(pose_in_local * point,
+                                      options_.max_correspondence_distance(),
+                                      kNumNeighbours, &neighbours_);
+    if (static_cast<int>(neighbours_.size()) < kNumNeighbours) {
+      continue;
+    }
+    FitNeighbourhood(neighbours_, &mean, &eigen_solver);
+    const Eigen::Vector3f normal = eigen_solver.eigenvectors().col(0);
+    if (std::any_of(neighbours_.begin(), neighbours_.end(),
+                    [&normal, &mean](const Eigen::Vector3f& neighbour) {
+                      return std::abs(normal.dot(neighbour - mean)) >
+                             kMaxPlaneDistance;
+                    })) {
+      continue;
+    }
+    problem->AddResidualBlock(
+        new PointToPlaneCostFunction3D(scaling_factor, point.cast<double>(),
+                                       mean.cast<double>(),
+                                       normal.cast<double>()),
+        nullptr /* loss function */, translation, rotation);
+  }
+}
+
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
@@ -1,15 +1,17 @@
 #ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_SCAN_MATCHER_3D_H_
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_LOAM_SCAN_MATCHER_3D_H_
 
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
-#include "cartographer/mapping/3d/hybrid_grid.h"
+#include "cartographer/mapping/internal/3d/scan_matching/loam_feature.h"
 #include "cartographer/mapping/proto/scan_matching/loam_scan_matcher_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/rigid_transform.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping {
@@ -20,9 +22,65 @@ namespace scan_matching {
 
 proto::LoamScanMatcherOptions CreateLoamScanMatcherOptions(
     common::LuaParameterDictionary* parameter_dictionary);
-using PointCloudAndHybridGridPointers =
-    std::pair<const sensor::PointCloud*, const HybridGrid*>;
-// This scan matcher uses Ceres to align scans with an existing map.
+
+// Sparse point map hashed by voxel used as the local map of edge or planar
+// features. Each voxel keeps a bounded number of points.
+class LoamFeatureMap {
+ public:
+  LoamFeatureMap(float voxel_size, int max_points_per_voxel);
+
+  LoamFeatureMap(const LoamFeatureMap&) = delete;
+  LoamFeatureMap& operator=(const LoamFeatureMap&) = delete;
+
+  // Inserts 'points' transformed by 'pose'. Points closer than a tenth of the
+  // voxel size to a point already in the map are skipped, the oldest point is
+  // replaced once a voxel is full.
+  void Insert(const LoamFeaturePoints& points, const transform::Rigid3f& pose);
+
+  // Drops all voxels whose center is farther than 'radius' from 'center'.
+  void RemoveVoxelsFarFrom(const Eigen::Vector3f& center, float radius);
+
+  // Fills 'neighbours' with up to 'num_neighbours' map points closest to
+  // 'point' which are at most 'max_distance' away, nearest first.
+  void FindNearestNeighbours(const Eigen::Vector3f& point, float max_distance,
+                             int num_neighbours,
+                             std::vector<Eigen::Vector3f>* neighbours) const;
+
+  bool empty() const { return voxels_.empty(); }
+  size_t num_voxels() const { return voxels_.size(); }
+
+ private:
+  struct Voxel {
+    std::vector<Eigen::Vector3f> points;
+    // Index of the point to be replaced next once the voxel is full.
+    int next_to_replace = 0;
+  };
+
+  struct VoxelIndexHash {
+    size_t operator()(const Eigen::Array3i& index) const {
+      return (static_cast<size_t>(index.x()) * 73856093) ^
+             (static_cast<size_t>(index.y()) * 19349669) ^
+             (static_cast<size_t>(index.z()) * 83492791);
+    }
+  };
+
+  struct VoxelIndexEqual {
+    bool operator()(const Eigen::Array3i& lhs,
+                    const Eigen::Array3i& rhs) const {
+      return (lhs == rhs).all();
+    }
+  };
+
+  Eigen::Array3i GetVoxelIndex(const Eigen::Vector3f& point) const;
+
+  const float voxel_size_;
+  const int max_points_per_voxel_;
+  std::unordered_map<Eigen::Array3i, Voxel, VoxelIndexHash, VoxelIndexEqual>
+      voxels_;
+};
+
+// Registers LOAM edge and planar features against a local feature map using
+// point-to-line and point-to-plane residuals with analytic Jacobians.
 class LoamScanMatcher {
  public:
   explicit LoamScanMatcher(const proto::LoamScanMatcherOptions& options);
@@ -30,23 +88,40 @@ class LoamScanMatcher {
   LoamScanMatcher(const LoamScanMatcher&) = delete;
   LoamScanMatcher& operator=(const LoamScanMatcher&) = delete;
 
-  // Aligns 'point_clouds' within the 'hybrid_grids' given an
-  // 'initial_pose_estimate' and returns a 'pose_estimate' and the solver
-  // 'summary'.
+  // Aligns 'features' given in the tracking frame with the local feature map
+  // given an 'initial_pose_estimate' in the local frame and returns a
+  // 'pose_estimate' and the solver 'summary' of the last solve. If the map is
+  // still empty, the initial pose estimate is returned.
   void Match(const Eigen::Vector3d& target_translation,
              const transform::Rigid3d& initial_pose_estimate,
-             const std::vector<PointCloudAndHybridGridPointers>&
-                 point_clouds_and_hybrid_grids,
+             const LoamFeatures& features,
              transform::Rigid3d* pose_estimate,
              ceres::Solver::Summary* summary);
-  
+
+  // Inserts 'features' given in the tracking frame at 'pose' into the local
+  // feature map.
+  void InsertFeatures(const LoamFeatures& features,
+                      const transform::Rigid3d& pose);
+
  private:
+  // Adds point-to-line residuals for all 'edge_points' which have a linear
+  // neighbourhood in the map when transformed by 'pose'.
+  void AddEdgeResiduals(const LoamFeaturePoints& edge_points,
+                        const transform::Rigid3d& pose, double* translation,
+                        double* rotation, ceres::Problem* problem);
+  void AddPlanarResiduals(const LoamFeaturePoints& planar_points,
+                          const transform::Rigid3d& pose, double* translation,
+                          double* rotation, ceres::Problem* problem);
+
   const proto::LoamScanMatcherOptions options_;
   ceres::Solver::Options ceres_solver_options_;
+  LoamFeatureMap edge_map_;
+  LoamFeatureMap planar_map_;
+  std::vector<Eigen::Vector3f> neighbours_;
 };
 
 }  // namespace scan_matching
 }  // namespace mapping
 }  // namespace cartographer
 
-#endif
\ No newline at end of file
+#endif
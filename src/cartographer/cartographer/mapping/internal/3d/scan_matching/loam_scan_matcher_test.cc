@@ -0,0 +1,239 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/scan_matching/loam_scan_matcher.h"
+
+#include <memory>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+namespace {
+
+constexpr float kHalfRoomSize = 10.f;
+constexpr float kFloorHeight = -2.f;
+constexpr float kCeilingHeight = 3.f;
+
+// Adds 'point' transformed into the tracking frame of 'pose'.
+void AddPoint(const transform::Rigid3f& pose, const Eigen::Vector3f& point,
+              LoamFeaturePoints* points) {
+  const Eigen::Vector3f point_in_tracking = pose.inverse() * point;
+  points->Add(Eigen::Vector4f(point_in_tracking.x(), point_in_tracking.y(),
+                              point_in_tracking.z(), 0.f));
+}
+
+// Samples the floor and the walls of a box shaped room as planar features and
+// its vertical corners as edge features, seen from 'pose'. 'offset' shifts the
+// samples so that different calls do not produce identical points.
+LoamFeatures GenerateRoomFeatures(const transform::Rigid3f& pose,
+                                  const float spacing, const float offset) {
+  LoamFeatures features;
+  const float limit = kHalfRoomSize - 0.1f;
+  for (float a = -limit + offset; a < limit; a += spacing) {
+    for (float b = -limit + offset; b < limit; b += spacing) {
+      AddPoint(pose, Eigen::Vector3f(a, b, kFloorHeight),
+               &features.planar_points);
+    }
+    for (float z = kFloorHeight + 0.1f + offset; z < kCeilingHeight - 0.1f;
+         z += spacing) {
+      AddPoint(pose, Eigen::Vector3f(a, kHalfRoomSize, z),
+               &features.planar_points);
+      AddPoint(pose, Eigen::Vector3f(a, -kHalfRoomSize, z),
+               &features.planar_points);
+      AddPoint(pose, Eigen::Vector3f(kHalfRoomSize, a, z),
+               &features.planar_points);
+      AddPoint(pose, Eigen::Vector3f(-kHalfRoomSize, a, z),
+               &features.planar_points);
+    }
+  }
+  for (float z = kFloorHeight + offset; z < kCeilingHeight; z += 0.2f) {
+    for (const float x : {-kHalfRoomSize, kHalfRoomSize}) {
+      for (const float y : {-kHalfRoomSize, kHalfRoomSize}) {
+        AddPoint(pose, Eigen::Vector3f(x, y, z), &features.edge_points);
+      }
+    }
+  }
+  return features;
+}
+
+class LoamScanMatcherTest : public ::testing::Test {
+ protected:
+  LoamScanMatcherTest()
+      : expected_pose_(Eigen::Vector3d(1., -0.5, 0.2),
+                       Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ())) {
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          edge_weight = 1.,
+          planar_weight = 1.,
+          translation_weight = 0.01,
+          rotation_weight = 0.01,
+          num_correspondence_iterations = 5,
+          max_correspondence_distance = 1.,
+          map_voxel_size = 1.,
+          max_points_per_voxel = 20,
+          map_radius = 50.,
+          feature_extractor = {
+            num_scan_lines = 16,
+            min_vertical_angle = math.rad(-15.),
+            max_vertical_angle = math.rad(15.),
+            min_range = 1.,
+            num_sectors = 6,
+            max_edge_points_per_sector = 4,
+            max_planar_points_per_sector = 20,
+            edge_threshold = 1.,
+            planar_threshold = 0.1,
+          },
+          ceres_solver_options = {
+            use_nonmonotonic_steps = false,
+            max_num_iterations = 10,
+            num_threads = 1,
+          },
+        })text");
+    loam_scan_matcher_ = common::make_unique<LoamScanMatcher>(
+        CreateLoamScanMatcherOptions(parameter_dictionary.get()));
+    loam_scan_matcher_->InsertFeatures(
+        GenerateRoomFeatures(transform::Rigid3f::Identity(), 0.25f, 0.f),
+        transform::Rigid3d::Identity());
+    features_ =
+        GenerateRoomFeatures(expected_pose_.cast<float>(), 0.5f, 0.1f);
+  }
+
+  void TestFromInitialPose(const transform::Rigid3d& initial_pose) {
+    transform::Rigid3d pose;
+    ceres::Solver::Summary summary;
+    loam_scan_matcher_->Match(initial_pose.translation(), initial_pose,
+                              features_, &pose, &summary);
+    EXPECT_THAT(pose, transform::IsNearly(expected_pose_, 2e-2));
+  }
+
+  transform::Rigid3d expected_pose_;
+  LoamFeatures features_;
+  std::unique_ptr<LoamScanMatcher> loam_scan_matcher_;
+};
+
+TEST(LoamFeatureMapTest, FindsNearestNeighbours) {
+  LoamFeatureMap map(1.f /* voxel_size */, 4 /* max_points_per_voxel */);
+  LoamFeaturePoints points;
+  for (const float x : {0.2f, 0.4f, 0.9f, 1.3f, 2.5f}) {
+    points.Add(Eigen::Vector4f(x, 0.f, 0.f, 0.f));
+  }
+  map.Insert(points, transform::Rigid3f::Identity());
+  EXPECT_EQ(3, map.num_voxels());
+
+  std::vector<Eigen::Vector3f> neighbours;
+  map.FindNearestNeighbours(Eigen::Vector3f(1.f, 0.f, 0.f), 1.f, 3,
+                            &neighbours);
+  ASSERT_EQ(3, neighbours.size());
+  EXPECT_FLOAT_EQ(0.9f, neighbours[0].x());
+  EXPECT_FLOAT_EQ(1.3f, neighbours[1].x());
+  EXPECT_FLOAT_EQ(0.4f, neighbours[2].x());
+
+  map.FindNearestNeighbours(Eigen::Vector3f(2.f, 0.f, 0.f), 0.6f, 3,
+                            &neighbours);
+  ASSERT_EQ(1, neighbours.size());
+  EXPECT_FLOAT_EQ(2.5f, neighbours[0].x());
+
+  map.RemoveVoxelsFarFrom(Eigen::Vector3f::Zero(), 1.f);
+  EXPECT_EQ(1, map.num_voxels());
+}
+
+TEST(LoamFeatureMapTest, BoundsPointsPerVoxel) {
+  LoamFeatureMap map(1.f /* voxel_size */, 2 /* max_points_per_voxel */);
+  LoamFeaturePoints points;
+  for (const float x : {0.1f, 0.3f, 0.5f, 0.7f, 0.72f}) {
+    points.Add(Eigen::Vector4f(x, 0.5f, 0.5f, 0.f));
+  }
+  map.Insert(points, transform::Rigid3f::Identity());
+  std::vector<Eigen::Vector3f> neighbours;
+  map.FindNearestNeighbours(Eigen::Vector3f(0.5f, 0.5f, 0.5f), 1.f, 4,
+                            &neighbours);
+  ASSERT_EQ(2, neighbours.size());
+  EXPECT_FLOAT_EQ(0.5f, neighbours[0].x());
+  EXPECT_FLOAT_EQ(0.7f, neighbours[1].x());
+}
+
+TEST_F(LoamScanMatcherTest, PerfectEstimate) {
+  TestFromInitialPose(expected_pose_);
+}
+
+TEST_F(LoamScanMatcherTest, AlongXYZ) {
+  TestFromInitialPose(transform::Rigid3d(
+      expected_pose_.translation() + Eigen::Vector3d(0.2, -0.2, 0.15),
+      expected_pose_.rotation()));
+}
+
+TEST_F(LoamScanMatcherTest, FullPoseCorrection) {
+  TestFromInitialPose(transform::Rigid3d(
+      expected_pose_.translation() + Eigen::Vector3d(-0.15, 0.1, -0.1),
+      expected_pose_.rotation() *
+          Eigen::AngleAxisd(0.05, Eigen::Vector3d(1., 1., 0.).normalized()) *
+          Eigen::AngleAxisd(-0.05, Eigen::Vector3d::UnitZ())));
+}
+
+TEST(LoamScanMatcherEmptyMapTest, ReturnsInitialPose) {
+  auto parameter_dictionary = common::MakeDictionary(R"text(
+      return {
+        edge_weight = 1.,
+        planar_weight = 1.,
+        translation_weight = 0.,
+        rotation_weight = 0.,
+        num_correspondence_iterations = 1,
+        max_correspondence_distance = 1.,
+        map_voxel_size = 1.,
+        max_points_per_voxel = 20,
+        map_radius = 50.,
+        feature_extractor = {
+          num_scan_lines = 16,
+          min_vertical_angle = math.rad(-15.),
+          max_vertical_angle = math.rad(15.),
+          min_range = 1.,
+          num_sectors = 6,
+          max_edge_points_per_sector = 4,
+          max_planar_points_per_sector = 20,
+          edge_threshold = 1.,
+          planar_threshold = 0.1,
+        },
+        ceres_solver_options = {
+          use_nonmonotonic_steps = false,
+          max_num_iterations = 10,
+          num_threads = 1,
+        },
+      })text");
+  LoamScanMatcher loam_scan_matcher(
+      CreateLoamScanMatcherOptions(parameter_dictionary.get()));
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(1., 2., 3.));
+  transform::Rigid3d pose;
+  ceres::Solver::Summary summary;
+  loam_scan_matcher.Match(
+      initial_pose.translation(), initial_pose,
+      GenerateRoomFeatures(transform::Rigid3f::Identity(), 1.f, 0.f), &pose,
+      &summary);
+  EXPECT_THAT(pose, transform::IsNearly(initial_pose, 1e-9));
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
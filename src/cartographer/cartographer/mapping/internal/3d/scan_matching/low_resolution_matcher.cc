@@ -23,12 +23,14 @@ namespace scan_matching {
 std::function<float(const transform::Rigid3f&)> CreateLowResolutionMatcher(
     const HybridGrid* low_resolution_grid, const sensor::PointCloud* points) {
   return [=](const transform::Rigid3f& pose) {
+    std::vector<Eigen::Array3i> cell_indices;
+    low_resolution_grid->GetCellIndices(pose, *points, &cell_indices);
+    // TODO(zhengj, whess): Interpolate the Grid to get better score.
+    std::vector<float> probabilities;
+    low_resolution_grid->GetProbabilities(cell_indices, &probabilities);
     float score = 0.f;
-    for (const Eigen::Vector3f& point :
-         sensor::TransformPointCloud(*points, pose)) {
-      // TODO(zhengj, whess): Interpolate the Grid to get better score.
-      score += low_resolution_grid->GetProbability(
-          low_resolution_grid->GetCellIndex(point));
+    for (const float probability : probabilities) {
+      score += probability;
     }
     return score / points->size();
   };
@@ -18,11 +18,14 @@
 #define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_3D_H_
 
 #include "Eigen/Core"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/internal/3d/scan_matching/interpolated_grid.h"
+#include "cartographer/mapping/internal/3d/scan_matching/rotated_point_jacobian_3d.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/transform/rigid_transform.h"
 #include "cartographer/transform/transform.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping {
@@ -31,54 +34,82 @@ namespace scan_matching {
 // Computes a cost for matching the 'point_cloud' to the 'hybrid_grid' with a
 // 'translation' and 'rotation'. The cost increases when points fall into less
 // occupied space, i.e. at voxels with lower values.
-class OccupiedSpaceCostFunction3D {
+//
+// Jacobians are computed analytically from the gradient of the tricubic
+// interpolation and the derivative of the rotated point with respect to the
+// quaternion, instead of evaluating the interpolation on Jets.
+class OccupiedSpaceCostFunction3D
+    : public ceres::SizedCostFunction<ceres::DYNAMIC /* residuals */,
+                                      3 /* translation variables */,
+                                      4 /* rotation variables */> {
  public:
-  static ceres::CostFunction* CreateAutoDiffCostFunction(
+  static ceres::CostFunction* CreateAnalyticCostFunction(
       const double scaling_factor, const sensor::PointCloud& point_cloud,
       const mapping::HybridGrid& hybrid_grid) {
-    return new ceres::AutoDiffCostFunction<
-        OccupiedSpaceCostFunction3D, ceres::DYNAMIC /* residuals */,
-        3 /* translation variables */, 4 /* rotation variables */>(
-        new OccupiedSpaceCostFunction3D(scaling_factor, point_cloud,
-                                        hybrid_grid),
-        point_cloud.size());
+    return CreateAnalyticCostFunction(scaling_factor, point_cloud, hybrid_grid,
+                                      nullptr /* dense_window */);
   }
 
-  template <typename T>
-  bool operator()(const T* const translation, const T* const rotation,
-                  T* const residual) const {
-    const transform::Rigid3<T> transform(
-        Eigen::Map<const Eigen::Matrix<T, 3, 1>>(translation),
-        Eigen::Quaternion<T>(rotation[0], rotation[1], rotation[2],
-                             rotation[3]));
-    return Evaluate(transform, residual);
+  // Same as above, but looks up cells inside 'dense_window' of 'hybrid_grid'
+  // in its dense copy.
+  static ceres::CostFunction* CreateAnalyticCostFunction(
+      const double scaling_factor, const sensor::PointCloud& point_cloud,
+      const mapping::HybridGrid& hybrid_grid,
+      const DenseHybridGridWindow* const dense_window) {
+    return new OccupiedSpaceCostFunction3D(scaling_factor, point_cloud,
+                                           hybrid_grid, dense_window);
+  }
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override {
+    const double* const translation = parameters[0];
+    const double* const rotation = parameters[1];
+    const transform::Rigid3d transform(
+        Eigen::Map<const Eigen::Vector3d>(translation),
+        Eigen::Quaterniond(rotation[0], rotation[1], rotation[2],
+                           rotation[3]));
+    Eigen::Vector3d gradient;
+    for (size_t i = 0; i < point_cloud_.size(); ++i) {
+      const Eigen::Vector3d point = point_cloud_[i].cast<double>();
+      const Eigen::Vector3d world = transform * point;
+      const double probability = interpolated_grid_.GetProbabilityAndGradient(
+          world[0], world[1], world[2], &gradient);
+      residuals[i] = scaling_factor_ * (1. - probability);
+      if (jacobians == nullptr) {
+        continue;
+      }
+      const Eigen::RowVector3d residual_gradient =
+          -scaling_factor_ * gradient.transpose();
+      if (jacobians[0] != nullptr) {
+        Eigen::Map<Eigen::RowVector3d> translation_jacobian(jacobians[0] +
+                                                            3 * i);
+        translation_jacobian = residual_gradient;
+      }
+      if (jacobians[1] != nullptr) {
+        Eigen::Map<Eigen::Matrix<double, 1, 4>> rotation_jacobian(
+            jacobians[1] + 4 * i);
+        rotation_jacobian =
+            residual_gradient * RotatedPointJacobian(rotation, point);
+      }
+    }
+    return true;
   }
 
  private:
   OccupiedSpaceCostFunction3D(const double scaling_factor,
                               const sensor::PointCloud& point_cloud,
-                              const mapping::HybridGrid& hybrid_grid)
+                              const mapping::HybridGrid& hybrid_grid,
+                              const DenseHybridGridWindow* const dense_window)
       : scaling_factor_(scaling_factor),
         point_cloud_(point_cloud),
-        interpolated_grid_(hybrid_grid) {}
+        interpolated_grid_(hybrid_grid, dense_window) {
+    set_num_residuals(point_cloud.size());
+  }
 
   OccupiedSpaceCostFunction3D(const OccupiedSpaceCostFunction3D&) = delete;
   OccupiedSpaceCostFunction3D& operator=(const OccupiedSpaceCostFunction3D&) =
       delete;
 
-  template <typename T>
-  bool Evaluate(const transform::Rigid3<T>& transform,
-                T* const residual) const {
-    for (size_t i = 0; i < point_cloud_.size(); ++i) {
-      const Eigen::Matrix<T, 3, 1> world =
-          transform * point_cloud_[i].cast<T>();
-      const T probability =
-          interpolated_grid_.GetProbability(world[0], world[1], world[2]);
-      residual[i] = scaling_factor_ * (1. - probability);
-    }
-    return true;
-  }
-
   const double scaling_factor_;
   const sensor::PointCloud& point_cloud_;
   const InterpolatedGrid interpolated_grid_;
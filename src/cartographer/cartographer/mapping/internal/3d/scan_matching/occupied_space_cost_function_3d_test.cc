@@ -0,0 +1,166 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/3d/scan_matching/occupied_space_cost_function_3d.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/mapping/3d/hybrid_grid.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+namespace {
+
+class OccupiedSpaceCostFunction3DTest : public ::testing::Test {
+ protected:
+  OccupiedSpaceCostFunction3DTest() : hybrid_grid_(0.3f) {
+    for (int x = -10; x <= 10; ++x) {
+      for (int y = -10; y <= 10; ++y) {
+        // A slanted, blurred wall so that the gradient is nonzero in all
+        // directions.
+        const int wall_z = (x + 2 * y) / 4;
+        for (int z = wall_z - 1; z <= wall_z + 1; ++z) {
+          hybrid_grid_.SetProbability(Eigen::Array3i(x, y, z),
+                                      z == wall_z ? 0.9f : 0.6f);
+        }
+      }
+    }
+    for (const Eigen::Vector3f& point :
+         {Eigen::Vector3f(0.1f, 0.2f, 0.05f), Eigen::Vector3f(-1.f, 0.5f, 0.f),
+          Eigen::Vector3f(1.2f, -0.7f, -0.2f), Eigen::Vector3f(0.4f, 1.f, 0.3f),
+          Eigen::Vector3f(-0.8f, -1.1f, -0.4f)}) {
+      point_cloud_.push_back(point);
+    }
+    cost_function_.reset(
+        OccupiedSpaceCostFunction3D::CreateAnalyticCostFunction(
+            2., point_cloud_, hybrid_grid_));
+  }
+
+  std::vector<double> Evaluate(const std::array<double, 3>& translation,
+                               const std::array<double, 4>& rotation,
+                               std::vector<double>* translation_jacobian,
+                               std::vector<double>* rotation_jacobian) const {
+    std::vector<double> residuals(point_cloud_.size());
+    const double* parameters[] = {translation.data(), rotation.data()};
+    if (translation_jacobian == nullptr) {
+      EXPECT_TRUE(
+          cost_function_->Evaluate(parameters, residuals.data(), nullptr));
+      return residuals;
+    }
+    translation_jacobian->resize(3 * point_cloud_.size());
+    rotation_jacobian->resize(4 * point_cloud_.size());
+    double* jacobians[] = {translation_jacobian->data(),
+                           rotation_jacobian->data()};
+    EXPECT_TRUE(
+        cost_function_->Evaluate(parameters, residuals.data(), jacobians));
+    return residuals;
+  }
+
+  HybridGrid hybrid_grid_;
+  sensor::PointCloud point_cloud_;
+  std::unique_ptr<ceres::CostFunction> cost_function_;
+};
+
+TEST_F(OccupiedSpaceCostFunction3DTest, ResidualsMatchInterpolatedGrid) {
+  const Eigen::Quaterniond rotation(
+      Eigen::AngleAxisd(0.3, Eigen::Vector3d(1., 2., 3.).normalized()));
+  const std::array<double, 3> translation = {{0.05, -0.1, 0.2}};
+  const std::vector<double> residuals = Evaluate(
+      translation, {{rotation.w(), rotation.x(), rotation.y(), rotation.z()}},
+      nullptr, nullptr);
+  const InterpolatedGrid interpolated_grid(hybrid_grid_);
+  for (size_t i = 0; i != point_cloud_.size(); ++i) {
+    const Eigen::Vector3d world =
+        rotation * point_cloud_[i].cast<double>() +
+        Eigen::Vector3d(translation[0], translation[1], translation[2]);
+    EXPECT_NEAR(2. * (1. - interpolated_grid.GetProbability(
+                               world.x(), world.y(), world.z())),
+                residuals[i], 1e-6);
+  }
+}
+
+TEST_F(OccupiedSpaceCostFunction3DTest, JacobiansMatchFiniteDifferences) {
+  constexpr double kDelta = 1e-7;
+  const Eigen::Quaterniond quaternion(
+      Eigen::AngleAxisd(0.3, Eigen::Vector3d(1., 2., 3.).normalized()));
+  const std::array<double, 3> translation = {{0.05, -0.1, 0.2}};
+  const std::array<double, 4> rotation = {
+      {quaternion.w(), quaternion.x(), quaternion.y(), quaternion.z()}};
+  std::vector<double> translation_jacobian;
+  std::vector<double> rotation_jacobian;
+  const std::vector<double> residuals = Evaluate(
+      translation, rotation, &translation_jacobian, &rotation_jacobian);
+  EXPECT_EQ(residuals, Evaluate(translation, rotation, nullptr, nullptr));
+
+  const int num_residuals = point_cloud_.size();
+  for (int j = 0; j != 3; ++j) {
+    std::array<double, 3> plus = translation;
+    std::array<double, 3> minus = translation;
+    plus[j] += kDelta;
+    minus[j] -= kDelta;
+    const std::vector<double> residuals_plus =
+        Evaluate(plus, rotation, nullptr, nullptr);
+    const std::vector<double> residuals_minus =
+        Evaluate(minus, rotation, nullptr, nullptr);
+    for (int i = 0; i != num_residuals; ++i) {
+      EXPECT_NEAR((residuals_plus[i] - residuals_minus[i]) / (2. * kDelta),
+                  translation_jacobian[3 * i + j], 1e-4);
+    }
+  }
+  // The quaternion is evaluated as a rotation also off the unit sphere, so we
+  // compare against differences along its tangent space.
+  for (int j = 0; j != 3; ++j) {
+    Eigen::Vector3d delta = Eigen::Vector3d::Zero();
+    delta[j] = kDelta;
+    const Eigen::Quaterniond plus_quaternion =
+        quaternion * Eigen::Quaterniond(1., delta.x(), delta.y(), delta.z());
+    const Eigen::Quaterniond minus_quaternion =
+        quaternion * Eigen::Quaterniond(1., -delta.x(), -delta.y(), -delta.z());
+    const std::vector<double> residuals_plus = Evaluate(
+        translation,
+        {{plus_quaternion.w(), plus_quaternion.x(), plus_quaternion.y(),
+          plus_quaternion.z()}},
+        nullptr, nullptr);
+    const std::vector<double> residuals_minus = Evaluate(
+        translation,
+        {{minus_quaternion.w(), minus_quaternion.x(), minus_quaternion.y(),
+          minus_quaternion.z()}},
+        nullptr, nullptr);
+    const Eigen::Vector4d quaternion_delta =
+        Eigen::Vector4d(plus_quaternion.w(), plus_quaternion.x(),
+                        plus_quaternion.y(), plus_quaternion.z()) -
+        Eigen::Vector4d(minus_quaternion.w(), minus_quaternion.x(),
+                        minus_quaternion.y(), minus_quaternion.z());
+    for (int i = 0; i != num_residuals; ++i) {
+      const Eigen::Map<const Eigen::Vector4d> jacobian(
+          rotation_jacobian.data() + 4 * i);
+      EXPECT_NEAR(residuals_plus[i] - residuals_minus[i],
+                  jacobian.dot(quaternion_delta), 1e-10);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
@@ -17,6 +17,8 @@
 #include "cartographer/mapping/internal/3d/scan_matching/precomputation_grid_3d.h"
 
 #include <algorithm>
+#include <array>
+#include <unordered_map>
 
 #include "Eigen/Core"
 #include "cartographer/common/math.h"
@@ -28,20 +30,228 @@ namespace mapping {
 namespace scan_matching {
 namespace {
 
-// C++11 defines that integer division rounds towards zero. For index math, we
-// actually need it to round towards negative infinity. Luckily bit shifts have
-// that property.
-inline int DivideByTwoRoundingTowardsNegativeInfinity(const int value) {
-  return value >> 1;
+// The max filter works on dense blocks of kBlockSize^3 cells. These match the
+// FlatGrids of a HybridGridBase which store the cells of blocks aligned to
+// multiples of kBlockSize contiguously in the same z-major order.
+constexpr int kBlockBits = 3;
+constexpr int kBlockSize = 1 << kBlockBits;
+constexpr int kCellsPerBlock = kBlockSize * kBlockSize * kBlockSize;
+// Offsets between neighbouring cells of a block along x, y and z.
+constexpr int kBlockStrides[3] = {1, kBlockSize, kBlockSize * kBlockSize};
+
+using Block = std::array<uint8, kCellsPerBlock>;
+
+// Block indices are packed into 21 bits per axis for hashing.
+constexpr int kKeyBits = 21;
+constexpr int kKeyOffset = 1 << (kKeyBits - 1);
+constexpr uint64 kKeyMask = (uint64{1} << kKeyBits) - 1;
+
+uint64 ToKey(const Eigen::Array3i& block_index) {
+  return static_cast<uint64>(block_index.x() + kKeyOffset) |
+         (static_cast<uint64>(block_index.y() + kKeyOffset) << kKeyBits) |
+         (static_cast<uint64>(block_index.z() + kKeyOffset) << (2 * kKeyBits));
 }
 
-// Computes the half resolution index corresponding to the full resolution
-// 'cell_index'.
-Eigen::Array3i CellIndexAtHalfResolution(const Eigen::Array3i& cell_index) {
-  return Eigen::Array3i(
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[0]),
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[1]),
-      DivideByTwoRoundingTowardsNegativeInfinity(cell_index[2]));
+Eigen::Array3i FromKey(const uint64 key) {
+  return Eigen::Array3i(static_cast<int>(key & kKeyMask),
+                        static_cast<int>((key >> kKeyBits) & kKeyMask),
+                        static_cast<int>(key >> (2 * kKeyBits))) -
+         kKeyOffset;
+}
+
+// A sparse grid of dense blocks, omitting blocks of default values.
+class BlockGrid {
+ public:
+  BlockGrid() = default;
+
+  explicit BlockGrid(const PrecomputationGrid3D& grid) {
+    // The iterator visits the cells of one block after another.
+    Eigen::Array3i block_index = Eigen::Array3i::Zero();
+    Block* block = nullptr;
+    for (auto it = PrecomputationGrid3D::Iterator(grid); !it.Done();
+         it.Next()) {
+      const Eigen::Array3i cell_index = it.GetCellIndex();
+      const Eigen::Array3i current_block_index(cell_index.x() >> kBlockBits,
+                                               cell_index.y() >> kBlockBits,
+                                               cell_index.z() >> kBlockBits);
+      if (block == nullptr || (current_block_index != block_index).any()) {
+        block_index = current_block_index;
+        block = &blocks_[ToKey(block_index)];
+      }
+      (*block)[ToFlatIndex(cell_index - block_index * kBlockSize,
+                           kBlockBits)] = it.GetValue();
+    }
+  }
+
+  const std::unordered_map<uint64, Block>& blocks() const { return blocks_; }
+
+  bool Contains(const uint64 key) const { return blocks_.count(key) != 0; }
+
+  // Returns the block at 'block_index' which is all zeros if not present.
+  const Block& Get(const Eigen::Array3i& block_index) const {
+    static const Block kEmptyBlock = Block();
+    const auto it = blocks_.find(ToKey(block_index));
+    return it == blocks_.end() ? kEmptyBlock : it->second;
+  }
+
+  // Stores 'block' at the block with 'key' unless it is all zeros.
+  void Insert(const uint64 key, const Block& block) {
+    if (std::any_of(block.begin(), block.end(),
+                    [](const uint8 value) { return value != 0; })) {
+      blocks_.emplace(key, block);
+    }
+  }
+
+  // Copies all blocks into an empty 'grid'.
+  void CopyTo(PrecomputationGrid3D* const grid) const {
+    for (const auto& entry : blocks_) {
+      const Eigen::Array3i lowest_cell_index =
+          FromKey(entry.first) * kBlockSize;
+      uint8* const cells = grid->mutable_value(lowest_cell_index);
+      DCHECK_EQ(cells + kCellsPerBlock - 1,
+                grid->mutable_value(lowest_cell_index + (kBlockSize - 1)));
+      std::copy(entry.second.begin(), entry.second.end(), cells);
+    }
+  }
+
+ private:
+  std::unordered_map<uint64, Block> blocks_;
+};
+
+// Sets each cell of 'max_block' to the maximum of the cell at the same index
+// in 'block' and the one 'shift' cells further along the axis with 'kStride'
+// in 'shifted_block'. Where this is beyond 'shifted_block', the cell is read
+// from 'next_block' which follows it along the axis.
+template <int kStride>
+void MaxWithShiftedCellsInBlock(const Block& block, const Block& shifted_block,
+                                const Block& next_block, const int shift,
+                                Block* const max_block) {
+  // Cells with the same coordinate along the axis form runs of 'kStride'
+  // contiguous cells which are read from the same block.
+  for (int outer = 0; outer != kCellsPerBlock; outer += kBlockSize * kStride) {
+    for (int coordinate = 0; coordinate != kBlockSize; ++coordinate) {
+      const int shifted = coordinate + shift;
+      const uint8* const shifted_values =
+          (shifted < kBlockSize ? shifted_block : next_block).data() + outer +
+          (shifted % kBlockSize) * kStride;
+      const int begin = outer + coordinate * kStride;
+      for (int inner = 0; inner != kStride; ++inner) {
+        (*max_block)[begin + inner] =
+            std::max(block[begin + inner], shifted_values[inner]);
+      }
+    }
+  }
+}
+
+// Along x, each row is concatenated with the same row of the next block.
+template <>
+void MaxWithShiftedCellsInBlock<1>(const Block& block,
+                                   const Block& shifted_block,
+                                   const Block& next_block, const int shift,
+                                   Block* const max_block) {
+  std::array<uint8, 2 * kBlockSize> row;
+  for (int begin = 0; begin != kCellsPerBlock; begin += kBlockSize) {
+    std::copy_n(shifted_block.data() + begin, kBlockSize, row.begin());
+    std::copy_n(next_block.data() + begin, kBlockSize,
+                row.begin() + kBlockSize);
+    for (int x = 0; x != kBlockSize; ++x) {
+      (*max_block)[begin + x] = std::max(block[begin + x], row[x + shift]);
+    }
+  }
+}
+
+// Sets each cell of 'max_block' to the maximum of the two cells it covers at
+// twice the resolution along the axis with 'kStride', which are in
+// 'low_block' for the lower and in 'high_block' for the upper half of
+// 'max_block'.
+template <int kStride>
+void HalveResolutionInBlock(const Block& low_block, const Block& high_block,
+                            Block* const max_block) {
+  for (int outer = 0; outer != kCellsPerBlock; outer += kBlockSize * kStride) {
+    for (int coordinate = 0; coordinate != kBlockSize; ++coordinate) {
+      const int low_coordinate = 2 * coordinate;
+      const uint8* const low_values =
+          (low_coordinate < kBlockSize ? low_block : high_block).data() +
+          outer + (low_coordinate % kBlockSize) * kStride;
+      const int begin = outer + coordinate * kStride;
+      for (int inner = 0; inner != kStride; ++inner) {
+        (*max_block)[begin + inner] =
+            std::max(low_values[inner], low_values[inner + kStride]);
+      }
+    }
+  }
+}
+
+template <>
+void HalveResolutionInBlock<1>(const Block& low_block, const Block& high_block,
+                               Block* const max_block) {
+  std::array<uint8, 2 * kBlockSize> row;
+  for (int begin = 0; begin != kCellsPerBlock; begin += kBlockSize) {
+    std::copy_n(low_block.data() + begin, kBlockSize, row.begin());
+    std::copy_n(high_block.data() + begin, kBlockSize,
+                row.begin() + kBlockSize);
+    for (int x = 0; x != kBlockSize; ++x) {
+      (*max_block)[begin + x] = std::max(row[2 * x], row[2 * x + 1]);
+    }
+  }
+}
+
+// Returns a grid with each cell being the maximum of the cell at the same
+// index in 'grid' and the one 'shift' cells further along 'axis'.
+BlockGrid MaxWithShiftedCells(const BlockGrid& grid, const int axis,
+                              const int shift) {
+  const auto max_with_shifted_cells_in_block =
+      axis == 0 ? &MaxWithShiftedCellsInBlock<kBlockStrides[0]>
+                : axis == 1 ? &MaxWithShiftedCellsInBlock<kBlockStrides[1]>
+                            : &MaxWithShiftedCellsInBlock<kBlockStrides[2]>;
+  const Eigen::Array3i unit = Eigen::Vector3i::Unit(axis).array();
+  const int block_shift = shift >> kBlockBits;
+  const int shift_in_block = shift & (kBlockSize - 1);
+  BlockGrid result;
+  Block max_block;
+  for (const auto& entry : grid.blocks()) {
+    // Blocks of 'result' which read from this block of 'grid'.
+    for (const int block_offset : {0, block_shift, block_shift + 1}) {
+      const Eigen::Array3i block_index =
+          FromKey(entry.first) - block_offset * unit;
+      const uint64 key = ToKey(block_index);
+      if (result.Contains(key)) {
+        continue;
+      }
+      max_with_shifted_cells_in_block(
+          grid.Get(block_index), grid.Get(block_index + block_shift * unit),
+          grid.Get(block_index + (block_shift + 1) * unit), shift_in_block,
+          &max_block);
+      result.Insert(key, max_block);
+    }
+  }
+  return result;
+}
+
+// Returns a grid of half the resolution along 'axis', each cell being the
+// maximum of the two cells of 'grid' it covers.
+BlockGrid HalveResolution(const BlockGrid& grid, const int axis) {
+  const auto halve_resolution_in_block =
+      axis == 0 ? &HalveResolutionInBlock<kBlockStrides[0]>
+                : axis == 1 ? &HalveResolutionInBlock<kBlockStrides[1]>
+                            : &HalveResolutionInBlock<kBlockStrides[2]>;
+  const Eigen::Array3i unit = Eigen::Vector3i::Unit(axis).array();
+  BlockGrid result;
+  Block max_block;
+  for (const auto& entry : grid.blocks()) {
+    Eigen::Array3i block_index = FromKey(entry.first);
+    block_index[axis] >>= 1;
+    const uint64 key = ToKey(block_index);
+    if (result.Contains(key)) {
+      continue;
+    }
+    Eigen::Array3i low_block_index = block_index;
+    low_block_index[axis] *= 2;
+    halve_resolution_in_block(grid.Get(low_block_index),
+                              grid.Get(low_block_index + unit), &max_block);
+    result.Insert(key, max_block);
+  }
+  return result;
 }
 
 }  // namespace
@@ -63,20 +273,20 @@ PrecomputationGrid3D ConvertToPrecomputationGrid(
 PrecomputationGrid3D PrecomputeGrid(const PrecomputationGrid3D& grid,
                                     const bool half_resolution,
                                     const Eigen::Array3i& shift) {
-  PrecomputationGrid3D result(grid.resolution());
-  for (auto it = PrecomputationGrid3D::Iterator(grid); !it.Done(); it.Next()) {
-    for (int i = 0; i != 8; ++i) {
-      // We use this value to update 8 values in the resulting grid, at
-      // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
-      // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
-      // this results in precomputation grids analogous to the 2D case.
-      const Eigen::Array3i cell_index =
-          it.GetCellIndex() - shift * PrecomputationGrid3D::GetOctant(i);
-      auto* const cell_value = result.mutable_value(
-          half_resolution ? CellIndexAtHalfResolution(cell_index) : cell_index);
-      *cell_value = std::max(it.GetValue(), *cell_value);
+  // The maximum over the 8 shifted cells is separable into maxima over pairs
+  // of cells along each axis, which are computed on dense blocks.
+  BlockGrid block_grid(grid);
+  for (int axis = 0; axis != 3; ++axis) {
+    CHECK_GE(shift[axis], 0);
+    if (shift[axis] != 0) {
+      block_grid = MaxWithShiftedCells(block_grid, axis, shift[axis]);
+    }
+    if (half_resolution) {
+      block_grid = HalveResolution(block_grid, axis);
     }
   }
+  PrecomputationGrid3D result(grid.resolution());
+  block_grid.CopyTo(&result);
   return result;
 }
 
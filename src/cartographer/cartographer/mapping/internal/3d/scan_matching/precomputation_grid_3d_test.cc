@@ -76,6 +76,45 @@ TEST(PrecomputedGridGenerator3DTest, TestAgainstNaiveAlgorithm) {
   }
 }
 
+TEST(PrecomputedGridGenerator3DTest, TestHalfResolutionAgainstNaiveAlgorithm) {
+  HybridGrid hybrid_grid(2.f);
+
+  std::mt19937 rng(23847);
+  std::uniform_int_distribution<int> coordinate_distribution(-50, 49);
+  std::uniform_real_distribution<float> value_distribution(kMinProbability,
+                                                           kMaxProbability);
+  for (int i = 0; i < 5000; ++i) {
+    const auto x = coordinate_distribution(rng);
+    const auto y = coordinate_distribution(rng);
+    const auto z = coordinate_distribution(rng);
+    const Eigen::Array3i cell_index(x, y, z);
+    hybrid_grid.SetProbability(cell_index, value_distribution(rng));
+  }
+
+  const PrecomputationGrid3D original_grid =
+      ConvertToPrecomputationGrid(hybrid_grid);
+  // Shifts beyond a single block of the flat grids are included.
+  const Eigen::Array3i shift(1, 4, 11);
+  const PrecomputationGrid3D precomputed_grid =
+      PrecomputeGrid(original_grid, true, shift);
+  for (int i = 0; i < 1000; ++i) {
+    const Eigen::Array3i half_resolution_index(
+        coordinate_distribution(rng) / 2, coordinate_distribution(rng) / 2,
+        coordinate_distribution(rng) / 2);
+    uint8 expected_value = 0;
+    for (int j = 0; j != 8; ++j) {
+      for (int k = 0; k != 8; ++k) {
+        expected_value = std::max(
+            expected_value,
+            original_grid.value(2 * half_resolution_index +
+                                PrecomputationGrid3D::GetOctant(j) +
+                                shift * PrecomputationGrid3D::GetOctant(k)));
+      }
+    }
+    EXPECT_EQ(expected_value, precomputed_grid.value(half_resolution_index));
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
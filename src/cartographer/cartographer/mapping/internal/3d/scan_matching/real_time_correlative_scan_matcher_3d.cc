@@ -16,48 +16,261 @@
 
 #include "cartographer/mapping/internal/3d/scan_matching/real_time_correlative_scan_matcher_3d.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/math.h"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 
 namespace cartographer {
 namespace mapping {
 namespace scan_matching {
+namespace {
+
+// Translational candidates are first evaluated in blocks of up to
+// 2^kMaxDepth voxels along each axis.
+constexpr int kMaxDepth = 3;
+
+using MaxValueGrid = HybridGridBase<uint16>;
+
+// Searches the translations of a point cloud, discretized for one rotation at
+// a time, by branch and bound. A block of translations is bounded by the
+// maximum of the grid values over the block. Since the matched submap changes
+// with every scan, these maxima are not precomputed for the whole grid but
+// lazily for the cells the search visits, and reused across rotations.
+template <typename GridType>
+class TranslationalSearch {
+ public:
+  TranslationalSearch(
+      const GridType& grid, const int linear_window_size,
+      const proto::RealTimeCorrelativeScanMatcherOptions& options)
+      : grid_(grid),
+        linear_window_size_(linear_window_size),
+        translation_delta_cost_weight_(
+            options.translation_delta_cost_weight()),
+        rotation_delta_cost_weight_(options.rotation_delta_cost_weight()) {
+    while (max_depth_ < kMaxDepth &&
+           (1 << max_depth_) < 2 * linear_window_size_ + 1) {
+      ++max_depth_;
+    }
+    for (int depth = 1; depth <= max_depth_; ++depth) {
+      max_value_grids_.emplace_back(grid_.resolution());
+    }
+  }
+
+  // Searches all translations of the discretized 'cell_indices' which were
+  // rotated by 'angle' away from the initial pose estimate. Returns true if a
+  // candidate scoring above 'best_score' was found, in which case
+  // 'best_score' and 'best_offset' are updated.
+  bool Search(const std::vector<Eigen::Array3i>& cell_indices,
+              const float angle, float* const best_score,
+              Eigen::Array3i* const best_offset) {
+    cell_indices_ = &cell_indices;
+    angle_ = angle;
+    best_score_ = *best_score;
+    found_better_candidate_ = false;
+    const int step_size = 1 << max_depth_;
+    lowest_resolution_candidates_.clear();
+    for (int z = -linear_window_size_; z <= linear_window_size_;
+         z += step_size) {
+      for (int y = -linear_window_size_; y <= linear_window_size_;
+           y += step_size) {
+        for (int x = -linear_window_size_; x <= linear_window_size_;
+             x += step_size) {
+          const Eigen::Array3i offset(x, y, z);
+          lowest_resolution_candidates_.push_back(
+              Candidate{offset, ScoreCandidate(max_depth_, offset)});
+        }
+      }
+    }
+    std::sort(lowest_resolution_candidates_.begin(),
+              lowest_resolution_candidates_.end());
+    for (const Candidate& candidate : lowest_resolution_candidates_) {
+      if (candidate.score <= best_score_) {
+        break;
+      }
+      BranchAndBound(max_depth_, candidate);
+    }
+    if (found_better_candidate_) {
+      *best_score = best_score_;
+      *best_offset = best_offset_;
+    }
+    return found_better_candidate_;
+  }
+
+ private:
+  struct Candidate {
+    // The lowest offset of the 2^depth voxels wide block of translations.
+    Eigen::Array3i offset;
+    // Upper bound of the scores in the block, for depth 0 the score.
+    float score;
+
+    // Orders candidates by decreasing score.
+    bool operator<(const Candidate& other) const {
+      return score > other.score;
+    }
+  };
+
+  void BranchAndBound(const int depth, const Candidate& candidate) {
+    if (depth == 0) {
+      best_score_ = candidate.score;
+      best_offset_ = candidate.offset;
+      found_better_candidate_ = true;
+      return;
+    }
+    std::array<Candidate, 8> children;
+    int num_children = 0;
+    const int half_width = 1 << (depth - 1);
+    for (int i = 0; i != 8; ++i) {
+      const Eigen::Array3i offset =
+          candidate.offset + half_width * MaxValueGrid::GetOctant(i);
+      if ((offset > linear_window_size_).any()) {
+        continue;
+      }
+      children[num_children++] =
+          Candidate{offset, ScoreCandidate(depth - 1, offset)};
+    }
+    std::sort(children.begin(), children.begin() + num_children);
+    for (int i = 0; i != num_children; ++i) {
+      if (children[i].score <= best_score_) {
+        break;
+      }
+      BranchAndBound(depth - 1, children[i]);
+    }
+  }
+
+  // Returns the score of the translation 'offset' for depth 0, otherwise an
+  // upper bound of the scores of all translations in the block.
+  float ScoreCandidate(const int depth, const Eigen::Array3i& offset) {
+    float score = 0.f;
+    for (const Eigen::Array3i& cell_index : *cell_indices_) {
+      score += ValueToProbability(GetMaxValue(depth, cell_index + offset));
+    }
+    score /= static_cast<float>(cell_indices_->size());
+    // The translation of the block which is closest to the initial estimate.
+    const Eigen::Array3i block_end =
+        (offset + ((1 << depth) - 1)).min(linear_window_size_);
+    const Eigen::Array3i closest_offset =
+        offset.max(0) + block_end.min(0);
+    const float translation_norm =
+        grid_.resolution() * closest_offset.matrix().cast<float>().norm();
+    score *= std::exp(-common::Pow2(
+        translation_norm * translation_delta_cost_weight_ +
+        angle_ * rotation_delta_cost_weight_));
+    CHECK_GT(score, 0.f);
+    return score;
+  }
+
+  // Returns the maximum of the grid values in the block of 2^depth voxels
+  // along each axis with the lowest cell 'index'.
+  uint16 GetMaxValue(const int depth, const Eigen::Array3i& index) {
+    if (depth == 0) {
+      return static_cast<uint16>(grid_.value(index) & ~kUpdateMarker);
+    }
+    // Zero marks maxima which have not been computed yet, so values are
+    // stored incremented by one.
+    uint16* const max_value = max_value_grids_[depth - 1].mutable_value(index);
+    if (*max_value == 0) {
+      const int half_width = 1 << (depth - 1);
+      uint16 result = 0;
+      for (int i = 0; i != 8; ++i) {
+        result = std::max(
+            result,
+            GetMaxValue(depth - 1,
+                        index + half_width * MaxValueGrid::GetOctant(i)));
+      }
+      *max_value = result + 1;
+    }
+    return *max_value - 1;
+  }
+
+  const GridType& grid_;
+  const int linear_window_size_;
+  const double translation_delta_cost_weight_;
+  const double rotation_delta_cost_weight_;
+  int max_depth_ = 0;
+  // Maxima of the grid values for depths 1 to 'max_depth_'.
+  std::vector<MaxValueGrid> max_value_grids_;
+  std::vector<Candidate> lowest_resolution_candidates_;
+
+  // State of the current search.
+  const std::vector<Eigen::Array3i>* cell_indices_ = nullptr;
+  float angle_ = 0.f;
+  float best_score_ = 0.f;
+  Eigen::Array3i best_offset_ = Eigen::Array3i::Zero();
+  bool found_better_candidate_ = false;
+};
+
+}  // namespace
 
 RealTimeCorrelativeScanMatcher3D::RealTimeCorrelativeScanMatcher3D(
     const proto::RealTimeCorrelativeScanMatcherOptions& options)
     : options_(options) {}
-//在当前位姿估计附近开一个窗口，穷举可能值获得匹配概率最大的匹配位姿
+//在当前位姿估计附近开一个窗口，搜索可能值获得匹配概率最大的匹配位姿
 float RealTimeCorrelativeScanMatcher3D::Match(
     const transform::Rigid3d& initial_pose_estimate,
     const sensor::PointCloud& point_cloud, const HybridGrid& hybrid_grid,
     transform::Rigid3d* pose_estimate) const {
+  return MatchInGrid(initial_pose_estimate, point_cloud, hybrid_grid,
+                     pose_estimate);
+}
+
+float RealTimeCorrelativeScanMatcher3D::Match(
+    const transform::Rigid3d& initial_pose_estimate,
+    const sensor::PointCloud& point_cloud,
+    const DenseHybridGridWindow& dense_window,
+    transform::Rigid3d* pose_estimate) const {
+  return MatchInGrid(initial_pose_estimate, point_cloud, dense_window,
+                     pose_estimate);
+}
+
+template <typename GridType>
+float RealTimeCorrelativeScanMatcher3D::MatchInGrid(
+    const transform::Rigid3d& initial_pose_estimate,
+    const sensor::PointCloud& point_cloud, const GridType& grid,
+    transform::Rigid3d* pose_estimate) const {
   CHECK_NOTNULL(pose_estimate);
+  CHECK(!point_cloud.empty());
+  const float resolution = grid.resolution();
+  const transform::Rigid3f initial_pose = initial_pose_estimate.cast<float>();
+  TranslationalSearch<GridType> translational_search(
+      grid,
+      common::RoundToInt(options_.linear_search_window() / resolution),
+      options_);
+  std::vector<Eigen::Array3i> cell_indices;
   float best_score = -1.f;
-  for (const transform::Rigid3f& transform : GenerateExhaustiveSearchTransforms(
-           hybrid_grid.resolution(), point_cloud)) {
-    const transform::Rigid3f candidate =
-        initial_pose_estimate.cast<float>() * transform;
-    const float score = ScoreCandidate(
-        hybrid_grid, sensor::TransformPointCloud(point_cloud, candidate),
-        transform);
-    if (score > best_score) {
-      best_score = score;
-      *pose_estimate = candidate.cast<double>();
+  // Rotations closer to the initial estimate are searched first, since they
+  // are the most likely to yield a good score which prunes the search.
+  for (const Eigen::Vector3f& angle_axis :
+       GenerateSearchRotations(resolution, point_cloud)) {
+    const Eigen::Quaternionf rotation =
+        initial_pose.rotation() *
+        transform::AngleAxisVectorToRotationQuaternion(angle_axis);
+    grid.GetCellIndices(
+        transform::Rigid3f(initial_pose.translation(), rotation), point_cloud,
+        &cell_indices);
+    Eigen::Array3i offset;
+    if (translational_search.Search(cell_indices, angle_axis.norm(),
+                                    &best_score, &offset)) {
+      *pose_estimate =
+          transform::Rigid3f(initial_pose.translation() +
+                                 resolution * offset.matrix().cast<float>(),
+                             rotation)
+              .cast<double>();
     }
   }
+  CHECK_GT(best_score, 0.f);
   return best_score;
 }
 
-std::vector<transform::Rigid3f>
-RealTimeCorrelativeScanMatcher3D::GenerateExhaustiveSearchTransforms(
+std::vector<Eigen::Vector3f>
+RealTimeCorrelativeScanMatcher3D::GenerateSearchRotations(
     const float resolution, const sensor::PointCloud& point_cloud) const {
-  std::vector<transform::Rigid3f> result;
-  const int linear_window_size =
-      common::RoundToInt(options_.linear_search_window() / resolution);
   // We set this value to something on the order of resolution to make sure that
   // the std::acos() below is defined.
   float max_scan_range = 3.f * resolution;
@@ -71,47 +284,22 @@ RealTimeCorrelativeScanMatcher3D::GenerateExhaustiveSearchTransforms(
                                           (2.f * common::Pow2(max_scan_range)));
   const int angular_window_size =
       common::RoundToInt(options_.angular_search_window() / angular_step_size);
-  for (int z = -linear_window_size; z <= linear_window_size; ++z) {
-    for (int y = -linear_window_size; y <= linear_window_size; ++y) {
-      for (int x = -linear_window_size; x <= linear_window_size; ++x) {
-        for (int rz = -angular_window_size; rz <= angular_window_size; ++rz) {
-          for (int ry = -angular_window_size; ry <= angular_window_size; ++ry) {
-            for (int rx = -angular_window_size; rx <= angular_window_size;
-                 ++rx) {
-              const Eigen::Vector3f angle_axis(rx * angular_step_size,
-                                               ry * angular_step_size,
-                                               rz * angular_step_size);
-              result.emplace_back(
-                  Eigen::Vector3f(x * resolution, y * resolution,
-                                  z * resolution),
-                  transform::AngleAxisVectorToRotationQuaternion(angle_axis));
-            }
-          }
-        }
+  std::vector<Eigen::Vector3f> result;
+  for (int rz = -angular_window_size; rz <= angular_window_size; ++rz) {
+    for (int ry = -angular_window_size; ry <= angular_window_size; ++ry) {
+      for (int rx = -angular_window_size; rx <= angular_window_size; ++rx) {
+        result.emplace_back(rx * angular_step_size, ry * angular_step_size,
+                            rz * angular_step_size);
       }
     }
   }
+  std::stable_sort(result.begin(), result.end(),
+                   [](const Eigen::Vector3f& lhs, const Eigen::Vector3f& rhs) {
+                     return lhs.squaredNorm() < rhs.squaredNorm();
+                   });
   return result;
 }
 
-float RealTimeCorrelativeScanMatcher3D::ScoreCandidate(
-    const HybridGrid& hybrid_grid,
-    const sensor::PointCloud& transformed_point_cloud,
-    const transform::Rigid3f& transform) const {
-  float score = 0.f;
-  for (const Eigen::Vector3f& point : transformed_point_cloud) {
-    score += hybrid_grid.GetProbability(hybrid_grid.GetCellIndex(point));
-  }
-  score /= static_cast<float>(transformed_point_cloud.size());
-  const float angle = transform::GetAngle(transform);
-  score *=
-      std::exp(-common::Pow2(transform.translation().norm() *
-                                 options_.translation_delta_cost_weight() +
-                             angle * options_.rotation_delta_cost_weight()));
-  CHECK_GT(score, 0.f);
-  return score;
-}
-
 }  // namespace scan_matching
 }  // namespace mapping
 }  // namespace cartographer
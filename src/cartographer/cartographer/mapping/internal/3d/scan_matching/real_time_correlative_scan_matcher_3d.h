@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/proto/scan_matching/real_time_correlative_scan_matcher_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -28,8 +29,9 @@ namespace cartographer {
 namespace mapping {
 namespace scan_matching {
 
-// A voxel accurate scan matcher, exhaustively evaluating the scan matching
-// search space.
+// A voxel accurate scan matcher, evaluating the scan matching search space.
+// Each rotation is applied to the point cloud once, translations are integer
+// voxel offsets searched by branch and bound.
 class RealTimeCorrelativeScanMatcher3D {
  public:
   explicit RealTimeCorrelativeScanMatcher3D(
@@ -49,12 +51,23 @@ class RealTimeCorrelativeScanMatcher3D {
               const HybridGrid& hybrid_grid,
               transform::Rigid3d* pose_estimate) const;
 
+  // Same as above, but looks up cells inside 'dense_window' in its dense copy
+  // and all other cells in its HybridGrid.
+  float Match(const transform::Rigid3d& initial_pose_estimate,
+              const sensor::PointCloud& point_cloud,
+              const DenseHybridGridWindow& dense_window,
+              transform::Rigid3d* pose_estimate) const;
+
  private:
-  std::vector<transform::Rigid3f> GenerateExhaustiveSearchTransforms(
+  // 'GridType' is either HybridGrid or DenseHybridGridWindow.
+  template <typename GridType>
+  float MatchInGrid(const transform::Rigid3d& initial_pose_estimate,
+                    const sensor::PointCloud& point_cloud, const GridType& grid,
+                    transform::Rigid3d* pose_estimate) const;
+  // Returns the angle-axis vectors of all rotations to search, ordered by
+  // increasing angle.
+  std::vector<Eigen::Vector3f> GenerateSearchRotations(
       float resolution, const sensor::PointCloud& point_cloud) const;
-  float ScoreCandidate(const HybridGrid& hybrid_grid,
-                       const sensor::PointCloud& transformed_point_cloud,
-                       const transform::Rigid3f& transform) const;
 
   const proto::RealTimeCorrelativeScanMatcherOptions options_;
 };
@@ -16,10 +16,14 @@
 
 #include "cartographer/mapping/internal/3d/scan_matching/real_time_correlative_scan_matcher_3d.h"
 
+#include <cmath>
 #include <memory>
+#include <random>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/math.h"
+#include "cartographer/mapping/3d/dense_hybrid_grid_window.h"
 #include "cartographer/mapping/3d/hybrid_grid.h"
 #include "cartographer/mapping/internal/scan_matching/real_time_correlative_scan_matcher.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -116,6 +120,96 @@ TEST_F(RealTimeCorrelativeScanMatcher3DTest, RotationAroundYZ) {
       Eigen::AngleAxisd(0.8 / 180. * M_PI, Eigen::Vector3d(0., 1., 1.))));
 }
 
+TEST_F(RealTimeCorrelativeScanMatcher3DTest, DenseWindowMatchesHybridGrid) {
+  // The window only covers part of the point cloud, the remaining points are
+  // looked up in the HybridGrid.
+  DenseHybridGridWindow dense_window(&hybrid_grid_, 20);
+  dense_window.Recenter(Eigen::Array3i(-60, 25, 0));
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(-0.9, -0.2, 0.2));
+  transform::Rigid3d expected_pose;
+  const float expected_score = real_time_correlative_scan_matcher_->Match(
+      initial_pose, point_cloud_, hybrid_grid_, &expected_pose);
+  transform::Rigid3d pose;
+  const float score = real_time_correlative_scan_matcher_->Match(
+      initial_pose, point_cloud_, dense_window, &pose);
+  EXPECT_EQ(expected_score, score);
+  EXPECT_THAT(pose, transform::IsNearly(expected_pose, 1e-9));
+}
+
+TEST(RealTimeCorrelativeScanMatcher3DSearchTest, MatchesExhaustiveSearch) {
+  constexpr float kResolution = 0.1f;
+  constexpr int kLinearWindowSize = 5;
+  constexpr double kTranslationDeltaCostWeight = 1.;
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> probability_distribution(0.1f, 0.9f);
+  std::uniform_real_distribution<float> point_distribution(-1.f, 1.f);
+  HybridGrid hybrid_grid(kResolution);
+  for (int z = -15; z <= 15; ++z) {
+    for (int y = -15; y <= 15; ++y) {
+      for (int x = -15; x <= 15; ++x) {
+        if (x % 3 == 0 || y % 4 == 0) {
+          hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                                     probability_distribution(prng));
+        }
+      }
+    }
+  }
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 20; ++i) {
+    point_cloud.emplace_back(point_distribution(prng),
+                             point_distribution(prng),
+                             point_distribution(prng));
+  }
+  auto parameter_dictionary = common::MakeDictionary(R"text(
+      return {
+        linear_search_window = 0.5,
+        angular_search_window = 0.,
+        translation_delta_cost_weight = 1.,
+        rotation_delta_cost_weight = 1.,
+      })text");
+  const RealTimeCorrelativeScanMatcher3D real_time_correlative_scan_matcher(
+      CreateRealTimeCorrelativeScanMatcherOptions(parameter_dictionary.get()));
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.02, -0.01, 0.03));
+  transform::Rigid3d pose;
+  const float score = real_time_correlative_scan_matcher.Match(
+      initial_pose, point_cloud, hybrid_grid, &pose);
+
+  // Without rotations, the search space consists of voxel offsets in the
+  // map frame.
+  float expected_score = -1.f;
+  Eigen::Array3i expected_offset = Eigen::Array3i::Zero();
+  for (int z = -kLinearWindowSize; z <= kLinearWindowSize; ++z) {
+    for (int y = -kLinearWindowSize; y <= kLinearWindowSize; ++y) {
+      for (int x = -kLinearWindowSize; x <= kLinearWindowSize; ++x) {
+        const Eigen::Array3i offset(x, y, z);
+        float candidate_score = 0.f;
+        for (const Eigen::Vector3f& point : point_cloud) {
+          candidate_score += hybrid_grid.GetProbability(
+              hybrid_grid.GetCellIndex(initial_pose.cast<float>() * point) +
+              offset);
+        }
+        candidate_score /= static_cast<float>(point_cloud.size());
+        candidate_score *= std::exp(-common::Pow2(
+            kResolution * offset.matrix().cast<float>().norm() *
+            kTranslationDeltaCostWeight));
+        if (candidate_score > expected_score) {
+          expected_score = candidate_score;
+          expected_offset = offset;
+        }
+      }
+    }
+  }
+  EXPECT_NEAR(expected_score, score, 1e-6);
+  EXPECT_THAT(pose, transform::IsNearly(
+                        transform::Rigid3d::Translation(
+                            initial_pose.translation() +
+                            kResolution *
+                                expected_offset.matrix().cast<double>()),
+                        1e-6));
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping
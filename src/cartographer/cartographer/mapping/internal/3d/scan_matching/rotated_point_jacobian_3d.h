@@ -0,0 +1,51 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_ROTATED_POINT_JACOBIAN_3D_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_ROTATED_POINT_JACOBIAN_3D_H_
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+
+namespace cartographer {
+namespace mapping {
+namespace scan_matching {
+
+// Returns the Jacobian of 'rotation' * 'point' with respect to the four
+// quaternion parameters (w, x, y, z) as they are stored by
+// 'optimization::CeresPose'. For a unit quaternion q = (w, v) the rotated point
+// is (w^2 - v.v) p + 2 (v.p) v + 2 w (v x p), which is differentiated here.
+// The quaternion parameterization projects this onto the tangent space.
+inline Eigen::Matrix<double, 3, 4> RotatedPointJacobian(
+    const double* const rotation, const Eigen::Vector3d& point) {
+  const double w = rotation[0];
+  const Eigen::Vector3d v(rotation[1], rotation[2], rotation[3]);
+  Eigen::Matrix3d point_cross;
+  point_cross << 0., -point.z(), point.y(), point.z(), 0., -point.x(),
+      -point.y(), point.x(), 0.;
+  Eigen::Matrix<double, 3, 4> jacobian;
+  jacobian.col(0) = 2. * (w * point + v.cross(point));
+  jacobian.rightCols<3>() =
+      2. * (v.dot(point) * Eigen::Matrix3d::Identity() + v * point.transpose() -
+            point * v.transpose() - w * point_cross);
+  return jacobian;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_3D_SCAN_MATCHING_ROTATED_POINT_JACOBIAN_3D_H_
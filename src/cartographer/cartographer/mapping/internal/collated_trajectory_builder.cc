@@ -29,15 +29,21 @@ constexpr double kSensorDataRatesLoggingPeriodSeconds = 15.;
 }  // namespace
 
 CollatedTrajectoryBuilder::CollatedTrajectoryBuilder(
+    const proto::TrajectoryBuilderOptions& trajectory_options,
     sensor::CollatorInterface* const sensor_collator, const int trajectory_id,
     const std::set<SensorId>& expected_sensor_ids,
     std::unique_ptr<TrajectoryBuilderInterface> wrapped_trajectory_builder)
     : sensor_collator_(sensor_collator),
+      collate_imu_(!trajectory_options.bypass_imu_collator()),
       trajectory_id_(trajectory_id),
       wrapped_trajectory_builder_(std::move(wrapped_trajectory_builder)),
       last_logging_time_(std::chrono::steady_clock::now()) {
   std::unordered_set<std::string> expected_sensor_id_strings;
   for (const auto& sensor_id : expected_sensor_ids) {
+    // The collator must not wait for IMU data it never gets.
+    if (sensor_id.type == SensorId::SensorType::IMU && !collate_imu_) {
+      continue;
+    }
     expected_sensor_id_strings.insert(sensor_id.id);
   }
   sensor_collator_->AddTrajectory(
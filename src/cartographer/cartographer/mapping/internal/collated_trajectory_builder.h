@@ -26,6 +26,7 @@
 #include "cartographer/common/port.h"
 #include "cartographer/common/rate_timer.h"
 #include "cartographer/mapping/local_slam_result_data.h"
+#include "cartographer/mapping/proto/trajectory_builder_options.pb.h"
 #include "cartographer/mapping/submaps.h"
 #include "cartographer/mapping/trajectory_builder_interface.h"
 #include "cartographer/sensor/collator_interface.h"
@@ -35,12 +36,14 @@ namespace cartographer {
 namespace mapping {
 
 // Collates sensor data using a sensor::CollatorInterface, then passes it on to
-// a mapping::TrajectoryBuilderInterface which is common for 2D and 3D.
+// a mapping::TrajectoryBuilderInterface which is common for 2D and 3D. IMU
+// data is passed on directly if 'bypass_imu_collator' is enabled.
 class CollatedTrajectoryBuilder : public TrajectoryBuilderInterface {
  public:
   using SensorId = TrajectoryBuilderInterface::SensorId;
 
   CollatedTrajectoryBuilder(
+      const proto::TrajectoryBuilderOptions& trajectory_options,
       sensor::CollatorInterface* sensor_collator, int trajectory_id,
       const std::set<SensorId>& expected_sensor_ids,
       std::unique_ptr<TrajectoryBuilderInterface> wrapped_trajectory_builder);
@@ -58,7 +61,11 @@ class CollatedTrajectoryBuilder : public TrajectoryBuilderInterface {
 
   void AddSensorData(const std::string& sensor_id,
                      const sensor::ImuData& imu_data) override {
-    AddData(sensor::MakeDispatchable(sensor_id, imu_data));
+    if (collate_imu_) {
+      AddData(sensor::MakeDispatchable(sensor_id, imu_data));
+      return;
+    }
+    wrapped_trajectory_builder_->AddSensorData(sensor_id, imu_data);
   }
 
   void AddSensorData(const std::string& sensor_id,
@@ -82,6 +89,13 @@ class CollatedTrajectoryBuilder : public TrajectoryBuilderInterface {
     AddData(std::move(local_slam_result_data));
   }
 
+  void SetImuPropagatedStateCallback(
+      const ImuPropagatedStateCallback& imu_propagated_state_callback)
+      override {
+    wrapped_trajectory_builder_->SetImuPropagatedStateCallback(
+        imu_propagated_state_callback);
+  }
+
  private:
   void AddData(std::unique_ptr<sensor::Data> data);
 
@@ -89,6 +103,7 @@ class CollatedTrajectoryBuilder : public TrajectoryBuilderInterface {
                                 std::unique_ptr<sensor::Data> data);
 
   sensor::CollatorInterface* const sensor_collator_;
+  const bool collate_imu_;
   const int trajectory_id_;
   std::unique_ptr<TrajectoryBuilderInterface> wrapped_trajectory_builder_;
 
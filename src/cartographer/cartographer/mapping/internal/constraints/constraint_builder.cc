@@ -54,6 +54,16 @@ proto::ConstraintBuilderOptions CreateConstraintBuilderOptions(
       parameter_dictionary->GetDouble("ransac_thresh_of_2d_transform_estimate"));
   options.set_scale_estimated_tolerance(
       parameter_dictionary->GetDouble("scale_estimated_tolerance"));
+  options.set_num_place_recognition_candidates(
+      parameter_dictionary->GetInt("num_place_recognition_candidates"));
+  CHECK_GE(options.num_place_recognition_candidates(), 0);
+  options.set_place_recognition_num_rings(
+      parameter_dictionary->GetInt("place_recognition_num_rings"));
+  options.set_place_recognition_max_radius(
+      parameter_dictionary->GetDouble("place_recognition_max_radius"));
+  options.set_submap_cache_memory_limit_mb(
+      parameter_dictionary->GetDouble("submap_cache_memory_limit_mb"));
+  CHECK_GE(options.submap_cache_memory_limit_mb(), 0.);
 
 
   options.set_log_matches(parameter_dictionary->GetBool("log_matches"));
@@ -16,6 +16,7 @@
 
 #include "cartographer/mapping/internal/constraints/constraint_builder_3d.h"
 
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <iomanip>
@@ -57,19 +58,22 @@ static auto* kGlobalConstraintLowResolutionScoresMetric =
 
 ConstraintBuilder3D::ConstraintBuilder3D(
     const proto::ConstraintBuilderOptions& options,
-    common::ThreadPoolInterface* const thread_pool)
+    common::ThreadPoolInterface* const thread_pool,
+    SubmapNodesCallback submap_nodes_callback)
     : options_(options),
       thread_pool_(thread_pool),
+      submap_nodes_callback_(std::move(submap_nodes_callback)),
       finish_node_task_(common::make_unique<common::Task>()),
       when_done_task_(common::make_unique<common::Task>()),
       sampler_(options.sampling_ratio()),
-      ceres_scan_matcher_(options.ceres_scan_matcher_options_3d()) {}
+      ceres_scan_matcher_(options.ceres_scan_matcher_options_3d()),
+      place_index_(options.place_recognition_num_rings(),
+                   options.place_recognition_max_radius()) {}
 
 ConstraintBuilder3D::~ConstraintBuilder3D() {
   common::MutexLocker locker(&mutex_);
   CHECK_EQ(finish_node_task_->GetState(), common::Task::NEW);
   CHECK_EQ(when_done_task_->GetState(), common::Task::NEW);
-  // CHECK_EQ(constraints_.size(), 0) << "WhenDone() was not called";
   CHECK_EQ(num_started_nodes_, num_finished_nodes_);
   CHECK(when_done_ == nullptr);
 }
@@ -106,7 +110,7 @@ void ConstraintBuilder3D::WhenDone(
 void ConstraintBuilder3D::DispatchScanMatcherConstruction(
     const SubmapId& submap_id, 
     const transform::Rigid3d& global_submap_pose,
-    const std::vector<std::pair<NodeId, TrajectoryNode>>& submap_nodes,
+    const SubmapNodes& submap_nodes,
     const Submap3D* submap) {
   common::MutexLocker locker(&mutex_);
   if (when_done_) {
@@ -121,28 +125,25 @@ void ConstraintBuilder3D::DispatchScanMatcherConstruction(
       &submap->high_resolution_hybrid_grid();
   submap_scan_matcher.low_resolution_hybrid_grid =
       &submap->low_resolution_hybrid_grid();
-  auto& scan_matcher_options =
-      options_.fast_correlative_scan_matcher_options_3d();
-  std::vector<TrajectoryNode> nodes_wiouout_id={};
-  for(const auto& node: submap_nodes){
-    nodes_wiouout_id.emplace_back(node.second);
-  }
+  submap_scan_matcher.global_submap_pose = global_submap_pose;
+  submap_scan_matcher.nodes_in_submap =
+      std::make_shared<const SubmapNodes>(submap_nodes);
+  CacheSubmapData(submap_id);
+  const HybridGrid* const high_resolution_hybrid_grid =
+      submap_scan_matcher.high_resolution_hybrid_grid;
   auto scan_matcher_task = common::make_unique<common::Task>();
   //捕获列表临时变量要以值拷贝的形式传入
-  scan_matcher_task->SetWorkItem(
-      [=,  &submap_scan_matcher, &scan_matcher_options]() {
-        cartographer::common::TicToc tic_toc;
-        tic_toc.Tic();
-        submap_scan_matcher.fast_correlative_scan_matcher =
-            common::make_unique<scan_matching::FastCorrelativeScanMatcher3D>(
-              *submap_scan_matcher.high_resolution_hybrid_grid,
-              submap_scan_matcher.low_resolution_hybrid_grid, nodes_wiouout_id,
-              scan_matcher_options);
-        sum_t_cost_ += tic_toc.Toc();
-        submap_scan_matcher.global_submap_pose = global_submap_pose;
-        submap_scan_matcher.nodes_in_submap = submap_nodes;
-        ExtractFeaturesForSubmap(submap_id);
-      });
+  scan_matcher_task->SetWorkItem([=]() EXCLUDES(mutex_) {
+    cartographer::common::TicToc tic_toc;
+    tic_toc.Tic();
+    GetScanMatcher(submap_id);
+    {
+      common::MutexLocker locker(&mutex_);
+      sum_t_cost_ += tic_toc.Toc();
+    }
+    ExtractFeaturesForSubmap(submap_id, *high_resolution_hybrid_grid,
+                             global_submap_pose);
+  });
   submap_scan_matcher.creation_task_handle =
       thread_pool_->Schedule(std::move(scan_matcher_task));
   
@@ -159,90 +160,166 @@ void ConstraintBuilder3D::DispatchScanMatcherConstruction(
   when_done_task_->AddDependency(submap_constraints_task_handle);
 }
 
+void ConstraintBuilder3D::MaybeAddConstraintsForSubmapPair(
+    const SubmapId& submap_id, const SubmapId& node_submap_id,
+    const transform::Rigid3d& submap_to_submap) {
+  {
+    common::MutexLocker locker(&mutex_);
+    submap_scan_matchers_.at(node_submap_id).matched_submaps[submap_id] =
+        submap_to_submap;
+  }
+  const std::shared_ptr<const SubmapNodes> nodes =
+      GetSubmapNodes(node_submap_id);
+  if (nodes == nullptr) return;
+  common::MutexLocker locker(&mutex_);
+  ScheduleConstraintsForSubmapPair(submap_id, node_submap_id, nodes);
+}
+
 void ConstraintBuilder3D::ComputeConstraintsBetweenSubmaps(
       const SubmapId& submap_id_from) EXCLUDES(mutex_){
-  const auto& scan_matcher_from = submap_scan_matchers_.at(submap_id_from);
-  // no constraints for this submap
-  if(scan_matcher_from.matched_submaps.empty()) return;
-  
-  for(const auto& submap_id_to: scan_matcher_from.matched_submaps){
-    if(submap_scan_matchers_.find(submap_id_to.first) 
-        == submap_scan_matchers_.end()){
-      LOG(WARNING)<<"This should not happen!";
-      continue;
-    };
-    
-    const auto& scan_matcher_to = submap_scan_matchers_.at(submap_id_to.first);
-    int j = 0;
-    for(const auto& node: scan_matcher_from.nodes_in_submap){
-      if(j++ % options_.every_nodes_to_find_constraint() != 0) continue;
-      // constraint between the node and the submap has been added before.
-      const auto& it = computed_constraints_.find(submap_id_to.first);
-      if(it != computed_constraints_.end() 
-        && it->second.find(node.first) != it->second.end()){
-        continue;
+  {
+    common::MutexLocker locker(&mutex_);
+    const auto it = submap_scan_matchers_.find(submap_id_from);
+    if (it == submap_scan_matchers_.end() ||
+        it->second.matched_submaps.empty()) {
+      return;
+    }
+  }
+  const std::shared_ptr<const SubmapNodes> nodes =
+      GetSubmapNodes(submap_id_from);
+  if (nodes == nullptr) return;
+  common::MutexLocker locker(&mutex_);
+  const auto it = submap_scan_matchers_.find(submap_id_from);
+  if (it == submap_scan_matchers_.end()) return;
+  for (const auto& submap_id_to : it->second.matched_submaps) {
+    ScheduleConstraintsForSubmapPair(submap_id_to.first, submap_id_from,
+                                     nodes);
+  }
+}
+
+void ConstraintBuilder3D::ScheduleConstraintsForSubmapPair(
+    const SubmapId& submap_id, const SubmapId& node_submap_id,
+    const std::shared_ptr<const SubmapNodes>& nodes_ptr) {
+  if (submap_scan_matchers_.count(submap_id) == 0) {
+    LOG(WARNING) << "No scan matcher for submap " << submap_id << ".";
+    return;
+  }
+  const SubmapNodes& nodes = *nodes_ptr;
+  // As many nodes are matched as the stride 'every_nodes_to_find_constraint'
+  // used to select, but they are spread over the submap.
+  const int every_nodes = options_.every_nodes_to_find_constraint();
+  const size_t num_nodes_to_match =
+      (nodes.size() + every_nodes - 1) / every_nodes;
+
+  // Skip nodes whose constraint to the submap has been found or is being
+  // computed, so that scheduling a pair again does not duplicate constraints.
+  std::set<NodeId>& computed_nodes = computed_constraints_[submap_id];
+  std::vector<int> candidate_indices;
+  for (int i = 0; i != static_cast<int>(nodes.size()); ++i) {
+    if (computed_nodes.count(nodes[i].first) == 0) {
+      candidate_indices.push_back(i);
+    }
+  }
+  const std::vector<int> node_indices = SelectSpatiallyDiverseNodes(
+      nodes, candidate_indices, num_nodes_to_match);
+  if (node_indices.empty()) return;
+  for (const int node_index : node_indices) {
+    computed_nodes.insert(nodes[node_index].first);
+  }
+  num_pending_matches_ += node_indices.size();
+  kQueueLengthMetric->Set(num_pending_matches_);
+
+  // All nodes of the pair are matched in one task against the same
+  // scan matcher.
+  auto constraint_task = common::make_unique<common::Task>();
+  constraint_task->SetWorkItem([=]() EXCLUDES(mutex_) {
+    ComputeConstraintsForSubmapPair(submap_id, node_submap_id, *nodes_ptr,
+                                    node_indices);
+    common::MutexLocker locker(&mutex_);
+    num_pending_matches_ -= node_indices.size();
+    kQueueLengthMetric->Set(num_pending_matches_);
+  });
+  thread_pool_->Schedule(std::move(constraint_task));
+}
+
+std::vector<int> ConstraintBuilder3D::SelectSpatiallyDiverseNodes(
+    const SubmapNodes& nodes, const std::vector<int>& candidate_indices,
+    const size_t num_nodes) {
+  if (candidate_indices.size() <= num_nodes) {
+    return candidate_indices;
+  }
+  // Farthest point sampling: starting from the first candidate, repeatedly
+  // take the candidate farthest away from all nodes taken so far. Taken
+  // candidates are marked with a negative distance.
+  std::vector<double> min_squared_distances(
+      candidate_indices.size(), std::numeric_limits<double>::infinity());
+  std::vector<int> selected_indices;
+  selected_indices.reserve(num_nodes);
+  size_t next = 0;
+  while (selected_indices.size() != num_nodes) {
+    selected_indices.push_back(candidate_indices[next]);
+    min_squared_distances[next] = -1.;
+    const Eigen::Vector3d selected_position =
+        nodes[candidate_indices[next]].second.global_pose.translation();
+    double max_squared_distance = -1.;
+    for (size_t i = 0; i != candidate_indices.size(); ++i) {
+      if (min_squared_distances[i] < 0.) continue;
+      min_squared_distances[i] = std::min(
+          min_squared_distances[i],
+          (nodes[candidate_indices[i]].second.global_pose.translation() -
+           selected_position)
+              .squaredNorm());
+      if (min_squared_distances[i] > max_squared_distance) {
+        max_squared_distance = min_squared_distances[i];
+        next = i;
       }
-      constraints_.emplace_back();
-      kQueueLengthMetric->Set(constraints_.size());
-      auto* const constraint = &constraints_.back();
-      
-      auto constraint_task = common::make_unique<common::Task>();
-      constraint_task->SetWorkItem([=]() 
-        EXCLUDES(mutex_) {
-        ComputeConstraint(
-          submap_id_to.first, node.first, submap_id_from, constraint);
-      });
-      
-      auto constraint_task_handle =
-          thread_pool_->Schedule(std::move(constraint_task));
-    } 
+    }
   }
+  std::sort(selected_indices.begin(), selected_indices.end());
+  return selected_indices;
 }
 
-void ConstraintBuilder3D::ComputeConstraint(
-    const SubmapId& submap_id, const NodeId& node_id, 
-    const SubmapId& node_submap_id /*submap_id the node belongs to*/,
-    std::unique_ptr<Constraint>* constraint) {
+void ConstraintBuilder3D::ComputeConstraintsForSubmapPair(
+    const SubmapId& submap_id, const SubmapId& node_submap_id,
+    const SubmapNodes& nodes, const std::vector<int>& node_indices) {
   cartographer::common::TicToc tic_toc;
   tic_toc.Tic();
-  // The 'constraint_transform' (submap i <- node j) is computed from:
-  // - a 'high_resolution_point_cloud' in node j and
-  // - the initial guess 'initial_pose' (submap i <- node j).
-  std::unique_ptr<scan_matching::FastCorrelativeScanMatcher3D::Result>
-      match_result;
-  const SubmapScanMatcher& submap_to_matcher 
-      = submap_scan_matchers_.at(submap_id);
-  const SubmapScanMatcher& submap_from_matcher 
-      = submap_scan_matchers_.at(node_submap_id);
-
-  
-  const auto& iter = submap_from_matcher.matched_submaps.find(submap_id);
-  if(iter == submap_from_matcher.matched_submaps.end()) {
-    LOG(WARNING) << "No matching between submaps, should not get into this function.";
-    return;
+  const HybridGrid* high_resolution_hybrid_grid;
+  const HybridGrid* low_resolution_hybrid_grid;
+  transform::Rigid3d global_submap_pose_from;
+  transform::Rigid3d global_submap_pose_to;
+  transform::Rigid3d submap_to_submap_2D;
+  {
+    common::MutexLocker locker(&mutex_);
+    const auto to_it = submap_scan_matchers_.find(submap_id);
+    const auto from_it = submap_scan_matchers_.find(node_submap_id);
+    if (to_it == submap_scan_matchers_.end() ||
+        from_it == submap_scan_matchers_.end()) {
+      // One of the submaps has been deleted in the meantime.
+      return;
+    }
+    const auto iter = from_it->second.matched_submaps.find(submap_id);
+    if (iter == from_it->second.matched_submaps.end()) {
+      LOG(WARNING) << "No matching between submaps, "
+                   << "should not get into this function.";
+      return;
+    }
+    submap_to_submap_2D = iter->second;
+    high_resolution_hybrid_grid = to_it->second.high_resolution_hybrid_grid;
+    low_resolution_hybrid_grid = to_it->second.low_resolution_hybrid_grid;
+    global_submap_pose_to = to_it->second.global_submap_pose;
+    global_submap_pose_from = from_it->second.global_submap_pose;
   }
-  // LOG(WARNING) << "Matching " <<node_submap_id.submap_index
-  //              <<" to "<< submap_id.submap_index;
-  transform::Rigid3d submap_to_submap_2D = iter->second;
-  transform::Rigid3d node_pose_in_submap_from;
-  
+  const std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher3D>
+      fast_correlative_scan_matcher = GetScanMatcher(submap_id);
+  if (fast_correlative_scan_matcher == nullptr) return;
 
-  std::shared_ptr<const TrajectoryNode::Data> constant_data = nullptr;
-  const auto nodes = submap_from_matcher.nodes_in_submap;
-  for(int i = 0; i < nodes.size(); ++i){
-    if(nodes.at(i).first == node_id){
-      constant_data = nodes.at(i).second.constant_data;
-      node_pose_in_submap_from = nodes.at(i).second.global_pose;
-      break;
-    }
-  } 
-  CHECK(constant_data != nullptr) << "Invalid constant_data!";
   // P in submap to match
   // T_G1_S1 * T_G2_G1 * T_S2_G2 * T_N_S2 * P
-  transform::Rigid3d gravity_aligned_from = transform::Rigid3d::Rotation(
-      submap_from_matcher.global_submap_pose.rotation());
-  transform::Rigid3d gravity_aligned_to = transform::Rigid3d::Rotation(
-      submap_to_matcher.global_submap_pose.rotation());
+  transform::Rigid3d gravity_aligned_from =
+      transform::Rigid3d::Rotation(global_submap_pose_from.rotation());
+  transform::Rigid3d gravity_aligned_to =
+      transform::Rigid3d::Rotation(global_submap_pose_to.rotation());
   // Remove yaw in map frame
   double yaw_from = transform::GetYaw(gravity_aligned_from);
   auto inv_yaw_from_rot = transform::Embed3D(
@@ -255,94 +332,95 @@ void ConstraintBuilder3D::ComputeConstraint(
 
   const auto& T_G1_S1 = gravity_aligned_to.inverse();
   const auto& T_S2_G2 = gravity_aligned_from;
-  transform::Rigid3d node_pose_in_submap_to = T_G1_S1 * submap_to_submap_2D 
-      * T_S2_G2 * node_pose_in_submap_from;
-  
+  const transform::Rigid3d submap_from_to_submap_to =
+      T_G1_S1 * submap_to_submap_2D * T_S2_G2;
+
+  // The 'constraint_transform' (submap i <- node j) is computed from:
+  // - a 'high_resolution_point_cloud' in node j and
+  // - the initial guess 'poses_in_submap_to' (submap i <- node j).
+  std::vector<transform::Rigid3d> poses_in_submap_to;
+  std::vector<const TrajectoryNode::Data*> constant_data;
+  for (const int node_index : node_indices) {
+    const TrajectoryNode& node = nodes.at(node_index).second;
+    CHECK(node.constant_data != nullptr) << "Invalid constant_data!";
+    poses_in_submap_to.push_back(submap_from_to_submap_to * node.global_pose);
+    constant_data.push_back(node.constant_data.get());
+  }
 
   // Compute 'pose_estimate' in three stages:
   // 1. Fast estimate using the fast correlative scan matcher.
   // 2. Prune if the score is too low.
   // 3. Refine.
-  {
-    kConstraintsSearchedMetric->Increment();
-    // Match full submap.
-    /* match_result =
-        submap_to_matcher.fast_correlative_scan_matcher->MatchFullSubmap(
-            global_node_pose.rotation(), 
-            submap_to_matcher.global_submap_pose.rotation(),
-            *constant_data, options_.global_localization_min_score()); */
-    // Match with initial guess.
-    match_result = submap_to_matcher.fast_correlative_scan_matcher
-        ->MatchWith3DofInitial(node_pose_in_submap_to,  
-          *constant_data, options_.min_score());
-    if (match_result != nullptr) {
-      /* auto relative_submap_to_submap = match_result->pose_estimate 
-        * (node_pose_in_submap_from.inverse());
-      LOG(WARNING)<<node_pose_in_submap_to.translation().x()
-                  <<","<<node_pose_in_submap_to.translation().y()
-                  <<","<<node_pose_in_submap_to.translation().z();
-      LOG(WARNING)<<match_result->pose_estimate.translation().x()
-                  <<","<<match_result->pose_estimate.translation().y()
-                  <<","<<match_result->pose_estimate.translation().z();
-      LOG(WARNING)<<submap_to_submap_2D.translation().x()
-                  <<","<<submap_to_submap_2D.translation().y()
-                  <<","<<submap_to_submap_2D.translation().z()
-                  <<","<<transform::GetYaw(submap_to_submap_2D);
-      LOG(WARNING)<<relative_submap_to_submap.translation().x()
-                  <<","<<relative_submap_to_submap.translation().y()
-                  <<","<<relative_submap_to_submap.translation().z()
-                  <<","<<transform::GetYaw(relative_submap_to_submap); */
-      
-      // We've reported a successful local match.
-      CHECK_GT(match_result->score, options_.min_score());
-      kConstraintsFoundMetric->Increment();
-      kConstraintScoresMetric->Observe(match_result->score);
-      kConstraintRotationalScoresMetric->Observe(
-          match_result->rotational_score);
-      kConstraintLowResolutionScoresMetric->Observe(
-          match_result->low_resolution_score);
-    } else {
-      return;
+  kConstraintsSearchedMetric->Increment(node_indices.size());
+  const std::vector<
+      std::unique_ptr<scan_matching::FastCorrelativeScanMatcher3D::Result>>
+      match_results = fast_correlative_scan_matcher->MatchBatchWith3DofInitial(
+          poses_in_submap_to, constant_data, options_.min_score());
+  for (size_t i = 0; i != node_indices.size(); ++i) {
+    const auto& match_result = match_results[i];
+    const NodeId& node_id = nodes.at(node_indices[i]).first;
+    if (match_result == nullptr) {
+      // Allow the node to be matched again if the pair is scheduled again.
+      common::MutexLocker locker(&mutex_);
+      const auto computed_it = computed_constraints_.find(submap_id);
+      if (computed_it != computed_constraints_.end()) {
+        computed_it->second.erase(node_id);
+      }
+      continue;
+    }
+
+    // We've reported a successful local match.
+    CHECK_GT(match_result->score, options_.min_score());
+    kConstraintsFoundMetric->Increment();
+    kConstraintScoresMetric->Observe(match_result->score);
+    kConstraintRotationalScoresMetric->Observe(
+        match_result->rotational_score);
+    kConstraintLowResolutionScoresMetric->Observe(
+        match_result->low_resolution_score);
+
+    // Use the CSM estimate as both the initial and previous pose. This has
+    // the effect that, in the absence of better information, we prefer the
+    // original CSM estimate.
+    ceres::Solver::Summary unused_summary;
+    transform::Rigid3d constraint_transform;
+    ceres_scan_matcher_.Match(match_result->pose_estimate.translation(),
+                              match_result->pose_estimate,
+                              {{&constant_data[i]->high_resolution_point_cloud,
+                                high_resolution_hybrid_grid,
+                                nullptr /* dense_window */},
+                               {&constant_data[i]->low_resolution_point_cloud,
+                                low_resolution_hybrid_grid,
+                                nullptr /* dense_window */}},
+                              &constraint_transform, &unused_summary);
+
+    {
+      common::MutexLocker locker(&mutex_);
+      score_histogram_.Add(match_result->score);
+      rotational_score_histogram_.Add(match_result->rotational_score);
+      low_resolution_score_histogram_.Add(match_result->low_resolution_score);
+      // Constraints to a submap deleted in the meantime are dropped.
+      if (submap_scan_matchers_.count(submap_id) != 0) {
+        new_constraints_.push_back(Constraint{
+            submap_id,
+            node_id,
+            {constraint_transform, options_.loop_closure_translation_weight(),
+             options_.loop_closure_rotation_weight()},
+            Constraint::INTER_SUBMAP});
+      }
+    }
+
+    if (options_.log_matches()) {
+      std::ostringstream info;
+      info << "Node " << node_id << " with "
+           << constant_data[i]->high_resolution_point_cloud.size()
+           << " points on submap " << submap_id << std::fixed;
+      info << " matches";
+      info << " with score " << std::setprecision(1)
+           << 100. * match_result->score << "%.";
+      LOG(INFO) << info.str();
     }
   }
-  {
-    common::MutexLocker locker(&mutex_);
-    score_histogram_.Add(match_result->score);
-    rotational_score_histogram_.Add(match_result->rotational_score);
-    low_resolution_score_histogram_.Add(match_result->low_resolution_score);
-  }
-
-  // Use the CSM estimate as both the initial and previous pose. This has the
-  // effect that, in the absence of better information, we prefer the original
-  // CSM estimate.
-  ceres::Solver::Summary unused_summary;
-  transform::Rigid3d constraint_transform;
-  ceres_scan_matcher_.Match(match_result->pose_estimate.translation(),
-                            match_result->pose_estimate,
-                            {{&constant_data->high_resolution_point_cloud,
-                              submap_to_matcher.high_resolution_hybrid_grid},
-                             {&constant_data->low_resolution_point_cloud,
-                              submap_to_matcher.low_resolution_hybrid_grid}},
-                            &constraint_transform, &unused_summary);
-
-  constraint->reset(new Constraint{
-      submap_id,
-      node_id,
-      {constraint_transform, options_.loop_closure_translation_weight(),
-       options_.loop_closure_rotation_weight()},
-      Constraint::INTER_SUBMAP});
-  computed_constraints_[submap_id].insert(node_id);
-
-  if (options_.log_matches()) {
-    std::ostringstream info;
-    info << "Node " << node_id << " with "
-         << constant_data->high_resolution_point_cloud.size()
-         << " points on submap " << submap_id << std::fixed;
-    info << " matches";
-    info << " with score " << std::setprecision(1) << 100. * match_result->score
-         << "%.";
-    LOG(INFO) << info.str();
-  }
+  common::MutexLocker locker(&mutex_);
   sum_t_cost_ += tic_toc.Toc();
 }
 
@@ -352,13 +430,9 @@ void ConstraintBuilder3D::RunWhenDoneCallback() {
   {
     common::MutexLocker locker(&mutex_);
     CHECK(when_done_ != nullptr);
-    for (const std::unique_ptr<Constraint>& constraint : constraints_) {
-      if (constraint == nullptr) continue;
-      result.push_back(*constraint);
-    }
+    result.swap(new_constraints_);
     if (options_.log_matches()) {
-      LOG(INFO) << constraints_.size() << " computations resulted in "
-                << result.size() << " additional constraints.\n"
+      LOG(INFO) << result.size() << " additional constraints.\n"
                 << "Score histogram:\n"
                 << score_histogram_.ToString(10) << "\n"
                 << "Rotational score histogram:\n"
@@ -366,10 +440,8 @@ void ConstraintBuilder3D::RunWhenDoneCallback() {
                 << "Low resolution score histogram:\n"
                 << low_resolution_score_histogram_.ToString(10);
     }
-    constraints_.clear();
     callback = std::move(when_done_);
     when_done_.reset();
-    kQueueLengthMetric->Set(constraints_.size());
   }
   (*callback)(result);
 }
@@ -390,12 +462,19 @@ void ConstraintBuilder3D::DeleteScanMatcher(const SubmapId& submap_id) {
     LOG(WARNING)
         << "DeleteScanMatcher was called while WhenDone was scheduled.";
   }
-  submap_scan_matchers_.erase(submap_id);
-  for(auto& constrait: constraints_){
-    if(constrait && constrait->submap_id == submap_id){
-      constrait = nullptr;
-    }
+  const auto it = submap_scan_matchers_.find(submap_id);
+  if (it != submap_scan_matchers_.end() && it->second.cached) {
+    cached_submaps_.erase(it->second.cache_position);
+    cached_memory_usage_ -= it->second.memory_usage;
   }
+  submap_scan_matchers_.erase(submap_id);
+  place_index_.Remove(submap_id);
+  new_constraints_.erase(
+      std::remove_if(new_constraints_.begin(), new_constraints_.end(),
+                     [&submap_id](const Constraint& constraint) {
+                       return constraint.submap_id == submap_id;
+                     }),
+      new_constraints_.end());
   computed_constraints_.erase(submap_id);
 }
 
@@ -433,101 +512,311 @@ void ConstraintBuilder3D::RegisterMetrics(metrics::FamilyFactory* factory) {
       {{"search_region", "global"}, {"kind", "low_resolution_score"}});
 }
 
+std::shared_ptr<const ConstraintBuilder3D::SubmapNodes>
+ConstraintBuilder3D::GetSubmapNodes(const SubmapId& submap_id) {
+  {
+    common::MutexLocker locker(&mutex_);
+    const auto it = submap_scan_matchers_.find(submap_id);
+    if (it == submap_scan_matchers_.end()) return nullptr;
+    if (it->second.nodes_in_submap != nullptr) {
+      CacheSubmapData(submap_id);
+      return it->second.nodes_in_submap;
+    }
+  }
+  // The nodes have been dropped from memory.
+  const auto nodes =
+      std::make_shared<const SubmapNodes>(submap_nodes_callback_(submap_id));
+  common::MutexLocker locker(&mutex_);
+  const auto it = submap_scan_matchers_.find(submap_id);
+  if (it == submap_scan_matchers_.end()) return nullptr;
+  it->second.nodes_in_submap = nodes;
+  CacheSubmapData(submap_id);
+  return nodes;
+}
+
+std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher3D>
+ConstraintBuilder3D::GetScanMatcher(const SubmapId& submap_id) {
+  const HybridGrid* high_resolution_hybrid_grid;
+  const HybridGrid* low_resolution_hybrid_grid;
+  {
+    common::MutexLocker locker(&mutex_);
+    locker.Await([this, &submap_id]() REQUIRES(mutex_) {
+      const auto it = submap_scan_matchers_.find(submap_id);
+      return it == submap_scan_matchers_.end() ||
+             !it->second.building_scan_matcher;
+    });
+    const auto it = submap_scan_matchers_.find(submap_id);
+    if (it == submap_scan_matchers_.end()) return nullptr;
+    SubmapScanMatcher& submap_scan_matcher = it->second;
+    if (submap_scan_matcher.fast_correlative_scan_matcher != nullptr) {
+      CacheSubmapData(submap_id);
+      return submap_scan_matcher.fast_correlative_scan_matcher;
+    }
+    // Other threads needing this scan matcher wait for this build.
+    submap_scan_matcher.building_scan_matcher = true;
+    high_resolution_hybrid_grid =
+        submap_scan_matcher.high_resolution_hybrid_grid;
+    low_resolution_hybrid_grid = submap_scan_matcher.low_resolution_hybrid_grid;
+  }
+  const std::shared_ptr<const SubmapNodes> nodes_in_submap =
+      GetSubmapNodes(submap_id);
+  // The submap has been deleted, which also dropped the build flag.
+  if (nodes_in_submap == nullptr) return nullptr;
+  std::vector<TrajectoryNode> nodes;
+  nodes.reserve(nodes_in_submap->size());
+  for (const auto& node : *nodes_in_submap) {
+    nodes.push_back(node.second);
+  }
+  const auto fast_correlative_scan_matcher =
+      std::make_shared<const scan_matching::FastCorrelativeScanMatcher3D>(
+          *high_resolution_hybrid_grid, low_resolution_hybrid_grid, nodes,
+          options_.fast_correlative_scan_matcher_options_3d());
+  const size_t memory_usage = fast_correlative_scan_matcher->MemoryUsage();
+
+  common::MutexLocker locker(&mutex_);
+  const auto it = submap_scan_matchers_.find(submap_id);
+  if (it == submap_scan_matchers_.end()) return nullptr;
+  SubmapScanMatcher& submap_scan_matcher = it->second;
+  submap_scan_matcher.building_scan_matcher = false;
+  submap_scan_matcher.fast_correlative_scan_matcher =
+      fast_correlative_scan_matcher;
+  submap_scan_matcher.scan_matcher_memory_usage = memory_usage;
+  CacheSubmapData(submap_id);
+  return fast_correlative_scan_matcher;
+}
+
+void ConstraintBuilder3D::CacheSubmapData(const SubmapId& submap_id) {
+  const auto it = submap_scan_matchers_.find(submap_id);
+  if (it == submap_scan_matchers_.end()) return;
+  SubmapScanMatcher& submap_scan_matcher = it->second;
+  size_t memory_usage = 0;
+  if (submap_scan_matcher.fast_correlative_scan_matcher != nullptr) {
+    memory_usage += submap_scan_matcher.scan_matcher_memory_usage;
+  }
+  if (submap_scan_matcher.features != nullptr) {
+    const SubmapFeatures& features = *submap_scan_matcher.features;
+    memory_usage += sizeof(SubmapFeatures) +
+                    features.key_points.capacity() * sizeof(cv::KeyPoint) +
+                    features.descriptors.total() *
+                        features.descriptors.elemSize();
+  }
+  if (submap_scan_matcher.nodes_in_submap != nullptr) {
+    memory_usage += sizeof(SubmapNodes) +
+                    submap_scan_matcher.nodes_in_submap->capacity() *
+                        sizeof(SubmapNodes::value_type);
+  }
+  if (submap_scan_matcher.cached) {
+    cached_submaps_.erase(submap_scan_matcher.cache_position);
+    cached_memory_usage_ -= submap_scan_matcher.memory_usage;
+  }
+  cached_submaps_.push_front(submap_id);
+  submap_scan_matcher.cached = true;
+  submap_scan_matcher.cache_position = cached_submaps_.begin();
+  submap_scan_matcher.memory_usage = memory_usage;
+  cached_memory_usage_ += memory_usage;
+
+  // The most recently used submap is always kept.
+  const double memory_limit =
+      options_.submap_cache_memory_limit_mb() * 1024. * 1024.;
+  while (memory_limit > 0. && cached_memory_usage_ > memory_limit &&
+         cached_submaps_.size() > 1) {
+    SubmapScanMatcher& dropped =
+        submap_scan_matchers_.at(cached_submaps_.back());
+    dropped.fast_correlative_scan_matcher.reset();
+    dropped.scan_matcher_memory_usage = 0;
+    dropped.features.reset();
+    dropped.nodes_in_submap.reset();
+    dropped.cached = false;
+    cached_memory_usage_ -= dropped.memory_usage;
+    dropped.memory_usage = 0;
+    cached_submaps_.pop_back();
+  }
+}
+
+std::shared_ptr<const ConstraintBuilder3D::SubmapFeatures>
+ConstraintBuilder3D::ExtractFeatures(
+    const HybridGrid& high_resolution_hybrid_grid,
+    const transform::Rigid3d& global_submap_pose,
+    std::vector<Eigen::Vector2f>* const occupied_points) const {
+  auto features = std::make_shared<SubmapFeatures>();
+  // generate cv Mat for imcomming submap
+  cv::Mat grid =
+      ProjectToCvMat(&high_resolution_hybrid_grid, global_submap_pose,
+                     features->ox, features->oy, features->resolution);
+  cv::threshold(
+      grid, grid, options_.cv_binary_threshold(), 255, CV_THRESH_BINARY);
+  int se = options_.cv_structure_element_size();
+  auto ele = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(se, se));
+  cv::erode(grid, grid, ele);
+  // A detector per call, so that submaps are processed concurrently.
+  cv::xfeatures2d::SURF::create(kMinHessian)->detectAndCompute(
+      grid, cv::noArray(), features->key_points, features->descriptors);
+
+  // Structure pixels of the binarized projection, relative to the submap
+  // origin.
+  occupied_points->clear();
+  for (int row = 0; row < grid.rows; ++row) {
+    const uchar* const pixels = grid.ptr<uchar>(row);
+    for (int col = 0; col < grid.cols; ++col) {
+      if (pixels[col] == 0) {
+        occupied_points->emplace_back(
+            features->ox + col * features->resolution,
+            features->oy + row * features->resolution);
+      }
+    }
+  }
+  return features;
+}
+
+std::vector<ConstraintBuilder3D::FeaturesCandidate>
+ConstraintBuilder3D::FindLoopClosureCandidates(
+    const SubmapId& submap_id,
+    const std::vector<Eigen::Vector2f>& occupied_points) {
+  const auto is_candidate = [this, &submap_id](const SubmapId& id) {
+    if (id == submap_id) return false;
+    // skip adjacent submaps for they are sharing most of scans and
+    // intra-constraints have been added.
+    if (submap_id.trajectory_id == id.trajectory_id &&
+        std::abs(submap_id.submap_index - id.submap_index) <= 2) {
+      return false;
+    }
+    const auto it = submap_scan_matchers_.find(id);
+    return it != submap_scan_matchers_.end() &&
+           it->second.num_key_points >= 2;
+  };
+
+  const std::vector<float> signature =
+      place_index_.ComputeSignature(occupied_points);
+  place_index_.Insert(submap_id, signature);
+
+  std::vector<SubmapId> candidate_ids;
+  const int num_candidates = options_.num_place_recognition_candidates();
+  if (num_candidates > 0) {
+    candidate_ids = place_index_.Query(signature, num_candidates, is_candidate);
+  } else {
+    for (const auto& entry : submap_scan_matchers_) {
+      if (is_candidate(entry.first)) {
+        candidate_ids.push_back(entry.first);
+      }
+    }
+  }
+  std::vector<FeaturesCandidate> candidates;
+  for (const SubmapId& id : candidate_ids) {
+    const SubmapScanMatcher& candidate = submap_scan_matchers_.at(id);
+    candidates.push_back(FeaturesCandidate{
+        id, candidate.features, candidate.high_resolution_hybrid_grid,
+        candidate.global_submap_pose});
+  }
+  return candidates;
+}
+
+bool ConstraintBuilder3D::MatchFeatures(
+    const SubmapFeatures& from, const SubmapFeatures& to,
+    transform::Rigid3d* const submap_to_submap) const {
+  if (from.key_points.size() < 2 || to.key_points.size() < 2) {
+    return false;
+  }
+  // The FLANN matcher trains an index on the descriptors it matches
+  // against, so it cannot be shared between threads.
+  std::vector< std::vector<cv::DMatch> > knn_matches;
+  cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED)
+      ->knnMatch(from.descriptors, to.descriptors, knn_matches, 2);
+
+  const double r = options_.good_match_ratio_of_distance();
+  std::vector<cv::DMatch> good_matches = {};
+  for (size_t i = 0; i < knn_matches.size(); i++){
+    if (knn_matches[i][0].distance < r * knn_matches[i][1].distance){
+      good_matches.push_back(knn_matches[i][0]);
+    }
+  }
+  if(good_matches.size() < options_.minimum_good_match_num()){
+    return false;
+  }
+
+  const cv::Point2f tl(from.ox, from.oy);
+  const cv::Point2f tl_to(to.ox, to.oy);
+  std::vector<cv::Point2f> from_pts={};
+  std::vector<cv::Point2f> to_pts={};
+  for(const cv::DMatch& gmt : good_matches){
+    from_pts.push_back(tl + from.key_points.at(gmt.queryIdx).pt
+                                * from.resolution);
+    to_pts.push_back(tl_to + to.key_points.at(gmt.trainIdx).pt
+                                 * to.resolution);
+  }
+  std::vector<uchar> inliers;
+  cv::Mat transform = cv::estimateAffinePartial2D(
+      from_pts, to_pts, inliers,
+      cv::RANSAC, options_.ransac_thresh_of_2d_transform_estimate());
+  if(transform.empty()){
+    return false;
+  }
+  double scale = std::sqrt(
+    transform.at<double>(0, 0) * transform.at<double>(0, 0)
+    + transform.at<double>(0, 1) * transform.at<double>(0, 1));
+  if(std::abs(scale - 1) > options_.scale_estimated_tolerance()) {
+    return false; //no constraint exists
+  }
+  double theta = std::atan2(
+    transform.at<double>(1,0), transform.at<double>(1,1));
+  transform::Rigid2d::Vector pos;
+  transform::Rigid2d::Rotation2D rot(theta);
+  pos << transform.at<double>(0,2), transform.at<double>(1,2);
+  *submap_to_submap = transform::Embed3D(transform::Rigid2d(pos, rot));
+  return true;
+}
+
 void ConstraintBuilder3D::ExtractFeaturesForSubmap(
-    const SubmapId& submap_id){
+    const SubmapId& submap_id, const HybridGrid& high_resolution_hybrid_grid,
+    const transform::Rigid3d& global_submap_pose) {
   cartographer::common::TicToc tic_toc;
   tic_toc.Tic();
-  const double resolution = submap_scan_matchers_.at(
-    submap_id).high_resolution_hybrid_grid->resolution();
-  if(submap_scan_matchers_.at(submap_id).prj_grid.empty()){
-    // generate cv Mat for imcomming submap
-    submap_scan_matchers_.at(submap_id).prj_grid = ProjectToCvMat(
-        submap_scan_matchers_.at(submap_id).high_resolution_hybrid_grid,
-        submap_scan_matchers_.at(submap_id).global_submap_pose,
-        submap_scan_matchers_.at(submap_id).ox, 
-        submap_scan_matchers_.at(submap_id).oy, 
-        submap_scan_matchers_.at(submap_id).resolution); 
-    cv::Mat& grid = submap_scan_matchers_.at(submap_id).prj_grid;
-    cv::threshold(
-        grid, grid, options_.cv_binary_threshold(), 255, CV_THRESH_BINARY);
-    int se = options_.cv_structure_element_size();  
-    auto ele = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(se, se));
-    cv::erode(grid, grid, ele);
-    surf_detector_->detectAndCompute(grid, cv::noArray(), 
-        submap_scan_matchers_.at(submap_id).key_points, 
-        submap_scan_matchers_.at(submap_id).descriptors);
-    // compute constraints between submaps.
-    cv::Point2f tl(submap_scan_matchers_.at(submap_id).ox,
-                   submap_scan_matchers_.at(submap_id).oy);
-    for(const auto& entry: submap_scan_matchers_){
-      const SubmapId& id = entry.first;
-      const SubmapScanMatcher& scan_matcher = entry.second;
-      
-      if(id == submap_id) continue;
-      if(scan_matcher.prj_grid.empty()) continue;
-      // skip adjacent submaps for they are sharing most of scans and 
-      // intra-constraints have been added.
-      if(submap_id.trajectory_id == id.trajectory_id 
-        && std::abs(submap_id.submap_index - id.submap_index) <= 2){
-        continue;
-      }
-      
-      std::vector< std::vector<cv::DMatch> > knn_matches;
-      if(submap_scan_matchers_.at(submap_id).key_points.size() >= 2 
-          && submap_scan_matchers_.at(id).key_points.size() >= 2){
-          surf_matcher_->knnMatch(
-            submap_scan_matchers_.at(submap_id).descriptors, 
-            submap_scan_matchers_.at(id).descriptors, knn_matches, 2);
-      }else{
-        continue;
-      }
-    
-      const double r = options_.good_match_ratio_of_distance();
-      std::vector<cv::DMatch> good_matches = {};
-      for (size_t i = 0; i < knn_matches.size(); i++){
-        if (knn_matches[i][0].distance < r * knn_matches[i][1].distance){
-          good_matches.push_back(knn_matches[i][0]);
-        }
-      }
+  std::vector<Eigen::Vector2f> occupied_points;
+  const std::shared_ptr<const SubmapFeatures> features = ExtractFeatures(
+      high_resolution_hybrid_grid, global_submap_pose, &occupied_points);
+  std::vector<FeaturesCandidate> candidates;
+  {
+    common::MutexLocker locker(&mutex_);
+    const auto it = submap_scan_matchers_.find(submap_id);
+    if (it == submap_scan_matchers_.end()) return;
+    it->second.features = features;
+    it->second.num_key_points = features->key_points.size();
+    CacheSubmapData(submap_id);
+    candidates = FindLoopClosureCandidates(submap_id, occupied_points);
+  }
 
-      if(good_matches.size() >= options_.minimum_good_match_num()){ 
-        std::vector<cv::Point2f> from_pts={};
-        std::vector<cv::Point2f> to_pts={};
-        for(int i = 0; i < good_matches.size(); ++i){
-          auto gmt = good_matches[i];
-          cv::Point2f tl_to(submap_scan_matchers_.at(id).ox,
-                            submap_scan_matchers_.at(id).oy);
-          from_pts.push_back(tl + submap_scan_matchers_.at(
-            submap_id).key_points.at(gmt.queryIdx).pt * resolution);
-          to_pts.push_back(tl_to + submap_scan_matchers_.at(
-            id).key_points.at(gmt.trainIdx).pt * resolution);
-        }
-        std::vector<uchar> inliers;
-        cv::Mat transform = cv::estimateAffinePartial2D(
-            from_pts, to_pts, inliers, 
-            cv::RANSAC, options_.ransac_thresh_of_2d_transform_estimate());
-        if(!transform.empty()){
-          double scale = std::sqrt(
-            transform.at<double>(0, 0) * transform.at<double>(0, 0) 
-            + transform.at<double>(0, 1) * transform.at<double>(0, 1));
-          if(std::abs(scale - 1) > options_.scale_estimated_tolerance()) {
-            continue; //no constraint exists
-          }else{
-            double theta = std::atan2(
-              transform.at<double>(1,0), transform.at<double>(1,1));
-           
-            transform::Rigid2d::Vector pos;
-            transform::Rigid2d::Rotation2D rot(theta);
-            pos << transform.at<double>(0,2), transform.at<double>(1,2);
-            transform::Rigid2d rt2(pos, rot);
-            // insert submap-to-submap constraint
-            submap_scan_matchers_.at(submap_id).matched_submaps.insert(
-              {id, transform::Embed3D(rt2)});
-          }
-        }
-      }
+  // compute constraints between submaps.
+  std::map<SubmapId, transform::Rigid3d> matched_submaps;
+  std::vector<FeaturesCandidate> extracted_candidates;
+  for (auto& candidate : candidates) {
+    if (candidate.features == nullptr) {
+      // The features of the candidate have been dropped from memory.
+      std::vector<Eigen::Vector2f> unused_occupied_points;
+      candidate.features = ExtractFeatures(
+          *candidate.high_resolution_hybrid_grid, candidate.global_submap_pose,
+          &unused_occupied_points);
+      extracted_candidates.push_back(candidate);
+    }
+    transform::Rigid3d submap_to_submap;
+    if (MatchFeatures(*features, *candidate.features, &submap_to_submap)) {
+      matched_submaps.emplace(candidate.submap_id, submap_to_submap);
+    }
+  }
+
+  common::MutexLocker locker(&mutex_);
+  for (const auto& candidate : extracted_candidates) {
+    const auto candidate_it = submap_scan_matchers_.find(candidate.submap_id);
+    if (candidate_it != submap_scan_matchers_.end() &&
+        candidate_it->second.features == nullptr) {
+      candidate_it->second.features = candidate.features;
+      CacheSubmapData(candidate.submap_id);
     }
   }
+  const auto it = submap_scan_matchers_.find(submap_id);
+  if (it == submap_scan_matchers_.end()) return;
+  // insert submap-to-submap constraints
+  it->second.matched_submaps.insert(matched_submaps.begin(),
+                                    matched_submaps.end());
+  CacheSubmapData(submap_id);
   sum_t_cost_ += tic_toc.Toc();
 }
 
@@ -21,6 +21,8 @@
 #include <deque>
 #include <functional>
 #include <limits>
+#include <list>
+#include <memory>
 #include <vector>
 
 #include "Eigen/Core"
@@ -36,6 +38,7 @@
 #include "cartographer/mapping/3d/submap_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/ceres_scan_matcher_3d.h"
 #include "cartographer/mapping/internal/3d/scan_matching/fast_correlative_scan_matcher_3d.h"
+#include "cartographer/mapping/internal/constraints/submap_place_index.h"
 #include "cartographer/mapping/pose_graph_interface.h"
 #include "cartographer/mapping/proto/pose_graph/constraint_builder_options.pb.h"
 #include "cartographer/mapping/trajectory_node.h"
@@ -67,9 +70,18 @@ class ConstraintBuilder3D {
  public:
   using Constraint = mapping::PoseGraphInterface::Constraint;
   using Result = std::vector<Constraint>;
-
+  // Nodes of a submap with their poses relative to it.
+  using SubmapNodes = std::vector<std::pair<NodeId, TrajectoryNode>>;
+  // Returns the nodes of a submap, as passed to
+  // 'DispatchScanMatcherConstruction', or none if it was trimmed.
+  using SubmapNodesCallback = std::function<SubmapNodes(const SubmapId&)>;
+
+  // 'submap_nodes_callback' is used to get the nodes of a submap again after
+  // they were dropped from memory. It is called from the 'thread_pool'
+  // without holding any lock of this class.
   ConstraintBuilder3D(const proto::ConstraintBuilderOptions& options,
-                      common::ThreadPoolInterface* thread_pool);
+                      common::ThreadPoolInterface* thread_pool,
+                      SubmapNodesCallback submap_nodes_callback);
   ~ConstraintBuilder3D();
 
   ConstraintBuilder3D(const ConstraintBuilder3D&) = delete;
@@ -79,10 +91,18 @@ class ConstraintBuilder3D {
   void DispatchScanMatcherConstruction(
       const SubmapId& submap_id,
       const transform::Rigid3d& global_submap_pose,
-      const std::vector<std::pair<NodeId, TrajectoryNode>>& submap_nodes, 
+      const SubmapNodes& submap_nodes,
       const Submap3D* submap);
 
 
+  // Matches the nodes of 'node_submap_id' against 'submap_id', given the
+  // transform 'submap_to_submap' between their gravity aligned projections.
+  // Both scan matchers must have been dispatched. Nodes whose constraint to
+  // 'submap_id' has been found or is being computed are skipped.
+  void MaybeAddConstraintsForSubmapPair(
+      const SubmapId& submap_id, const SubmapId& node_submap_id,
+      const transform::Rigid3d& submap_to_submap);
+
   // Must be called after all computations related to one node have been added.
   void NotifyEndOfNode();
 
@@ -99,13 +119,11 @@ class ConstraintBuilder3D {
       common::MutexLocker locker(&mutex_);
       return thread_pool_;
   }
-  Result GetConstraints() {
+  // Returns the constraints found since the last call.
+  Result TakeNewConstraints() {
     common::MutexLocker locker(&mutex_);
     Result result;
-    for (const std::unique_ptr<Constraint>& constraint : constraints_) {
-      if (constraint == nullptr) continue;
-      result.push_back(*constraint);
-    }
+    result.swap(new_constraints_);
     return result;
   }
 
@@ -122,49 +140,130 @@ class ConstraintBuilder3D {
   }
 
   // Not used anymore.
-  // Registers the 'callback' to be called with the results, after all
-  // computations triggered by 'MaybeAdd*Constraint' have finished.
-  // 'callback' is executed in the 'ThreadPool'.
+  // Registers the 'callback' to be called with the constraints found since the
+  // last call to 'TakeNewConstraints', after all computations triggered by
+  // 'DispatchScanMatcherConstruction' have finished. 'callback' is executed in
+  // the 'ThreadPool'.
   void WhenDone(const std::function<void(const Result&)>& callback);
  private:
+  // Features of the projected submap for finding loop closures between
+  // submaps. They are immutable once extracted, so that they can be matched
+  // without holding 'mutex_'. The projection itself is not kept.
+  struct SubmapFeatures {
+    double ox, oy, resolution;
+    std::vector<cv::KeyPoint> key_points;
+    cv::Mat descriptors;
+  };
+  struct FeaturesCandidate {
+    SubmapId submap_id;
+    // 'nullptr' if the features have been dropped and need to be extracted
+    // again from the grid.
+    std::shared_ptr<const SubmapFeatures> features;
+    const HybridGrid* high_resolution_hybrid_grid;
+    transform::Rigid3d global_submap_pose;
+  };
+
   struct SubmapScanMatcher {
     const HybridGrid* high_resolution_hybrid_grid;
     const HybridGrid* low_resolution_hybrid_grid;
     transform::Rigid3d global_submap_pose; //retrieve gravity_aligned
 
-    std::unique_ptr<scan_matching::FastCorrelativeScanMatcher3D>
+    // The scan matcher, features and nodes are dropped while the submap is
+    // among the least recently used ones beyond
+    // 'submap_cache_memory_limit_mb', and rebuilt on demand. They are shared
+    // so that running computations keep them alive.
+    std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher3D>
         fast_correlative_scan_matcher;
+    size_t scan_matcher_memory_usage = 0;
+    // Set while a thread builds the scan matcher, which others wait for.
+    bool building_scan_matcher = false;
     std::weak_ptr<common::Task> creation_task_handle;
     
     // wz: add for loop closure searching 
-    cv::Mat prj_grid = cv::Mat();
-    double ox, oy, resolution;
-    std::vector<cv::KeyPoint> key_points = {};
-    cv::Mat descriptors = cv::Mat();
+    std::shared_ptr<const SubmapFeatures> features;
+    // Number of key points of 'features', which is kept when they are
+    // dropped. -1 until they have been extracted.
+    int num_key_points = -1;
     // only keep tracking of matched submaps with smaller submap_id
     std::map<SubmapId, transform::Rigid3d> matched_submaps;
 
-    std::vector<std::pair<NodeId, TrajectoryNode>> nodes_in_submap;
+    std::shared_ptr<const SubmapNodes> nodes_in_submap;
+
+    // Entry in 'cached_submaps_' and memory usage of the data above, while
+    // any of it is kept.
+    bool cached = false;
+    std::list<SubmapId>::iterator cache_position;
+    size_t memory_usage = 0;
   };
 
-  
-  void ExtractFeaturesForSubmap(const SubmapId& submap_id) REQUIRES(mutex_);
+  // Extracts features of 'submap_id' and matches them against those of the
+  // candidates from 'place_index_', extracting them again for candidates
+  // whose features were dropped. Only looking up the candidates and
+  // publishing the results is done while holding 'mutex_'.
+  void ExtractFeaturesForSubmap(
+      const SubmapId& submap_id,
+      const HybridGrid& high_resolution_hybrid_grid,
+      const transform::Rigid3d& global_submap_pose) EXCLUDES(mutex_);
+  // Also returns the structure pixels of the projection, relative to the
+  // submap origin, in 'occupied_points'.
+  std::shared_ptr<const SubmapFeatures> ExtractFeatures(
+      const HybridGrid& high_resolution_hybrid_grid,
+      const transform::Rigid3d& global_submap_pose,
+      std::vector<Eigen::Vector2f>* occupied_points) const;
+  // Adds the projection 'occupied_points' of 'submap_id' to 'place_index_'
+  // and returns the submaps its features are matched against.
+  std::vector<FeaturesCandidate> FindLoopClosureCandidates(
+      const SubmapId& submap_id,
+      const std::vector<Eigen::Vector2f>& occupied_points) REQUIRES(mutex_);
+  // Estimates the 2D transform between the projections of two submaps, if
+  // enough of their features agree.
+  bool MatchFeatures(const SubmapFeatures& from, const SubmapFeatures& to,
+                     transform::Rigid3d* submap_to_submap) const;
   void ComputeConstraintsBetweenSubmaps(
       const SubmapId& submap_id_from) EXCLUDES(mutex_);
-
-  // Runs in a background thread and does computations for an additional
-  // constraint.
-  // As output, it may create a new Constraint in 'constraint'.
-  void ComputeConstraint(const SubmapId& submap_id, const NodeId& node_id,
-                         /*submap_id the node belongs to*/
-                         const SubmapId& node_submap_id,
-                         std::unique_ptr<Constraint>* constraint)
+  // Schedules matching the 'nodes' of 'node_submap_id' which have no
+  // constraint to 'submap_id' yet against it, using the entry of 'submap_id'
+  // in the 'matched_submaps' of 'node_submap_id'.
+  void ScheduleConstraintsForSubmapPair(
+      const SubmapId& submap_id, const SubmapId& node_submap_id,
+      const std::shared_ptr<const SubmapNodes>& nodes) REQUIRES(mutex_);
+
+  // Returns the nodes of 'submap_id', getting them from
+  // 'submap_nodes_callback_' if they have been dropped, or 'nullptr' if the
+  // submap has been deleted.
+  std::shared_ptr<const SubmapNodes> GetSubmapNodes(const SubmapId& submap_id)
+      EXCLUDES(mutex_);
+  // Returns the fast correlative scan matcher of 'submap_id', building it if
+  // it has been dropped, or 'nullptr' if the submap has been deleted. A build
+  // already running in another thread is waited for.
+  std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher3D>
+  GetScanMatcher(const SubmapId& submap_id) EXCLUDES(mutex_);
+  // Marks the data of 'submap_id' as most recently used and updates its
+  // memory usage. Then drops the data of the least recently used submaps
+  // until the total is within 'submap_cache_memory_limit_mb'.
+  void CacheSubmapData(const SubmapId& submap_id) REQUIRES(mutex_);
+
+  // Picks up to 'num_nodes' of the 'candidate_indices' into 'nodes' such that
+  // they are spread over the submap rather than clustered where the robot
+  // moved slowly. The result is sorted.
+  static std::vector<int> SelectSpatiallyDiverseNodes(
+      const SubmapNodes& nodes, const std::vector<int>& candidate_indices,
+      size_t num_nodes);
+
+  // Runs in a background thread and matches the nodes at 'node_indices' of
+  // the 'nodes' of 'node_submap_id' against 'submap_id' in one batch.
+  // As output, it may add a new Constraint per node to 'new_constraints_'.
+  void ComputeConstraintsForSubmapPair(const SubmapId& submap_id,
+                                       const SubmapId& node_submap_id,
+                                       const SubmapNodes& nodes,
+                                       const std::vector<int>& node_indices)
       EXCLUDES(mutex_);
 
   void RunWhenDoneCallback() EXCLUDES(mutex_);
 
   const proto::ConstraintBuilderOptions options_;
   common::ThreadPoolInterface* thread_pool_;
+  const SubmapNodesCallback submap_nodes_callback_;
   common::Mutex mutex_;
 
   // 'callback' set by WhenDone().
@@ -183,19 +282,27 @@ class ConstraintBuilder3D {
   std::unique_ptr<common::Task> when_done_task_ GUARDED_BY(mutex_);
   std::vector<std::weak_ptr<common::Task>> tasks_tracker_ GUARDED_BY(mutex_);
 
-  // Constraints currently being computed in the background. A deque is used to
-  // keep pointers valid when adding more entries. Constraint search results
-  // with below-threshold scores are also 'nullptr'.
-  std::deque<std::unique_ptr<Constraint>> constraints_ GUARDED_BY(mutex_);
+  // Number of nodes currently being matched in the background.
+  int num_pending_matches_ GUARDED_BY(mutex_) = 0;
+
+  // Constraints found since the last call to 'TakeNewConstraints'.
+  Result new_constraints_ GUARDED_BY(mutex_);
 
+  // Nodes per submap whose constraint to it has been found or is being
+  // computed. Nodes which did not match are removed again.
   std::map<SubmapId, std::set<NodeId>> computed_constraints_ GUARDED_BY(mutex_);
 
   // Map of dispatched or constructed scan matchers by 'submap_id'.
   std::map<SubmapId, SubmapScanMatcher> submap_scan_matchers_
       GUARDED_BY(mutex_);
+  // Submaps with data kept in memory, most recently used first, and the total
+  // memory usage of their data.
+  std::list<SubmapId> cached_submaps_ GUARDED_BY(mutex_);
+  size_t cached_memory_usage_ GUARDED_BY(mutex_) = 0;
 
   common::FixedRatioSampler sampler_;
   scan_matching::CeresScanMatcher3D ceres_scan_matcher_;
+  SubmapPlaceIndex place_index_ GUARDED_BY(mutex_);
 
   // Histograms of scan matcher scores.
   common::Histogram score_histogram_ GUARDED_BY(mutex_);
@@ -203,14 +310,10 @@ class ConstraintBuilder3D {
   common::Histogram low_resolution_score_histogram_ GUARDED_BY(mutex_);
   
   // added by wz
-  const int min_hessian = 400;
-  cv::Ptr<cv::xfeatures2d::SURF> surf_detector_ 
-    = cv::xfeatures2d::SURF::create(min_hessian);
-  cv::Ptr<cv::DescriptorMatcher> surf_matcher_ 
-    = cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED);
+  static constexpr double kMinHessian = 400.;
 
   // For experiment only
-  double sum_t_cost_ = 0.;
+  double sum_t_cost_ GUARDED_BY(mutex_) = 0.;
   double avg_t_cost_ = 0.;
 };
 
@@ -16,9 +16,13 @@
 
 #include "cartographer/mapping/internal/constraints/constraint_builder_3d.h"
 
+#include <atomic>
 #include <functional>
+#include <map>
 
 #include "cartographer/common/internal/testing/thread_pool_for_testing.h"
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/mapping/3d/range_data_inserter_3d.h"
 #include "cartographer/mapping/3d/submap_3d.h"
 #include "cartographer/mapping/internal/constraints/constraint_builder.h"
 #include "cartographer/mapping/internal/testing/test_helpers.h"
@@ -48,11 +52,101 @@ class ConstraintBuilder3DTest : public ::testing::Test {
     POSE_GRAPH.constraint_builder.fast_correlative_scan_matcher_3d.min_low_resolution_score = 0
     POSE_GRAPH.constraint_builder.fast_correlative_scan_matcher_3d.min_rotational_score = 0
     return POSE_GRAPH.constraint_builder)text");
+    options_ =
+        CreateConstraintBuilderOptions(constraint_builder_parameters.get());
+    CreateConstraintBuilder();
+  }
+
+  void CreateConstraintBuilder() {
     constraint_builder_ = common::make_unique<ConstraintBuilder3D>(
-        CreateConstraintBuilderOptions(constraint_builder_parameters.get()),
-        &thread_pool_);
+        options_, &thread_pool_, [this](const SubmapId& submap_id) {
+          ++num_submap_nodes_requests_;
+          const auto it = submap_nodes_.find(submap_id);
+          return it != submap_nodes_.end() ? it->second
+                                           : ConstraintBuilder3D::SubmapNodes();
+        });
   }
 
+  // Matches the node of a submap against another submap with the same grid
+  // and returns the constraints found.
+  ConstraintBuilder3D::Result AddConstraintsForSubmapPair() {
+    auto node_data = std::make_shared<TrajectoryNode::Data>();
+    node_data->gravity_alignment = Eigen::Quaterniond::Identity();
+    node_data->local_pose = transform::Rigid3d::Identity();
+    node_data->rotational_scan_matcher_histogram = Eigen::VectorXf::Zero(3);
+    sensor::PointCloud returns;
+    for (int i = -10; i <= 10; ++i) {
+      returns.push_back(Eigen::Vector3f(2.f, 0.2f * i, 0.f));
+      returns.push_back(Eigen::Vector3f(0.2f * i, -2.f, 0.f));
+    }
+    node_data->high_resolution_point_cloud = returns;
+    node_data->low_resolution_point_cloud = returns;
+    TrajectoryNode node;
+    node.constant_data = node_data;
+    node.global_pose = transform::Rigid3d::Identity();
+    const ConstraintBuilder3D::SubmapNodes submap_nodes = {
+        {NodeId{0, 0}, node}};
+
+    auto parameter_dictionary = common::MakeDictionary(
+        "return { "
+        "hit_probability = 0.7, "
+        "miss_probability = 0.4, "
+        "num_free_space_voxels = 5, "
+        "}");
+    const RangeDataInserter3D range_data_inserter(
+        CreateRangeDataInserterOptions3D(parameter_dictionary.get()));
+    submap_ = common::make_unique<Submap3D>(0.1, 0.4,
+                                            transform::Rigid3d::Identity());
+    submap_->InsertRangeData(
+        sensor::RangeData{Eigen::Vector3f::Zero(), returns, {}},
+        range_data_inserter, 100 /* max_range */);
+    submap_->Finish();
+
+    submap_nodes_[kSubmapId] = submap_nodes;
+    submap_nodes_[kNodeSubmapId] = submap_nodes;
+    constraint_builder_->DispatchScanMatcherConstruction(
+        kSubmapId, transform::Rigid3d::Identity(), submap_nodes,
+        submap_.get());
+    constraint_builder_->DispatchScanMatcherConstruction(
+        kNodeSubmapId, transform::Rigid3d::Identity(), submap_nodes,
+        submap_.get());
+    thread_pool_.WaitUntilIdle();
+    // Place recognition may already have matched the pair.
+    ConstraintBuilder3D::Result constraints =
+        constraint_builder_->TakeNewConstraints();
+
+    // The pair is scheduled twice before its matches finish, and once more
+    // after the constraint has been taken.
+    for (int i = 0; i != 2; ++i) {
+      constraint_builder_->MaybeAddConstraintsForSubmapPair(
+          kSubmapId, kNodeSubmapId, transform::Rigid3d::Identity());
+    }
+    thread_pool_.WaitUntilIdle();
+    for (const auto& constraint : constraint_builder_->TakeNewConstraints()) {
+      constraints.push_back(constraint);
+    }
+    constraint_builder_->MaybeAddConstraintsForSubmapPair(
+        kSubmapId, kNodeSubmapId, transform::Rigid3d::Identity());
+    thread_pool_.WaitUntilIdle();
+    EXPECT_TRUE(constraint_builder_->TakeNewConstraints().empty());
+    return constraints;
+  }
+
+  void ExpectOneConstraintForSubmapPair(
+      const ConstraintBuilder3D::Result& constraints) {
+    ASSERT_EQ(1, constraints.size());
+    EXPECT_EQ(kSubmapId, constraints[0].submap_id);
+    EXPECT_EQ((NodeId{0, 0}), constraints[0].node_id);
+    EXPECT_EQ(PoseGraphInterface::Constraint::INTER_SUBMAP,
+              constraints[0].tag);
+  }
+
+  const SubmapId kSubmapId{0, 0};
+  const SubmapId kNodeSubmapId{0, 3};
+  proto::ConstraintBuilderOptions options_;
+  std::unique_ptr<Submap3D> submap_;
+  std::map<SubmapId, ConstraintBuilder3D::SubmapNodes> submap_nodes_;
+  std::atomic<int> num_submap_nodes_requests_{0};
   std::unique_ptr<ConstraintBuilder3D> constraint_builder_;
   MockCallback mock_;
   common::testing::ThreadPoolForTesting thread_pool_;
@@ -112,6 +206,28 @@ TEST_F(ConstraintBuilder3DTest, FindsConstraints) {
   }
 }
 
+TEST_F(ConstraintBuilder3DTest, AddsConstraintForSubmapPairOnce) {
+  ExpectOneConstraintForSubmapPair(AddConstraintsForSubmapPair());
+  // Everything fits into the default memory limit.
+  EXPECT_EQ(0, num_submap_nodes_requests_);
+}
+
+TEST_F(ConstraintBuilder3DTest, KeepsSubmapDataWithoutMemoryLimit) {
+  options_.set_submap_cache_memory_limit_mb(0.);
+  CreateConstraintBuilder();
+  ExpectOneConstraintForSubmapPair(AddConstraintsForSubmapPair());
+  EXPECT_EQ(0, num_submap_nodes_requests_);
+}
+
+TEST_F(ConstraintBuilder3DTest, RebuildsSubmapDataDroppedByMemoryLimit) {
+  // Only the data of the most recently used submap fits, so the scan matcher,
+  // features and nodes of the other one are dropped and rebuilt on demand.
+  options_.set_submap_cache_memory_limit_mb(1e-6);
+  CreateConstraintBuilder();
+  ExpectOneConstraintForSubmapPair(AddConstraintsForSubmapPair());
+  EXPECT_GT(num_submap_nodes_requests_, 0);
+}
+
 }  // namespace
 }  // namespace constraints
 }  // namespace mapping
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/constraints/submap_place_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+
+SubmapPlaceIndex::SubmapPlaceIndex(const int num_rings,
+                                   const double max_radius)
+    : num_rings_(num_rings), max_radius_(max_radius) {
+  CHECK_GT(num_rings_, 0);
+  CHECK_GT(max_radius_, 0.f);
+}
+
+std::vector<float> SubmapPlaceIndex::ComputeSignature(
+    const std::vector<Eigen::Vector2f>& points) const {
+  std::vector<float> signature(num_rings_, 0.f);
+  const float rings_per_meter = num_rings_ / max_radius_;
+  int num_points = 0;
+  for (const Eigen::Vector2f& point : points) {
+    const int ring = static_cast<int>(point.norm() * rings_per_meter);
+    if (ring >= num_rings_) {
+      continue;
+    }
+    signature[ring] += 1.f;
+    ++num_points;
+  }
+  if (num_points > 0) {
+    for (float& value : signature) {
+      value /= num_points;
+    }
+  }
+  return signature;
+}
+
+void SubmapPlaceIndex::Insert(const SubmapId& submap_id,
+                              const std::vector<float>& signature) {
+  CHECK_EQ(signature.size(), num_rings_);
+  const auto it =
+      std::find(submap_ids_.begin(), submap_ids_.end(), submap_id);
+  if (it != submap_ids_.end()) {
+    std::copy(signature.begin(), signature.end(),
+              signatures_.begin() + (it - submap_ids_.begin()) * num_rings_);
+    return;
+  }
+  submap_ids_.push_back(submap_id);
+  signatures_.insert(signatures_.end(), signature.begin(), signature.end());
+}
+
+void SubmapPlaceIndex::Remove(const SubmapId& submap_id) {
+  const auto it =
+      std::find(submap_ids_.begin(), submap_ids_.end(), submap_id);
+  if (it == submap_ids_.end()) {
+    return;
+  }
+  // Moves the last entry into the freed slot.
+  const int index = it - submap_ids_.begin();
+  const int last = submap_ids_.size() - 1;
+  submap_ids_[index] = submap_ids_[last];
+  std::copy(signatures_.begin() + last * num_rings_, signatures_.end(),
+            signatures_.begin() + index * num_rings_);
+  submap_ids_.pop_back();
+  signatures_.resize(last * num_rings_);
+}
+
+std::vector<SubmapId> SubmapPlaceIndex::Query(
+    const std::vector<float>& signature, const int num_candidates,
+    const std::function<bool(const SubmapId&)>& filter) const {
+  CHECK_EQ(signature.size(), num_rings_);
+  std::vector<std::pair<float, int>> distances;
+  distances.reserve(submap_ids_.size());
+  for (size_t i = 0; i != submap_ids_.size(); ++i) {
+    if (!filter(submap_ids_[i])) {
+      continue;
+    }
+    const float* const other = signatures_.data() + i * num_rings_;
+    float distance = 0.f;
+    for (int ring = 0; ring != num_rings_; ++ring) {
+      distance += std::abs(signature[ring] - other[ring]);
+    }
+    distances.emplace_back(distance, i);
+  }
+  const int num_results =
+      std::min(num_candidates, static_cast<int>(distances.size()));
+  std::partial_sort(distances.begin(), distances.begin() + num_results,
+                    distances.end());
+  std::vector<SubmapId> result;
+  result.reserve(num_results);
+  for (int i = 0; i != num_results; ++i) {
+    result.push_back(submap_ids_[distances[i].second]);
+  }
+  return result;
+}
+
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_SUBMAP_PLACE_INDEX_H_
+#define CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_SUBMAP_PLACE_INDEX_H_
+
+#include <functional>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/mapping/id.h"
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+
+// Retrieves the submaps which most likely show the same place as a new one,
+// so that only these have to be verified by feature matching.
+//
+// Each submap is described by a rotation invariant signature, the fraction of
+// its occupied cells falling into each of 'num_rings' concentric rings around
+// the submap origin, similar to the ring key of Scan Context. Signatures are
+// kept contiguously and compared by their L1 distance.
+class SubmapPlaceIndex {
+ public:
+  SubmapPlaceIndex(int num_rings, double max_radius);
+
+  SubmapPlaceIndex(const SubmapPlaceIndex&) = delete;
+  SubmapPlaceIndex& operator=(const SubmapPlaceIndex&) = delete;
+
+  // Computes the signature of the occupied cells 'points' given in the
+  // gravity-aligned plane relative to the submap origin.
+  std::vector<float> ComputeSignature(
+      const std::vector<Eigen::Vector2f>& points) const;
+
+  // Adds or replaces the signature of 'submap_id'.
+  void Insert(const SubmapId& submap_id, const std::vector<float>& signature);
+  void Remove(const SubmapId& submap_id);
+
+  // Returns up to 'num_candidates' submaps for which 'filter' is true,
+  // ordered by increasing distance of their signature to 'signature'.
+  std::vector<SubmapId> Query(
+      const std::vector<float>& signature, int num_candidates,
+      const std::function<bool(const SubmapId&)>& filter) const;
+
+  int size() const { return submap_ids_.size(); }
+
+ private:
+  const int num_rings_;
+  const float max_radius_;
+  std::vector<SubmapId> submap_ids_;
+  // 'num_rings_' values for each entry of 'submap_ids_'.
+  std::vector<float> signatures_;
+};
+
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_INTERNAL_CONSTRAINTS_SUBMAP_PLACE_INDEX_H_
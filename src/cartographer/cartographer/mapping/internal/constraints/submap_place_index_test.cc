@@ -0,0 +1,100 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/internal/constraints/submap_place_index.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace constraints {
+namespace {
+
+// Samples a wall of a square room of 'half_size' and a pillar at 'pillar'.
+std::vector<Eigen::Vector2f> GeneratePlace(const float half_size,
+                                           const Eigen::Vector2f& pillar,
+                                           const float angle) {
+  const Eigen::Rotation2Df rotation(angle);
+  std::vector<Eigen::Vector2f> points;
+  for (float a = -half_size; a <= half_size; a += 0.1f) {
+    points.push_back(rotation * Eigen::Vector2f(a, half_size));
+    points.push_back(rotation * Eigen::Vector2f(a, -half_size));
+    points.push_back(rotation * Eigen::Vector2f(half_size, a));
+    points.push_back(rotation * Eigen::Vector2f(-half_size, a));
+  }
+  for (float a = 0.f; a < 2.f * M_PI; a += 0.1f) {
+    points.push_back(
+        rotation * (pillar + 0.5f * Eigen::Vector2f(std::cos(a), std::sin(a))));
+  }
+  return points;
+}
+
+TEST(SubmapPlaceIndexTest, SignatureIsRotationInvariant) {
+  SubmapPlaceIndex index(20 /* num_rings */, 20. /* max_radius */);
+  const std::vector<float> signature = index.ComputeSignature(
+      GeneratePlace(8.f, Eigen::Vector2f(3.f, 1.f), 0.f));
+  const std::vector<float> rotated_signature = index.ComputeSignature(
+      GeneratePlace(8.f, Eigen::Vector2f(3.f, 1.f), 1.3f));
+  ASSERT_EQ(20, signature.size());
+  float sum = 0.f;
+  for (int ring = 0; ring != 20; ++ring) {
+    EXPECT_NEAR(signature[ring], rotated_signature[ring], 1e-2f);
+    sum += signature[ring];
+  }
+  EXPECT_NEAR(1.f, sum, 1e-5f);
+}
+
+TEST(SubmapPlaceIndexTest, RetrievesClosestPlaces) {
+  SubmapPlaceIndex index(20 /* num_rings */, 20. /* max_radius */);
+  for (int i = 0; i != 10; ++i) {
+    index.Insert(SubmapId{0, i},
+                 index.ComputeSignature(GeneratePlace(
+                     2.f + 1.5f * i, Eigen::Vector2f(1.f, 1.f), 0.f)));
+  }
+  EXPECT_EQ(10, index.size());
+  const std::vector<float> query = index.ComputeSignature(
+      GeneratePlace(2.f + 1.5f * 6, Eigen::Vector2f(1.f, 1.f), 2.f));
+  const auto all = [](const SubmapId&) { return true; };
+  EXPECT_THAT(index.Query(query, 1, all),
+              ::testing::ElementsAre(SubmapId{0, 6}));
+  EXPECT_EQ(3, index.Query(query, 3, all).size());
+  EXPECT_EQ(10, index.Query(query, 20, all).size());
+  EXPECT_THAT(index.Query(query, 1,
+                          [](const SubmapId& submap_id) {
+                            return submap_id.submap_index != 6;
+                          }),
+              ::testing::Not(::testing::Contains(SubmapId{0, 6})));
+
+  index.Remove(SubmapId{0, 6});
+  index.Remove(SubmapId{0, 42});
+  EXPECT_EQ(9, index.size());
+  EXPECT_THAT(index.Query(query, 9, all),
+              ::testing::Not(::testing::Contains(SubmapId{0, 6})));
+  EXPECT_THAT(index.Query(index.ComputeSignature(GeneratePlace(
+                              2.f, Eigen::Vector2f(1.f, 1.f), 0.f)),
+                          1, all),
+              ::testing::ElementsAre(SubmapId{0, 0}));
+}
+
+}  // namespace
+}  // namespace constraints
+}  // namespace mapping
+}  // namespace cartographer
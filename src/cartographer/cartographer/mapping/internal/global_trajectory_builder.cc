@@ -35,6 +35,30 @@ namespace {
 static auto* kLocalSlamMatchingResults = metrics::Counter::Null();
 static auto* kLocalSlamInsertionResults = metrics::Counter::Null();
 
+// 2D local SLAM does not preintegrate IMU data, so the callback is never
+// called.
+void SetLocalImuPropagatedStateCallback(
+    const int trajectory_id,
+    const TrajectoryBuilderInterface::ImuPropagatedStateCallback&
+        imu_propagated_state_callback,
+    LocalTrajectoryBuilder2D* const local_trajectory_builder) {
+  LOG(WARNING) << "IMU propagated states are not yet implemented for 2D, "
+                  "ignoring the callback of trajectory "
+               << trajectory_id << ".";
+}
+
+void SetLocalImuPropagatedStateCallback(
+    const int trajectory_id,
+    const TrajectoryBuilderInterface::ImuPropagatedStateCallback&
+        imu_propagated_state_callback,
+    LocalTrajectoryBuilder3D* const local_trajectory_builder) {
+  local_trajectory_builder->SetImuPropagatedStateCallback(
+      [trajectory_id, imu_propagated_state_callback](
+          const TrajectoryBuilderInterface::ImuPropagatedState& state) {
+        imu_propagated_state_callback(trajectory_id, state);
+      });
+}
+
 template <typename LocalTrajectoryBuilder, typename PoseGraph>
 class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
  public:
@@ -134,6 +158,16 @@ class GlobalTrajectoryBuilder : public mapping::TrajectoryBuilderInterface {
     local_slam_result_data->AddToPoseGraph(trajectory_id_, pose_graph_);
   }
 
+  void SetImuPropagatedStateCallback(
+      const ImuPropagatedStateCallback& imu_propagated_state_callback)
+      override {
+    if (local_trajectory_builder_) {
+      SetLocalImuPropagatedStateCallback(trajectory_id_,
+                                         imu_propagated_state_callback,
+                                         local_trajectory_builder_.get());
+    }
+  }
+
  private:
   const int trajectory_id_;
   PoseGraph* const pose_graph_;
@@ -26,7 +26,6 @@
 #include <vector>
 
 #include "Eigen/Core"
-#include "cartographer/common/ceres_solver_options.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/time.h"
@@ -37,6 +36,7 @@
 #include "cartographer/mapping/internal/optimization/cost_functions/landmark_cost_function_3d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/rotation_cost_function_3d.h"
 #include "cartographer/mapping/internal/optimization/cost_functions/spa_cost_function_3d.h"
+#include "cartographer/mapping/internal/optimization/optimization_problem_options.h"
 #include "cartographer/transform/timestamped_transform.h"
 #include "cartographer/transform/transform.h"
 #include "ceres/ceres.h"
@@ -121,19 +121,63 @@ transform::Rigid3d GetInitialLandmarkPose(
          observation.landmark_to_tracking_transform;
 }
 
+void SetPoseConstant(const bool constant, CeresPose* const pose,
+                     ceres::Problem* const problem) {
+  if (constant) {
+    problem->SetParameterBlockConstant(pose->rotation());
+    problem->SetParameterBlockConstant(pose->translation());
+  } else {
+    problem->SetParameterBlockVariable(pose->rotation());
+    problem->SetParameterBlockVariable(pose->translation());
+  }
+}
+
+void RemovePose(CeresPose* const pose, ceres::Problem* const problem) {
+  problem->RemoveParameterBlock(pose->rotation());
+  problem->RemoveParameterBlock(pose->translation());
+}
+
+bool IsSamePose(const transform::Rigid3d& a, const transform::Rigid3d& b) {
+  return a.translation() == b.translation() &&
+         a.rotation().coeffs() == b.rotation().coeffs();
+}
+
+// Adds cost functions for the landmark observations which are not yet in
+// 'problem', and the poses of new landmarks. 'landmark_data' holds the poses
+// from the last call, landmarks moved since then start from their new pose.
 void AddLandmarkCostFunctions(
     const std::map<std::string, LandmarkNode>& landmark_nodes,
     bool freeze_landmarks, const MapById<NodeId, NodeSpec3D>& node_data,
+    const std::map<std::string, transform::Rigid3d>& landmark_data,
     MapById<NodeId, CeresPose>* C_nodes,
-    std::map<std::string, CeresPose>* C_landmarks, ceres::Problem* problem) {
+    std::map<std::string, CeresPose>* C_landmarks,
+    std::map<std::pair<std::string, size_t>, std::pair<NodeId, NodeId>>*
+        landmark_observations_in_problem,
+    ceres::Problem* problem) {
   for (const auto& landmark_node : landmark_nodes) {
-    // Do not use landmarks that were not optimized for localization.
-    if (!landmark_node.second.global_landmark_pose.has_value() &&
-        freeze_landmarks) {
+    const std::string& landmark_id = landmark_node.first;
+    const auto C_landmark = C_landmarks->find(landmark_id);
+    if (C_landmark != C_landmarks->end()) {
+      const auto landmark_data_it = landmark_data.find(landmark_id);
+      if (landmark_node.second.global_landmark_pose.has_value() &&
+          landmark_data_it != landmark_data.end() &&
+          !IsSamePose(landmark_node.second.global_landmark_pose.value(),
+                      landmark_data_it->second)) {
+        C_landmark->second.data() =
+            FromPose(landmark_node.second.global_landmark_pose.value());
+      }
+      SetPoseConstant(freeze_landmarks, &C_landmark->second, problem);
+    } else if (!landmark_node.second.global_landmark_pose.has_value() &&
+               freeze_landmarks) {
+      // Do not use landmarks that were not optimized for localization.
       continue;
     }
-    for (const auto& observation : landmark_node.second.landmark_observations) {
-      const std::string& landmark_id = landmark_node.first;
+    const auto& observations = landmark_node.second.landmark_observations;
+    for (size_t i = 0; i != observations.size(); ++i) {
+      if (landmark_observations_in_problem->count({landmark_id, i}) != 0) {
+        continue;
+      }
+      const auto& observation = observations[i];
       const auto& begin_of_trajectory =
           node_data.BeginOfTrajectory(observation.trajectory_id);
       // The landmark observation was made before the trajectory was created.
@@ -181,6 +225,8 @@ void AddLandmarkCostFunctions(
           next_node_pose->translation(),
           C_landmarks->at(landmark_id).rotation(),
           C_landmarks->at(landmark_id).translation());
+      landmark_observations_in_problem->emplace(
+          std::make_pair(landmark_id, i), std::make_pair(prev->id, next->id));
     }
   }
 }
@@ -227,12 +273,42 @@ void OptimizationProblem3D::InsertTrajectoryNode(const NodeId& node_id,
 }
 
 void OptimizationProblem3D::TrimTrajectoryNode(const NodeId& node_id) {
+  if (C_nodes_.Contains(node_id)) {
+    // Also removes the residual blocks of its constraints.
+    // Also removes the residual blocks of its constraints, fixed frame pose
+    // and landmark observations.
+    RemovePose(&C_nodes_.at(node_id), problem_.get());
+    C_nodes_.Trim(node_id);
+    for (auto it = constraints_in_problem_.begin();
+         it != constraints_in_problem_.end();) {
+      if (it->second == node_id) {
+        it = constraints_in_problem_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    fixed_frame_nodes_in_problem_.erase(node_id);
+    // The observations are added again between the remaining nodes.
+    for (auto it = landmark_observations_in_problem_.begin();
+         it != landmark_observations_in_problem_.end();) {
+      if (it->second.first == node_id || it->second.second == node_id) {
+        it = landmark_observations_in_problem_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
   imu_data_.Trim(node_data_, node_id);
   odometry_data_.Trim(node_data_, node_id);
   fixed_frame_pose_data_.Trim(node_data_, node_id);
   node_data_.Trim(node_id);
   if (node_data_.SizeOfTrajectoryOrZero(node_id.trajectory_id) == 0) {
     trajectory_data_.erase(node_id.trajectory_id);
+    const auto C_fixed_frame = C_fixed_frames_.find(node_id.trajectory_id);
+    if (C_fixed_frame != C_fixed_frames_.end()) {
+      RemovePose(&C_fixed_frame->second, problem_.get());
+      C_fixed_frames_.erase(C_fixed_frame);
+    }
   }
 }
 
@@ -247,6 +323,19 @@ void OptimizationProblem3D::InsertSubmap(
 }
 
 void OptimizationProblem3D::TrimSubmap(const SubmapId& submap_id) {
+  if (anchor_submap_id_.has_value() &&
+      anchor_submap_id_.value() == submap_id) {
+    // The next submap becomes the anchor which is parameterized differently.
+    ResetProblem();
+  } else if (C_submaps_.Contains(submap_id)) {
+    RemovePose(&C_submaps_.at(submap_id), problem_.get());
+    C_submaps_.Trim(submap_id);
+    constraints_in_problem_.erase(
+        constraints_in_problem_.lower_bound({submap_id, NodeId{0, 0}}),
+        constraints_in_problem_.lower_bound(
+            {SubmapId{submap_id.trajectory_id, submap_id.submap_index + 1},
+             NodeId{0, 0}}));
+  }
   submap_data_.Trim(submap_id);
 }
 
@@ -256,18 +345,29 @@ void OptimizationProblem3D::SetMaxNumIterations(
       max_num_iterations);
 }
 
-void OptimizationProblem3D::Solve(
+void OptimizationProblem3D::ResetProblem() {
+  problem_.reset();
+  C_submaps_ = MapById<SubmapId, CeresPose>();
+  C_nodes_ = MapById<NodeId, CeresPose>();
+  C_fixed_frames_.clear();
+  C_landmarks_.clear();
+  fixed_frame_nodes_in_problem_.clear();
+  landmark_observations_in_problem_.clear();
+  anchor_submap_id_ = common::optional<SubmapId>();
+  constraints_in_problem_.clear();
+  frozen_trajectories_.clear();
+}
+
+void OptimizationProblem3D::UpdateProblem(
     const std::vector<Constraint>& constraints,
-    const std::set<int>& frozen_trajectories,
-    const std::map<std::string, LandmarkNode>& landmark_nodes) {
-  if (node_data_.empty()) {
-    // Nothing to optimize.
-    return;
+    const std::set<int>& frozen_trajectories) {
+  if (problem_ == nullptr) {
+    ceres::Problem::Options problem_options;
+    // Parameter blocks of trimmed submaps and nodes are removed.
+    problem_options.enable_fast_removal = true;
+    problem_ = common::make_unique<ceres::Problem>(problem_options);
   }
 
-  ceres::Problem::Options problem_options;
-  ceres::Problem problem(problem_options);
-
   const auto translation_parameterization =
       [this]() -> std::unique_ptr<ceres::LocalParameterization> {
     return options_.fix_z_in_3d()
@@ -276,74 +376,113 @@ void OptimizationProblem3D::Solve(
                : nullptr;
   };
 
-  // Set the starting point.
+  // Update trajectories which were frozen or unfrozen since the last call.
+  for (const int trajectory_id : C_nodes_.trajectory_ids()) {
+    const bool frozen = frozen_trajectories.count(trajectory_id) != 0;
+    if (frozen == (frozen_trajectories_.count(trajectory_id) != 0)) {
+      continue;
+    }
+    for (const auto& C_submap_id_data : C_submaps_.trajectory(trajectory_id)) {
+      SetPoseConstant(frozen, &C_submaps_.at(C_submap_id_data.id),
+                      problem_.get());
+    }
+    for (const auto& C_node_id_data : C_nodes_.trajectory(trajectory_id)) {
+      SetPoseConstant(frozen, &C_nodes_.at(C_node_id_data.id),
+                      problem_.get());
+    }
+  }
+  frozen_trajectories_ = frozen_trajectories;
+  if (anchor_submap_id_.has_value()) {
+    problem_->SetParameterBlockConstant(
+        C_submaps_.at(anchor_submap_id_.value()).translation());
+  }
+
+  // Set the starting point of new submaps and nodes.
   CHECK(!submap_data_.empty());
-  MapById<SubmapId, CeresPose> C_submaps;
-  MapById<NodeId, CeresPose> C_nodes;
-  std::map<std::string, CeresPose> C_landmarks;
-  bool first_submap = true;
-  bool freeze_landmarks = !frozen_trajectories.empty();
   for (const auto& submap_id_data : submap_data_) {
+    if (C_submaps_.Contains(submap_id_data.id)) {
+      continue;
+    }
     const bool frozen =
         frozen_trajectories.count(submap_id_data.id.trajectory_id) != 0;
-    if (first_submap) {
-      first_submap = false;
+    if (!anchor_submap_id_.has_value()) {
+      anchor_submap_id_ = submap_id_data.id;
       // Fix the first submap of the first trajectory except for allowing
       // gravity alignment.
-      C_submaps.Insert(
+      C_submaps_.Insert(
           submap_id_data.id,
           CeresPose(submap_id_data.data.global_pose,
                     translation_parameterization(),
                     common::make_unique<ceres::AutoDiffLocalParameterization<
                         ConstantYawQuaternionPlus, 4, 2>>(),
-                    &problem));
-      problem.SetParameterBlockConstant(
-          C_submaps.at(submap_id_data.id).translation());
+                    problem_.get()));
+      problem_->SetParameterBlockConstant(
+          C_submaps_.at(submap_id_data.id).translation());
     } else {
-      C_submaps.Insert(
+      C_submaps_.Insert(
           submap_id_data.id,
           CeresPose(submap_id_data.data.global_pose,
                     translation_parameterization(),
                     common::make_unique<ceres::QuaternionParameterization>(),
-                    &problem));
+                    problem_.get()));
     }
     if (frozen) {
-      problem.SetParameterBlockConstant(
-          C_submaps.at(submap_id_data.id).rotation());
-      problem.SetParameterBlockConstant(
-          C_submaps.at(submap_id_data.id).translation());
+      SetPoseConstant(true, &C_submaps_.at(submap_id_data.id),
+                      problem_.get());
     }
   }
   for (const auto& node_id_data : node_data_) {
+    if (C_nodes_.Contains(node_id_data.id)) {
+      continue;
+    }
     const bool frozen =
         frozen_trajectories.count(node_id_data.id.trajectory_id) != 0;
-    C_nodes.Insert(
+    C_nodes_.Insert(
         node_id_data.id,
         CeresPose(node_id_data.data.global_pose, translation_parameterization(),
                   common::make_unique<ceres::QuaternionParameterization>(),
-                  &problem));
+                  problem_.get()));
     if (frozen) {
-      problem.SetParameterBlockConstant(C_nodes.at(node_id_data.id).rotation());
-      problem.SetParameterBlockConstant(
-          C_nodes.at(node_id_data.id).translation());
+      SetPoseConstant(true, &C_nodes_.at(node_id_data.id), problem_.get());
     }
   }
-  // Add cost functions for intra- and inter-submap constraints.
+  // Add cost functions for new intra- and inter-submap constraints.
   for (const Constraint& constraint : constraints) {
-    problem.AddResidualBlock(
+    if (!constraints_in_problem_
+             .emplace(constraint.submap_id, constraint.node_id)
+             .second) {
+      continue;
+    }
+    problem_->AddResidualBlock(
       SpaCostFunction3D::CreateAutoDiffCostFunction(constraint.pose),
       // Only loop closure constraints should have a loss function. ? new ceres::HuberLoss(options_.huber_scale())
       constraint.tag == Constraint::INTER_SUBMAP
           ? new ceres::TrivialLoss()
           : nullptr /* loss function */,
-      C_submaps.at(constraint.submap_id).rotation(),
-      C_submaps.at(constraint.submap_id).translation(),
-      C_nodes.at(constraint.node_id).rotation(),
-      C_nodes.at(constraint.node_id).translation());
+      C_submaps_.at(constraint.submap_id).rotation(),
+      C_submaps_.at(constraint.submap_id).translation(),
+      C_nodes_.at(constraint.node_id).rotation(),
+      C_nodes_.at(constraint.node_id).translation());
   }
+}
+
+void OptimizationProblem3D::Solve(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories,
+    const std::map<std::string, LandmarkNode>& landmark_nodes) {
+  if (node_data_.empty()) {
+    // Nothing to optimize.
+    return;
+  }
+
+  UpdateProblem(constraints, frozen_trajectories);
+  ceres::Problem& problem = *problem_;
+  MapById<NodeId, CeresPose>& C_nodes = C_nodes_;
+  bool freeze_landmarks = !frozen_trajectories.empty();
   // Add cost functions for landmarks.
   AddLandmarkCostFunctions(landmark_nodes, freeze_landmarks, node_data_,
-                           &C_nodes, &C_landmarks, &problem);
+                           landmark_data_, &C_nodes, &C_landmarks_,
+                           &landmark_observations_in_problem_, &problem);
   // Add constraints based on IMU observations of angular velocities and
   // linear acceleration.
   // 这里计算加速度约束的依据是什么???????
@@ -488,8 +627,8 @@ void OptimizationProblem3D::Solve(
     }
   }*/
 
-  // Add fixed frame pose constraints.
-  std::map<int, CeresPose> C_fixed_frames;
+  // Add fixed frame pose constraints for nodes which have none yet. Nodes
+  // are retried until fixed frame poses around their time are available.
   for (auto node_it = node_data_.begin(); node_it != node_data_.end();) {
     const int trajectory_id = node_it->id.trajectory_id;
     const auto trajectory_end = node_data_.EndOfTrajectory(trajectory_id);
@@ -499,10 +638,14 @@ void OptimizationProblem3D::Solve(
     }
 
     const TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
-    bool fixed_frame_pose_initialized = false;
+    bool fixed_frame_pose_initialized =
+        C_fixed_frames_.count(trajectory_id) != 0;
     for (; node_it != trajectory_end; ++node_it) {
       const NodeId node_id = node_it->id;
       const NodeSpec3D& node_data = node_it->data;
+      if (fixed_frame_nodes_in_problem_.count(node_id) != 0) {
+        continue;
+      }
 
       const std::unique_ptr<transform::Rigid3d> fixed_frame_pose =
           Interpolate(fixed_frame_pose_data_, trajectory_id, node_data.time);
@@ -523,7 +666,7 @@ void OptimizationProblem3D::Solve(
           fixed_frame_pose_in_map =
               node_data.global_pose * constraint_pose.zbar_ij.inverse();
         }
-        C_fixed_frames.emplace(
+        C_fixed_frames_.emplace(
             std::piecewise_construct, std::forward_as_tuple(trajectory_id),
             std::forward_as_tuple(
                 transform::Rigid3d(
@@ -541,16 +684,15 @@ void OptimizationProblem3D::Solve(
       problem.AddResidualBlock(
           SpaCostFunction3D::CreateAutoDiffCostFunction(constraint_pose),
           nullptr ,
-          C_fixed_frames.at(trajectory_id).rotation(),
-          C_fixed_frames.at(trajectory_id).translation(),
+          C_fixed_frames_.at(trajectory_id).rotation(),
+          C_fixed_frames_.at(trajectory_id).translation(),
           C_nodes.at(node_id).rotation(), C_nodes.at(node_id).translation());
+      fixed_frame_nodes_in_problem_.insert(node_id);
     }
   }
   // Solve.
   ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
+  ceres::Solve(CreateCeresSolverOptions(options_), &problem, &summary);
 
   if (options_.log_solver_summary()) {
     LOG(INFO) << summary.FullReport();
@@ -571,19 +713,19 @@ void OptimizationProblem3D::Solve(
   }
 
   // Store the result.
-  for (const auto& C_submap_id_data : C_submaps) {
+  for (const auto& C_submap_id_data : C_submaps_) {
     submap_data_.at(C_submap_id_data.id).global_pose =
         C_submap_id_data.data.ToRigid();
   }
-  for (const auto& C_node_id_data : C_nodes) {
+  for (const auto& C_node_id_data : C_nodes_) {
     node_data_.at(C_node_id_data.id).global_pose =
         C_node_id_data.data.ToRigid();
   }
-  for (const auto& C_fixed_frame : C_fixed_frames) {
+  for (const auto& C_fixed_frame : C_fixed_frames_) {
     trajectory_data_.at(C_fixed_frame.first).fixed_frame_origin_in_map =
         C_fixed_frame.second.ToRigid();
   }
-  for (const auto& C_landmark : C_landmarks) {
+  for (const auto& C_landmark : C_landmarks_) {
     landmark_data_[C_landmark.first] = C_landmark.second.ToRigid();
   }
 }
@@ -19,7 +19,9 @@
 
 #include <array>
 #include <map>
+#include <memory>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
@@ -28,6 +30,7 @@
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/id.h"
+#include "cartographer/mapping/internal/optimization/ceres_pose.h"
 #include "cartographer/mapping/internal/optimization/optimization_problem_interface.h"
 #include "cartographer/mapping/pose_graph_interface.h"
 #include "cartographer/mapping/proto/pose_graph/optimization_problem_options.pb.h"
@@ -121,6 +124,13 @@ class OptimizationProblem3D
       int trajectory_id, const NodeSpec3D& first_node_data,
       const NodeSpec3D& second_node_data) const;
 
+  // Adds parameter blocks for the submaps and nodes which are not yet part
+  // of 'problem_' and residual blocks for the new 'constraints'.
+  void UpdateProblem(const std::vector<Constraint>& constraints,
+                     const std::set<int>& frozen_trajectories);
+  // Discards 'problem_', so that the next 'Solve()' builds it from scratch.
+  void ResetProblem();
+
   optimization::proto::OptimizationProblemOptions options_;
   MapById<NodeId, NodeSpec3D> node_data_;
   MapById<SubmapId, SubmapSpec3D> submap_data_;
@@ -129,6 +139,24 @@ class OptimizationProblem3D
   sensor::MapByTime<sensor::OdometryData> odometry_data_;
   sensor::MapByTime<sensor::FixedFramePoseData> fixed_frame_pose_data_;
   std::map<int, PoseGraphInterface::TrajectoryData> trajectory_data_;
+
+  // The problem is kept between calls to 'Solve()', so that each call only
+  // adds what changed since the last one.
+  std::unique_ptr<ceres::Problem> problem_;
+  MapById<SubmapId, CeresPose> C_submaps_;
+  MapById<NodeId, CeresPose> C_nodes_;
+  std::map<int, CeresPose> C_fixed_frames_;
+  std::map<std::string, CeresPose> C_landmarks_;
+  // Nodes with a fixed frame pose residual.
+  std::set<NodeId> fixed_frame_nodes_in_problem_;
+  // The nodes between which each landmark observation, identified by its
+  // landmark and index, is interpolated in its residual.
+  std::map<std::pair<std::string, size_t>, std::pair<NodeId, NodeId>>
+      landmark_observations_in_problem_;
+  // The first submap, which is held fixed except for gravity alignment.
+  common::optional<SubmapId> anchor_submap_id_;
+  std::set<std::pair<SubmapId, NodeId>> constraints_in_problem_;
+  std::set<int> frozen_trajectories_;
 };
 
 }  // namespace optimization
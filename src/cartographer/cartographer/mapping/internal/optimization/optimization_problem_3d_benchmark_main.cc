@@ -0,0 +1,246 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cartographer/common/configuration_file_resolver.h"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/time.h"
+#include "cartographer/io/proto_stream_deserializer.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping/internal/optimization/optimization_problem_3d.h"
+#include "cartographer/mapping/pose_graph.h"
+#include "cartographer/mapping/proto/pose_graph.pb.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_string(configuration_directory, "",
+              "First directory in which configuration files are searched, "
+              "second is always the Cartographer installation to allow "
+              "including files from there.");
+DEFINE_string(configuration_basename, "",
+              "Basename, i.e. not containing any directory prefix, of the "
+              "configuration file returning the pose graph options.");
+DEFINE_string(pose_graph_filename, "",
+              "Proto stream file containing the pose graph to optimize.");
+DEFINE_string(node_counts, "",
+              "Comma-separated list of node counts to benchmark. The first N "
+              "nodes of the pose graph are used for each entry. If empty, "
+              "all nodes are used.");
+DEFINE_double(perturbation_meters, 0.1,
+              "Standard deviation of the noise added to the initial node and "
+              "submap translations so that the solver has work to do.");
+DEFINE_double(perturbation_radians, 0.01,
+              "Standard deviation of the noise added to the initial node and "
+              "submap rotations.");
+
+namespace cartographer {
+namespace mapping {
+namespace optimization {
+namespace {
+
+constexpr int kRandomSeed = 42;
+
+std::vector<int> ParseNodeCounts(const std::string& node_counts,
+                                 const int total_num_nodes) {
+  std::vector<int> result;
+  std::string::size_type start = 0;
+  while (start < node_counts.size()) {
+    std::string::size_type end = node_counts.find(',', start);
+    if (end == std::string::npos) {
+      end = node_counts.size();
+    }
+    const int node_count = std::stoi(node_counts.substr(start, end - start));
+    CHECK_GT(node_count, 0);
+    result.push_back(std::min(node_count, total_num_nodes));
+    start = end + 1;
+  }
+  if (result.empty()) {
+    result.push_back(total_num_nodes);
+  }
+  return result;
+}
+
+class Perturbation {
+ public:
+  Perturbation(const double translation_stddev, const double rotation_stddev)
+      : translation_stddev_(translation_stddev),
+        rotation_stddev_(rotation_stddev),
+        rng_(kRandomSeed) {}
+
+  transform::Rigid3d operator()(const transform::Rigid3d& pose) {
+    std::normal_distribution<double> translation_distribution(
+        0., translation_stddev_);
+    std::normal_distribution<double> rotation_distribution(0.,
+                                                           rotation_stddev_);
+    const Eigen::Vector3d translation(translation_distribution(rng_),
+                                      translation_distribution(rng_),
+                                      translation_distribution(rng_));
+    const Eigen::Vector3d rotation(rotation_distribution(rng_),
+                                   rotation_distribution(rng_),
+                                   rotation_distribution(rng_));
+    return transform::Rigid3d(translation,
+                              transform::AngleAxisVectorToRotationQuaternion(
+                                  rotation)) *
+           pose;
+  }
+
+ private:
+  const double translation_stddev_;
+  const double rotation_stddev_;
+  std::mt19937 rng_;
+};
+
+// Inserts the first 'num_nodes' nodes of 'pose_graph', the submaps they are
+// constrained to and the constraints between them into a fresh optimization
+// problem, solves it once and returns the wall time of the solve in seconds.
+double BenchmarkSolve(const proto::OptimizationProblemOptions& options,
+                      const mapping::proto::PoseGraph& pose_graph,
+                      const std::vector<PoseGraphInterface::Constraint>&
+                          all_constraints,
+                      const int num_nodes, int* num_submaps,
+                      int* num_constraints) {
+  OptimizationProblem3D optimization_problem(options);
+  Perturbation perturbation(FLAGS_perturbation_meters,
+                            FLAGS_perturbation_radians);
+
+  int remaining_nodes = num_nodes;
+  for (const auto& trajectory : pose_graph.trajectory()) {
+    for (const auto& node : trajectory.node()) {
+      if (remaining_nodes == 0) {
+        break;
+      }
+      --remaining_nodes;
+      // The optimized global pose doubles as local pose so that the local
+      // SLAM residuals agree with the loaded solution.
+      const transform::Rigid3d pose = transform::ToRigid3(node.pose());
+      optimization_problem.InsertTrajectoryNode(
+          NodeId{trajectory.trajectory_id(), node.node_index()},
+          NodeSpec3D{common::FromUniversal(node.timestamp()), pose,
+                     perturbation(pose)});
+    }
+  }
+
+  std::vector<PoseGraphInterface::Constraint> constraints;
+  for (const auto& constraint : all_constraints) {
+    if (optimization_problem.node_data().Contains(constraint.node_id)) {
+      constraints.push_back(constraint);
+    }
+  }
+  std::set<SubmapId> constrained_submap_ids;
+  for (const auto& constraint : constraints) {
+    constrained_submap_ids.insert(constraint.submap_id);
+  }
+  for (const auto& trajectory : pose_graph.trajectory()) {
+    for (const auto& submap : trajectory.submap()) {
+      const SubmapId submap_id{trajectory.trajectory_id(),
+                               submap.submap_index()};
+      if (constrained_submap_ids.count(submap_id) != 0) {
+        optimization_problem.InsertSubmap(
+            submap_id, perturbation(transform::ToRigid3(submap.pose())));
+      }
+    }
+  }
+  *num_submaps = optimization_problem.submap_data().size();
+  *num_constraints = constraints.size();
+
+  const auto start = std::chrono::steady_clock::now();
+  optimization_problem.Solve(constraints, {} /* frozen_trajectories */,
+                             {} /* landmark_nodes */);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void Run(const std::string& configuration_directory,
+         const std::string& configuration_basename,
+         const std::string& pose_graph_filename,
+         const std::string& node_counts) {
+  auto file_resolver = common::make_unique<common::ConfigurationFileResolver>(
+      std::vector<std::string>{configuration_directory});
+  const std::string code =
+      file_resolver->GetFileContentOrDie(configuration_basename);
+  common::LuaParameterDictionary lua_parameter_dictionary(
+      code, std::move(file_resolver));
+  const proto::OptimizationProblemOptions options =
+      mapping::CreatePoseGraphOptions(&lua_parameter_dictionary)
+          .optimization_problem_options();
+
+  LOG(INFO) << "Reading pose graph from '" << pose_graph_filename << "'...";
+  const mapping::proto::PoseGraph pose_graph =
+      io::DeserializePoseGraphFromFile(pose_graph_filename);
+  const std::vector<PoseGraphInterface::Constraint> constraints =
+      mapping::FromProto(pose_graph.constraint());
+  int total_num_nodes = 0;
+  for (const auto& trajectory : pose_graph.trajectory()) {
+    total_num_nodes += trajectory.node_size();
+  }
+  CHECK_GT(total_num_nodes, 0) << "Pose graph does not contain any nodes.";
+
+  LOG(INFO) << "Linear solver: "
+            << proto::OptimizationProblemOptions_LinearSolverType_Name(
+                   options.linear_solver_type())
+            << ", preconditioner: "
+            << proto::OptimizationProblemOptions_PreconditionerType_Name(
+                   options.preconditioner_type())
+            << ", threads: " << options.ceres_solver_options().num_threads();
+  for (const int num_nodes : ParseNodeCounts(node_counts, total_num_nodes)) {
+    int num_submaps = 0;
+    int num_constraints = 0;
+    const double seconds =
+        BenchmarkSolve(options, pose_graph, constraints, num_nodes,
+                       &num_submaps, &num_constraints);
+    LOG(INFO) << "nodes: " << num_nodes << " submaps: " << num_submaps
+              << " constraints: " << num_constraints
+              << " solve time: " << seconds << " s";
+  }
+}
+
+}  // namespace
+}  // namespace optimization
+}  // namespace mapping
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "This program measures the time of a single 3D global optimization\n"
+      "over growing prefixes of a serialized pose graph. Use it to compare\n"
+      "the linear solver, preconditioner and thread count settings of\n"
+      "'optimization_problem'.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_configuration_directory.empty() ||
+      FLAGS_configuration_basename.empty() ||
+      FLAGS_pose_graph_filename.empty()) {
+    google::ShowUsageWithFlagsRestrict(argv[0],
+                                       "optimization_problem_3d_benchmark");
+    return EXIT_FAILURE;
+  }
+  ::cartographer::mapping::optimization::Run(
+      FLAGS_configuration_directory, FLAGS_configuration_basename,
+      FLAGS_pose_graph_filename, FLAGS_node_counts);
+}
@@ -22,6 +22,7 @@
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/internal/optimization/optimization_problem_options.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
@@ -54,6 +55,8 @@ class OptimizationProblem3DTest : public ::testing::Test {
             max_num_iterations = 200,
             num_threads = 4,
           },
+          linear_solver_type = "SPARSE_NORMAL_CHOLESKY",
+          preconditioner_type = "JACOBI",
         })text");
     return optimization::CreateOptimizationProblemOptions(
         parameter_dictionary.get());
@@ -190,6 +193,157 @@ TEST_F(OptimizationProblem3DTest, ReducesNoise) {
   EXPECT_GT(0.8 * rotation_error_before, rotation_error_after);
 }
 
+TEST_F(OptimizationProblem3DTest, SolvesIncrementally) {
+  constexpr int kNumNodes = 40;
+  const int kTrajectoryId = 0;
+  const std::set<int> kFrozen = {};
+  std::vector<transform::Rigid3d> ground_truth_poses;
+  std::vector<OptimizationProblem3D::Constraint> constraints;
+  for (int j = 0; j != kNumNodes; ++j) {
+    ground_truth_poses.push_back(RandomTransform(10., 3.));
+    for (const int submap_index : {0, 1}) {
+      constraints.push_back(OptimizationProblem3D::Constraint{
+          SubmapId{kTrajectoryId, submap_index}, NodeId{kTrajectoryId, j},
+          OptimizationProblem3D::Constraint::Pose{
+              AddNoise(ground_truth_poses[j], RandomYawOnlyTransform(0.2, 0.3)),
+              1., 1.}});
+    }
+  }
+  const auto add_nodes = [&](const int begin, const int end) {
+    for (int j = begin; j != end; ++j) {
+      const transform::Rigid3d pose =
+          AddNoise(ground_truth_poses[j], RandomYawOnlyTransform(0.2, 0.3));
+      optimization_problem_.AddTrajectoryNode(
+          kTrajectoryId,
+          NodeSpec3D{common::FromUniversal(j), pose, pose});
+    }
+  };
+
+  // Solve for the first half of the nodes, then add the rest.
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  transform::Rigid3d::Identity());
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  transform::Rigid3d::Identity());
+  add_nodes(0, kNumNodes / 2);
+  optimization_problem_.Solve(
+      std::vector<OptimizationProblem3D::Constraint>(
+          constraints.begin(), constraints.begin() + kNumNodes),
+      kFrozen, {});
+  add_nodes(kNumNodes / 2, kNumNodes);
+
+  // A problem built from scratch starting at the same poses has to give the
+  // same result.
+  OptimizationProblem3D expected_problem(CreateOptions());
+  for (const auto& submap_id_data : optimization_problem_.submap_data()) {
+    expected_problem.InsertSubmap(submap_id_data.id,
+                                  submap_id_data.data.global_pose);
+  }
+  for (const auto& node_id_data : optimization_problem_.node_data()) {
+    expected_problem.InsertTrajectoryNode(node_id_data.id, node_id_data.data);
+  }
+  optimization_problem_.Solve(constraints, kFrozen, {});
+  expected_problem.Solve(constraints, kFrozen, {});
+  for (const auto& node_id_data : expected_problem.node_data()) {
+    EXPECT_THAT(
+        optimization_problem_.node_data().at(node_id_data.id).global_pose,
+        transform::IsNearly(node_id_data.data.global_pose, 1e-6));
+  }
+  for (const auto& submap_id_data : expected_problem.submap_data()) {
+    EXPECT_THAT(
+        optimization_problem_.submap_data().at(submap_id_data.id).global_pose,
+        transform::IsNearly(submap_id_data.data.global_pose, 1e-6));
+  }
+
+  // Trimmed nodes and their constraints are removed from the problem.
+  const NodeId trimmed_node_id{kTrajectoryId, 3};
+  optimization_problem_.TrimTrajectoryNode(trimmed_node_id);
+  std::vector<OptimizationProblem3D::Constraint> remaining_constraints;
+  for (const auto& constraint : constraints) {
+    if (constraint.node_id != trimmed_node_id) {
+      remaining_constraints.push_back(constraint);
+    }
+  }
+  optimization_problem_.Solve(remaining_constraints, kFrozen, {});
+  EXPECT_FALSE(optimization_problem_.node_data().Contains(trimmed_node_id));
+}
+
+TEST_F(OptimizationProblem3DTest, SolvesFixedFramePosesIncrementally) {
+  constexpr int kNumNodes = 20;
+  const int kTrajectoryId = 0;
+  const std::set<int> kFrozen = {};
+  std::vector<transform::Rigid3d> ground_truth_poses;
+  std::vector<OptimizationProblem3D::Constraint> constraints;
+  for (int j = 0; j != kNumNodes; ++j) {
+    ground_truth_poses.push_back(RandomTransform(10., 3.));
+    constraints.push_back(OptimizationProblem3D::Constraint{
+        SubmapId{kTrajectoryId, 0}, NodeId{kTrajectoryId, j},
+        OptimizationProblem3D::Constraint::Pose{
+            AddNoise(ground_truth_poses[j], RandomYawOnlyTransform(0.2, 0.3)),
+            1., 1.}});
+  }
+  const auto add_nodes = [&](const int begin, const int end) {
+    for (int j = begin; j != end; ++j) {
+      const transform::Rigid3d pose =
+          AddNoise(ground_truth_poses[j], RandomYawOnlyTransform(0.2, 0.3));
+      optimization_problem_.AddTrajectoryNode(
+          kTrajectoryId, NodeSpec3D{common::FromUniversal(j), pose, pose});
+      optimization_problem_.AddFixedFramePoseData(
+          kTrajectoryId,
+          sensor::FixedFramePoseData{
+              common::FromUniversal(j),
+              common::optional<transform::Rigid3d>(ground_truth_poses[j])});
+    }
+  };
+
+  // The fixed frame pose and its residuals are kept when the rest of the
+  // nodes is added.
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  transform::Rigid3d::Identity());
+  add_nodes(0, kNumNodes / 2);
+  optimization_problem_.Solve(
+      std::vector<OptimizationProblem3D::Constraint>(
+          constraints.begin(), constraints.begin() + kNumNodes / 2),
+      kFrozen, {});
+  ASSERT_TRUE(optimization_problem_.trajectory_data()
+                  .at(kTrajectoryId)
+                  .fixed_frame_origin_in_map.has_value());
+  add_nodes(kNumNodes / 2, kNumNodes);
+
+  // A problem built from scratch starting at the same poses has to give the
+  // same result.
+  OptimizationProblem3D expected_problem(CreateOptions());
+  for (const auto& submap_id_data : optimization_problem_.submap_data()) {
+    expected_problem.InsertSubmap(submap_id_data.id,
+                                  submap_id_data.data.global_pose);
+  }
+  for (const auto& node_id_data : optimization_problem_.node_data()) {
+    expected_problem.InsertTrajectoryNode(node_id_data.id, node_id_data.data);
+  }
+  for (int j = 0; j != kNumNodes; ++j) {
+    expected_problem.AddFixedFramePoseData(
+        kTrajectoryId,
+        sensor::FixedFramePoseData{
+            common::FromUniversal(j),
+            common::optional<transform::Rigid3d>(ground_truth_poses[j])});
+  }
+  expected_problem.SetTrajectoryData(
+      kTrajectoryId, optimization_problem_.trajectory_data().at(kTrajectoryId));
+  optimization_problem_.Solve(constraints, kFrozen, {});
+  expected_problem.Solve(constraints, kFrozen, {});
+  for (const auto& node_id_data : expected_problem.node_data()) {
+    EXPECT_THAT(
+        optimization_problem_.node_data().at(node_id_data.id).global_pose,
+        transform::IsNearly(node_id_data.data.global_pose, 1e-6));
+  }
+  EXPECT_THAT(optimization_problem_.trajectory_data()
+                  .at(kTrajectoryId)
+                  .fixed_frame_origin_in_map.value(),
+              transform::IsNearly(expected_problem.trajectory_data()
+                                      .at(kTrajectoryId)
+                                      .fixed_frame_origin_in_map.value(),
+                                  1e-6));
+}
+
 }  // namespace
 }  // namespace optimization
 }  // namespace mapping
@@ -16,7 +16,10 @@
 
 #include "cartographer/mapping/internal/optimization/optimization_problem_options.h"
 
+#include <string>
+
 #include "cartographer/common/ceres_solver_options.h"
+#include "glog/logging.h"
 
 namespace cartographer {
 namespace mapping {
@@ -47,9 +50,63 @@ proto::OptimizationProblemOptions CreateOptimizationProblemOptions(
   *options.mutable_ceres_solver_options() =
       common::CreateCeresSolverOptionsProto(
           parameter_dictionary->GetDictionary("ceres_solver_options").get());
+  proto::OptimizationProblemOptions::LinearSolverType linear_solver_type;
+  const std::string linear_solver_type_string =
+      parameter_dictionary->GetString("linear_solver_type");
+  CHECK(proto::OptimizationProblemOptions_LinearSolverType_Parse(
+      linear_solver_type_string, &linear_solver_type))
+      << "Unknown OptimizationProblemOptions_LinearSolverType kind: "
+      << linear_solver_type_string;
+  options.set_linear_solver_type(linear_solver_type);
+  proto::OptimizationProblemOptions::PreconditionerType preconditioner_type;
+  const std::string preconditioner_type_string =
+      parameter_dictionary->GetString("preconditioner_type");
+  CHECK(proto::OptimizationProblemOptions_PreconditionerType_Parse(
+      preconditioner_type_string, &preconditioner_type))
+      << "Unknown OptimizationProblemOptions_PreconditionerType kind: "
+      << preconditioner_type_string;
+  options.set_preconditioner_type(preconditioner_type);
   return options;
 }
 
+ceres::Solver::Options CreateCeresSolverOptions(
+    const proto::OptimizationProblemOptions& options) {
+  ceres::Solver::Options solver_options =
+      common::CreateCeresSolverOptions(options.ceres_solver_options());
+  switch (options.linear_solver_type()) {
+    case proto::OptimizationProblemOptions::SPARSE_NORMAL_CHOLESKY:
+      solver_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+      break;
+    case proto::OptimizationProblemOptions::SPARSE_SCHUR:
+      solver_options.linear_solver_type = ceres::SPARSE_SCHUR;
+      break;
+    case proto::OptimizationProblemOptions::ITERATIVE_SCHUR:
+      solver_options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+      break;
+    default:
+      LOG(FATAL) << "Unhandled linear solver type: "
+                 << options.linear_solver_type();
+  }
+  switch (options.preconditioner_type()) {
+    case proto::OptimizationProblemOptions::JACOBI:
+      solver_options.preconditioner_type = ceres::JACOBI;
+      break;
+    case proto::OptimizationProblemOptions::SCHUR_JACOBI:
+      solver_options.preconditioner_type = ceres::SCHUR_JACOBI;
+      break;
+    case proto::OptimizationProblemOptions::CLUSTER_JACOBI:
+      solver_options.preconditioner_type = ceres::CLUSTER_JACOBI;
+      break;
+    case proto::OptimizationProblemOptions::CLUSTER_TRIDIAGONAL:
+      solver_options.preconditioner_type = ceres::CLUSTER_TRIDIAGONAL;
+      break;
+    default:
+      LOG(FATAL) << "Unhandled preconditioner type: "
+                 << options.preconditioner_type();
+  }
+  return solver_options;
+}
+
 }  // namespace optimization
 }  // namespace mapping
 }  // namespace cartographer
@@ -18,6 +18,7 @@
 #define CARTOGRAPHER_MAPPING_INTERNAL_OPTIMIZATION_OPTIMIZATION_PROBLEM_OPTIONS_H_
 
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "ceres/ceres.h"
 #include "cartographer/mapping/proto/pose_graph/optimization_problem_options.pb.h"
 
 namespace cartographer {
@@ -27,6 +28,11 @@ namespace optimization {
 proto::OptimizationProblemOptions CreateOptimizationProblemOptions(
     common::LuaParameterDictionary* parameter_dictionary);
 
+// Returns the Ceres options for the global optimization, i.e. the generic
+// 'ceres_solver_options' plus the linear solver and preconditioner choice.
+ceres::Solver::Options CreateCeresSolverOptions(
+    const proto::OptimizationProblemOptions& options);
+
 }  // namespace optimization
 }  // namespace mapping
 }  // namespace cartographer
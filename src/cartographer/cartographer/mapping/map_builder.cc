@@ -110,12 +110,15 @@ int MapBuilder::AddTrajectoryBuilder(
     DCHECK(dynamic_cast<PoseGraph3D*>(pose_graph_.get()));
     trajectory_builders_.push_back(
         common::make_unique<CollatedTrajectoryBuilder>(
-            sensor_collator_.get(), trajectory_id, expected_sensor_ids,
+            trajectory_options, sensor_collator_.get(), trajectory_id,
+            expected_sensor_ids,
             CreateGlobalTrajectoryBuilder3D(
                 std::move(local_trajectory_builder), trajectory_id,
                 static_cast<PoseGraph3D*>(pose_graph_.get()),
                 local_slam_result_callback)));
   } else {
+    CHECK(!trajectory_options.bypass_imu_collator())
+        << "Uncollated IMU data is not yet implemented for 2D.";
     std::unique_ptr<LocalTrajectoryBuilder2D> local_trajectory_builder;
     if (trajectory_options.has_trajectory_builder_2d_options()) {
       local_trajectory_builder = common::make_unique<LocalTrajectoryBuilder2D>(
@@ -125,7 +128,8 @@ int MapBuilder::AddTrajectoryBuilder(
     DCHECK(dynamic_cast<PoseGraph2D*>(pose_graph_.get()));
     trajectory_builders_.push_back(
         common::make_unique<CollatedTrajectoryBuilder>(
-            sensor_collator_.get(), trajectory_id, expected_sensor_ids,
+            trajectory_options, sensor_collator_.get(), trajectory_id,
+            expected_sensor_ids,
             CreateGlobalTrajectoryBuilder2D(
                 std::move(local_trajectory_builder), trajectory_id,
                 static_cast<PoseGraph2D*>(pose_graph_.get()),
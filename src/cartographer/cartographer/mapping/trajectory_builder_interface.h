@@ -21,6 +21,7 @@
 #include <memory>
 #include <string>
 
+#include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/make_unique.h"
 #include "cartographer/common/port.h"
@@ -62,6 +63,26 @@ class TrajectoryBuilderInterface {
                          sensor::RangeData /* in local frame */,
                          std::unique_ptr<const InsertionResult>)>;
 
+  // State of the tracking frame propagated by local SLAM from the IMU data up
+  // to 'time'. 'velocity' is given in the local frame, 'angular_velocity' in
+  // the tracking frame.
+  struct ImuPropagatedState {
+    common::Time time;
+    transform::Rigid3d local_pose;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d angular_velocity;
+    Eigen::Vector3d accelerometer_bias;
+    Eigen::Vector3d gyroscope_bias;
+  };
+
+  // A callback which is called for every IMU measurement integrated by local
+  // SLAM. It is called synchronously while the IMU data is added, so it must
+  // not block. Unless 'bypass_imu_collator' is enabled, IMU data passes
+  // through the collator together with the range data and the callbacks come
+  // in bursts, usually once per range data message, instead of at IMU rate.
+  using ImuPropagatedStateCallback =
+      std::function<void(int /* trajectory ID */, const ImuPropagatedState&)>;
+
   struct SensorId {
     enum class SensorType {
       RANGE = 0,
@@ -110,6 +131,11 @@ class TrajectoryBuilderInterface {
   // 'LocalTrajectoryBuilder2D/3D'.
   virtual void AddLocalSlamResultData(
       std::unique_ptr<mapping::LocalSlamResultData> local_slam_result_data) = 0;
+
+  // Registers a callback for IMU-rate state estimates. Trajectory builders
+  // without local SLAM ignore it. Not yet implemented for 2D local SLAM.
+  virtual void SetImuPropagatedStateCallback(
+      const ImuPropagatedStateCallback& imu_propagated_state_callback) {}
 };
 
 proto::SensorId ToProto(const TrajectoryBuilderInterface::SensorId& sensor_id);
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/azimuth_point_stamper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/math.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+constexpr float kPi = static_cast<float>(M_PI);
+
+// Approximates std::atan2 to within 1e-5 rad. Written without data dependent
+// branches so that loops calling it can be vectorized.
+float FastAtan2(const float y, const float x) {
+  const float abs_x = std::abs(x);
+  const float abs_y = std::abs(y);
+  // min() and max() of 'abs_x' and 'abs_y'. Selecting them would let the
+  // compiler duplicate the division below into two branches.
+  const float sum = abs_x + abs_y;
+  const float difference = std::abs(abs_x - abs_y);
+  const float a = (sum - difference) /
+                  (sum + difference + std::numeric_limits<float>::min());
+  const float s = a * a;
+  const float r =
+      ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+  const bool steep = abs_y > abs_x;
+  const float octant_angle =
+      (steep ? 0.5f * kPi : 0.f) + (steep ? -1.f : 1.f) * r;
+  const float half_angle = (x < 0.f ? kPi : 0.f) +
+                           (x < 0.f ? -1.f : 1.f) * octant_angle;
+  return (y < 0.f ? -1.f : 1.f) * half_angle;
+}
+
+// Returns 'angle' wrapped into [-pi, pi).
+float NormalizeAngle(const float angle) {
+  return angle - 2.f * kPi * std::floor((angle + kPi) / (2.f * kPi));
+}
+
+}  // namespace
+
+AzimuthPointStamper::AzimuthPointStamper(const float scan_period,
+                                         const int num_scan_lines,
+                                         const float min_vertical_angle,
+                                         const float max_vertical_angle)
+    : scan_period_(scan_period),
+      num_scan_lines_(num_scan_lines),
+      min_vertical_angle_(min_vertical_angle),
+      max_vertical_angle_(max_vertical_angle) {
+  CHECK_GT(scan_period_, 0.f);
+  CHECK_GT(num_scan_lines_, 0);
+  CHECK_LT(min_vertical_angle_, max_vertical_angle_);
+}
+
+float AzimuthPointStamper::Stamp(const std::vector<int>& rings,
+                                 TimedPointCloud* const points) {
+  const size_t num_points = points->size();
+  if (num_points < 2) return 0.f;
+  CHECK(rings.empty() || rings.size() == num_points);
+  azimuths_.resize(num_points);
+  scan_lines_.resize(num_points);
+  // The azimuth is negated so that it increases in the scan direction of a
+  // clockwise spinning LiDAR. This loop gets vectorized.
+  const Eigen::Vector4f* const data = points->data();
+  float* const azimuths = azimuths_.data();
+  for (size_t i = 0; i < num_points; ++i) {
+    azimuths[i] = -FastAtan2(data[i][1], data[i][0]);
+  }
+  // Points with an unknown scan line share an extra one.
+  int num_scan_lines = num_scan_lines_;
+  if (!rings.empty()) {
+    num_scan_lines = std::max(
+        num_scan_lines, *std::max_element(rings.begin(), rings.end()) + 1);
+    for (size_t i = 0; i < num_points; ++i) {
+      scan_lines_[i] = rings[i] >= 0 ? rings[i] : num_scan_lines;
+    }
+  } else {
+    const float line_scale = (num_scan_lines_ - 1) /
+                             (max_vertical_angle_ - min_vertical_angle_);
+    for (size_t i = 0; i < num_points; ++i) {
+      const float line =
+          (FastAtan2(data[i][2], data[i].head<2>().norm()) -
+           min_vertical_angle_) *
+              line_scale +
+          0.5f;
+      scan_lines_[i] = line >= 0.f && line < num_scan_lines_
+                           ? static_cast<int>(line)
+                           : num_scan_lines_;
+    }
+  }
+
+  // Unwrap the azimuths along each scan line, starting close to the azimuth
+  // of the first point. Scan lines are unwrapped separately, so this works
+  // for points ordered by scan line as well as for points ordered by firing.
+  const float start_azimuth = azimuths_[0];
+  previous_azimuths_.assign(num_scan_lines + 1, start_azimuth);
+  float max_time = 0.f;
+  for (size_t i = 0; i < num_points; ++i) {
+    float& previous = previous_azimuths_[scan_lines_[i]];
+    const float azimuth = previous + NormalizeAngle(azimuths_[i] - previous);
+    previous = azimuth;
+    const float time = common::Clamp(
+        (azimuth - start_azimuth) * (scan_period_ / (2.f * kPi)), 0.f,
+        scan_period_);
+    (*points)[i][3] = time;
+    max_time = std::max(max_time, time);
+  }
+  for (Eigen::Vector4f& point : *points) {
+    point[3] -= max_time;
+  }
+  return max_time;
+}
+
+std::unique_ptr<AzimuthPointStamper> CreateAzimuthPointStamper(
+    const mapping::proto::LocalTrajectoryBuilderOptions3D& options) {
+  if (!options.eable_mannually_discrew()) {
+    return nullptr;
+  }
+  return common::make_unique<AzimuthPointStamper>(
+      options.scan_period(), options.num_scan_lines(),
+      options.min_vertical_angle(), options.max_vertical_angle());
+}
+
+}  // namespace sensor
+}  // namespace cartographer
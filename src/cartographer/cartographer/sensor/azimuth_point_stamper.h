@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_SENSOR_AZIMUTH_POINT_STAMPER_H_
+#define CARTOGRAPHER_SENSOR_AZIMUTH_POINT_STAMPER_H_
+
+#include <memory>
+#include <vector>
+
+#include "cartographer/mapping/proto/3d/local_trajectory_builder_options_3d.pb.h"
+#include "cartographer/sensor/point_cloud.h"
+
+namespace cartographer {
+namespace sensor {
+
+// Computes the point times of one sweep of a spinning LiDAR from the azimuth
+// of each point, for sensors which do not provide per point times. The points
+// have to be given in the sensor frame, whose z axis is the spin axis.
+class AzimuthPointStamper {
+ public:
+  // The sensor sweeps once per 'scan_period' seconds. Without ring numbers,
+  // the scan line of a point is recovered from its elevation, given the
+  // number of scan lines and the elevation angles in radians of the lowest and
+  // highest line.
+  AzimuthPointStamper(float scan_period, int num_scan_lines,
+                      float min_vertical_angle, float max_vertical_angle);
+
+  AzimuthPointStamper(const AzimuthPointStamper&) = delete;
+  AzimuthPointStamper& operator=(const AzimuthPointStamper&) = delete;
+
+  // Overwrites the times of 'points' so that the sweep starts at the azimuth
+  // of the first point and the last point of the sweep has time 0. 'rings'
+  // holds the scan line of each point, or is empty to use the elevation.
+  // Returns the duration from the first to the last point of the sweep.
+  float Stamp(const std::vector<int>& rings, TimedPointCloud* points);
+
+ private:
+  const float scan_period_;
+  const int num_scan_lines_;
+  const float min_vertical_angle_;
+  const float max_vertical_angle_;
+
+  // Buffers reused across calls.
+  std::vector<float> azimuths_;
+  std::vector<int> scan_lines_;
+  // Last unwrapped azimuth per scan line.
+  std::vector<float> previous_azimuths_;
+};
+
+// Returns the stamper configured by 'options', or 'nullptr' if
+// 'eable_mannually_discrew' is disabled.
+std::unique_ptr<AzimuthPointStamper> CreateAzimuthPointStamper(
+    const mapping::proto::LocalTrajectoryBuilderOptions3D& options);
+
+}  // namespace sensor
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_SENSOR_AZIMUTH_POINT_STAMPER_H_
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2018 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/sensor/azimuth_point_stamper.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+constexpr int kNumScanLines = 16;
+constexpr int kNumAzimuthSteps = 360;
+constexpr float kScanPeriod = 0.1f;
+constexpr float kMinVerticalAngle = -15.f * M_PI / 180.f;
+constexpr float kMaxVerticalAngle = 15.f * M_PI / 180.f;
+
+// Creates one sweep of a clockwise spinning LiDAR in the sensor frame as points
+// at the given (azimuth step, scan line) pairs. Their scan lines are returned
+// in 'rings' and their correct times relative to the last point of the sweep
+// in 'expected_times'.
+TimedPointCloud CreateSweep(
+    const std::vector<std::pair<int, int>>& steps_and_lines,
+    std::vector<int>* const rings, std::vector<float>* const expected_times) {
+  constexpr double kStartAzimuth = 1.;
+  TimedPointCloud result;
+  for (const auto& step_and_line : steps_and_lines) {
+    const double azimuth =
+        kStartAzimuth - 2. * M_PI * step_and_line.first / kNumAzimuthSteps;
+    const double elevation =
+        kMinVerticalAngle + (kMaxVerticalAngle - kMinVerticalAngle) *
+                                step_and_line.second / (kNumScanLines - 1);
+    const double range = 10. + step_and_line.second;
+    result.emplace_back(range * std::cos(elevation) * std::cos(azimuth),
+                        range * std::cos(elevation) * std::sin(azimuth),
+                        range * std::sin(elevation), 0.f);
+    rings->push_back(step_and_line.second);
+    expected_times->push_back(kScanPeriod *
+                              (step_and_line.first - (kNumAzimuthSteps - 1)) /
+                              kNumAzimuthSteps);
+  }
+  return result;
+}
+
+class AzimuthPointStamperTest : public ::testing::Test {
+ protected:
+  AzimuthPointStamperTest()
+      : stamper_(kScanPeriod, kNumScanLines, kMinVerticalAngle,
+                 kMaxVerticalAngle) {
+    for (int step = 0; step < kNumAzimuthSteps; ++step) {
+      for (int line = 0; line < kNumScanLines; ++line) {
+        firing_order_.emplace_back(step, line);
+      }
+    }
+    for (int line = 0; line < kNumScanLines; ++line) {
+      for (int step = 0; step < kNumAzimuthSteps; ++step) {
+        scan_line_order_.emplace_back(step, line);
+      }
+    }
+  }
+
+  void ExpectStampsSweep(
+      const std::vector<std::pair<int, int>>& steps_and_lines,
+      const bool use_rings) {
+    std::vector<int> rings;
+    std::vector<float> expected_times;
+    TimedPointCloud points =
+        CreateSweep(steps_and_lines, &rings, &expected_times);
+    if (!use_rings) {
+      rings.clear();
+    }
+    EXPECT_NEAR(kScanPeriod * (kNumAzimuthSteps - 1) / kNumAzimuthSteps,
+                stamper_.Stamp(rings, &points), 1e-5f);
+    ASSERT_EQ(expected_times.size(), points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      EXPECT_NEAR(expected_times[i], points[i][3], 1e-5f);
+    }
+  }
+
+  AzimuthPointStamper stamper_;
+  std::vector<std::pair<int, int>> firing_order_;
+  std::vector<std::pair<int, int>> scan_line_order_;
+};
+
+TEST_F(AzimuthPointStamperTest, StampsByElevation) {
+  ExpectStampsSweep(firing_order_, false /* use_rings */);
+  ExpectStampsSweep(scan_line_order_, false /* use_rings */);
+}
+
+TEST_F(AzimuthPointStamperTest, StampsByRing) {
+  ExpectStampsSweep(firing_order_, true /* use_rings */);
+  ExpectStampsSweep(scan_line_order_, true /* use_rings */);
+}
+
+TEST_F(AzimuthPointStamperTest, IgnoresElevationIfRingsAreGiven) {
+  // All points lie in the horizontal plane, so only the rings tell the scan
+  // lines apart.
+  std::vector<int> rings;
+  std::vector<float> expected_times;
+  TimedPointCloud points =
+      CreateSweep(scan_line_order_, &rings, &expected_times);
+  for (Eigen::Vector4f& point : points) {
+    point[2] = 0.f;
+  }
+  stamper_.Stamp(rings, &points);
+  for (size_t i = 0; i < points.size(); ++i) {
+    EXPECT_NEAR(expected_times[i], points[i][3], 1e-5f);
+  }
+}
+
+TEST_F(AzimuthPointStamperTest, KeepsTooSmallClouds) {
+  TimedPointCloud points = {Eigen::Vector4f(1.f, 0.f, 0.f, -0.05f)};
+  EXPECT_EQ(0.f, stamper_.Stamp({}, &points));
+  EXPECT_EQ(-0.05f, points[0][3]);
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
@@ -16,6 +16,7 @@
 
 #include "cartographer/sensor/internal/voxel_filter.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "cartographer/common/math.h"
@@ -25,6 +26,30 @@ namespace sensor {
 
 namespace {
 
+constexpr int kPackedBitsPerAxis = 21;
+constexpr int32 kPackedIndexOffset = 1 << (kPackedBitsPerAxis - 1);
+constexpr uint64 kEmptyPackedKey = ~uint64{0};
+constexpr size_t kInitialNumPackedKeySlots = 1024;
+
+// Packs 'index' into 'packed_key'. Returns false if a component is outside of
+// the range that fits into 'kPackedBitsPerAxis' bits.
+bool PackCellIndex(const Eigen::Array3i& index, uint64* const packed_key) {
+  const uint32 x = static_cast<uint32>(index.x() + kPackedIndexOffset);
+  const uint32 y = static_cast<uint32>(index.y() + kPackedIndexOffset);
+  const uint32 z = static_cast<uint32>(index.z() + kPackedIndexOffset);
+  if (((x | y | z) >> kPackedBitsPerAxis) != 0) {
+    return false;
+  }
+  *packed_key = (static_cast<uint64>(x) << (2 * kPackedBitsPerAxis)) |
+                (static_cast<uint64>(y) << kPackedBitsPerAxis) | z;
+  return true;
+}
+
+// Fibonacci hashing, returns the top bits selected by 'shift'.
+size_t HashPackedKey(const uint64 packed_key, const int shift) {
+  return static_cast<size_t>((packed_key * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
 PointCloud FilterByMaxRange(const PointCloud& point_cloud,
                             const float max_range) {
   PointCloud result;
@@ -36,6 +61,49 @@ PointCloud FilterByMaxRange(const PointCloud& point_cloud,
   return result;
 }
 
+Eigen::Array3i GetFloorCellIndex(const Eigen::Vector3f& point,
+                                 const float inverse_length) {
+  const Eigen::Array3f index = point.array() * inverse_length;
+  return Eigen::Array3i(static_cast<int>(std::floor(index.x())),
+                        static_cast<int>(std::floor(index.y())),
+                        static_cast<int>(std::floor(index.z())));
+}
+
+// Returns the number of voxels with edge length 'length' that contain points
+// of 'point_cloud'. 'voxel_set' is cleared first, so that its memory can be
+// reused across calls.
+size_t CountOccupiedVoxels(const PointCloud& point_cloud, const float length,
+                           VoxelIndexSet* const voxel_set) {
+  voxel_set->Clear();
+  const float inverse_length = 1.f / length;
+  size_t num_voxels = 0;
+  for (const Eigen::Vector3f& point : point_cloud) {
+    if (voxel_set->Insert(GetFloorCellIndex(point, inverse_length))) {
+      ++num_voxels;
+    }
+  }
+  return num_voxels;
+}
+
+// Returns the first point in each voxel counted by 'CountOccupiedVoxels'.
+PointCloud SelectFirstPointInEachVoxel(const PointCloud& point_cloud,
+                                       const float length,
+                                       VoxelIndexSet* const voxel_set) {
+  voxel_set->Clear();
+  const float inverse_length = 1.f / length;
+  PointCloud result;
+  for (const Eigen::Vector3f& point : point_cloud) {
+    if (voxel_set->Insert(GetFloorCellIndex(point, inverse_length))) {
+      result.push_back(point);
+    }
+  }
+  return result;
+}
+
+// Searches for the largest voxel edge length that keeps 'min_num_points'. The
+// candidate lengths only need the number of occupied voxels, so they are
+// counted without building point clouds, and the filtered point cloud is
+// assembled once for the chosen length.
 PointCloud AdaptivelyVoxelFiltered(
     const proto::AdaptiveVoxelFilterOptions& options,
     const PointCloud& point_cloud) {
@@ -43,46 +111,121 @@ PointCloud AdaptivelyVoxelFiltered(
     // 'point_cloud' is already sparse enough.
     return point_cloud;
   }
-  PointCloud result = VoxelFilter(options.max_length()).Filter(point_cloud);
+  VoxelIndexSet voxel_set;
+  voxel_set.Reserve(point_cloud.size());
+  PointCloud result = SelectFirstPointInEachVoxel(
+      point_cloud, options.max_length(), &voxel_set);
   if (result.size() >= options.min_num_points()) {
     // Filtering with 'max_length' resulted in a sufficiently dense point cloud.
     return result;
   }
   // Search for a 'low_length' that is known to result in a sufficiently
-  // dense point cloud. We give up and use the full 'point_cloud' if reducing
-  // the edge length by a factor of 1e-2 is not enough.
+  // dense point cloud. We give up and use the smallest length we tried if
+  // reducing the edge length by a factor of 1e-2 is not enough.
+  float low_length = options.max_length();
   for (float high_length = options.max_length();
        high_length > 1e-2f * options.max_length(); high_length /= 2.f) {
-    float low_length = high_length / 2.f;
-    result = VoxelFilter(low_length).Filter(point_cloud);
-    if (result.size() >= options.min_num_points()) {
+    low_length = high_length / 2.f;
+    if (CountOccupiedVoxels(point_cloud, low_length, &voxel_set) >=
+        options.min_num_points()) {
       // Binary search to find the right amount of filtering. 'low_length' gave
-      // a sufficiently dense 'result', 'high_length' did not. We stop when the
-      // edge length is at most 10% off.
+      // a sufficiently dense point cloud, 'high_length' did not. We stop when
+      // the edge length is at most 10% off.
       while ((high_length - low_length) / low_length > 1e-1f) {
         const float mid_length = (low_length + high_length) / 2.f;
-        const PointCloud candidate =
-            VoxelFilter(mid_length).Filter(point_cloud);
-        if (candidate.size() >= options.min_num_points()) {
+        if (CountOccupiedVoxels(point_cloud, mid_length, &voxel_set) >=
+            options.min_num_points()) {
           low_length = mid_length;
-          result = candidate;
         } else {
           high_length = mid_length;
         }
       }
-      return result;
+      break;
     }
   }
-  return result;
+  return SelectFirstPointInEachVoxel(point_cloud, low_length, &voxel_set);
 }
 
 }  // namespace
 
+VoxelIndexSet::KeyType VoxelIndexSet::IndexToKey(
+    const Eigen::Array3i& index) {
+  KeyType k_0(static_cast<uint32>(index[0]));
+  KeyType k_1(static_cast<uint32>(index[1]));
+  KeyType k_2(static_cast<uint32>(index[2]));
+  return (k_0 << 2 * 32) | (k_1 << 1 * 32) | k_2;
+}
+
+bool VoxelIndexSet::Insert(const Eigen::Array3i& index) {
+  uint64 packed_key;
+  if (PackCellIndex(index, &packed_key)) {
+    return InsertPackedKey(packed_key);
+  }
+  return unpacked_keys_.insert(IndexToKey(index)).second;
+}
+
+void VoxelIndexSet::Clear() {
+  std::fill(packed_keys_.begin(), packed_keys_.end(), kEmptyPackedKey);
+  num_packed_keys_ = 0;
+  unpacked_keys_.clear();
+}
+
+bool VoxelIndexSet::InsertPackedKey(const uint64 packed_key) {
+  // Keep the load factor at most 1/2 so that probe sequences stay short.
+  if (2 * (num_packed_keys_ + 1) > packed_keys_.size()) {
+    RehashPackedKeys(packed_keys_.empty() ? kInitialNumPackedKeySlots
+                                          : 2 * packed_keys_.size());
+  }
+  const size_t mask = packed_keys_.size() - 1;
+  for (size_t slot = HashPackedKey(packed_key, packed_keys_shift_);;
+       slot = (slot + 1) & mask) {
+    if (packed_keys_[slot] == packed_key) {
+      return false;
+    }
+    if (packed_keys_[slot] == kEmptyPackedKey) {
+      packed_keys_[slot] = packed_key;
+      ++num_packed_keys_;
+      return true;
+    }
+  }
+}
+
+void VoxelIndexSet::Reserve(const size_t num_indices) {
+  size_t num_slots = kInitialNumPackedKeySlots;
+  while (num_slots < 2 * num_indices) {
+    num_slots *= 2;
+  }
+  if (num_slots > packed_keys_.size()) {
+    RehashPackedKeys(num_slots);
+  }
+}
+
+void VoxelIndexSet::RehashPackedKeys(const size_t num_slots) {
+  std::vector<uint64> old_packed_keys;
+  old_packed_keys.swap(packed_keys_);
+  packed_keys_.assign(num_slots, kEmptyPackedKey);
+  packed_keys_shift_ = 64;
+  for (size_t size = packed_keys_.size(); size > 1; size /= 2) {
+    --packed_keys_shift_;
+  }
+  const size_t mask = packed_keys_.size() - 1;
+  for (const uint64 packed_key : old_packed_keys) {
+    if (packed_key == kEmptyPackedKey) {
+      continue;
+    }
+    size_t slot = HashPackedKey(packed_key, packed_keys_shift_);
+    while (packed_keys_[slot] != kEmptyPackedKey) {
+      slot = (slot + 1) & mask;
+    }
+    packed_keys_[slot] = packed_key;
+  }
+}
+
 PointCloud VoxelFilter::Filter(const PointCloud& point_cloud) {
+  voxel_set_.Reserve(point_cloud.size());
   PointCloud results;
   for (const Eigen::Vector3f& point : point_cloud) {
-    auto it_inserted = voxel_set_.insert(IndexToKey(GetCellIndex(point)));
-    if (it_inserted.second) {
+    if (voxel_set_.Insert(GetCellIndex(point))) {
       results.push_back(point);
     }
   }
@@ -90,11 +233,10 @@ PointCloud VoxelFilter::Filter(const PointCloud& point_cloud) {
 }
 
 TimedPointCloud VoxelFilter::Filter(const TimedPointCloud& timed_point_cloud) {
+  voxel_set_.Reserve(timed_point_cloud.size());
   TimedPointCloud results;
   for (const Eigen::Vector4f& point : timed_point_cloud) {
-    auto it_inserted =
-        voxel_set_.insert(IndexToKey(GetCellIndex(point.head<3>())));
-    if (it_inserted.second) {
+    if (voxel_set_.Insert(GetCellIndex(point.head<3>()))) {
       results.push_back(point);
     }
   }
@@ -105,24 +247,17 @@ std::vector<sensor::TimedPointCloudOriginData::RangeMeasurement>
 VoxelFilter::Filter(
     const std::vector<sensor::TimedPointCloudOriginData::RangeMeasurement>&
         range_measurements) {
+  voxel_set_.Reserve(range_measurements.size());
   std::vector<sensor::TimedPointCloudOriginData::RangeMeasurement> results;
   for (const auto& range_measurement : range_measurements) {
-    auto it_inserted = voxel_set_.insert(
-        IndexToKey(GetCellIndex(range_measurement.point_time.head<3>())));
-    if (it_inserted.second) {
+    if (voxel_set_.Insert(
+            GetCellIndex(range_measurement.point_time.head<3>()))) {
       results.push_back(range_measurement);
     }
   }
   return results;
 }
 
-VoxelFilter::KeyType VoxelFilter::IndexToKey(const Eigen::Array3i& index) {
-  KeyType k_0(static_cast<uint32>(index[0]));
-  KeyType k_1(static_cast<uint32>(index[1]));
-  KeyType k_2(static_cast<uint32>(index[2]));
-  return (k_0 << 2 * 32) | (k_1 << 1 * 32) | k_2;
-}
-
 Eigen::Array3i VoxelFilter::GetCellIndex(const Eigen::Vector3f& point) const {
   Eigen::Array3f index = point.array() / resolution_;
   return Eigen::Array3i(common::RoundToInt(index.x()),
@@ -19,8 +19,10 @@
 
 #include <bitset>
 #include <unordered_set>
+#include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/port.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/proto/adaptive_voxel_filter_options.pb.h"
 #include "cartographer/sensor/timed_point_cloud_data.h"
@@ -28,6 +30,45 @@
 namespace cartographer {
 namespace sensor {
 
+// Set of voxel indices. Indices within 2^20 cells of the origin are packed
+// into 21 bits per axis and kept in an open addressing hash table, which does
+// not allocate per insertion. Indices further away go into a node-based set.
+class VoxelIndexSet {
+ public:
+  VoxelIndexSet() = default;
+
+  VoxelIndexSet(const VoxelIndexSet&) = delete;
+  VoxelIndexSet& operator=(const VoxelIndexSet&) = delete;
+
+  // Returns true if 'index' was not in the set before.
+  bool Insert(const Eigen::Array3i& index);
+
+  // Removes all indices but keeps the allocated memory for reuse.
+  void Clear();
+
+  // Makes room for 'num_indices' packed indices without growing the table
+  // during insertion.
+  void Reserve(size_t num_indices);
+
+ private:
+  using KeyType = std::bitset<3 * 32>;
+
+  static KeyType IndexToKey(const Eigen::Array3i& index);
+
+  // Inserts a packed key into 'packed_keys_'. Returns true if it was new.
+  bool InsertPackedKey(uint64 packed_key);
+
+  // Moves all packed keys into a table of 'num_slots' slots, which must be a
+  // power of 2.
+  void RehashPackedKeys(size_t num_slots);
+
+  // Empty slots hold 'kEmptyPackedKey', which no packed index is equal to.
+  std::vector<uint64> packed_keys_;
+  size_t num_packed_keys_ = 0;
+  int packed_keys_shift_ = 64;
+  std::unordered_set<KeyType> unpacked_keys_;
+};
+
 // Voxel filter for point clouds. For each voxel, the assembled point cloud
 // contains the first point that fell into it from any of the inserted point
 // clouds.
@@ -51,14 +92,10 @@ class VoxelFilter {
           range_measurements);
 
  private:
-  using KeyType = std::bitset<3 * 32>;
-
-  static KeyType IndexToKey(const Eigen::Array3i& index);
-
   Eigen::Array3i GetCellIndex(const Eigen::Vector3f& point) const;
 
   float resolution_;
-  std::unordered_set<KeyType> voxel_set_;
+  VoxelIndexSet voxel_set_;
 };
 
 proto::AdaptiveVoxelFilterOptions CreateAdaptiveVoxelFilterOptions(
@@ -16,7 +16,13 @@
 
 #include "cartographer/sensor/internal/voxel_filter.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <random>
+#include <set>
+
+#include "cartographer/common/port.h"
 
 #include "gmock/gmock.h"
 
@@ -44,6 +50,30 @@ TEST(VoxelFilterTest, HandlesLargeCoordinates) {
               ContainerEq(PointCloud{point_cloud[0], point_cloud[3]}));
 }
 
+TEST(VoxelFilterTest, MatchesNaiveFilterOnManyVoxels) {
+  PointCloud point_cloud;
+  for (int i = 0; i < 20000; ++i) {
+    point_cloud.emplace_back(std::sin(0.37f * i) * 50.f,
+                             std::cos(0.11f * i) * 50.f, 0.01f * (i % 300));
+  }
+  constexpr float kResolution = 0.2f;
+  std::set<std::array<int, 3>> voxels;
+  PointCloud expected;
+  for (const Eigen::Vector3f& point : point_cloud) {
+    const std::array<int, 3> voxel = {
+        {common::RoundToInt(point.x() / kResolution),
+         common::RoundToInt(point.y() / kResolution),
+         common::RoundToInt(point.z() / kResolution)}};
+    if (voxels.insert(voxel).second) {
+      expected.push_back(point);
+    }
+  }
+  VoxelFilter voxel_filter(kResolution);
+  EXPECT_THAT(voxel_filter.Filter(point_cloud), ContainerEq(expected));
+  // Voxels seen before are remembered across calls.
+  EXPECT_TRUE(voxel_filter.Filter(point_cloud).empty());
+}
+
 TEST(VoxelFilterTest, IgnoresTime) {
   TimedPointCloud timed_point_cloud;
   for (int i = 0; i < 100; ++i) {
@@ -53,6 +83,65 @@ TEST(VoxelFilterTest, IgnoresTime) {
               ContainerEq(TimedPointCloud{timed_point_cloud[0]}));
 }
 
+proto::AdaptiveVoxelFilterOptions CreateTestAdaptiveVoxelFilterOptions(
+    const float max_length, const int min_num_points) {
+  proto::AdaptiveVoxelFilterOptions options;
+  options.set_max_length(max_length);
+  options.set_min_num_points(min_num_points);
+  options.set_max_range(1e6f);
+  return options;
+}
+
+PointCloud CreateRandomPointCloud(const int num_points, const float offset) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-10.f, 10.f);
+  PointCloud point_cloud;
+  for (int i = 0; i < num_points; ++i) {
+    point_cloud.emplace_back(offset + distribution(prng), distribution(prng),
+                             0.1f * distribution(prng));
+  }
+  return point_cloud;
+}
+
+TEST(AdaptiveVoxelFilterTest, KeepsSparsePointClouds) {
+  const PointCloud point_cloud = CreateRandomPointCloud(100, 0.f);
+  EXPECT_THAT(AdaptiveVoxelFilter(CreateTestAdaptiveVoxelFilterOptions(
+                                      1.f /* max_length */,
+                                      100 /* min_num_points */))
+                  .Filter(point_cloud),
+              ContainerEq(point_cloud));
+}
+
+TEST(AdaptiveVoxelFilterTest, UsesMaxLengthIfDenseEnough) {
+  const PointCloud point_cloud = CreateRandomPointCloud(10000, 0.f);
+  const PointCloud result =
+      AdaptiveVoxelFilter(CreateTestAdaptiveVoxelFilterOptions(
+                              1.f /* max_length */, 50 /* min_num_points */))
+          .Filter(point_cloud);
+  // About 20 x 20 voxels of 1 m are occupied.
+  EXPECT_GE(result.size(), 50);
+  EXPECT_LE(result.size(), 21 * 21 * 2);
+}
+
+TEST(AdaptiveVoxelFilterTest, FindsEdgeLengthForMinNumPoints) {
+  for (const float offset : {0.f, 1e5f}) {
+    const PointCloud point_cloud = CreateRandomPointCloud(20000, offset);
+    const PointCloud result =
+        AdaptiveVoxelFilter(CreateTestAdaptiveVoxelFilterOptions(
+                                8.f /* max_length */,
+                                2000 /* min_num_points */))
+            .Filter(point_cloud);
+    EXPECT_GE(result.size(), 2000);
+    // The edge length is within 10% of the coarsest sufficient one, so we
+    // should not keep more than about 1.1^2 times as many points.
+    EXPECT_LE(result.size(), 2600);
+    for (const Eigen::Vector3f& point : result) {
+      EXPECT_NE(std::find(point_cloud.begin(), point_cloud.end(), point),
+                point_cloud.end());
+    }
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -30,6 +30,10 @@ POSE_GRAPH = {
     good_match_ratio_of_distance = 0.5,
     ransac_thresh_of_2d_transform_estimate = 3.0,
     scale_estimated_tolerance = 0.1,
+    num_place_recognition_candidates = 10,
+    place_recognition_num_rings = 20,
+    place_recognition_max_radius = 40.,
+    submap_cache_memory_limit_mb = 2048.,
     
     fast_correlative_scan_matcher = {
       linear_search_window = 7.,
@@ -54,6 +58,7 @@ POSE_GRAPH = {
       linear_xy_search_window = 5.,
       linear_z_search_window = 1.,
       angular_search_window = math.rad(15.),
+      num_threads = 4,
     },
     ceres_scan_matcher_3d = {
       occupied_space_weight_0 = 5.,
@@ -86,6 +91,8 @@ POSE_GRAPH = {
       max_num_iterations = 50,
       num_threads = 7,
     },
+    linear_solver_type = "SPARSE_NORMAL_CHOLESKY",
+    preconditioner_type = "JACOBI",
   },
   max_num_final_iterations = 200,
   global_sampling_ratio = 0.003,
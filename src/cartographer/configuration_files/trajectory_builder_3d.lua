@@ -22,6 +22,9 @@ TRAJECTORY_BUILDER_3D = {
   
   scan_period = 0.1,
   eable_mannually_discrew = false,
+  num_scan_lines = 16,
+  min_vertical_angle = math.rad(-15.),
+  max_vertical_angle = math.rad(15.),
 
   enable_ndt_initialization = false,
   frames_for_static_initialization = 7,
@@ -29,6 +32,8 @@ TRAJECTORY_BUILDER_3D = {
   frames_for_online_gravity_estimate = 7,
 
   enable_gravity_factor = false,
+  use_fixed_lag_smoother = false,
+  fixed_lag_smoother_lag = 3.,
 
   high_resolution_adaptive_voxel_filter = {
     max_length = 2.,
@@ -63,6 +68,35 @@ TRAJECTORY_BUILDER_3D = {
     },
   },
 
+  use_loam_scan_matching = false,
+  loam_scan_matcher = {
+    edge_weight = 1.,
+    planar_weight = 1.,
+    translation_weight = 0.1,
+    rotation_weight = 0.1,
+    num_correspondence_iterations = 3,
+    max_correspondence_distance = 1.,
+    map_voxel_size = 1.,
+    max_points_per_voxel = 20,
+    map_radius = 50.,
+    feature_extractor = {
+      num_scan_lines = 16,
+      min_vertical_angle = math.rad(-15.),
+      max_vertical_angle = math.rad(15.),
+      min_range = 1.,
+      num_sectors = 6,
+      max_edge_points_per_sector = 4,
+      max_planar_points_per_sector = 20,
+      edge_threshold = 1.,
+      planar_threshold = 0.1,
+    },
+    ceres_solver_options = {
+      use_nonmonotonic_steps = false,
+      max_num_iterations = 4,
+      num_threads = 1,
+    },
+  },
+
   motion_filter = {
     max_time_seconds = 0.5,
     max_distance_meters = 0.1,
@@ -82,6 +116,10 @@ TRAJECTORY_BUILDER_3D = {
       miss_probability = 0.49,
       num_free_space_voxels = 2,
     },
+    use_dense_active_window = true,
+    high_resolution_active_window_size = 16.,
+    low_resolution_active_window_size = 60.,
+    compact_finished_submaps = true,
   },
 
   imu = {
@@ -140,13 +140,26 @@ int MapBuilderBridge::AddTrajectory(
           trajectory_options.num_subdivisions_per_laser_scan,
           trajectory_options.tracking_frame,
           node_options_.lookup_transform_timeout_sec, tf_buffer_,
-          map_builder_->GetTrajectoryBuilder(trajectory_id));
+          map_builder_->GetTrajectoryBuilder(trajectory_id),
+          node_options_.map_builder_options.use_trajectory_builder_3d()
+              ? cartographer::sensor::CreateAzimuthPointStamper(
+                    trajectory_options.trajectory_builder_options
+                        .trajectory_builder_3d_options())
+              : nullptr);
   auto emplace_result =
       trajectory_options_.emplace(trajectory_id, trajectory_options);
   CHECK(emplace_result.second == true);
   return trajectory_id;
 }
 
+void MapBuilderBridge::SetImuPropagatedStateCallback(
+    const int trajectory_id,
+    const cartographer::mapping::TrajectoryBuilderInterface::
+        ImuPropagatedStateCallback& imu_propagated_state_callback) {
+  map_builder_->GetTrajectoryBuilder(trajectory_id)
+      ->SetImuPropagatedStateCallback(imu_propagated_state_callback);
+}
+
 void MapBuilderBridge::FinishTrajectory(const int trajectory_id) {
   LOG(INFO) << "Finishing trajectory with ID '" << trajectory_id << "'...";
 
@@ -70,6 +70,14 @@ class MapBuilderBridge {
           ::cartographer::mapping::TrajectoryBuilderInterface::SensorId>&
           expected_sensor_ids,
       const TrajectoryOptions& trajectory_options);
+  // Forwards IMU-rate state estimates of local SLAM to
+  // 'imu_propagated_state_callback'. The callback is invoked while IMU data
+  // is added to the trajectory, i.e. on the IMU callback queue of the node if
+  // IMU data is not collated.
+  void SetImuPropagatedStateCallback(
+      int trajectory_id,
+      const ::cartographer::mapping::TrajectoryBuilderInterface::
+          ImuPropagatedStateCallback& imu_propagated_state_callback);
   void FinishTrajectory(int trajectory_id);
   void RunFinalOptimization();
   bool SerializeState(const std::string& filename);
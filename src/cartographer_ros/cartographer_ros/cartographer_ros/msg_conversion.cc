@@ -17,6 +17,7 @@
 #include "cartographer_ros/msg_conversion.h"
 
 #include <cmath>
+#include <cstring>
 
 #include "cartographer/common/math.h"
 #include "cartographer/common/port.h"
@@ -154,6 +155,75 @@ bool PointCloud2HasField(const sensor_msgs::PointCloud2& pc2,
   return false;
 }
 
+const sensor_msgs::PointField* FindPointField(
+    const sensor_msgs::PointCloud2& message, const std::string& field_name) {
+  for (const auto& field : message.fields) {
+    if (field.name == field_name) {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+
+template <typename T>
+T ReadUnaligned(const uint8_t* const data) {
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+// Returns the size in bytes of a field of type 'datatype', or 0 for field types
+// we cannot read as a scalar.
+size_t PointFieldTypeSize(const uint8_t datatype) {
+  switch (datatype) {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return 1;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2;
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    case sensor_msgs::PointField::FLOAT32:
+      return 4;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8;
+  }
+  return 0;
+}
+
+// Returns true if 'field' is a scalar which lies within each point of
+// 'message'.
+bool IsReadablePointField(const sensor_msgs::PointCloud2& message,
+                          const sensor_msgs::PointField& field) {
+  const size_t size = PointFieldTypeSize(field.datatype);
+  return size != 0 && field.offset + size <= message.point_step;
+}
+
+double ReadPointFieldAsDouble(const uint8_t* const data,
+                              const uint8_t datatype) {
+  switch (datatype) {
+    case sensor_msgs::PointField::INT8:
+      return ReadUnaligned<int8_t>(data);
+    case sensor_msgs::PointField::UINT8:
+      return ReadUnaligned<uint8_t>(data);
+    case sensor_msgs::PointField::INT16:
+      return ReadUnaligned<int16_t>(data);
+    case sensor_msgs::PointField::UINT16:
+      return ReadUnaligned<uint16_t>(data);
+    case sensor_msgs::PointField::INT32:
+      return ReadUnaligned<int32_t>(data);
+    case sensor_msgs::PointField::UINT32:
+      return ReadUnaligned<uint32_t>(data);
+    case sensor_msgs::PointField::FLOAT32:
+      return ReadUnaligned<float>(data);
+    case sensor_msgs::PointField::FLOAT64:
+      return ReadUnaligned<double>(data);
+  }
+  LOG(FATAL) << "Unsupported point field type " << static_cast<int>(datatype);
+  return 0.;
+}
+
 }  // namespace
 
 sensor_msgs::PointCloud2 ToPointCloud2Message(
@@ -225,6 +295,104 @@ ToPointCloudWithIntensitiesRsLiDAR(const sensor_msgs::PointCloud2& message) {
   return std::make_tuple(point_cloud, FromRos(message.header.stamp));
 }
 
+bool ToTimedPointCloud(const sensor_msgs::PointCloud2& message,
+                       const std::string& time_field, const double time_scale,
+                       const std::string& ring_field,
+                       ::cartographer::sensor::TimedPointCloud* point_cloud,
+                       std::vector<int>* rings, double* last_point_time) {
+  CHECK(ring_field.empty() || rings != nullptr);
+  point_cloud->clear();
+  if (rings != nullptr) {
+    rings->clear();
+  }
+  *last_point_time = 0.;
+  if (message.is_bigendian) {
+    LOG(WARNING) << "Big endian point clouds are not supported.";
+    return false;
+  }
+  const sensor_msgs::PointField* const x_field = FindPointField(message, "x");
+  const sensor_msgs::PointField* const y_field = FindPointField(message, "y");
+  const sensor_msgs::PointField* const z_field = FindPointField(message, "z");
+  for (const sensor_msgs::PointField* field : {x_field, y_field, z_field}) {
+    if (field == nullptr ||
+        field->datatype != sensor_msgs::PointField::FLOAT32 ||
+        !IsReadablePointField(message, *field)) {
+      LOG(WARNING) << "Point cloud needs FLOAT32 fields 'x', 'y' and 'z'.";
+      return false;
+    }
+  }
+  const sensor_msgs::PointField* time = nullptr;
+  if (!time_field.empty()) {
+    time = FindPointField(message, time_field);
+    if (time == nullptr || !IsReadablePointField(message, *time)) {
+      LOG(WARNING) << "Point cloud has no usable time field '" << time_field
+                   << "'.";
+      return false;
+    }
+  }
+  const sensor_msgs::PointField* ring = nullptr;
+  if (!ring_field.empty()) {
+    ring = FindPointField(message, ring_field);
+    if (ring == nullptr || !IsReadablePointField(message, *ring)) {
+      LOG(WARNING) << "Point cloud has no usable ring field '" << ring_field
+                   << "'.";
+      return false;
+    }
+  }
+  const size_t num_points =
+      static_cast<size_t>(message.width) * message.height;
+  if (num_points == 0) {
+    return true;
+  }
+  if (message.data.size() <
+      (message.height - 1) * static_cast<size_t>(message.row_step) +
+          message.width * static_cast<size_t>(message.point_step)) {
+    LOG(WARNING) << "Point cloud data of " << message.data.size()
+                 << " bytes is too short for " << message.height << " rows of "
+                 << message.width << " points.";
+    return false;
+  }
+
+  const uint8_t* const data = message.data.data();
+  if (time != nullptr) {
+    const uint8_t* const last_point =
+        data + (message.height - 1) * static_cast<size_t>(message.row_step) +
+        (message.width - 1) * static_cast<size_t>(message.point_step);
+    *last_point_time =
+        ReadPointFieldAsDouble(last_point + time->offset, time->datatype) *
+        time_scale;
+  }
+
+  point_cloud->reserve(num_points);
+  if (ring != nullptr) {
+    rings->reserve(num_points);
+  }
+  for (uint32_t row = 0; row != message.height; ++row) {
+    const uint8_t* point = data + row * static_cast<size_t>(message.row_step);
+    for (uint32_t column = 0; column != message.width;
+         ++column, point += message.point_step) {
+      const float x = ReadUnaligned<float>(point + x_field->offset);
+      const float y = ReadUnaligned<float>(point + y_field->offset);
+      const float z = ReadUnaligned<float>(point + z_field->offset);
+      if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+        continue;
+      }
+      float relative_time = 0.f;
+      if (time != nullptr) {
+        relative_time = static_cast<float>(
+            ReadPointFieldAsDouble(point + time->offset, time->datatype) *
+                time_scale -
+            *last_point_time);
+      }
+      point_cloud->emplace_back(x, y, z, relative_time);
+      if (ring != nullptr) {
+        rings->push_back(static_cast<int>(
+            ReadPointFieldAsDouble(point + ring->offset, ring->datatype)));
+      }
+    }
+  }
+  return true;
+}
 
 LandmarkData ToLandmarkData(const LandmarkList& landmark_list) {
   LandmarkData landmark_data;
@@ -286,6 +454,14 @@ geometry_msgs::Point ToGeometryMsgPoint(const Eigen::Vector3d& vector3d) {
   return point;
 }
 
+geometry_msgs::Vector3 ToGeometryMsgVector3(const Eigen::Vector3d& vector3d) {
+  geometry_msgs::Vector3 vector3;
+  vector3.x = vector3d.x();
+  vector3.y = vector3d.y();
+  vector3.z = vector3d.z();
+  return vector3;
+}
+
 Eigen::Vector3d LatLongAltToEcef(const double latitude, const double longitude,
                                  const double altitude) {
   // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#From_geodetic_to_ECEF_coordinates
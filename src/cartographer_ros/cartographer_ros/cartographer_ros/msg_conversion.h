@@ -27,6 +27,7 @@
 #include "geometry_msgs/Pose.h"
 #include "geometry_msgs/Transform.h"
 #include "geometry_msgs/TransformStamped.h"
+#include "geometry_msgs/Vector3.h"
 #include "nav_msgs/OccupancyGrid.h"
 #include "pcl/point_cloud.h"
 #include "pcl/point_types.h"
@@ -50,6 +51,8 @@ geometry_msgs::Pose ToGeometryMsgPose(
 
 geometry_msgs::Point ToGeometryMsgPoint(const Eigen::Vector3d& vector3d);
 
+geometry_msgs::Vector3 ToGeometryMsgVector3(const Eigen::Vector3d& vector3d);
+
 // Converts ROS message to point cloud. Returns the time when the last point
 // was acquired (different from the ROS timestamp). Timing of points is given in
 // the fourth component of each point relative to `Time`.
@@ -69,6 +72,22 @@ std::tuple<::cartographer::sensor::PointCloudWithIntensities,
            ::cartographer::common::Time>
 ToPointCloudWithIntensitiesRsLiDAR(const sensor_msgs::PointCloud2& message);
 
+// Decodes the points of 'message' straight from its binary data into
+// 'point_cloud' using the field offsets, without an intermediate PCL cloud.
+// Points with non-finite coordinates are skipped. If 'time_field' is not
+// empty, the time of each point is read from it, multiplied by 'time_scale' to
+// get seconds and stored relative to the time of the last point, which is
+// returned in 'last_point_time'. Otherwise all point times are 0. If
+// 'ring_field' is not empty, the scan line of each point is read from it into
+// 'rings'. Returns false if a requested field is missing, has an unsupported
+// type or does not fit into a point, if the data is too short, or if it is big
+// endian.
+bool ToTimedPointCloud(const sensor_msgs::PointCloud2& message,
+                       const std::string& time_field, double time_scale,
+                       const std::string& ring_field,
+                       ::cartographer::sensor::TimedPointCloud* point_cloud,
+                       std::vector<int>* rings, double* last_point_time);
+
 ::cartographer::sensor::LandmarkData ToLandmarkData(
     const cartographer_ros_msgs::LandmarkList& landmark_list);
 
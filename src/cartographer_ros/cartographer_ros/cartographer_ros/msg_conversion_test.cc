@@ -15,6 +15,8 @@
  */
 
 #include <cmath>
+#include <cstring>
+#include <limits>
 #include <random>
 
 #include "cartographer/transform/rigid_transform_test_helpers.h"
@@ -23,6 +25,8 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "sensor_msgs/LaserScan.h"
+#include "sensor_msgs/PointCloud2.h"
+#include "sensor_msgs/PointField.h"
 
 namespace cartographer_ros {
 namespace {
@@ -106,6 +110,110 @@ TEST(MsgConversion, LaserScanToPointCloudWithInfinityAndNaN) {
             DoubleNear(expected.rotation_weight, kEps)));
 }
 
+// Builds an Ouster-like cloud with a padded 'x, y, z, t, ring' layout.
+sensor_msgs::PointCloud2 CreateOusterPointCloud2(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<uint32_t>& times_ns, const std::vector<uint8_t>& rings) {
+  sensor_msgs::PointCloud2 message;
+  message.height = 1;
+  message.width = points.size();
+  message.is_bigendian = false;
+  const std::vector<std::pair<std::string, uint8_t>> fields = {
+      {"x", sensor_msgs::PointField::FLOAT32},
+      {"y", sensor_msgs::PointField::FLOAT32},
+      {"z", sensor_msgs::PointField::FLOAT32},
+      {"t", sensor_msgs::PointField::UINT32},
+      {"ring", sensor_msgs::PointField::UINT8}};
+  const std::vector<uint32_t> offsets = {0, 4, 8, 18, 22};
+  for (size_t i = 0; i != fields.size(); ++i) {
+    sensor_msgs::PointField field;
+    field.name = fields[i].first;
+    field.offset = offsets[i];
+    field.datatype = fields[i].second;
+    field.count = 1;
+    message.fields.push_back(field);
+  }
+  message.point_step = 24;
+  message.row_step = message.point_step * message.width;
+  message.data.resize(message.row_step);
+  for (size_t i = 0; i != points.size(); ++i) {
+    uint8_t* const point = message.data.data() + i * message.point_step;
+    std::memcpy(point, points[i].data(), 3 * sizeof(float));
+    std::memcpy(point + 18, &times_ns[i], sizeof(uint32_t));
+    point[22] = rings[i];
+  }
+  return message;
+}
+
+TEST(MsgConversion, PointCloud2ToTimedPointCloud) {
+  const sensor_msgs::PointCloud2 message = CreateOusterPointCloud2(
+      {Eigen::Vector3f(1.f, 2.f, 3.f),
+       Eigen::Vector3f(std::numeric_limits<float>::quiet_NaN(), 0.f, 0.f),
+       Eigen::Vector3f(4.f, 5.f, std::numeric_limits<float>::infinity()),
+       Eigen::Vector3f(-1.f, -2.f, -3.f)},
+      {0, 25000000, 50000000, 100000000}, {3, 7, 11, 15});
+  ::cartographer::sensor::TimedPointCloud point_cloud;
+  std::vector<int> rings;
+  double last_point_time;
+  ASSERT_TRUE(ToTimedPointCloud(message, "t", 1e-9, "ring", &point_cloud,
+                                &rings, &last_point_time));
+  EXPECT_NEAR(0.1, last_point_time, kEps);
+  ASSERT_EQ(2, point_cloud.size());
+  EXPECT_TRUE(
+      point_cloud[0].isApprox(Eigen::Vector4f(1.f, 2.f, 3.f, -0.1f), kEps));
+  EXPECT_TRUE(
+      point_cloud[1].isApprox(Eigen::Vector4f(-1.f, -2.f, -3.f, 0.f), kEps));
+  EXPECT_THAT(rings, ElementsAre(3, 15));
+
+  ASSERT_TRUE(ToTimedPointCloud(message, "", 1., "", &point_cloud, &rings,
+                                &last_point_time));
+  EXPECT_EQ(0., last_point_time);
+  ASSERT_EQ(2, point_cloud.size());
+  EXPECT_EQ(0.f, point_cloud[0][3]);
+  EXPECT_TRUE(rings.empty());
+  EXPECT_FALSE(ToTimedPointCloud(message, "timestamp", 1., "", &point_cloud,
+                                 &rings, &last_point_time));
+  EXPECT_FALSE(ToTimedPointCloud(message, "t", 1e-9, "line", &point_cloud,
+                                 &rings, &last_point_time));
+
+  sensor_msgs::PointCloud2 big_endian_message = message;
+  big_endian_message.is_bigendian = true;
+  EXPECT_FALSE(ToTimedPointCloud(big_endian_message, "t", 1e-9, "",
+                                 &point_cloud, &rings, &last_point_time));
+}
+
+TEST(MsgConversion, MalformedPointCloud2ToTimedPointCloud) {
+  const sensor_msgs::PointCloud2 message = CreateOusterPointCloud2(
+      {Eigen::Vector3f(1.f, 2.f, 3.f), Eigen::Vector3f(-1.f, -2.f, -3.f)},
+      {0, 100000000}, {0, 1});
+  ::cartographer::sensor::TimedPointCloud point_cloud;
+  std::vector<int> rings;
+  double last_point_time;
+
+  sensor_msgs::PointCloud2 short_message = message;
+  short_message.data.pop_back();
+  EXPECT_FALSE(ToTimedPointCloud(short_message, "t", 1e-9, "ring",
+                                 &point_cloud, &rings, &last_point_time));
+  EXPECT_TRUE(point_cloud.empty());
+
+  // The 4 byte time field would be read past the end of each point.
+  sensor_msgs::PointCloud2 truncated_time_message = message;
+  truncated_time_message.fields[3].offset = 21;
+  EXPECT_FALSE(ToTimedPointCloud(truncated_time_message, "t", 1e-9, "",
+                                 &point_cloud, &rings, &last_point_time));
+
+  sensor_msgs::PointCloud2 truncated_ring_message = message;
+  truncated_ring_message.fields[4].offset = 24;
+  EXPECT_FALSE(ToTimedPointCloud(truncated_ring_message, "", 1., "ring",
+                                 &point_cloud, &rings, &last_point_time));
+
+  sensor_msgs::PointCloud2 truncated_z_message = message;
+  truncated_z_message.point_step = 10;
+  truncated_z_message.row_step = 20;
+  EXPECT_FALSE(ToTimedPointCloud(truncated_z_message, "", 1., "",
+                                 &point_cloud, &rings, &last_point_time));
+}
+
 TEST(MsgConversion, LandmarkListToLandmarkData) {
   cartographer_ros_msgs::LandmarkList message;
   message.header.stamp.fromSec(10);
@@ -87,8 +87,11 @@ Node::Node(
     std::unique_ptr<cartographer::mapping::MapBuilderInterface> map_builder,
     tf2_ros::Buffer* const tf_buffer)
     : node_options_(node_options),
-      map_builder_bridge_(node_options_, std::move(map_builder), tf_buffer) {
+      map_builder_bridge_(node_options_, std::move(map_builder), tf_buffer),
+      imu_spinner_(1 /* thread_count */, &imu_callback_queue_) {
   carto::common::MutexLocker lock(&mutex_);
+  imu_node_handle_.setCallbackQueue(&imu_callback_queue_);
+  imu_spinner_.start();
   submap_list_publisher_ =
       node_handle_.advertise<::cartographer_ros_msgs::SubmapList>(
           kSubmapListTopic, kLatestOnlyPublisherQueueSize);
@@ -119,6 +122,8 @@ Node::Node(
   full_map_publisher_ =
       node_handle_.advertise<sensor_msgs::PointCloud2>(
           kFullOptimizedPointCloudTopic, kLatestOnlyPublisherQueueSize);
+  imu_odometry_publisher_ = node_handle_.advertise<nav_msgs::Odometry>(
+      kImuOdometryTopic, kImuOdometryPublisherQueueSize);
 
   wall_timers_.push_back(node_handle_.createWallTimer(
       ::ros::WallDuration(node_options_.submap_publish_period_sec),
@@ -145,6 +150,7 @@ Node::Node(
 
 Node::~Node() { 
   FinishAllTrajectories(); 
+  imu_spinner_.stop();
 }
 
 ::ros::NodeHandle* Node::node_handle() { return &node_handle_; }
@@ -179,6 +185,58 @@ void Node::AddExtrapolator(const int trajectory_id,
           gravity_time_constant));
 }
 
+void Node::AddImuOdometryPublisher(const int trajectory_id,
+                                   const TrajectoryOptions& options) {
+  if (!node_options_.map_builder_options.use_trajectory_builder_3d()) {
+    return;
+  }
+  // Local SLAM poses are not corrected by loop closure, so they can only be
+  // published in the odom frame.
+  if (!options.provide_odom_frame) {
+    LOG(WARNING) << "Not publishing IMU odometry of trajectory "
+                 << trajectory_id << " since 'provide_odom_frame' is disabled.";
+    return;
+  }
+  const std::string frame_id = options.odom_frame;
+  const std::string child_frame_id = options.tracking_frame;
+  // Called by local SLAM from within AddSensorData(), i.e. while the IMU
+  // handler holds 'mutex_' or 'imu_mutex_', so we must take neither.
+  map_builder_bridge_.SetImuPropagatedStateCallback(
+      trajectory_id,
+      [this, frame_id, child_frame_id](
+          const int trajectory_id,
+          const carto::mapping::TrajectoryBuilderInterface::ImuPropagatedState&
+              state) {
+        if (imu_odometry_publisher_.getNumSubscribers() == 0) {
+          return;
+        }
+        nav_msgs::Odometry odometry;
+        odometry.header.stamp = ToRos(state.time);
+        odometry.header.frame_id = frame_id;
+        odometry.child_frame_id = child_frame_id;
+        odometry.pose.pose = ToGeometryMsgPose(state.local_pose);
+        // The twist of 'nav_msgs::Odometry' is given in the child frame.
+        odometry.twist.twist.linear = ToGeometryMsgVector3(
+            state.local_pose.rotation().inverse() * state.velocity);
+        odometry.twist.twist.angular =
+            ToGeometryMsgVector3(state.angular_velocity);
+        imu_odometry_publisher_.publish(odometry);
+      });
+}
+
+void Node::AddUncollatedImuTrajectory(const int trajectory_id,
+                                      const TrajectoryOptions& options) {
+  if (!options.trajectory_builder_options.bypass_imu_collator()) {
+    return;
+  }
+  carto::common::MutexLocker lock(&imu_mutex_);
+  CHECK(uncollated_imu_trajectories_.count(trajectory_id) == 0);
+  uncollated_imu_trajectories_.emplace(
+      std::piecewise_construct, std::forward_as_tuple(trajectory_id),
+      std::forward_as_tuple(options.imu_sampling_ratio,
+                            map_builder_bridge_.sensor_bridge(trajectory_id)));
+}
+
 void Node::AddSensorSamplers(const int trajectory_id,
                              const TrajectoryOptions& options) {
   CHECK(sensor_samplers_.count(trajectory_id) == 0);
@@ -406,7 +464,9 @@ int Node::AddTrajectory(const TrajectoryOptions& options,
   const int trajectory_id =
       map_builder_bridge_.AddTrajectory(expected_sensor_ids, options);
   AddExtrapolator(trajectory_id, options);
+  AddImuOdometryPublisher(trajectory_id, options);
   AddSensorSamplers(trajectory_id, options);
+  AddUncollatedImuTrajectory(trajectory_id, options);
   LaunchSubscribers(options, topics, trajectory_id);
   is_active_trajectory_[trajectory_id] = true;
   for (const auto& sensor_id : expected_sensor_ids) {
@@ -450,12 +510,15 @@ void Node::LaunchSubscribers(const TrajectoryOptions& options,
       (node_options_.map_builder_options.use_trajectory_builder_2d() &&
        options.trajectory_builder_options.trajectory_builder_2d_options()
            .use_imu_data())) {
-    
+    // Uncollated IMU data is handled on its own callback queue.
     std::string topic = topics.imu_topic;
     subscribers_[trajectory_id].push_back(
-        {SubscribeWithHandler<sensor_msgs::Imu>(&Node::HandleImuMessage,
-                                                trajectory_id, topic,
-                                                &node_handle_, this),
+        {SubscribeWithHandler<sensor_msgs::Imu>(
+             &Node::HandleImuMessage, trajectory_id, topic,
+             options.trajectory_builder_options.bypass_imu_collator()
+                 ? &imu_node_handle_
+                 : &node_handle_,
+             this),
          topic});
   }
 
@@ -549,6 +612,11 @@ cartographer_ros_msgs::StatusResponse Node::FinishTrajectoryUnderLock(
   }
   CHECK_EQ(subscribers_.erase(trajectory_id), 1);
   CHECK(is_active_trajectory_.at(trajectory_id));
+  {
+    // The sensor bridge is destroyed below.
+    carto::common::MutexLocker lock(&imu_mutex_);
+    uncollated_imu_trajectories_.erase(trajectory_id);
+  }
   map_builder_bridge_.FinishTrajectory(trajectory_id);
   is_active_trajectory_[trajectory_id] = false;
   const std::string message =
@@ -617,7 +685,9 @@ int Node::AddOfflineTrajectory(
   const int trajectory_id =
       map_builder_bridge_.AddTrajectory(expected_sensor_ids, options);
   AddExtrapolator(trajectory_id, options);
+  AddImuOdometryPublisher(trajectory_id, options);
   AddSensorSamplers(trajectory_id, options);
+  AddUncollatedImuTrajectory(trajectory_id, options);
   is_active_trajectory_[trajectory_id] = true;
   return trajectory_id;
 }
@@ -716,6 +786,18 @@ void Node::HandleLandmarkMessage(
 void Node::HandleImuMessage(const int trajectory_id,
                             const std::string& sensor_id,
                             const sensor_msgs::Imu::ConstPtr& msg) {
+  {
+    carto::common::MutexLocker lock(&imu_mutex_);
+    const auto it = uncollated_imu_trajectories_.find(trajectory_id);
+    if (it != uncollated_imu_trajectories_.end()) {
+      // The extrapolator is not fed here, as it is guarded by 'mutex_'. The
+      // published poses are not extrapolated with IMU data anyway.
+      if (it->second.imu_sampler.Pulse()) {
+        it->second.sensor_bridge->HandleImuMessage(sensor_id, msg);
+      }
+      return;
+    }
+  }
   carto::common::MutexLocker lock(&mutex_);
   if (!sensor_samplers_.at(trajectory_id).imu_sampler.Pulse()) {
     return;
@@ -42,7 +42,9 @@
 #include "cartographer_ros_msgs/TrajectoryOptions.h"
 #include "cartographer_ros_msgs/WriteState.h"
 #include "nav_msgs/Odometry.h"
+#include "ros/callback_queue.h"
 #include "ros/ros.h"
+#include "ros/spinner.h"
 #include "sensor_msgs/Imu.h"
 #include "sensor_msgs/LaserScan.h"
 #include "sensor_msgs/MultiEchoLaserScan.h"
@@ -98,6 +100,7 @@ class Node {
   void HandleLandmarkMessage(
       int trajectory_id, const std::string& sensor_id,
       const cartographer_ros_msgs::LandmarkList::ConstPtr& msg);
+  // Does not take 'mutex_' if the trajectory does not collate IMU data.
   void HandleImuMessage(int trajectory_id, const std::string& sensor_id,
                         const sensor_msgs::Imu::ConstPtr& msg);
   void HandleLaserScanMessage(int trajectory_id, const std::string& sensor_id,
@@ -153,6 +156,15 @@ class Node {
   void PublishSubmapList(const ::ros::WallTimerEvent& timer_event);
   void AddExtrapolator(int trajectory_id, const TrajectoryOptions& options);
   void AddSensorSamplers(int trajectory_id, const TrajectoryOptions& options);
+  void AddUncollatedImuTrajectory(int trajectory_id,
+                                  const TrajectoryOptions& options)
+      REQUIRES(mutex_);
+  // Publishes the state estimates of local SLAM for every IMU measurement as
+  // odometry in the odom frame. They are only published at IMU rate if
+  // 'bypass_imu_collator' is enabled, otherwise in bursts once per scan.
+  void AddImuOdometryPublisher(int trajectory_id,
+                               const TrajectoryOptions& options)
+      REQUIRES(mutex_);
   void PublishTrajectoryStates(const ::ros::WallTimerEvent& timer_event);
   void PublishTrajectoryNodeList(const ::ros::WallTimerEvent& timer_event);
   void PublishLandmarkPosesList(const ::ros::WallTimerEvent& timer_event);
@@ -170,10 +182,33 @@ class Node {
 
   tf2_ros::TransformBroadcaster tf_broadcaster_;
 
+  // Used by the IMU propagated state callback of local SLAM, so it has to
+  // outlive 'map_builder_bridge_'.
+  ::ros::Publisher imu_odometry_publisher_;
+
   cartographer::common::Mutex mutex_;
   MapBuilderBridge map_builder_bridge_ GUARDED_BY(mutex_);
 
+  // IMU data of trajectories which do not collate it is handled on
+  // 'imu_callback_queue_' and passed to local SLAM without taking 'mutex_', so
+  // that it does not wait for range data to be processed.
+  struct UncollatedImuTrajectory {
+    UncollatedImuTrajectory(const double imu_sampling_ratio,
+                            SensorBridge* const sensor_bridge)
+        : imu_sampler(imu_sampling_ratio), sensor_bridge(sensor_bridge) {}
+
+    ::cartographer::common::FixedRatioSampler imu_sampler;
+    SensorBridge* const sensor_bridge;
+  };
+  cartographer::common::Mutex imu_mutex_;
+  std::unordered_map<int, UncollatedImuTrajectory>
+      uncollated_imu_trajectories_ GUARDED_BY(imu_mutex_);
+  ::ros::CallbackQueue imu_callback_queue_;
+  ::ros::AsyncSpinner imu_spinner_;
+
   ::ros::NodeHandle node_handle_;
+  // Uses 'imu_callback_queue_'.
+  ::ros::NodeHandle imu_node_handle_;
   ::ros::Publisher submap_list_publisher_;
   ::ros::Publisher trajectory_node_list_publisher_;
   ::ros::Publisher landmark_poses_list_publisher_;
@@ -33,6 +33,7 @@ constexpr char kLandmarkTopic[] = "landmark";
 constexpr char kFinishTrajectoryServiceName[] = "finish_trajectory";
 constexpr char kOccupancyGridTopic[] = "map";
 constexpr char kScanMatchedPointCloudTopic[] = "scan_matched_points2";
+constexpr char kImuOdometryTopic[] = "imu_odometry";
 constexpr char kFullOptimizedPointCloudTopic[] = "full_cloud_points2";
 constexpr char kSubmapListTopic[] = "submap_list";
 constexpr char kSubmapQueryServiceName[] = "submap_query";
@@ -47,6 +48,7 @@ constexpr double kFullMapCloudPublishPeriodSec = 5;
 
 constexpr int kInfiniteSubscriberQueueSize = 0;
 constexpr int kLatestOnlyPublisherQueueSize = 1;
+constexpr int kImuOdometryPublisherQueueSize = 100;
 
 // For multiple topics adds numbers to the topic name and returns the list.
 std::vector<std::string> ComputeRepeatedTopicNames(const std::string& topic,
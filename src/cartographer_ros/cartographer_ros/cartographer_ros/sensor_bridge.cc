@@ -55,10 +55,12 @@ SensorBridge::SensorBridge(
     const int num_subdivisions_per_laser_scan,
     const std::string& tracking_frame,
     const double lookup_transform_timeout_sec, tf2_ros::Buffer* const tf_buffer,
-    carto::mapping::TrajectoryBuilderInterface* const trajectory_builder)
+    carto::mapping::TrajectoryBuilderInterface* const trajectory_builder,
+    std::unique_ptr<carto::sensor::AzimuthPointStamper> azimuth_point_stamper)
     : num_subdivisions_per_laser_scan_(num_subdivisions_per_laser_scan),
       tf_bridge_(tracking_frame, lookup_transform_timeout_sec, tf_buffer),
-      trajectory_builder_(trajectory_builder) {}
+      trajectory_builder_(trajectory_builder),
+      azimuth_point_stamper_(std::move(azimuth_point_stamper)) {}
 
 std::unique_ptr<carto::sensor::OdometryData> SensorBridge::ToOdometryData(
     const nav_msgs::Odometry::ConstPtr& msg) {
@@ -177,63 +179,53 @@ void SensorBridge::HandlePointCloud2Message(
     const std::string& sensor_id,
     const sensor_msgs::PointCloud2::ConstPtr& msg,
     const std::string& sensor_type) {
+  // Per-point time field and its scale to seconds for each driver. Ouster and
+  // Velodyne stamp the message with the first point and store the time since
+  // then, Robosense stamps it with the last point and stores absolute times.
+  // Plain XYZI clouds have neither times nor rings.
+  std::string time_field;
+  double time_scale = 1.;
+  std::string ring_field;
+  bool stamp_is_first_point = false;
+  if (sensor_type == "ouster") {
+    time_field = "t";
+    time_scale = 1e-9;
+    ring_field = "ring";
+    stamp_is_first_point = true;
+  } else if (sensor_type == "velodyne") {
+    time_field = "time";
+    ring_field = "ring";
+    stamp_is_first_point = true;
+  } else if (sensor_type == "robosense") {
+    time_field = "timestamp";
+    ring_field = "ring";
+  }
+
+  // carto里面的TimedPointCloud中每一个元素的最后一维记录的是相对最后一个点的采集时间
   carto::sensor::TimedPointCloud point_cloud;
-  double rel_time_last = 0.;
-  carto::common::Time point_cloud_stamp;
-  if(sensor_type == "ouster"){
-    pcl::PointCloud<OusterPointXYZIRT> pcl_point_cloud;
-    pcl::fromROSMsg(*msg, pcl_point_cloud);
-   
-    rel_time_last = pcl_point_cloud.points.back().t * 1e-9f;
-    for (const auto& point : pcl_point_cloud.points) {
-      if(isnan(point) || isinf(point)) continue;
-      point_cloud.emplace_back(
-        point.x, point.y, point.z, point.t * 1e-9f - rel_time_last);
-    }
-    point_cloud_stamp = FromRos(msg->header.stamp) + 
-      carto::common::FromSeconds(rel_time_last);
-  }else if(sensor_type == "velodyne"){
-    pcl::PointCloud<PointXYZIRT> pcl_point_cloud;
-    pcl::fromROSMsg(*msg, pcl_point_cloud);
-    
-    //注意：Velodyne ROS消息的stamp记录的是第一个点的采集时间，
-    //而carto里面的TimedPointCloud中每一个元素的最后一维记录的是相对最后一个点的采集时间
-    rel_time_last = pcl_point_cloud.points.back().time;
-    for (const auto& point : pcl_point_cloud.points) {
-      if(isnan(point) || isinf(point)) continue;
-      point_cloud.emplace_back(
-        point.x, point.y, point.z, point.time - rel_time_last);
-    }
-    point_cloud_stamp = FromRos(msg->header.stamp) + 
-      carto::common::FromSeconds(rel_time_last);
-  }else if(sensor_type == "robosense"){
-    pcl::PointCloud<RsPointXYZIRT> pcl_point_cloud;
-    pcl::fromROSMsg(*msg, pcl_point_cloud);
-    double st = msg->header.stamp.toSec();
-    rel_time_last = pcl_point_cloud.points.back().timestamp;
-    // double rel_time_first = pcl_point_cloud.points.front().timestamp;
-    // LOG(INFO) << "Stamp - end: "<< st - rel_time_last;
-    // LOG(INFO) << "Stamp - start:"<< st - rel_time_first;
-    
-    //carto里面的TimedPointCloud中每一个元素的最后一维记录的是相对最后一个点的采集时间
-    for (const auto& point : pcl_point_cloud.points) {
-      if(isnan(point) || isinf(point)) continue;
-      point_cloud.emplace_back(
-        point.x, point.y, point.z, point.timestamp - rel_time_last);
-    }
-    //注意：Robosense ROS消息的stamp记录的是最后点的采集时间...
-    point_cloud_stamp = FromRos(msg->header.stamp);
-  }else{
-    pcl::PointCloud<pcl::PointXYZI> pcl_point_cloud;
-    pcl::fromROSMsg(*msg, pcl_point_cloud);
-        
-    for (const auto& point : pcl_point_cloud.points) {
-      if(isnan(point) || isinf(point)) continue;
-      point_cloud.emplace_back(point.x, point.y, point.z, 0.f);
+  std::vector<int> rings;
+  double last_point_time = 0.;
+  if (!ToTimedPointCloud(
+          *msg, time_field, time_scale,
+          azimuth_point_stamper_ != nullptr ? ring_field : std::string(),
+          &point_cloud, &rings, &last_point_time)) {
+    LOG(WARNING) << "Dropping point cloud from sensor '" << sensor_id << "'.";
+    return;
+  }
+  if (azimuth_point_stamper_ != nullptr) {
+    // The points are still in the sensor frame, whose z axis is the spin axis,
+    // so their azimuth and elevation are the ones the sensor measured.
+    const float sweep_duration =
+        azimuth_point_stamper_->Stamp(rings, &point_cloud);
+    if (stamp_is_first_point) {
+      last_point_time = sweep_duration;
     }
-    point_cloud_stamp = FromRos(msg->header.stamp);
   }
-  
+  carto::common::Time point_cloud_stamp = FromRos(msg->header.stamp);
+  if (stamp_is_first_point) {
+    point_cloud_stamp += carto::common::FromSeconds(last_point_time);
+  }
+
   //wz: 这里的时间改为最后一个点的时间戳
   HandleRangefinder(
     sensor_id, point_cloud_stamp, msg->header.frame_id, point_cloud);
@@ -21,6 +21,7 @@
 
 #include "cartographer/common/optional.h"
 #include "cartographer/mapping/trajectory_builder_interface.h"
+#include "cartographer/sensor/azimuth_point_stamper.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -109,10 +110,14 @@ bool isinf(const T& point){
 // Converts ROS messages into SensorData in tracking frame for the MapBuilder.
 class SensorBridge {
  public:
+  // If 'azimuth_point_stamper' is not null, the times of PointCloud2 points
+  // are recomputed by it in the sensor frame.
   explicit SensorBridge(
       int num_subdivisions_per_laser_scan, const std::string& tracking_frame,
       double lookup_transform_timeout_sec, tf2_ros::Buffer* tf_buffer,
-      ::cartographer::mapping::TrajectoryBuilderInterface* trajectory_builder);
+      ::cartographer::mapping::TrajectoryBuilderInterface* trajectory_builder,
+      std::unique_ptr<::cartographer::sensor::AzimuthPointStamper>
+          azimuth_point_stamper);
 
   SensorBridge(const SensorBridge&) = delete;
   SensorBridge& operator=(const SensorBridge&) = delete;
@@ -158,6 +163,8 @@ class SensorBridge {
   const TfBridge tf_bridge_;
   ::cartographer::mapping::TrajectoryBuilderInterface* const
       trajectory_builder_;
+  const std::unique_ptr<::cartographer::sensor::AzimuthPointStamper>
+      azimuth_point_stamper_;
 
   ::cartographer::common::optional<::cartographer::transform::Rigid3d>
       ecef_to_local_frame_;
@@ -45,6 +45,10 @@ options = {
   imu_sampling_ratio = 1.,
   landmarks_sampling_ratio = 1.,
 }
+-- Pass IMU data to local SLAM as it arrives instead of collating it with the
+-- range data.
+TRAJECTORY_BUILDER.bypass_imu_collator = true
+
 -- ============================================
 --        TRAJECTORY_BUILDER_3D params (local SLAM)
 -- ============================================
@@ -29,6 +29,9 @@ TRAJECTORY_BUILDER_3D.enable_gravity_factor = true
 TRAJECTORY_BUILDER_3D.imu.prior_gravity_noise = 0.1
  
 TRAJECTORY_BUILDER_3D.scan_period = 0.1
+-- The VLP-16 clouds carry neither times nor rings. Their points are stamped
+-- by azimuth in the sensor frame, where the tilt of the sensors does not
+-- affect the scan lines recovered from the elevation.
 TRAJECTORY_BUILDER_3D.eable_mannually_discrew = true
 TRAJECTORY_BUILDER_3D.frames_for_static_initialization = 7
 TRAJECTORY_BUILDER_3D.frames_for_dynamic_initialization = 7
@@ -18,7 +18,8 @@ options.tracking_frame = "os1_imu"
 options.sensor_type = "ouster"
 
 TRAJECTORY_BUILDER_3D.scan_period = 0.1
-TRAJECTORY_BUILDER_3D.eable_mannually_discrew = true
+-- The driver provides per point times which are used for deskewing.
+TRAJECTORY_BUILDER_3D.eable_mannually_discrew = false
 TRAJECTORY_BUILDER_3D.frames_for_static_initialization = 7
 TRAJECTORY_BUILDER_3D.frames_for_dynamic_initialization = 7
 TRAJECTORY_BUILDER_3D.enable_ndt_initialization = true